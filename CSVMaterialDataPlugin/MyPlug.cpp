@@ -14,21 +14,25 @@ CMyPlug::CMyPlug(void)
 
 CMyPlug::~CMyPlug(void)
 {
-
+	for (std::map<std::string,const MaterialPassDef*>::iterator it=m_mapPass.begin();it!=m_mapPass.end();++it)
+	{
+		delete it->second;
+	}
 }
 
 #include "FileSystem.h"
 
-std::string getLineCommand(IOReadBase* pRead, std::vector<std::string>& setWords)
+// The next command of strText from uPos on, its parameters go to setWords.
+std::string getLineCommand(const std::string& strText, size_t& uPos, std::vector<std::string>& setWords)
 {
 	setWords.clear();
 	std::string str;
 	std::string strCommand;
 	char c;
 	bool bString = false;
-	while (!pRead->IsEof())
+	while (uPos<strText.size())
 	{
-		pRead->Read(&c,sizeof(char));
+		c = strText[uPos++];
 		// ----
 		if ('"'==c)
 		{
@@ -68,7 +72,7 @@ std::string getLineCommand(IOReadBase* pRead, std::vector<std::string>& setWords
 			}
 		}
 	}
-	if (pRead->IsEof())
+	if (uPos>=strText.size())
 	{
 		if (strCommand.length()==0)
 		{
@@ -83,25 +87,101 @@ std::string getLineCommand(IOReadBase* pRead, std::vector<std::string>& setWords
 }
 // ------------------------------------------------------------------------------------------
 
-bool loadMaterialPass(CMaterial& material, const char* szFilename)
+MaterialPassDef::MaterialPassDef()
 {
-	IOReadBase* pRead = IOReadBase::autoOpen(szFilename);
-	if (pRead==NULL)
+	uFlags				= 0;
+	bLightingEnabled	= false;
+	uCull				= CULL_NONE;
+	bAlphaTest			= false;
+	nAlphaTestCompare	= CompareFunction();
+	nAlphaTestValue		= 0;
+	bBlend				= false;
+	nBlendOP			= SceneBlendOperation();
+	nBlendSrc			= SceneBlendFactor();
+	nBlendDest			= SceneBlendFactor();
+	bDepthTest			= true;
+	bDepthWrite			= true;
+	memset(textureOP,0,sizeof(textureOP));
+}
+
+void MaterialPassDef::apply(CMaterial& material)const
+{
+	if (uFlags&PASS_LIGHTING)
 	{
-		return false;
+		material.bLightingEnabled	= bLightingEnabled;
 	}
-	std::string strCommand;
+	if (uFlags&PASS_CULL)
+	{
+		material.uCull				= uCull;
+	}
+	if (uFlags&PASS_ALPHA_TEST)
+	{
+		material.bAlphaTest			= bAlphaTest;
+	}
+	if (uFlags&PASS_ALPHA_FUNC)
+	{
+		material.nAlphaTestCompare	= nAlphaTestCompare;
+		material.uAlphaTestValue	= nAlphaTestValue;
+	}
+	if (uFlags&PASS_BLEND)
+	{
+		material.bBlend				= bBlend;
+	}
+	if (uFlags&PASS_BLEND_FUNC)
+	{
+		material.nBlendOP			= nBlendOP;
+		material.nBlendSrc			= nBlendSrc;
+		material.nBlendDest			= nBlendDest;
+	}
+	if (uFlags&PASS_DEPTH)
+	{
+		material.bDepthTest			= bDepthTest;
+		material.bDepthWrite		= bDepthWrite;
+	}
+	for (size_t i=0; i<8; ++i)
+	{
+		const TextureOPDef& texOPDef	= textureOP[i];
+		CMaterial::TextureOP& texOP		= material.textureOP[i];
+		if (texOPDef.uFlags&TEXOP_COLOR)
+		{
+			texOP.nColorOP		= texOPDef.nColorOP;
+		}
+		if (texOPDef.uFlags&TEXOP_COLOR_SRC)
+		{
+			texOP.nColorSrc1	= texOPDef.nColorSrc1;
+			texOP.nColorSrc2	= texOPDef.nColorSrc2;
+		}
+		if (texOPDef.uFlags&TEXOP_ALPHA)
+		{
+			texOP.nAlphaOP		= texOPDef.nAlphaOP;
+		}
+		if (texOPDef.uFlags&TEXOP_ALPHA_SRC)
+		{
+			texOP.nAlphaSrc1	= texOPDef.nAlphaSrc1;
+			texOP.nAlphaSrc2	= texOPDef.nAlphaSrc2;
+		}
+	}
+	if (uFlags&PASS_SHADER)
+	{
+		material.setShader(strShader.c_str());
+	}
+}
+
+void loadMaterialPass(MaterialPassDef& pass, const std::string& strText)
+{
 	std::vector<std::string> setWords;
-	while (!pRead->IsEof())
+	size_t uPos = 0;
+	while (uPos<strText.size())
 	{
-		strCommand = getLineCommand(pRead,setWords);
+		std::string strCommand = getLineCommand(strText,uPos,setWords);
 		size_t	uParametersCount = setWords.size();
 		// ----
 		if ("LightingEnabled"==strCommand)
 		{
 			if (uParametersCount>0)
 			{
-				material.bLightingEnabled = setWords[0]=="true"?true:false;
+				pass.uFlags |= MaterialPassDef::PASS_LIGHTING;
+				pass.bLightingEnabled = setWords[0]=="true"?true:false;
 			}
 		}
 		// ----
@@ -109,7 +189,8 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 		{
 			if (uParametersCount>0)
 			{
-				material.uCull	= ConvertStringToEnum<CullingMode>(setWords[0].c_str());
+				pass.uFlags |= MaterialPassDef::PASS_CULL;
+				pass.uCull	= ConvertStringToEnum<CullingMode>(setWords[0].c_str());
 			}
 		}
 		// ----
@@ -117,12 +198,14 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 		{
 			if (uParametersCount>0)
 			{
-				material.bAlphaTest = setWords[0]=="true"?true:false;
+				pass.uFlags |= MaterialPassDef::PASS_ALPHA_TEST;
+				pass.bAlphaTest = setWords[0]=="true"?true:false;
 				// ----
 				if (uParametersCount>=3)
 				{
-					material.nAlphaTestCompare	= ConvertStringToEnum<CompareFunction>(setWords[1].c_str());
-					material.uAlphaTestValue	= atoi(setWords[2].c_str());
+					pass.uFlags |= MaterialPassDef::PASS_ALPHA_FUNC;
+					pass.nAlphaTestCompare	= ConvertStringToEnum<CompareFunction>(setWords[1].c_str());
+					pass.nAlphaTestValue	= atoi(setWords[2].c_str());
 				}
 			}
 		}
@@ -131,13 +214,15 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 		{
 			if (uParametersCount>0)
 			{
-				material.bBlend = setWords[0]=="true"?true:false;
+				pass.uFlags |= MaterialPassDef::PASS_BLEND;
+				pass.bBlend = setWords[0]=="true"?true:false;
 				// ----
 				if (uParametersCount>=4)
 				{
-					material.nBlendOP	= ConvertStringToEnum<SceneBlendOperation>(setWords[1].c_str());
-					material.nBlendSrc	= ConvertStringToEnum<SceneBlendFactor>(setWords[2].c_str());
-					material.nBlendDest	= ConvertStringToEnum<SceneBlendFactor>(setWords[3].c_str());
+					pass.uFlags |= MaterialPassDef::PASS_BLEND_FUNC;
+					pass.nBlendOP	= ConvertStringToEnum<SceneBlendOperation>(setWords[1].c_str());
+					pass.nBlendSrc	= ConvertStringToEnum<SceneBlendFactor>(setWords[2].c_str());
+					pass.nBlendDest	= ConvertStringToEnum<SceneBlendFactor>(setWords[3].c_str());
 				}
 			}
 		}
@@ -146,9 +231,10 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 		{
 			if (uParametersCount>=2)
 			{
-				material.bDepthTest		= setWords[0]=="true"?true:false;
+				pass.uFlags |= MaterialPassDef::PASS_DEPTH;
+				pass.bDepthTest		= setWords[0]=="true"?true:false;
 				// ----
-				material.bDepthWrite	= setWords[1]=="true"?true:false;
+				pass.bDepthWrite	= setWords[1]=="true"?true:false;
 			}
 		}
 		// ----
@@ -159,13 +245,15 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 				int nID						= atoi(setWords[0].c_str());
 				if (nID>=0 && nID<8)
 				{
-					CMaterial::TextureOP& texOP	= material.textureOP[nID];
-					texOP.nColorOP				= ConvertStringToEnum<TextureBlendOperation>(setWords[1].c_str());
+					MaterialPassDef::TextureOPDef& texOP	= pass.textureOP[nID];
+					texOP.uFlags			|= MaterialPassDef::TEXOP_COLOR;
+					texOP.nColorOP			= ConvertStringToEnum<TextureBlendOperation>(setWords[1].c_str());
 					// ----
 					if (uParametersCount>=4)
 					{
-						texOP.nColorSrc1		= ConvertStringToEnum<TextureBlendSource>(setWords[2].c_str());
-						texOP.nColorSrc2		= ConvertStringToEnum<TextureBlendSource>(setWords[3].c_str());
+						texOP.uFlags		|= MaterialPassDef::TEXOP_COLOR_SRC;
+						texOP.nColorSrc1	= ConvertStringToEnum<TextureBlendSource>(setWords[2].c_str());
+						texOP.nColorSrc2	= ConvertStringToEnum<TextureBlendSource>(setWords[3].c_str());
 					}
 				}
 			}
@@ -178,13 +266,15 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 				int nID						= atoi(setWords[0].c_str());
 				if (nID>=0 && nID<8)
 				{
-					CMaterial::TextureOP& texOP	= material.textureOP[nID];
+					MaterialPassDef::TextureOPDef& texOP	= pass.textureOP[nID];
+					texOP.uFlags			|= MaterialPassDef::TEXOP_ALPHA;
 					texOP.nAlphaOP			= ConvertStringToEnum<TextureBlendOperation>(setWords[1].c_str());
 					// ----
 					if (uParametersCount>=4)
 					{
-						texOP.nAlphaSrc1		= ConvertStringToEnum<TextureBlendSource>(setWords[2].c_str());
-						texOP.nAlphaSrc2		= ConvertStringToEnum<TextureBlendSource>(setWords[3].c_str());
+						texOP.uFlags		|= MaterialPassDef::TEXOP_ALPHA_SRC;
+						texOP.nAlphaSrc1	= ConvertStringToEnum<TextureBlendSource>(setWords[2].c_str());
+						texOP.nAlphaSrc2	= ConvertStringToEnum<TextureBlendSource>(setWords[3].c_str());
 					}
 				}
 			}
@@ -194,11 +284,76 @@ bool loadMaterialPass(CMaterial& material, const char* szFilename)
 		{
 			if (uParametersCount>0)
 			{
-				material.setShader(setWords[0].c_str());
+				pass.uFlags |= MaterialPassDef::PASS_SHADER;
+				pass.strShader = setWords[0];
 			}
 		}
 	}
+}
+
+// The whole file, false when it can't be opened.
+bool readPassFile(const char* szFilename, std::string& strText)
+{
+	IOReadBase* pRead = IOReadBase::autoOpen(szFilename);
+	if (pRead==NULL)
+	{
+		return false;
+	}
+	strText.resize(pRead->GetSize());
+	if (strText.size()>0)
+	{
+		pRead->Read(&strText[0],strText.size());
+	}
 	IOReadBase::autoClose(pRead);
+	return true;
+}
+// ------------------------------------------------------------------------------------------
+
+void setDefaultMaterialPass(CMaterial& material)
+{
+	material.bLightingEnabled = false;
+	// ----
+	material.uCull			= CULL_NONE;
+	// ----
+	material.bAlphaTest		= false;
+	// ----
+	material.bBlend			= false;
+	// ----
+	material.bDepthTest		= true;
+	material.bDepthWrite	= true;
+	// ----
+	CMaterial::TextureOP& texOP0	= material.textureOP[0];
+	CMaterial::TextureOP& texOP1	= material.textureOP[1];
+	// ----
+	texOP0.nColorOP			= TBOP_MODULATE;
+	texOP0.nColorSrc1		= TBS_CURRENT;
+	texOP0.nColorSrc2		= TBS_TEXTURE;
+	texOP0.nAlphaOP			= TBOP_MODULATE;
+	texOP0.nAlphaSrc1		= TBS_CURRENT;
+	texOP0.nAlphaSrc2		= TBS_TEXTURE;
+	// ----
+	texOP1.nColorOP			= TBOP_DISABLE;
+	texOP1.nAlphaOP			= TBOP_DISABLE;
+}
+
+const MaterialPassDef* CMyPlug::getPass(const std::string& strPass)
+{
+	std::map<std::string,const MaterialPassDef*>::iterator it = m_mapPass.find(strPass);
+	if (it!=m_mapPass.end())
+	{
+		return it->second;
+	}
+	char szPassFilename[255];
+	sprintf(szPassFilename,"EngineRes\\pass\\%s.pass",strPass.c_str());
+	MaterialPassDef* pPass = NULL;
+	std::string strText;
+	if (readPassFile(szPassFilename,strText))
+	{
+		pPass = new MaterialPassDef;
+		loadMaterialPass(*pPass,strText);
+	}
+	m_mapPass[strPass] = pPass;
+	return pPass;
 }
 
 iRenderNode* CMyPlug::importData(iRenderNodeMgr* pRenderNodeMgr, const char* szFilename)
@@ -219,35 +374,15 @@ iRenderNode* CMyPlug::importData(iRenderNodeMgr* pRenderNodeMgr, const char* szF
 		const char* szPass		=csv.getStr("pass",NULL);
 		if (szPass)
 		{
-			char szPassFilename[255];
-			sprintf(szPassFilename,"EngineRes\\pass\\%s.pass",szPass);
-			loadMaterialPass(material, szPassFilename);
+			const MaterialPassDef* pPass = getPass(szPass);
+			if (pPass)
+			{
+				pPass->apply(material);
+			}
 		}
 		else
 		{
-			material.bLightingEnabled = false;
-			// ----
-			material.uCull			= CULL_NONE;
-			// ----
-			material.bAlphaTest		= false;
-			// ----
-			material.bBlend			= false;
-			// ----
-			material.bDepthTest		= true;
-			material.bDepthWrite	= true;
-			// ----
-			CMaterial::TextureOP& texOP0	= material.textureOP[0];
-			CMaterial::TextureOP& texOP1	= material.textureOP[1];
-			// ----
-			texOP0.nColorOP			= TBOP_MODULATE;
-			texOP0.nColorSrc1		= TBS_CURRENT;
-			texOP0.nColorSrc2		= TBS_TEXTURE;
-			texOP0.nAlphaOP			= TBOP_MODULATE;
-			texOP0.nAlphaSrc1		= TBS_CURRENT;
-			texOP0.nAlphaSrc2		= TBS_TEXTURE;
-			// ----
-			texOP1.nColorOP			= TBOP_DISABLE;
-			texOP1.nAlphaOP			= TBOP_DISABLE;
+			setDefaultMaterialPass(material);
 		}
 	}
 	csv.close();
@@ -257,4 +392,4 @@ iRenderNode* CMyPlug::importData(iRenderNodeMgr* pRenderNodeMgr, const char* szF
 void CMyPlug::release()
 {
 	delete this;
-}
\ No newline at end of file
+}
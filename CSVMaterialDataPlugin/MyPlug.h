@@ -1,5 +1,57 @@
 #pragma once
 #include "InterfaceModel.h"
+#include "Material.h"
+#include <map>
+
+// A .pass file parsed once, apply() sets only what the file mentions.
+struct MaterialPassDef
+{
+	MaterialPassDef();
+	void apply(CMaterial& material)const;
+
+	enum
+	{
+		PASS_LIGHTING		= 1<<0,
+		PASS_CULL			= 1<<1,
+		PASS_ALPHA_TEST		= 1<<2,
+		PASS_ALPHA_FUNC		= 1<<3,
+		PASS_BLEND			= 1<<4,
+		PASS_BLEND_FUNC		= 1<<5,
+		PASS_DEPTH			= 1<<6,
+		PASS_SHADER			= 1<<7,
+	};
+	enum
+	{
+		TEXOP_COLOR			= 1<<0,
+		TEXOP_COLOR_SRC		= 1<<1,
+		TEXOP_ALPHA			= 1<<2,
+		TEXOP_ALPHA_SRC		= 1<<3,
+	};
+	struct TextureOPDef
+	{
+		unsigned int			uFlags;
+		TextureBlendOperation	nColorOP;
+		TextureBlendSource		nColorSrc1;
+		TextureBlendSource		nColorSrc2;
+		TextureBlendOperation	nAlphaOP;
+		TextureBlendSource		nAlphaSrc1;
+		TextureBlendSource		nAlphaSrc2;
+	};
+	unsigned int			uFlags;
+	bool					bLightingEnabled;
+	CullingMode				uCull;
+	bool					bAlphaTest;
+	CompareFunction			nAlphaTestCompare;
+	int						nAlphaTestValue;
+	bool					bBlend;
+	SceneBlendOperation		nBlendOP;
+	SceneBlendFactor		nBlendSrc;
+	SceneBlendFactor		nBlendDest;
+	bool					bDepthTest;
+	bool					bDepthWrite;
+	TextureOPDef			textureOP[8];
+	std::string				strShader;
+};
 
 class CMyPlug : public CModelPlugBase  
 {
@@ -11,4 +63,8 @@ public:
 	virtual iRenderNode* importData(iRenderNodeMgr* pRenderNodeMgr, const char* szFilename);
 	virtual void release();
 private:
+	// The pass parsed on its first use, NULL when its file can't be read.
+	const MaterialPassDef* getPass(const std::string& strPass);
+	// parsed passes by name, NULL when the pass file can't be read
+	std::map<std::string,const MaterialPassDef*> m_mapPass;
 };
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+
+struct CThreadPool::Sync
+{
+	CRITICAL_SECTION	cs;
+	CONDITION_VARIABLE	condWork;
+	CONDITION_VARIABLE	condDone;
+};
+
+static DWORD WINAPI threadProc(LPVOID pParam)
+{
+	CThreadPool::workerMain(pParam);
+	return 0;
+}
+
+CThreadPool::CThreadPool(size_t uThreadCount)
+	:m_pSync(new Sync)
+	,m_bQuit(false)
+{
+	InitializeCriticalSection(&m_pSync->cs);
+	InitializeConditionVariable(&m_pSync->condWork);
+	InitializeConditionVariable(&m_pSync->condDone);
+	if (0==uThreadCount)
+	{
+		uThreadCount = getCoreCount()-1;
+	}
+	for (size_t i=0; i<uThreadCount; ++i)
+	{
+		HANDLE hThread = CreateThread(NULL,0,threadProc,this,0,NULL);
+		if (hThread)
+		{
+			m_setThread.push_back(hThread);
+		}
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	lock();
+	m_bQuit = true;
+	notifyWork();
+	unlock();
+	for (size_t i=0; i<m_setThread.size(); ++i)
+	{
+		WaitForSingleObject((HANDLE)m_setThread[i],INFINITE);
+		CloseHandle((HANDLE)m_setThread[i]);
+	}
+	DeleteCriticalSection(&m_pSync->cs);
+	delete m_pSync;
+}
+
+void CThreadPool::lock()		{EnterCriticalSection(&m_pSync->cs);}
+void CThreadPool::unlock()		{LeaveCriticalSection(&m_pSync->cs);}
+void CThreadPool::waitWork()	{SleepConditionVariableCS(&m_pSync->condWork,&m_pSync->cs,INFINITE);}
+void CThreadPool::waitDone()	{SleepConditionVariableCS(&m_pSync->condDone,&m_pSync->cs,INFINITE);}
+void CThreadPool::notifyWork()	{WakeAllConditionVariable(&m_pSync->condWork);}
+void CThreadPool::notifyDone()	{WakeAllConditionVariable(&m_pSync->condDone);}
+
+// statically initialized, so it's usable before any constructor runs
+static SRWLOCK s_SharedLock = SRWLOCK_INIT;
+static void lockShared()	{AcquireSRWLockExclusive(&s_SharedLock);}
+static void unlockShared()	{ReleaseSRWLockExclusive(&s_SharedLock);}
+
+size_t CThreadPool::getCoreCount()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors>0?info.dwNumberOfProcessors:1;
+}
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+struct CThreadPool::Sync
+{
+	pthread_mutex_t	mutex;
+	pthread_cond_t	condWork;
+	pthread_cond_t	condDone;
+};
+
+static void* threadProc(void* pParam)
+{
+	CThreadPool::workerMain(pParam);
+	return NULL;
+}
+
+CThreadPool::CThreadPool(size_t uThreadCount)
+	:m_pSync(new Sync)
+	,m_bQuit(false)
+{
+	pthread_mutex_init(&m_pSync->mutex,NULL);
+	pthread_cond_init(&m_pSync->condWork,NULL);
+	pthread_cond_init(&m_pSync->condDone,NULL);
+	if (0==uThreadCount)
+	{
+		uThreadCount = getCoreCount()-1;
+	}
+	for (size_t i=0; i<uThreadCount; ++i)
+	{
+		pthread_t* pThread = new pthread_t;
+		if (0==pthread_create(pThread,NULL,threadProc,this))
+		{
+			m_setThread.push_back(pThread);
+		}
+		else
+		{
+			delete pThread;
+		}
+	}
+}
+
+CThreadPool::~CThreadPool()
+{
+	lock();
+	m_bQuit = true;
+	notifyWork();
+	unlock();
+	for (size_t i=0; i<m_setThread.size(); ++i)
+	{
+		pthread_t* pThread = (pthread_t*)m_setThread[i];
+		pthread_join(*pThread,NULL);
+		delete pThread;
+	}
+	pthread_cond_destroy(&m_pSync->condDone);
+	pthread_cond_destroy(&m_pSync->condWork);
+	pthread_mutex_destroy(&m_pSync->mutex);
+	delete m_pSync;
+}
+
+void CThreadPool::lock()		{pthread_mutex_lock(&m_pSync->mutex);}
+void CThreadPool::unlock()		{pthread_mutex_unlock(&m_pSync->mutex);}
+void CThreadPool::waitWork()	{pthread_cond_wait(&m_pSync->condWork,&m_pSync->mutex);}
+void CThreadPool::waitDone()	{pthread_cond_wait(&m_pSync->condDone,&m_pSync->mutex);}
+void CThreadPool::notifyWork()	{pthread_cond_broadcast(&m_pSync->condWork);}
+void CThreadPool::notifyDone()	{pthread_cond_broadcast(&m_pSync->condDone);}
+
+static pthread_mutex_t s_SharedLock = PTHREAD_MUTEX_INITIALIZER;
+static void lockShared()	{pthread_mutex_lock(&s_SharedLock);}
+static void unlockShared()	{pthread_mutex_unlock(&s_SharedLock);}
+
+size_t CThreadPool::getCoreCount()
+{
+	long nCount = sysconf(_SC_NPROCESSORS_ONLN);
+	return nCount>0?(size_t)nCount:1;
+}
+#endif
+
+// A function local static isn't made thread safely by VS2010 and its destructor would join
+// the workers under the loader lock, so the shared pool is a pointer behind a static lock.
+static CThreadPool* s_pSharedPool = NULL;
+
+CThreadPool& CThreadPool::getShared()
+{
+	lockShared();
+	if (NULL==s_pSharedPool)
+	{
+		s_pSharedPool = new CThreadPool;
+	}
+	CThreadPool* pPool = s_pSharedPool;
+	unlockShared();
+	return *pPool;
+}
+
+void CThreadPool::destroyShared()
+{
+	lockShared();
+	CThreadPool* pPool = s_pSharedPool;
+	s_pSharedPool = NULL;
+	unlockShared();
+	// joined outside the lock, a worker may still be finishing a getShared() call
+	delete pPool;
+}
+
+bool CThreadPool::runNext(Job* pOnly)
+{
+	Job* pJob = pOnly;
+	if (NULL==pJob)
+	{
+		if (m_setJob.empty())
+		{
+			return false;
+		}
+		pJob = m_setJob.front();
+	}
+	if (pJob->uNext>=pJob->uCount)
+	{
+		return false;
+	}
+	size_t uIndex = pJob->uNext++;
+	if (pJob->uNext>=pJob->uCount)
+	{
+		// every index is taken, workers move on to the next job
+		m_setJob.erase(std::find(m_setJob.begin(),m_setJob.end(),pJob));
+	}
+	unlock();
+	pJob->pTask->runTask(uIndex);
+	lock();
+	if (++pJob->uDone>=pJob->uCount)
+	{
+		notifyDone();
+	}
+	return true;
+}
+
+void CThreadPool::workerMain(void* pParam)
+{
+	CThreadPool* pPool = (CThreadPool*)pParam;
+	pPool->lock();
+	while (!pPool->m_bQuit)
+	{
+		if (!pPool->runNext(NULL))
+		{
+			pPool->waitWork();
+		}
+	}
+	pPool->unlock();
+}
+
+void CThreadPool::run(iThreadTask& task, size_t uCount)
+{
+	if (m_setThread.empty()||uCount<=1)
+	{
+		for (size_t i=0; i<uCount; ++i)
+		{
+			task.runTask(i);
+		}
+		return;
+	}
+	Job job;
+	job.pTask	= &task;
+	job.uCount	= uCount;
+	job.uNext	= 0;
+	job.uDone	= 0;
+	lock();
+	m_setJob.push_back(&job);
+	notifyWork();
+	while (runNext(&job))
+	{
+	}
+	while (job.uDone<job.uCount)
+	{
+		waitDone();
+	}
+	unlock();
+}
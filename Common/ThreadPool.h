@@ -0,0 +1,63 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Work item of CThreadPool::run, runTask is called once for each index, from any thread.
+class iThreadTask
+{
+public:
+	virtual ~iThreadTask(){}
+	virtual void runTask(size_t uIndex)=0;
+};
+
+// Fixed set of worker threads running parallel loops (win32 threads or pthreads).
+// The thread calling run() works on its own loop too, so a task may call run() again
+// on the same pool without dead locking.
+class CThreadPool
+{
+public:
+	// 0 threads = one per core, minus the calling thread
+	CThreadPool(size_t uThreadCount=0);
+	~CThreadPool();
+
+	size_t getThreadCount()const{return m_setThread.size();}
+	// Calls task.runTask(0..uCount-1) across the pool and returns when all are done.
+	void run(iThreadTask& task, size_t uCount);
+
+	// The pool shared by the loaders of this module, made on first use. The first use may come
+	// from several threads at once. Nothing tears it down on its own: joining the workers from
+	// DllMain or a static destructor would dead lock on the loader lock.
+	static CThreadPool& getShared();
+	// Joins and frees the pool getShared made. Call it before the module is unloaded, from a
+	// normal call such as a plugin's release(), never from DllMain.
+	static void destroyShared();
+	static size_t getCoreCount();
+	// entry of the worker threads
+	static void workerMain(void* pParam);
+private:
+	struct Job
+	{
+		iThreadTask*	pTask;
+		size_t			uCount;
+		size_t			uNext;
+		size_t			uDone;
+	};
+	// Runs one index of the first queued job, false when nothing is queued. Needs the lock held.
+	bool runNext(Job* pOnly);
+
+	void lock();
+	void unlock();
+	void waitWork();
+	void waitDone();
+	void notifyWork();
+	void notifyDone();
+
+	struct Sync;
+	Sync*				m_pSync;
+	std::vector<void*>	m_setThread;
+	std::vector<Job*>	m_setJob;
+	bool				m_bQuit;
+private:
+	CThreadPool(const CThreadPool&);
+	CThreadPool& operator=(const CThreadPool&);
+};
@@ -0,0 +1,635 @@
+#include "TriangleBVH.h"
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+static inline void vecSub(float* r, const float* a, const float* b)
+{
+	r[0] = a[0]-b[0];
+	r[1] = a[1]-b[1];
+	r[2] = a[2]-b[2];
+}
+
+static inline float vecDot(const float* a, const float* b)
+{
+	return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
+}
+
+static inline void vecCross(float* r, const float* a, const float* b)
+{
+	r[0] = a[1]*b[2]-a[2]*b[1];
+	r[1] = a[2]*b[0]-a[0]*b[2];
+	r[2] = a[0]*b[1]-a[1]*b[0];
+}
+
+static inline float boxArea(const float* vMin, const float* vMax)
+{
+	float x = vMax[0]-vMin[0];
+	float y = vMax[1]-vMin[1];
+	float z = vMax[2]-vMin[2];
+	return 2.0f*(x*y+y*z+z*x);
+}
+
+static inline void boxGrow(float* vMin, float* vMax, const float* vOtherMin, const float* vOtherMax)
+{
+	for (int a=0; a<3; ++a)
+	{
+		vMin[a] = std::min(vMin[a], vOtherMin[a]);
+		vMax[a] = std::max(vMax[a], vOtherMax[a]);
+	}
+}
+
+static inline int binOf(float fValue, float fMin, float fScale, int nBinCount)
+{
+	int nBin = (int)((fValue-fMin)*fScale);
+	return nBin<0?0:(nBin>=nBinCount?nBinCount-1:nBin);
+}
+
+// Slab test, fNear is where the ray enters the box.
+static inline bool rayBox(const CTriangleBVH::Node& node, const float* vOrigin, const float* vInvDir, float fMaxDist, float& fNear)
+{
+	float t0 = 0.0f;
+	float t1 = fMaxDist;
+	for (int a=0; a<3; ++a)
+	{
+		float tA = (node.vMin[a]-vOrigin[a])*vInvDir[a];
+		float tB = (node.vMax[a]-vOrigin[a])*vInvDir[a];
+		if (tA>tB)
+		{
+			std::swap(tA, tB);
+		}
+		// NaN when the origin is on a slab of a parallel ray, the compares leave t0 / t1 alone
+		if (tA>t0) t0 = tA;
+		if (tB<t1) t1 = tB;
+		if (t0>t1)
+		{
+			return false;
+		}
+	}
+	fNear = t0;
+	return true;
+}
+
+// Moller-Trumbore, both faces.
+static inline bool rayTriangle(const float* vOrigin, const float* vDir, const float* pCorners, float fMaxDist, float& t, float& u, float& v)
+{
+	float e1[3], e2[3], p[3], s[3], q[3];
+	vecSub(e1, pCorners+3, pCorners);
+	vecSub(e2, pCorners+6, pCorners);
+	vecCross(p, vDir, e2);
+	float fDet = vecDot(e1, p);
+	if (fDet==0.0f)
+	{
+		return false;
+	}
+	float fInvDet = 1.0f/fDet;
+	vecSub(s, vOrigin, pCorners);
+	u = vecDot(s, p)*fInvDet;
+	if (u<0.0f||u>1.0f)
+	{
+		return false;
+	}
+	vecCross(q, s, e1);
+	v = vecDot(vDir, q)*fInvDet;
+	if (v<0.0f||u+v>1.0f)
+	{
+		return false;
+	}
+	t = vecDot(e2, q)*fInvDet;
+	return t>=0.0f&&t<=fMaxDist;
+}
+
+static inline float boxPointDistSq(const CTriangleBVH::Node& node, const float* vPoint)
+{
+	float fDistSq = 0.0f;
+	for (int a=0; a<3; ++a)
+	{
+		float d = 0.0f;
+		if (vPoint[a]<node.vMin[a]) d = node.vMin[a]-vPoint[a];
+		else if (vPoint[a]>node.vMax[a]) d = vPoint[a]-node.vMax[a];
+		fDistSq += d*d;
+	}
+	return fDistSq;
+}
+
+static inline bool boxOverlap(const CTriangleBVH::Node& node, const float* vMin, const float* vMax)
+{
+	return node.vMin[0]<=vMax[0]&&node.vMax[0]>=vMin[0]
+		&&node.vMin[1]<=vMax[1]&&node.vMax[1]>=vMin[1]
+		&&node.vMin[2]<=vMax[2]&&node.vMax[2]>=vMin[2];
+}
+
+// Closest point of the triangle to p (Ericson, Real-Time Collision Detection 5.1.5).
+static void closestOnTriangle(float* r, const float* p, const float* pCorners)
+{
+	const float* a = pCorners;
+	const float* b = pCorners+3;
+	const float* c = pCorners+6;
+	float ab[3], ac[3], ap[3], bp[3], cp[3];
+	vecSub(ab, b, a);
+	vecSub(ac, c, a);
+	vecSub(ap, p, a);
+	float d1 = vecDot(ab, ap);
+	float d2 = vecDot(ac, ap);
+	if (d1<=0.0f&&d2<=0.0f)
+	{
+		r[0] = a[0]; r[1] = a[1]; r[2] = a[2];
+		return;
+	}
+	vecSub(bp, p, b);
+	float d3 = vecDot(ab, bp);
+	float d4 = vecDot(ac, bp);
+	if (d3>=0.0f&&d4<=d3)
+	{
+		r[0] = b[0]; r[1] = b[1]; r[2] = b[2];
+		return;
+	}
+	float vc = d1*d4-d3*d2;
+	if (vc<=0.0f&&d1>=0.0f&&d3<=0.0f)
+	{
+		float v = d1/(d1-d3);
+		for (int i=0; i<3; ++i) r[i] = a[i]+ab[i]*v;
+		return;
+	}
+	vecSub(cp, p, c);
+	float d5 = vecDot(ab, cp);
+	float d6 = vecDot(ac, cp);
+	if (d6>=0.0f&&d5<=d6)
+	{
+		r[0] = c[0]; r[1] = c[1]; r[2] = c[2];
+		return;
+	}
+	float vb = d5*d2-d1*d6;
+	if (vb<=0.0f&&d2>=0.0f&&d6<=0.0f)
+	{
+		float w = d2/(d2-d6);
+		for (int i=0; i<3; ++i) r[i] = a[i]+ac[i]*w;
+		return;
+	}
+	float va = d3*d6-d5*d4;
+	if (va<=0.0f&&(d4-d3)>=0.0f&&(d5-d6)>=0.0f)
+	{
+		float w = (d4-d3)/((d4-d3)+(d5-d6));
+		for (int i=0; i<3; ++i) r[i] = b[i]+(c[i]-b[i])*w;
+		return;
+	}
+	float fDenom = 1.0f/(va+vb+vc);
+	float v = vb*fDenom;
+	float w = vc*fDenom;
+	for (int i=0; i<3; ++i) r[i] = a[i]+ab[i]*v+ac[i]*w;
+}
+
+// Separating axis test of the triangle against the box (Akenine-Moller): the box axes, the
+// triangle normal and the nine cross products of their edges.
+static bool triangleBoxOverlap(const float* pCorners, const float* vMin, const float* vMax)
+{
+	float vCenter[3], vHalf[3], v[3][3], e[3][3];
+	for (int a=0; a<3; ++a)
+	{
+		vCenter[a] = (vMin[a]+vMax[a])*0.5f;
+		vHalf[a] = (vMax[a]-vMin[a])*0.5f;
+	}
+	for (int i=0; i<3; ++i)
+	{
+		vecSub(v[i], pCorners+i*3, vCenter);
+	}
+	for (int a=0; a<3; ++a)
+	{
+		float fLo = std::min(v[0][a], std::min(v[1][a], v[2][a]));
+		float fHi = std::max(v[0][a], std::max(v[1][a], v[2][a]));
+		if (fLo>vHalf[a]||fHi<-vHalf[a])
+		{
+			return false;
+		}
+	}
+	vecSub(e[0], v[1], v[0]);
+	vecSub(e[1], v[2], v[1]);
+	vecSub(e[2], v[0], v[2]);
+	float vNormal[3];
+	vecCross(vNormal, e[0], e[1]);
+	float fRadius = vHalf[0]*fabs(vNormal[0])+vHalf[1]*fabs(vNormal[1])+vHalf[2]*fabs(vNormal[2]);
+	if (fabs(vecDot(vNormal, v[0]))>fRadius)
+	{
+		return false;
+	}
+	for (int i=0; i<3; ++i)
+	{
+		for (int a=0; a<3; ++a)
+		{
+			float vBoxAxis[3] = {0.0f, 0.0f, 0.0f};
+			vBoxAxis[a] = 1.0f;
+			float vAxis[3];
+			vecCross(vAxis, vBoxAxis, e[i]);
+			float p0 = vecDot(vAxis, v[0]);
+			float p1 = vecDot(vAxis, v[1]);
+			float p2 = vecDot(vAxis, v[2]);
+			float r = vHalf[0]*fabs(vAxis[0])+vHalf[1]*fabs(vAxis[1])+vHalf[2]*fabs(vAxis[2]);
+			if (std::min(p0, std::min(p1, p2))>r||std::max(p0, std::max(p1, p2))<-r)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+CTriangleBVH::CTriangleBVH()
+{
+}
+
+void CTriangleBVH::clear()
+{
+	m_setNode.clear();
+	m_setVertex.clear();
+	m_setID.clear();
+}
+
+void CTriangleBVH::addTriangle(const float* v0, const float* v1, const float* v2, unsigned int uID)
+{
+	m_setVertex.insert(m_setVertex.end(), v0, v0+3);
+	m_setVertex.insert(m_setVertex.end(), v1, v1+3);
+	m_setVertex.insert(m_setVertex.end(), v2, v2+3);
+	m_setID.push_back(uID);
+}
+
+void CTriangleBVH::build()
+{
+	m_setNode.clear();
+	size_t uCount = m_setID.size();
+	if (uCount==0)
+	{
+		return;
+	}
+	std::vector<BuildTriangle> setTri(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		BuildTriangle& tri = setTri[i];
+		const float* pCorners = getCorners(i);
+		for (int a=0; a<3; ++a)
+		{
+			tri.vMin[a] = std::min(pCorners[a], std::min(pCorners[3+a], pCorners[6+a]));
+			tri.vMax[a] = std::max(pCorners[a], std::max(pCorners[3+a], pCorners[6+a]));
+			tri.vCenter[a] = (tri.vMin[a]+tri.vMax[a])*0.5f;
+		}
+		tri.uTriangle = (unsigned int)i;
+	}
+	// at most 2n-1 nodes, so the vector never moves while the tree is built
+	m_setNode.reserve(uCount*2);
+	m_setNode.resize(1);
+	buildNode(0, setTri, 0, uCount, 0);
+
+	// the triangles in leaf order
+	std::vector<float> setVertex(uCount*9);
+	std::vector<unsigned int> setID(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		const float* pCorners = getCorners(setTri[i].uTriangle);
+		std::copy(pCorners, pCorners+9, setVertex.begin()+i*9);
+		setID[i] = m_setID[setTri[i].uTriangle];
+	}
+	m_setVertex.swap(setVertex);
+	m_setID.swap(setID);
+}
+
+void CTriangleBVH::makeLeaf(Node& node, size_t uBegin, size_t uEnd)
+{
+	node.uIndex = (unsigned int)uBegin;
+	node.uCount = (unsigned int)(uEnd-uBegin);
+}
+
+void CTriangleBVH::buildNode(size_t uNode, std::vector<BuildTriangle>& setTri, size_t uBegin, size_t uEnd, int nDepth)
+{
+	float vCenterMin[3], vCenterMax[3];
+	{
+		Node& node = m_setNode[uNode];
+		for (int a=0; a<3; ++a)
+		{
+			node.vMin[a] = node.vMax[a] = setTri[uBegin].vMin[a];
+			vCenterMin[a] = vCenterMax[a] = setTri[uBegin].vCenter[a];
+		}
+		for (size_t i=uBegin; i<uEnd; ++i)
+		{
+			boxGrow(node.vMin, node.vMax, setTri[i].vMin, setTri[i].vMax);
+			boxGrow(vCenterMin, vCenterMax, setTri[i].vCenter, setTri[i].vCenter);
+		}
+	}
+	size_t uCount = uEnd-uBegin;
+	if (uCount<=1||nDepth>=MAX_DEPTH)
+	{
+		makeLeaf(m_setNode[uNode], uBegin, uEnd);
+		return;
+	}
+
+	// binned SAH: sort the centers into bins along each axis, sweep the bins from both sides
+	// and split where the child areas times their triangle counts are the smallest
+	struct Bin
+	{
+		float	vMin[3];
+		float	vMax[3];
+		size_t	uCount;
+	};
+	float fBestCost = FLT_MAX;
+	int nBestAxis = -1;
+	int nBestSplit = 0;
+	for (int nAxis=0; nAxis<3; ++nAxis)
+	{
+		float fExtent = vCenterMax[nAxis]-vCenterMin[nAxis];
+		if (fExtent<=0.0f)
+		{
+			continue;
+		}
+		float fScale = BIN_COUNT/fExtent;
+		Bin setBin[BIN_COUNT];
+		for (int b=0; b<BIN_COUNT; ++b)
+		{
+			for (int a=0; a<3; ++a)
+			{
+				setBin[b].vMin[a] = FLT_MAX;
+				setBin[b].vMax[a] = -FLT_MAX;
+			}
+			setBin[b].uCount = 0;
+		}
+		for (size_t i=uBegin; i<uEnd; ++i)
+		{
+			Bin& bin = setBin[binOf(setTri[i].vCenter[nAxis], vCenterMin[nAxis], fScale, BIN_COUNT)];
+			boxGrow(bin.vMin, bin.vMax, setTri[i].vMin, setTri[i].vMax);
+			bin.uCount++;
+		}
+		float setRightArea[BIN_COUNT];
+		size_t setRightCount[BIN_COUNT];
+		float vMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+		float vMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		size_t uRight = 0;
+		for (int b=BIN_COUNT-1; b>0; --b)
+		{
+			boxGrow(vMin, vMax, setBin[b].vMin, setBin[b].vMax);
+			uRight += setBin[b].uCount;
+			setRightArea[b] = uRight>0?boxArea(vMin, vMax):0.0f;
+			setRightCount[b] = uRight;
+		}
+		for (int a=0; a<3; ++a)
+		{
+			vMin[a] = FLT_MAX;
+			vMax[a] = -FLT_MAX;
+		}
+		size_t uLeft = 0;
+		for (int b=0; b<BIN_COUNT-1; ++b)
+		{
+			boxGrow(vMin, vMax, setBin[b].vMin, setBin[b].vMax);
+			uLeft += setBin[b].uCount;
+			if (uLeft==0||setRightCount[b+1]==0)
+			{
+				continue;
+			}
+			float fCost = boxArea(vMin, vMax)*uLeft+setRightArea[b+1]*setRightCount[b+1];
+			if (fCost<fBestCost)
+			{
+				fBestCost = fCost;
+				nBestAxis = nAxis;
+				nBestSplit = b+1;
+			}
+		}
+	}
+
+	size_t uMid = uBegin+uCount/2;
+	if (nBestAxis<0)
+	{
+		// all centers in one point, only the leaf size is left to bound
+		if (uCount<=MAX_LEAF_SIZE)
+		{
+			makeLeaf(m_setNode[uNode], uBegin, uEnd);
+			return;
+		}
+	}
+	else
+	{
+		// traversal counts as one triangle test
+		const Node& node = m_setNode[uNode];
+		float fParentArea = boxArea(node.vMin, node.vMax);
+		float fSplitCost = 1.0f+(fParentArea>0.0f?fBestCost/fParentArea:0.0f);
+		if (uCount<=MAX_LEAF_SIZE&&fSplitCost>=(float)uCount)
+		{
+			makeLeaf(m_setNode[uNode], uBegin, uEnd);
+			return;
+		}
+		float fScale = BIN_COUNT/(vCenterMax[nBestAxis]-vCenterMin[nBestAxis]);
+		size_t uSplit = uBegin;
+		for (size_t i=uBegin; i<uEnd; ++i)
+		{
+			if (binOf(setTri[i].vCenter[nBestAxis], vCenterMin[nBestAxis], fScale, BIN_COUNT)<nBestSplit)
+			{
+				std::swap(setTri[i], setTri[uSplit++]);
+			}
+		}
+		if (uSplit>uBegin&&uSplit<uEnd)
+		{
+			uMid = uSplit;
+		}
+	}
+
+	size_t uLeft = m_setNode.size();
+	m_setNode.push_back(Node());
+	buildNode(uLeft, setTri, uBegin, uMid, nDepth+1);
+	size_t uRight = m_setNode.size();
+	m_setNode.push_back(Node());
+	buildNode(uRight, setTri, uMid, uEnd, nDepth+1);
+	m_setNode[uNode].uIndex = (unsigned int)uRight;
+	m_setNode[uNode].uCount = 0;
+}
+
+namespace
+{
+	struct StackEntry
+	{
+		unsigned int	uNode;
+		float			fNear;
+	};
+}
+
+bool CTriangleBVH::intersectRay(const float* vOrigin, const float* vDir, float fMaxDist, RayHit& hit)const
+{
+	if (empty())
+	{
+		return false;
+	}
+	float vInvDir[3] = {1.0f/vDir[0], 1.0f/vDir[1], 1.0f/vDir[2]};
+	float fNear;
+	if (!rayBox(m_setNode[0], vOrigin, vInvDir, fMaxDist, fNear))
+	{
+		return false;
+	}
+	bool bHit = false;
+	float fBest = fMaxDist;
+	StackEntry setStack[MAX_DEPTH+4];
+	int nStack = 0;
+	unsigned int uNode = 0;
+	for (;;)
+	{
+		const Node& node = m_setNode[uNode];
+		if (node.uCount>0)
+		{
+			for (unsigned int i=node.uIndex; i<node.uIndex+node.uCount; ++i)
+			{
+				float t, u, v;
+				if (rayTriangle(vOrigin, vDir, getCorners(i), fBest, t, u, v))
+				{
+					fBest = t;
+					hit.fDist = t;
+					hit.u = u;
+					hit.v = v;
+					hit.uID = m_setID[i];
+					bHit = true;
+				}
+			}
+		}
+		else
+		{
+			unsigned int uNear = uNode+1;
+			unsigned int uFar = node.uIndex;
+			float fNearDist, fFarDist;
+			bool bNear = rayBox(m_setNode[uNear], vOrigin, vInvDir, fBest, fNearDist);
+			bool bFar = rayBox(m_setNode[uFar], vOrigin, vInvDir, fBest, fFarDist);
+			if (bNear&&bFar)
+			{
+				if (fFarDist<fNearDist)
+				{
+					std::swap(uNear, uFar);
+					std::swap(fNearDist, fFarDist);
+				}
+				setStack[nStack].uNode = uFar;
+				setStack[nStack].fNear = fFarDist;
+				nStack++;
+				uNode = uNear;
+				continue;
+			}
+			if (bNear||bFar)
+			{
+				uNode = bNear?uNear:uFar;
+				continue;
+			}
+		}
+		// the next deferred node the ray can still reach before the best hit
+		while (nStack>0&&setStack[nStack-1].fNear>fBest)
+		{
+			nStack--;
+		}
+		if (nStack==0)
+		{
+			break;
+		}
+		uNode = setStack[--nStack].uNode;
+	}
+	return bHit;
+}
+
+bool CTriangleBVH::intersectRayAny(const float* vOrigin, const float* vDir, float fMaxDist)const
+{
+	if (empty())
+	{
+		return false;
+	}
+	float vInvDir[3] = {1.0f/vDir[0], 1.0f/vDir[1], 1.0f/vDir[2]};
+	unsigned int setStack[MAX_DEPTH+4];
+	int nStack = 0;
+	setStack[nStack++] = 0;
+	while (nStack>0)
+	{
+		const Node& node = m_setNode[setStack[--nStack]];
+		float fNear;
+		if (!rayBox(node, vOrigin, vInvDir, fMaxDist, fNear))
+		{
+			continue;
+		}
+		if (node.uCount>0)
+		{
+			for (unsigned int i=node.uIndex; i<node.uIndex+node.uCount; ++i)
+			{
+				float t, u, v;
+				if (rayTriangle(vOrigin, vDir, getCorners(i), fMaxDist, t, u, v))
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			setStack[nStack++] = node.uIndex;
+			setStack[nStack++] = (unsigned int)(&node-&m_setNode[0])+1;
+		}
+	}
+	return false;
+}
+
+void CTriangleBVH::overlapSphere(const float* vCenter, float fRadius, std::vector<unsigned int>& setID)const
+{
+	if (empty())
+	{
+		return;
+	}
+	float fRadiusSq = fRadius*fRadius;
+	unsigned int setStack[MAX_DEPTH+4];
+	int nStack = 0;
+	setStack[nStack++] = 0;
+	while (nStack>0)
+	{
+		unsigned int uNode = setStack[--nStack];
+		const Node& node = m_setNode[uNode];
+		if (boxPointDistSq(node, vCenter)>fRadiusSq)
+		{
+			continue;
+		}
+		if (node.uCount>0)
+		{
+			for (unsigned int i=node.uIndex; i<node.uIndex+node.uCount; ++i)
+			{
+				float vClosest[3], d[3];
+				closestOnTriangle(vClosest, vCenter, getCorners(i));
+				vecSub(d, vClosest, vCenter);
+				if (vecDot(d, d)<=fRadiusSq)
+				{
+					setID.push_back(m_setID[i]);
+				}
+			}
+		}
+		else
+		{
+			setStack[nStack++] = node.uIndex;
+			setStack[nStack++] = uNode+1;
+		}
+	}
+}
+
+void CTriangleBVH::overlapBox(const float* vMin, const float* vMax, std::vector<unsigned int>& setID)const
+{
+	if (empty())
+	{
+		return;
+	}
+	unsigned int setStack[MAX_DEPTH+4];
+	int nStack = 0;
+	setStack[nStack++] = 0;
+	while (nStack>0)
+	{
+		unsigned int uNode = setStack[--nStack];
+		const Node& node = m_setNode[uNode];
+		if (!boxOverlap(node, vMin, vMax))
+		{
+			continue;
+		}
+		if (node.uCount>0)
+		{
+			for (unsigned int i=node.uIndex; i<node.uIndex+node.uCount; ++i)
+			{
+				if (triangleBoxOverlap(getCorners(i), vMin, vMax))
+				{
+					setID.push_back(m_setID[i]);
+				}
+			}
+		}
+		else
+		{
+			setStack[nStack++] = node.uIndex;
+			setStack[nStack++] = uNode+1;
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// Bounding volume hierarchy over a triangle soup, for picking and collision against the bound
+// meshes of the models (M2 bounds, MU bmd triangles). Points are passed as float[3], anything
+// laid out like {x,y,z} (Vec3D). The tree is split by binned SAH and stored depth first in
+// 32 byte nodes, the left child of a node follows it. Leaves keep their triangles' corners,
+// so queries don't go back to the mesh. Queries only read and can run on several threads.
+class CTriangleBVH
+{
+public:
+	struct Node
+	{
+		float			vMin[3];
+		unsigned int	uIndex;		// right child, or first triangle of a leaf
+		float			vMax[3];
+		unsigned int	uCount;		// triangles of a leaf, 0 for an inner node
+	};
+	struct RayHit
+	{
+		float			fDist;		// along the direction, in its lengths
+		float			u, v;		// barycentric, the point is v0+(v1-v0)*u+(v2-v0)*v
+		unsigned int	uID;		// as given to addTriangle
+	};
+
+	CTriangleBVH();
+
+	void clear();
+	void addTriangle(const float* v0, const float* v1, const float* v2, unsigned int uID);
+	// Builds the tree over the added triangles, they can be queried from then on.
+	void build();
+
+	bool empty()const{return m_setNode.empty();}
+	size_t getNodeCount()const{return m_setNode.size();}
+	size_t getTriangleCount()const{return m_setID.size();}
+	const Node* getRoot()const{return m_setNode.empty()?NULL:&m_setNode[0];}
+
+	// Closest triangle hit by the ray within fMaxDist, both faces count.
+	bool intersectRay(const float* vOrigin, const float* vDir, float fMaxDist, RayHit& hit)const;
+	// Whether any triangle is hit within fMaxDist, stops at the first one found.
+	bool intersectRayAny(const float* vOrigin, const float* vDir, float fMaxDist)const;
+	// IDs of the triangles touching the sphere / box are appended.
+	void overlapSphere(const float* vCenter, float fRadius, std::vector<unsigned int>& setID)const;
+	void overlapBox(const float* vMin, const float* vMax, std::vector<unsigned int>& setID)const;
+private:
+	enum
+	{
+		MAX_LEAF_SIZE	= 4,
+		MAX_DEPTH		= 60,
+		BIN_COUNT		= 16,
+	};
+	struct BuildTriangle
+	{
+		float			vMin[3];
+		float			vMax[3];
+		float			vCenter[3];
+		unsigned int	uTriangle;
+	};
+	void buildNode(size_t uNode, std::vector<BuildTriangle>& setTri, size_t uBegin, size_t uEnd, int nDepth);
+	void makeLeaf(Node& node, size_t uBegin, size_t uEnd);
+	const float* getCorners(unsigned int uTriangle)const{return &m_setVertex[uTriangle*9];}
+
+	std::vector<Node>			m_setNode;
+	std::vector<float>			m_setVertex;	// 9 per triangle, in leaf order once built
+	std::vector<unsigned int>	m_setID;
+};
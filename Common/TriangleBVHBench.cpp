@@ -0,0 +1,315 @@
+// Checks CTriangleBVH against brute force over random triangle soups, closest and any hit rays
+// and sphere overlaps, and times the build and the rays of both. Returns non zero when a check
+// fails, run by ctest. The soup sizes can be given, 2000 20000 200000 by default.
+#include "TriangleBVH.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+static double getSeconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER nFrequency, nCounter;
+	QueryPerformanceFrequency(&nFrequency);
+	QueryPerformanceCounter(&nCounter);
+	return (double)nCounter.QuadPart/(double)nFrequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+#endif
+}
+
+// small fixed generator, rand() differs between the C runtimes
+static float nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return (float)(uSeed>>8)/16777216.0f;
+}
+
+static float dot(const float* a, const float* b)
+{
+	return a[0]*b[0]+a[1]*b[1]+a[2]*b[2];
+}
+
+static void sub(float* r, const float* a, const float* b)
+{
+	r[0] = a[0]-b[0];
+	r[1] = a[1]-b[1];
+	r[2] = a[2]-b[2];
+}
+
+static void cross(float* r, const float* a, const float* b)
+{
+	r[0] = a[1]*b[2]-a[2]*b[1];
+	r[1] = a[2]*b[0]-a[0]*b[2];
+	r[2] = a[0]*b[1]-a[1]*b[0];
+}
+
+// Moller-Trumbore, both faces, written here and not taken from the library
+static bool bruteRayTriangle(const float* vOrigin, const float* vDir, const float* p, float fMaxDist, float& t)
+{
+	float e1[3], e2[3], h[3], s[3], q[3];
+	sub(e1, p+3, p);
+	sub(e2, p+6, p);
+	cross(h, vDir, e2);
+	float a = dot(e1, h);
+	if (a==0.0f)
+	{
+		return false;
+	}
+	float f = 1.0f/a;
+	sub(s, vOrigin, p);
+	float u = f*dot(s, h);
+	if (u<0.0f||u>1.0f)
+	{
+		return false;
+	}
+	cross(q, s, e1);
+	float v = f*dot(vDir, q);
+	if (v<0.0f||u+v>1.0f)
+	{
+		return false;
+	}
+	t = f*dot(e2, q);
+	return t>=0.0f&&t<=fMaxDist;
+}
+
+// Closest point of a triangle to a point, from its Voronoi regions.
+static void closestPoint(const float* p, const float* a, const float* b, const float* c, float* r)
+{
+	float ab[3], ac[3], ap[3], bp[3], cp[3];
+	sub(ab, b, a);
+	sub(ac, c, a);
+	sub(ap, p, a);
+	float d1 = dot(ab, ap), d2 = dot(ac, ap);
+	if (d1<=0.0f&&d2<=0.0f)
+	{
+		r[0] = a[0]; r[1] = a[1]; r[2] = a[2];
+		return;
+	}
+	sub(bp, p, b);
+	float d3 = dot(ab, bp), d4 = dot(ac, bp);
+	if (d3>=0.0f&&d4<=d3)
+	{
+		r[0] = b[0]; r[1] = b[1]; r[2] = b[2];
+		return;
+	}
+	float vc = d1*d4-d3*d2;
+	if (vc<=0.0f&&d1>=0.0f&&d3<=0.0f)
+	{
+		float v = d1/(d1-d3);
+		for (int i=0; i<3; ++i) r[i] = a[i]+ab[i]*v;
+		return;
+	}
+	sub(cp, p, c);
+	float d5 = dot(ab, cp), d6 = dot(ac, cp);
+	if (d6>=0.0f&&d5<=d6)
+	{
+		r[0] = c[0]; r[1] = c[1]; r[2] = c[2];
+		return;
+	}
+	float vb = d5*d2-d1*d6;
+	if (vb<=0.0f&&d2>=0.0f&&d6<=0.0f)
+	{
+		float w = d2/(d2-d6);
+		for (int i=0; i<3; ++i) r[i] = a[i]+ac[i]*w;
+		return;
+	}
+	float va = d3*d6-d5*d4;
+	if (va<=0.0f&&(d4-d3)>=0.0f&&(d5-d6)>=0.0f)
+	{
+		float w = (d4-d3)/((d4-d3)+(d5-d6));
+		for (int i=0; i<3; ++i) r[i] = b[i]+(c[i]-b[i])*w;
+		return;
+	}
+	float fDenom = 1.0f/(va+vb+vc);
+	float v = vb*fDenom, w = vc*fDenom;
+	for (int i=0; i<3; ++i) r[i] = a[i]+ab[i]*v+ac[i]*w;
+}
+
+// Small triangles in a 100 unit box, about as dense as a bound mesh or a map object.
+static void makeSoup(size_t uCount, std::vector<float>& setCorner)
+{
+	unsigned int uSeed = 2024+(unsigned int)uCount;
+	setCorner.resize(uCount*9);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		float vCenter[3] = {nextRandom(uSeed)*100.0f, nextRandom(uSeed)*100.0f, nextRandom(uSeed)*100.0f};
+		for (int j=0; j<9; ++j)
+		{
+			setCorner[i*9+j] = vCenter[j%3]+(nextRandom(uSeed)-0.5f)*4.0f;
+		}
+	}
+}
+
+// From outside the box towards a point in it, the direction normalized.
+static void makeRay(unsigned int& uSeed, float* vOrigin, float* vDir)
+{
+	float vTarget[3];
+	for (int a=0; a<3; ++a)
+	{
+		vOrigin[a] = nextRandom(uSeed)*300.0f-100.0f;
+		vTarget[a] = nextRandom(uSeed)*100.0f;
+	}
+	sub(vDir, vTarget, vOrigin);
+	float fLength = sqrtf(dot(vDir, vDir));
+	for (int a=0; a<3; ++a)
+	{
+		vDir[a] /= fLength;
+	}
+}
+
+static void testSoup(size_t uCount)
+{
+	std::vector<float> setCorner;
+	makeSoup(uCount, setCorner);
+	CTriangleBVH bvh;
+	double fStart = getSeconds();
+	for (size_t i=0; i<uCount; ++i)
+	{
+		bvh.addTriangle(&setCorner[i*9], &setCorner[i*9+3], &setCorner[i*9+6], (unsigned int)i);
+	}
+	bvh.build();
+	double fBuild = getSeconds()-fStart;
+	CHECK(bvh.getTriangleCount()==uCount);
+
+	// against brute force, fewer rays for the big soups
+	const float fMaxDist = 1000.0f;
+	size_t uChecks = uCount>20000 ? 200 : 2000;
+	unsigned int uSeed = 7;
+	size_t uMismatch = 0;
+	size_t uHits = 0;
+	double fBrute = 0.0;
+	for (size_t r=0; r<uChecks; ++r)
+	{
+		float vOrigin[3], vDir[3];
+		makeRay(uSeed, vOrigin, vDir);
+		fStart = getSeconds();
+		bool bBrute = false;
+		float fBest = fMaxDist;
+		for (size_t i=0; i<uCount; ++i)
+		{
+			float t;
+			if (bruteRayTriangle(vOrigin, vDir, &setCorner[i*9], fBest, t))
+			{
+				bBrute = true;
+				fBest = t;
+			}
+		}
+		fBrute += getSeconds()-fStart;
+		CTriangleBVH::RayHit hit;
+		bool bHit = bvh.intersectRay(vOrigin, vDir, fMaxDist, hit);
+		// the same distance, a tie may be another triangle
+		if (bHit!=bBrute||(bHit&&fabsf(hit.fDist-fBest)>1e-4f*(1.0f+fBest)))
+		{
+			uMismatch++;
+		}
+		if (bvh.intersectRayAny(vOrigin, vDir, fMaxDist)!=bBrute)
+		{
+			uMismatch++;
+		}
+		uHits += bBrute?1:0;
+
+		// a sphere around the point the ray aims at
+		float vCenter[3] = {vOrigin[0]+vDir[0]*100.0f, vOrigin[1]+vDir[1]*100.0f, vOrigin[2]+vDir[2]*100.0f};
+		float fRadius = 1.0f+nextRandom(uSeed)*8.0f;
+		std::vector<unsigned int> setID;
+		bvh.overlapSphere(vCenter, fRadius, setID);
+		std::sort(setID.begin(), setID.end());
+		std::vector<unsigned int> setBrute;
+		for (size_t i=0; i<uCount; ++i)
+		{
+			const float* p = &setCorner[i*9];
+			float vClosest[3], d[3];
+			closestPoint(vCenter, p, p+3, p+6, vClosest);
+			sub(d, vClosest, vCenter);
+			float fDistSq = dot(d, d);
+			// skip the ones at the surface, float rounding decides those
+			if (fabsf(fDistSq-fRadius*fRadius)<1e-3f*fRadius*fRadius)
+			{
+				setID.erase(std::remove(setID.begin(), setID.end(), (unsigned int)i), setID.end());
+				continue;
+			}
+			if (fDistSq<fRadius*fRadius)
+			{
+				setBrute.push_back((unsigned int)i);
+			}
+		}
+		if (setID!=setBrute)
+		{
+			uMismatch++;
+		}
+	}
+	CHECK(uMismatch==0);
+	CHECK(uHits>0);
+
+	// the rays alone
+	const size_t uRays = 100000;
+	uSeed = 11;
+	std::vector<float> setRay(uRays*6);
+	for (size_t r=0; r<uRays; ++r)
+	{
+		makeRay(uSeed, &setRay[r*6], &setRay[r*6+3]);
+	}
+	size_t uSum = 0;
+	fStart = getSeconds();
+	for (size_t r=0; r<uRays; ++r)
+	{
+		CTriangleBVH::RayHit hit;
+		uSum += bvh.intersectRay(&setRay[r*6], &setRay[r*6+3], fMaxDist, hit) ? hit.uID : 0;
+	}
+	double fRays = getSeconds()-fStart;
+	printf("%u tris: %u nodes, build %.1f ms, %.0f ns/ray, brute force %.0f ns/ray, %u of %u checks hit, %u mismatches (%u)\n",
+		(unsigned int)uCount, (unsigned int)bvh.getNodeCount(), fBuild*1e3, fRays*1e9/uRays, fBrute*1e9/uChecks,
+		(unsigned int)uHits, (unsigned int)uChecks, (unsigned int)uMismatch, (unsigned int)(uSum&1));
+}
+
+static void testEmpty()
+{
+	CTriangleBVH bvh;
+	bvh.build();
+	float vOrigin[3] = {0, 0, 0};
+	float vDir[3] = {0, 0, 1};
+	CTriangleBVH::RayHit hit;
+	CHECK(!bvh.intersectRay(vOrigin, vDir, 100.0f, hit));
+	CHECK(!bvh.intersectRayAny(vOrigin, vDir, 100.0f));
+	std::vector<unsigned int> setID;
+	bvh.overlapSphere(vOrigin, 10.0f, setID);
+	CHECK(setID.empty());
+}
+
+int main(int argc, char* argv[])
+{
+	testEmpty();
+	if (argc>1)
+	{
+		for (int i=1; i<argc; ++i)
+		{
+			testSoup((size_t)atoi(argv[i]));
+		}
+	}
+	else
+	{
+		testSoup(2000);
+		testSoup(20000);
+		testSoup(200000);
+	}
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
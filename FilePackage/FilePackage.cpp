@@ -1,257 +1,201 @@
 // FilePackage.cpp : ̨Ӧóڵ㡣
 //
+#include "PakWriter.h"
 #include <stdio.h>
-#include <tchar.h>
-#include "string.h"
-#include "io.h"
-
-#include <vector>
-
-#include <windows.h>
-#include <mmsystem.h>
-#include <math.h>
-#include <process.h>
-#include <signal.h>
-
-#include <cctype>
-#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <iostream>
-#include "conio.h"
-#include "direct.h"
-
-inline unsigned long GeneratePakFileID(const char* str)
-{
-	if(!str)
-		return 0;
-	int i;
-	unsigned int v;
-	static unsigned m[70];
-	strncpy((char *)m,str,256);
-	for (i=0;i<256/4 && m[i];i++) ;
-	m[i++]=0x9BE74448,m[i++]=0x66F42C48;
-	v=0xF4FA8928;
-
-	__asm {
-		mov esi,0x37A8470E		;x0=0x37A8470E
-			mov edi,0x7758B42B		;y0=0x7758B42B
-			xor ecx,ecx
-_loop:
-		mov ebx,0x267B0B11		;w=0x267B0B11
-			rol v,1
-			lea eax,m
-			xor ebx,v
-
-			mov eax,[eax+ecx*4]
-		mov edx,ebx
-			xor esi,eax
-			xor edi,eax
-
-			add edx,edi
-			or edx,0x2040801		;a=0x2040801
-			and edx,0xBFEF7FDF		;c=0xBFEF7FDF
-
-			mov eax,esi
-			mul edx
-			adc eax,edx
-			mov edx,ebx
-			adc eax,0
-
-			add edx,esi
-			or edx,0x804021			;b=0x804021
-			and edx,0x7DFEFBFF		;d=0x7DFEFBFF
 
-			mov esi,eax
-			mov eax,edi
-			mul edx
+#ifdef _WIN32
+#include <direct.h>
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
 
-			add edx,edx
-			adc eax,edx
-			jnc _skip
-			add eax,2
-_skip:
-		inc ecx;
-		mov edi,eax
-			cmp ecx,i
-			jnz _loop
-			xor esi,edi
-			mov v,esi
-	}
-	//#ifdef _DEBUG
-	//	char szTemp[512];
-	//	sprintf(szTemp, "%s FileID: %u\n", str,v);
-	//	::OutputDebugStringA(szTemp);	
-	//#endif
-	return v;
+static void printUsage()
+{
+	std::cout<<"usage: FilePackage [-u] [-z level] [-a alignment] [-b batch MB] [dir [pak]]"<<std::endl;
+	std::cout<<"       FilePackage -c [-a alignment] pak"<<std::endl;
+	std::cout<<"  packs dir (the current one by default) into dir.pak next to it"<<std::endl;
+	std::cout<<"  -u  updates the pak: adds new and changed files, keeps the rest"<<std::endl;
+	std::cout<<"  -c  compacts the pak, dropping what updates replaced"<<std::endl;
+	std::cout<<"  -z  zlib level 1-9 for the files that shrink, 0 stores (default)"<<std::endl;
+	std::cout<<"  -a  file data alignment, 4096 for page aligned files (default 16, -c keeps the pak's)"<<std::endl;
+	std::cout<<"  -b  megabytes read and compressed at once (default 64)"<<std::endl;
 }
 
-void GetFileListFromDir(const char* pszDir, std::vector<std::string>& setFilelist)
+static bool endsWith(const std::string& str, const char* szEnd)
 {
-	_finddata_t filestruct;
-	int p = 0;
-	int fn = 0;
-	char szSearch[255];
-	if (strlen(pszDir) == 0)
+	size_t uLength = strlen(szEnd);
+	if (str.size()<uLength)
 	{
-		strcpy(szSearch , "*.*");
+		return false;
 	}
-	else
+	for (size_t i=0; i<uLength; ++i)
 	{
-		strcpy(szSearch , pszDir);
-		strcat(szSearch , "/*.*");
+		if (tolower((unsigned char)str[str.size()-uLength+i])!=szEnd[i])
+		{
+			return false;
+		}
 	}
+	return true;
+}
 
-	int hnd = _findfirst(szSearch , &filestruct);
-	if(hnd == -1) 
+int main(int argc, char* argv[])
+{
+	int nLevel = 0;
+	unsigned int uAlignment = 0;	// not given
+	size_t uBatchMB = 64;
+	bool bUpdate = false;
+	bool bCompact = false;
+	std::string strDir;
+	std::string strPak;
+	for (int i=1; i<argc; ++i)
 	{
-		return;
+		std::string strArg = argv[i];
+		if ((strArg=="-z"||strArg=="-a"||strArg=="-b") && i+1<argc)
+		{
+			int nValue = atoi(argv[++i]);
+			if (strArg=="-z")
+			{
+				nLevel = nValue<0 ? 0 : (nValue>9 ? 9 : nValue);
+			}
+			else if (strArg=="-a")
+			{
+				uAlignment = nValue>0 ? (unsigned int)nValue : 1;
+			}
+			else
+			{
+				uBatchMB = nValue>0 ? (size_t)nValue : 1;
+			}
+		}
+		else if (strArg=="-u")
+		{
+			bUpdate = true;
+		}
+		else if (strArg=="-c")
+		{
+			bCompact = true;
+		}
+		else if (strArg.size()>1 && strArg[0]=='-')
+		{
+			printUsage();
+			return 1;
+		}
+		else if (strDir.empty())
+		{
+			strDir = strArg;
+		}
+		else if (strPak.empty())
+		{
+			strPak = strArg;
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
 	}
-	do
+	if (bCompact)
 	{
-		char szFullName[MAX_PATH] = "";
-		if (strlen(pszDir) > 0)
+		if (strDir.empty() || !strPak.empty())
 		{
-			sprintf(szFullName , "%s/%s" , pszDir , filestruct.name);		
+			printUsage();
+			return 1;
 		}
-		else
+		if (!CompactPakFile(strDir.c_str(), uAlignment))
 		{
-			strcpy(szFullName , filestruct.name);
+			std::cout<<"error: Compacting "<<strDir<<" failed."<<std::endl;
+			return 1;
 		}
-		if (!(filestruct.attrib & _A_HIDDEN)) // ignore hidden
+		std::cout<<"Completed."<<std::endl;
+		return 0;
+	}
+	if (strDir.empty() || strDir==".")
+	{
+		char szDir[1024] = "";
+		if (!getcwd(szDir, sizeof(szDir)))
 		{
-			if (!(filestruct.attrib & _A_SUBDIR)) 
-			{
-				// Process the file name
-				char szFileCopy[512];
-				strcpy(szFileCopy, szFullName);
-				strlwr(szFileCopy);
-				unsigned long uFileNameLength = strlen(szFileCopy);
-				for(size_t i = 0; i < uFileNameLength; ++i)
-				{
-					if(szFileCopy[i] == '/')
-					{
-						szFileCopy[i] = '\\';
-					}
-				}
-				if (szFileCopy[uFileNameLength-1]!='e'||
-					szFileCopy[uFileNameLength-2]!='x'||
-					szFileCopy[uFileNameLength-3]!='e'||
-					szFileCopy[uFileNameLength-4]!='.')
-				{
-					setFilelist.push_back(szFileCopy);
-				}
-			}
-			else // Directory
-			{
-				if (strcmp(filestruct.name , "..") != 0 && strcmp(filestruct.name, ".") != 0)
-				{
-					GetFileListFromDir(szFullName,setFilelist);
-				}
-			}
+			return 1;
 		}
-	}while(!_findnext(hnd , &filestruct)); 
-}
-
-#define FILE_INFO_SIZE sizeof(unsigned long)*3
-int _tmain(int argc, _TCHAR* argv[])
-{
-	//
-	//char   szModuleFile[MAX_PATH]   ;    
-	//GetModuleFileNameA(NULL, szModuleFile, MAX_PATH);  
-
-	// get file list from dir
-	std::vector<std::string> setFilelist;
-	GetFileListFromDir("",setFilelist);
-
-	std::cout<<"File count: "<<setFilelist.size()<<std::endl;
-	// get the save filename
-	char szPakFilename[128];
-	GetCurrentDirectoryA(128, szPakFilename);
-	if (strlen(szPakFilename) != 0)
+		strDir = szDir;
+	}
+	while (strDir.size()>1 && (strDir[strDir.size()-1]=='/'||strDir[strDir.size()-1]=='\\'))
 	{
-		strcat(szPakFilename , ".pak");
+		strDir.erase(strDir.size()-1);
 	}
-	std::cout<<"The pak filename: "<<szPakFilename<<std::endl;
-
-	// open or create pak
-	FILE* f=fopen(szPakFilename, "wb");
-	if(!f)
+	if (strPak.empty())
 	{
-		return false;
+		strPak = strDir+".pak";
 	}
 
-	// Head
-	char szFileHeader[32]="DawnPack.TqDigital";
-	fwrite(szFileHeader, sizeof(char), 32, f);
-
-	// Version
-	unsigned long uVersion = 1000;
-	fwrite(&uVersion, sizeof(unsigned long), 1, f);
-
-	// count
-	unsigned long uFileCount = setFilelist.size();
-	fwrite(&uFileCount, sizeof(unsigned long), 1, f);
-
-	// get offset
-	unsigned long uFileListOffset = ftell(f);
-	const unsigned long uFileDataStart = ftell(f)+setFilelist.size()*FILE_INFO_SIZE;
-	unsigned long uFileDataOffset = uFileDataStart;
+	// get file list from dir, not the packer itself
+	std::vector<std::string> setAll;
+	GetPakFileList(strDir, setAll);
+	std::vector<std::string> setFilelist;
+	for (size_t i=0; i<setAll.size(); ++i)
+	{
+		if (!endsWith(setAll[i], ".exe") && strDir+"/"+setAll[i]!=strPak)
+		{
+			setFilelist.push_back(setAll[i]);
+		}
+	}
+	std::cout<<"File count: "<<setFilelist.size()<<std::endl;
+	std::cout<<"The pak filename: "<<strPak<<std::endl;
 
-	// vector
-	int nCount = 0;
-	for (std::vector<std::string>::iterator it=setFilelist.begin();it!=setFilelist.end();it++)
+	CPakWriter writer;
+	FILE* f = bUpdate ? fopen(strPak.c_str(), "rb") : NULL;
+	if (f)
 	{
-		nCount++;
-		std::cout<<"packing "<<nCount<<"/"<<uFileCount<<": "<<it->c_str()<<std::endl;
-		// check the filelist is ok
-		if (uFileListOffset+FILE_INFO_SIZE>uFileDataStart)
+		fclose(f);
+		if (!writer.openAppend(strPak.c_str()))
 		{
-			std::cout<<"error: Out of file list range. Address: "<<uFileListOffset<<std::endl;
-			break;
+			std::cout<<"error: Can't update the pak, it has to be written by this version."<<std::endl;
+			return 1;
 		}
-		//
-		unsigned long uFileSize = 0;
-		// push back the file data to "*.pak"
+	}
+	else if (!writer.create(strPak.c_str(), uAlignment>0 ? uAlignment : 16))
+	{
+		std::cout<<"error: Can't create the pak."<<std::endl;
+		return 1;
+	}
+	writer.setCompressionLevel(nLevel);
+	writer.setBatchSize(uBatchMB<<20);
+
+	std::vector<PakWriteResult> setResult;
+	size_t uPacked = writer.addFiles(strDir, setFilelist, setResult);
+	unsigned long long uSize = 0;
+	unsigned long long uStoredSize = 0;
+	size_t uUnchanged = 0;
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		if (!setResult[i].bOk)
 		{
-			FILE* fFile = fopen(it->c_str(),"rb");
-			if (!fFile)
-			{
-				std::cout<<"warning: This file can be read."<<std::endl;
-				continue;
-			}
-			{
-				fseek(fFile, 0, SEEK_END);
-				uFileSize = ftell(fFile);
-				fseek(fFile, 0, SEEK_SET);
-			}
-			if (uFileSize>0)
-			{
-				char* buffer = new char[uFileSize];
-				fread(buffer,uFileSize,1,fFile);
-				// write data to pak
-				fseek(f,uFileDataOffset,SEEK_SET);
-				fwrite(buffer,uFileSize,1,f);
-				delete buffer;
-			}
-			fclose(fFile);
+			std::cout<<"warning: "<<setResult[i].strName<<" can't be packed, unreadable or its id is taken."<<std::endl;
+			continue;
 		}
-		// write file info to FileList
-		fseek(f, uFileListOffset, SEEK_SET);
-		unsigned long id = GeneratePakFileID(it->c_str());
+		if (setResult[i].bUnchanged)
 		{
-			fwrite(&id,sizeof(unsigned long),1,f);
-			fwrite(&uFileSize,sizeof(unsigned long),1,f);
-			fwrite(&uFileDataOffset, sizeof(unsigned long), 1, f);
+			uUnchanged++;
+			continue;
 		}
-		// offset
-		uFileListOffset+=FILE_INFO_SIZE;
-		uFileDataOffset+=uFileSize;
+		uSize += setResult[i].uSize;
+		uStoredSize += setResult[i].uStoredSize;
 	}
-	fclose(f);
-	std::cout<<"Completed."<<std::endl;
-
-	system("pause");   
-
-	//getch();
-	return 0;
+	unsigned long long uLiveSize = writer.getLiveSize();
+	unsigned long long uPakSize = writer.getPosition();
+	if (!writer.finish())
+	{
+		std::cout<<"error: Writing the pak failed."<<std::endl;
+		return 1;
+	}
+	std::cout<<"Completed: "<<uPacked<<"/"<<setFilelist.size()<<" files, "<<uUnchanged<<" unchanged, "
+		<<uSize<<" bytes stored in "<<uStoredSize<<"."<<std::endl;
+	if (bUpdate)
+	{
+		std::cout<<"Live data: "<<uLiveSize<<" of "<<uPakSize<<" bytes, -c compacts."<<std::endl;
+	}
+	return uPacked==setFilelist.size() ? 0 : 2;
 }
-
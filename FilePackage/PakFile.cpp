@@ -0,0 +1,526 @@
+#include "PakFile.h"
+#include <string.h>
+#include <algorithm>
+#include "zlib.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PAK_ID_SSE2
+#endif
+
+// The name is hashed as up to 64 little endian words, followed by two fixed ones. Each word
+// is mixed into x and y with two 32x32->64 multiplies whose halves are folded back with the
+// carries x86's mul/adc leave behind; the id is x^y.
+#define PAK_ID_MAX_WORDS	(256/4)
+#define PAK_ID_TAIL0		0x9BE74448u
+#define PAK_ID_TAIL1		0x66F42C48u
+#define PAK_ID_X0			0x37A8470Eu
+#define PAK_ID_Y0			0x7758B42Bu
+#define PAK_ID_V0			0xF4FA8928u
+#define PAK_ID_W			0x267B0B11u
+
+static size_t getPakIDLength(const char* szName)
+{
+	size_t uLength = 0;
+	while (uLength<PAK_ID_MAX_WORDS*4 && szName[uLength])
+	{
+		uLength++;
+	}
+	return uLength;
+}
+
+// Word uWord of a name uLength long, its own terminator and the fixed words after it.
+static unsigned int getPakIDWord(const char* szName, size_t uLength, size_t uWord)
+{
+	size_t uWordCount = (uLength+3)/4;
+	if (uWord>=uWordCount)
+	{
+		return uWord==uWordCount ? PAK_ID_TAIL0 : PAK_ID_TAIL1;
+	}
+	const unsigned char* p = (const unsigned char*)szName+uWord*4;
+	size_t uBytes = uLength-uWord*4;
+	unsigned int uValue = p[0];
+	if (uBytes>1) uValue |= (unsigned int)p[1]<<8;
+	if (uBytes>2) uValue |= (unsigned int)p[2]<<16;
+	if (uBytes>3) uValue |= (unsigned int)p[3]<<24;
+	return uValue;
+}
+
+static inline unsigned int rotatePakIDSeed(unsigned int v)
+{
+	return (v<<1)|(v>>31);
+}
+
+unsigned int GeneratePakFileID(const char* szName)
+{
+	if (!szName)
+	{
+		return 0;
+	}
+	size_t uLength = getPakIDLength(szName);
+	size_t uWordCount = (uLength+3)/4+2;
+	unsigned int x = PAK_ID_X0;
+	unsigned int y = PAK_ID_Y0;
+	unsigned int v = PAK_ID_V0;
+	for (size_t i=0; i<uWordCount; ++i)
+	{
+		v = rotatePakIDSeed(v);
+		unsigned int w = PAK_ID_W^v;
+		unsigned int a = getPakIDWord(szName, uLength, i);
+		x ^= a;
+		y ^= a;
+
+		// mul; adc eax,edx; adc eax,0
+		unsigned long long p = (unsigned long long)x*(((w+y)|0x2040801u)&0xBFEF7FDFu);
+		unsigned long long uHigh = p>>32;
+		unsigned long long t = (p&0xFFFFFFFFu)+uHigh+(uHigh!=0);
+		unsigned int uNewX = (unsigned int)(t+(t>>32));
+
+		// mul; add edx,edx; adc eax,edx; jnc +2
+		unsigned long long q = (unsigned long long)y*(((w+x)|0x804021u)&0x7DFEFBFFu);
+		unsigned long long uHigh2 = (q>>32)<<1;
+		t = (q&0xFFFFFFFFu)+(uHigh2&0xFFFFFFFFu)+(uHigh2>>32);
+		y = (unsigned int)(t+((t>>32)<<1));
+		x = uNewX;
+	}
+	return x^y;
+}
+
+#ifdef PAK_ID_SSE2
+// x*f per 64 bit lane, low half + high half + carries, as 'mul; adc eax,edx; adc eax,0'
+static inline __m128i mixPakIDx64(__m128i x, __m128i f, __m128i mLow)
+{
+	__m128i p = _mm_mul_epu32(x, f);
+	__m128i uHigh = _mm_srli_epi64(p, 32);
+	// carry of mul: high half not 0, it overflows into bit 32 adding 0xFFFFFFFF
+	__m128i uCarry = _mm_srli_epi64(_mm_add_epi64(uHigh, mLow), 32);
+	__m128i t = _mm_add_epi64(_mm_add_epi64(_mm_and_si128(p, mLow), uHigh), uCarry);
+	return _mm_add_epi64(t, _mm_srli_epi64(t, 32));
+}
+
+// y*f per 64 bit lane, as 'mul; add edx,edx; adc eax,edx; jnc +2'
+static inline __m128i mixPakIDy64(__m128i y, __m128i f, __m128i mLow)
+{
+	__m128i q = _mm_mul_epu32(y, f);
+	__m128i uHigh2 = _mm_slli_epi64(_mm_srli_epi64(q, 32), 1);
+	__m128i t = _mm_add_epi64(_mm_add_epi64(_mm_and_si128(q, mLow), _mm_and_si128(uHigh2, mLow)), _mm_srli_epi64(uHigh2, 32));
+	return _mm_add_epi64(t, _mm_slli_epi64(_mm_srli_epi64(t, 32), 1));
+}
+
+static inline __m128i mixPakIDx(__m128i x, __m128i f, __m128i mLow)
+{
+	__m128i uEven = mixPakIDx64(x, f, mLow);
+	__m128i uOdd = mixPakIDx64(_mm_srli_epi64(x, 32), _mm_srli_epi64(f, 32), mLow);
+	return _mm_or_si128(_mm_and_si128(uEven, mLow), _mm_slli_epi64(uOdd, 32));
+}
+
+static inline __m128i mixPakIDy(__m128i y, __m128i f, __m128i mLow)
+{
+	__m128i uEven = mixPakIDy64(y, f, mLow);
+	__m128i uOdd = mixPakIDy64(_mm_srli_epi64(y, 32), _mm_srli_epi64(f, 32), mLow);
+	return _mm_or_si128(_mm_and_si128(uEven, mLow), _mm_slli_epi64(uOdd, 32));
+}
+
+// The same rounds for four names, one per 32 bit lane. A lane keeps its x and y once its
+// words run out. v only depends on the round, so it's shared. SSE2 multiplies two lanes at a
+// time and the carries take as long again, so this measured about as fast as the scalar loop.
+static void generatePakFileIDs4(const char* const* pNames, unsigned int* pIDs)
+{
+	// the words of each name with its fixed tail, SSE2 means little endian
+	unsigned int setWord[4][PAK_ID_MAX_WORDS+2];
+	int setWordCount[4];
+	int nMaxWords = 0;
+	for (int i=0; i<4; ++i)
+	{
+		setWordCount[i] = 0;
+		if (pNames[i])
+		{
+			size_t uLength = getPakIDLength(pNames[i]);
+			size_t uWords = (uLength+3)/4;
+			setWord[i][uWords?uWords-1:0] = 0;
+			memcpy(setWord[i], pNames[i], uLength);
+			setWord[i][uWords] = PAK_ID_TAIL0;
+			setWord[i][uWords+1] = PAK_ID_TAIL1;
+			setWordCount[i] = (int)uWords+2;
+		}
+		if (setWordCount[i]>nMaxWords)
+		{
+			nMaxWords = setWordCount[i];
+		}
+	}
+	for (int i=0; i<4; ++i)
+	{
+		memset(setWord[i]+setWordCount[i], 0, (nMaxWords-setWordCount[i])*sizeof(unsigned int));
+	}
+	const __m128i mLow = _mm_set_epi32(0,-1,0,-1);
+	const __m128i mA = _mm_set1_epi32(0x2040801);
+	const __m128i mC = _mm_set1_epi32((int)0xBFEF7FDF);
+	const __m128i mB = _mm_set1_epi32(0x804021);
+	const __m128i mD = _mm_set1_epi32(0x7DFEFBFF);
+	const __m128i mWordCount = _mm_setr_epi32(setWordCount[0],setWordCount[1],setWordCount[2],setWordCount[3]);
+	__m128i x = _mm_set1_epi32((int)PAK_ID_X0);
+	__m128i y = _mm_set1_epi32((int)PAK_ID_Y0);
+	unsigned int v = PAK_ID_V0;
+	for (int i=0; i<nMaxWords; ++i)
+	{
+		v = rotatePakIDSeed(v);
+		const __m128i w = _mm_set1_epi32((int)(PAK_ID_W^v));
+		// a lane past its words reads 0s, mActive keeps its x and y
+		const __m128i a = _mm_setr_epi32((int)setWord[0][i],(int)setWord[1][i],(int)setWord[2][i],(int)setWord[3][i]);
+		const __m128i xa = _mm_xor_si128(x, a);
+		const __m128i ya = _mm_xor_si128(y, a);
+		const __m128i e1 = _mm_and_si128(_mm_or_si128(_mm_add_epi32(w, ya), mA), mC);
+		const __m128i e2 = _mm_and_si128(_mm_or_si128(_mm_add_epi32(w, xa), mB), mD);
+
+		// lanes 0,2 in the even products, 1,3 in the odd ones
+		const __m128i newX = mixPakIDx(xa, e1, mLow);
+		const __m128i newY = mixPakIDy(ya, e2, mLow);
+
+		const __m128i mActive = _mm_cmpgt_epi32(mWordCount, _mm_set1_epi32(i));
+		x = _mm_or_si128(_mm_and_si128(mActive, newX), _mm_andnot_si128(mActive, x));
+		y = _mm_or_si128(_mm_and_si128(mActive, newY), _mm_andnot_si128(mActive, y));
+	}
+	unsigned int setID[4];
+	_mm_storeu_si128((__m128i*)setID, _mm_xor_si128(x, y));
+	for (int i=0; i<4; ++i)
+	{
+		pIDs[i] = pNames[i] ? setID[i] : 0;
+	}
+}
+#endif
+
+void GeneratePakFileIDs(const char* const* pNames, size_t uCount, unsigned int* pIDs)
+{
+	size_t i = 0;
+#ifdef PAK_ID_SSE2
+	for (; i+4<=uCount; i+=4)
+	{
+		generatePakFileIDs4(pNames+i, pIDs+i);
+	}
+#endif
+	for (; i<uCount; ++i)
+	{
+		pIDs[i] = GeneratePakFileID(pNames[i]);
+	}
+}
+
+void NormalizePakFileName(char* szName)
+{
+	for (char* p=szName; *p; ++p)
+	{
+		if (*p>='A'&&*p<='Z')
+		{
+			*p += 'a'-'A';
+		}
+		else if (*p=='/')
+		{
+			*p = '\\';
+		}
+	}
+}
+
+static unsigned int readPakUInt(const unsigned char* p)
+{
+	return p[0]|((unsigned int)p[1]<<8)|((unsigned int)p[2]<<16)|((unsigned int)p[3]<<24);
+}
+
+static unsigned long long readPakUInt64(const unsigned char* p)
+{
+	return readPakUInt(p)|((unsigned long long)readPakUInt(p+4)<<32);
+}
+
+static bool lessPakEntry(const CPakFile::Entry& a, const CPakFile::Entry& b)
+{
+	return a.uID<b.uID;
+}
+
+static bool samePakEntry(const CPakFile::Entry& a, const CPakFile::Entry& b)
+{
+	return a.uID==b.uID;
+}
+
+CPakFile::CPakFile()
+	:m_pData(NULL)
+	,m_uSize(0)
+	,m_uVersion(0)
+	,m_hFile(NULL)
+	,m_hMapping(NULL)
+{
+}
+
+CPakFile::~CPakFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+bool CPakFile::open(const char* szFilename)
+{
+	close();
+	HANDLE hFile = CreateFileA(szFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile==INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart<PAK_FILE_LIST_START || (unsigned long long)size.QuadPart>(size_t)-1)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+	HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* pView = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!pView)
+	{
+		if (hMapping)
+		{
+			CloseHandle(hMapping);
+		}
+		CloseHandle(hFile);
+		return false;
+	}
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pData = (const unsigned char*)pView;
+	m_uSize = (size_t)size.QuadPart;
+	if (!parse())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void CPakFile::close()
+{
+	if (m_pData)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_hMapping)
+	{
+		CloseHandle(m_hMapping);
+	}
+	if (m_hFile)
+	{
+		CloseHandle(m_hFile);
+	}
+	m_pData = NULL;
+	m_uSize = 0;
+	m_hFile = NULL;
+	m_hMapping = NULL;
+	m_uVersion = 0;
+	m_setEntry.clear();
+}
+#else
+bool CPakFile::open(const char* szFilename)
+{
+	close();
+	int fd = ::open(szFilename, O_RDONLY);
+	if (fd<0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st)!=0 || st.st_size<PAK_FILE_LIST_START || (unsigned long long)st.st_size>(size_t)-1)
+	{
+		::close(fd);
+		return false;
+	}
+	void* pView = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping keeps the file
+	::close(fd);
+	if (pView==MAP_FAILED)
+	{
+		return false;
+	}
+	m_pData = (const unsigned char*)pView;
+	m_uSize = (size_t)st.st_size;
+	if (!parse())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void CPakFile::close()
+{
+	if (m_pData)
+	{
+		munmap((void*)m_pData, m_uSize);
+	}
+	m_pData = NULL;
+	m_uSize = 0;
+	m_uVersion = 0;
+	m_setEntry.clear();
+}
+#endif
+
+bool CPakFile::parse()
+{
+	if (memcmp(m_pData, PAK_FILE_HEADER, sizeof(PAK_FILE_HEADER))!=0)
+	{
+		return false;
+	}
+	m_uVersion = readPakUInt(m_pData+32);
+	if (m_uVersion==PAK_FILE_VERSION2)
+	{
+		return parseVersion2();
+	}
+	if (m_uVersion!=PAK_FILE_VERSION)
+	{
+		return false;
+	}
+	size_t uCount = readPakUInt(m_pData+36);
+	if (uCount>(m_uSize-PAK_FILE_LIST_START)/PAK_FILE_INFO_SIZE)
+	{
+		return false;
+	}
+	const size_t uDataStart = PAK_FILE_LIST_START+uCount*PAK_FILE_INFO_SIZE;
+	m_setEntry.reserve(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		const unsigned char* p = m_pData+PAK_FILE_LIST_START+i*PAK_FILE_INFO_SIZE;
+		Entry entry;
+		entry.uID = readPakUInt(p);
+		entry.uFlags = 0;
+		entry.uStoredSize = readPakUInt(p+4);
+		entry.uOffset = readPakUInt(p+8);
+		entry.uSize = entry.uStoredSize;
+		entry.uTime = 0;
+		entry.uCRC = 0;
+		// unwritten slots are all 0
+		if (entry.uOffset<uDataStart || entry.uOffset>m_uSize || entry.uStoredSize>m_uSize-entry.uOffset)
+		{
+			continue;
+		}
+		m_setEntry.push_back(entry);
+	}
+	// in file order, the first of an id wins like the old lookup
+	std::stable_sort(m_setEntry.begin(), m_setEntry.end(), lessPakEntry);
+	m_setEntry.erase(std::unique(m_setEntry.begin(), m_setEntry.end(), samePakEntry), m_setEntry.end());
+	return true;
+}
+
+unsigned int CPakFile::getAlignment()const
+{
+	if (m_uVersion!=PAK_FILE_VERSION2)
+	{
+		return 0;
+	}
+	return readPakUInt(m_pData+48);
+}
+
+bool CPakFile::parseVersion2()
+{
+	if (m_uSize<PAK_FILE_HEADER2_SIZE)
+	{
+		return false;
+	}
+	size_t uCount = readPakUInt(m_pData+36);
+	unsigned long long uIndex = readPakUInt64(m_pData+40);
+	// 0 while the packer is still writing
+	if (uIndex<PAK_FILE_HEADER2_SIZE || uIndex>m_uSize || uCount>(m_uSize-uIndex)/PAK_FILE_ENTRY2_SIZE)
+	{
+		return false;
+	}
+	m_setEntry.reserve(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		const unsigned char* p = m_pData+(size_t)uIndex+i*PAK_FILE_ENTRY2_SIZE;
+		Entry entry;
+		entry.uID = readPakUInt(p);
+		entry.uFlags = readPakUInt(p+4);
+		entry.uOffset = readPakUInt64(p+8);
+		entry.uStoredSize = readPakUInt64(p+16);
+		entry.uSize = readPakUInt64(p+24);
+		entry.uTime = readPakUInt64(p+32);
+		entry.uCRC = readPakUInt(p+40);
+		if ((entry.uFlags&PAK_ENTRY_DEAD) || entry.uOffset<PAK_FILE_HEADER2_SIZE
+			|| entry.uOffset>uIndex || entry.uStoredSize>uIndex-entry.uOffset)
+		{
+			continue;
+		}
+		m_setEntry.push_back(entry);
+	}
+	// written sorted, but the lookups depend on it
+	std::stable_sort(m_setEntry.begin(), m_setEntry.end(), lessPakEntry);
+	m_setEntry.erase(std::unique(m_setEntry.begin(), m_setEntry.end(), samePakEntry), m_setEntry.end());
+	return true;
+}
+
+const CPakFile::Entry* CPakFile::findEntry(unsigned int uID)const
+{
+	Entry key;
+	key.uID = uID;
+	std::vector<Entry>::const_iterator it = std::lower_bound(m_setEntry.begin(), m_setEntry.end(), key, lessPakEntry);
+	if (it==m_setEntry.end() || it->uID!=uID)
+	{
+		return NULL;
+	}
+	return &*it;
+}
+
+const CPakFile::Entry* CPakFile::findEntry(const char* szName)const
+{
+	if (!szName)
+	{
+		return NULL;
+	}
+	// only the first 256 characters are hashed
+	char szNormalized[257];
+	strncpy(szNormalized, szName, 256);
+	szNormalized[256] = 0;
+	NormalizePakFileName(szNormalized);
+	return findEntry(GeneratePakFileID(szNormalized));
+}
+
+bool CPakFile::getFile(const char* szName, const unsigned char*& pData, size_t& uSize)const
+{
+	const Entry* pEntry = findEntry(szName);
+	if (!pEntry || (pEntry->uFlags&PAK_ENTRY_ZLIB))
+	{
+		return false;
+	}
+	pData = getData(*pEntry);
+	uSize = (size_t)pEntry->uSize;
+	return true;
+}
+
+bool CPakFile::readFile(const Entry& entry, std::vector<unsigned char>& setData)const
+{
+	if (entry.uSize>(size_t)-1)
+	{
+		return false;
+	}
+	setData.resize((size_t)entry.uSize);
+	if (entry.uSize==0)
+	{
+		return true;
+	}
+	if ((entry.uFlags&PAK_ENTRY_ZLIB)==0)
+	{
+		memcpy(&setData[0], getData(entry), (size_t)entry.uSize);
+		return true;
+	}
+	// zlib counts in uLong, the packer only compresses files that fit
+	uLongf uLength = (uLongf)entry.uSize;
+	if (entry.uSize!=uLength || entry.uStoredSize!=(uLong)entry.uStoredSize
+		|| uncompress(&setData[0], &uLength, getData(entry), (uLong)entry.uStoredSize)!=Z_OK
+		|| uLength!=entry.uSize)
+	{
+		setData.clear();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// "DawnPack.TqDigital" archives, all little endian. Version 1000, written by the first packer:
+//   char[32]  header, zero padded
+//   uint32    version, 1000
+//   uint32    file count
+//   count x { uint32 id, uint32 size, uint32 offset }
+//   file data
+// Version 1001, written by CPakWriter:
+//   char[32]  header
+//   uint32    version, 1001
+//   uint32    entry count
+//   uint64    index offset, 0 until the index is written
+//   uint32    alignment of the file data
+//   uint32    0
+//   file data, each file at a multiple of the alignment
+//   count x { uint32 id, uint32 flags, uint64 offset, uint64 stored size, uint64 size,
+//             uint64 modification time, uint32 crc32 of the file, uint32 0 }, sorted by id
+// A file is found by GeneratePakFileID of its lower case path with '\' separators.
+#define PAK_FILE_HEADER			"DawnPack.TqDigital"
+#define PAK_FILE_VERSION		1000
+#define PAK_FILE_INFO_SIZE		12
+#define PAK_FILE_LIST_START		40
+#define PAK_FILE_VERSION2		1001
+#define PAK_FILE_HEADER2_SIZE	56
+#define PAK_FILE_ENTRY2_SIZE	48
+
+// Entry flags of version 1001
+#define PAK_ENTRY_ZLIB			0x1		// stored as a zlib stream
+#define PAK_ENTRY_DEAD			0x2		// replaced, the space is unused
+
+// ID of a file name in a pak, the first 256 characters count. Same values as the old x86
+// assembly, NULL gives 0.
+unsigned int GeneratePakFileID(const char* szName);
+// IDs of uCount names at once, four lanes per SSE2 step where the build has SSE2. That is no
+// faster than calling GeneratePakFileID for each, see test/PakFileIDCheck.
+void GeneratePakFileIDs(const char* const* pNames, size_t uCount, unsigned int* pIDs);
+// Lower case, '\' separated, as the packer names the files it hashes.
+void NormalizePakFileName(char* szName);
+
+// Read only view of a pak. The file is mapped, not read, and the data handed out points
+// into the mapping until close(), so a 32 bit process can only open archives that fit its
+// address space. Lookups only read and can run on several threads.
+class CPakFile
+{
+public:
+	struct Entry
+	{
+		unsigned int		uID;
+		unsigned int		uFlags;			// PAK_ENTRY_*
+		unsigned long long	uOffset;		// from the start of the pak
+		unsigned long long	uStoredSize;	// bytes in the pak
+		unsigned long long	uSize;			// bytes of the file
+		unsigned long long	uTime;			// modification time of the source, 0 in version 1000
+		unsigned int		uCRC;			// crc32 of the file, 0 in version 1000
+	};
+
+	CPakFile();
+	~CPakFile();
+
+	// False when the file can't be mapped or isn't a pak. Entries pointing out of the file
+	// and the empty slots left by files the packer couldn't read are dropped.
+	bool open(const char* szFilename);
+	void close();
+	bool isOpen()const{return m_pData!=NULL;}
+	unsigned int getVersion()const{return m_uVersion;}
+	// of the file data, 0 in version 1000
+	unsigned int getAlignment()const;
+
+	// the live files, sorted by id
+	size_t getFileCount()const{return m_setEntry.size();}
+	const Entry& getEntry(size_t uIndex)const{return m_setEntry[uIndex];}
+	// NULL when the pak has no such file; of duplicate IDs the first entry wins.
+	const Entry* findEntry(unsigned int uID)const;
+	const Entry* findEntry(const char* szName)const;
+	// the stored bytes, compressed ones as they are
+	const unsigned char* getData(const Entry& entry)const{return m_pData+entry.uOffset;}
+	// The bytes of a file in the mapping, false when it isn't there or is compressed.
+	bool getFile(const char* szName, const unsigned char*& pData, size_t& uSize)const;
+	// A copy of the file, uncompressed; false when the data doesn't inflate to its size.
+	bool readFile(const Entry& entry, std::vector<unsigned char>& setData)const;
+
+	size_t getSize()const{return m_uSize;}
+private:
+	bool parse();
+	bool parseVersion2();
+
+	const unsigned char*	m_pData;
+	size_t					m_uSize;
+	unsigned int			m_uVersion;
+	void*					m_hFile;
+	void*					m_hMapping;
+	std::vector<Entry>		m_setEntry;
+private:
+	CPakFile(const CPakFile&);
+	CPakFile& operator=(const CPakFile&);
+};
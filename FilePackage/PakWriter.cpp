@@ -0,0 +1,759 @@
+#include "PakWriter.h"
+#include "../Common/ThreadPool.h"
+#include <string.h>
+#include <algorithm>
+#include "zlib.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+// pieces of the files too large for a batch
+#define PAK_COPY_SIZE		(1<<20)
+#define PAK_BATCH_SIZE		(64<<20)
+// zlib takes the batch's files in one call each
+#define PAK_MAX_BATCH_SIZE	(1<<30)
+
+static void writePakUInt(unsigned char* p, unsigned int u)
+{
+	p[0] = (unsigned char)u;
+	p[1] = (unsigned char)(u>>8);
+	p[2] = (unsigned char)(u>>16);
+	p[3] = (unsigned char)(u>>24);
+}
+
+static void writePakUInt64(unsigned char* p, unsigned long long u)
+{
+	writePakUInt(p, (unsigned int)u);
+	writePakUInt(p+4, (unsigned int)(u>>32));
+}
+
+static bool lessPakEntry(const CPakFile::Entry& a, const CPakFile::Entry& b)
+{
+	return a.uID<b.uID;
+}
+
+static bool getPakSourceInfo(const std::string& strPath, unsigned long long& uSize, unsigned long long& uTime)
+{
+#ifdef _WIN32
+	struct _stati64 st;
+	if (_stati64(strPath.c_str(), &st)!=0 || (st.st_mode&_S_IFDIR))
+#else
+	struct stat st;
+	if (stat(strPath.c_str(), &st)!=0 || S_ISDIR(st.st_mode))
+#endif
+	{
+		return false;
+	}
+	uSize = (unsigned long long)st.st_size;
+	uTime = (unsigned long long)st.st_mtime;
+	return true;
+}
+
+// crc32 of a file read in pieces
+static bool getPakSourceCRC(const std::string& strPath, unsigned long long uSize, unsigned int& uCRC)
+{
+	FILE* f = fopen(strPath.c_str(), "rb");
+	if (!f)
+	{
+		return false;
+	}
+	std::vector<unsigned char> setBuffer(PAK_COPY_SIZE);
+	uLong uValue = 0;
+	unsigned long long uLeft = uSize;
+	while (uLeft>0)
+	{
+		size_t uBytes = (size_t)std::min(uLeft, (unsigned long long)setBuffer.size());
+		if (fread(&setBuffer[0], 1, uBytes, f)!=uBytes)
+		{
+			fclose(f);
+			return false;
+		}
+		uValue = crc32(uValue, &setBuffer[0], (uInt)uBytes);
+		uLeft -= uBytes;
+	}
+	fclose(f);
+	uCRC = (unsigned int)uValue;
+	return true;
+}
+
+static bool seekPakFile(FILE* f, unsigned long long uPos, int nOrigin)
+{
+#ifdef _WIN32
+	return _fseeki64(f, (__int64)uPos, nOrigin)==0;
+#else
+	return fseeko(f, (off_t)uPos, nOrigin)==0;
+#endif
+}
+
+static unsigned long long tellPakFile(FILE* f)
+{
+#ifdef _WIN32
+	return (unsigned long long)_ftelli64(f);
+#else
+	return (unsigned long long)ftello(f);
+#endif
+}
+
+static unsigned int readPakUInt(const unsigned char* p)
+{
+	return p[0]|((unsigned int)p[1]<<8)|((unsigned int)p[2]<<16)|((unsigned int)p[3]<<24);
+}
+
+static unsigned long long readPakUInt64(const unsigned char* p)
+{
+	return readPakUInt(p)|((unsigned long long)readPakUInt(p+4)<<32);
+}
+
+static void getPakFileList(const std::string& strDir, const std::string& strPrefix, std::vector<std::string>& setPath)
+{
+#ifdef _WIN32
+	_finddata_t filestruct;
+	std::string strSearch = strDir.empty() ? "*.*" : strDir+"/*.*";
+	intptr_t hnd = _findfirst(strSearch.c_str(), &filestruct);
+	if (hnd==-1)
+	{
+		return;
+	}
+	do
+	{
+		if (filestruct.attrib & _A_HIDDEN)
+		{
+			continue;
+		}
+		std::string strName = filestruct.name;
+		if (filestruct.attrib & _A_SUBDIR)
+		{
+			if (strName!="." && strName!="..")
+			{
+				getPakFileList(strDir.empty() ? strName : strDir+"/"+strName, strPrefix+strName+"/", setPath);
+			}
+		}
+		else
+		{
+			setPath.push_back(strPrefix+strName);
+		}
+	}while(!_findnext(hnd, &filestruct));
+	_findclose(hnd);
+#else
+	DIR* pDir = opendir(strDir.empty() ? "." : strDir.c_str());
+	if (!pDir)
+	{
+		return;
+	}
+	while (dirent* pEntry = readdir(pDir))
+	{
+		std::string strName = pEntry->d_name;
+		if (strName.empty() || strName[0]=='.')
+		{
+			continue;
+		}
+		std::string strPath = strDir.empty() ? strName : strDir+"/"+strName;
+		struct stat st;
+		if (stat(strPath.c_str(), &st)!=0)
+		{
+			continue;
+		}
+		if (S_ISDIR(st.st_mode))
+		{
+			getPakFileList(strPath, strPrefix+strName+"/", setPath);
+		}
+		else if (S_ISREG(st.st_mode))
+		{
+			setPath.push_back(strPrefix+strName);
+		}
+	}
+	closedir(pDir);
+#endif
+}
+
+void GetPakFileList(const std::string& strDir, std::vector<std::string>& setPath)
+{
+	setPath.clear();
+	getPakFileList(strDir, "", setPath);
+	std::sort(setPath.begin(), setPath.end());
+}
+
+// A batch of files read whole, each into its own buffer by a worker.
+class CPakReadTask: public iThreadTask
+{
+public:
+	struct Item
+	{
+		std::string					strPath;
+		unsigned long long			uSize;
+		bool						bCompare;		// against uCompareCRC, the size is the same
+		unsigned int				uCompareCRC;
+
+		std::vector<unsigned char>	setData;
+		unsigned int				uCRC;
+		bool						bZlib;
+		bool						bOk;
+		bool						bSame;			// matched uCompareCRC, nothing to write
+	};
+
+	CPakReadTask(int nLevel)
+		:m_nLevel(nLevel)
+	{
+	}
+
+	virtual void runTask(size_t uIndex)
+	{
+		Item& item = m_setItem[uIndex];
+		const size_t uSize = (size_t)item.uSize;
+		item.uCRC = 0;
+		item.bZlib = false;
+		item.bOk = false;
+		item.bSame = false;
+
+		FILE* f = fopen(item.strPath.c_str(), "rb");
+		if (!f)
+		{
+			return;
+		}
+		item.setData.resize(uSize);
+		bool bRead = uSize==0 || fread(&item.setData[0], 1, uSize, f)==uSize;
+		fclose(f);
+		if (!bRead)
+		{
+			item.setData.clear();
+			return;
+		}
+		item.uCRC = crc32(0, uSize ? &item.setData[0] : NULL, (uInt)uSize);
+		item.bOk = true;
+		if (item.bCompare && item.uCRC==item.uCompareCRC)
+		{
+			item.bSame = true;
+			std::vector<unsigned char>().swap(item.setData);
+			return;
+		}
+
+		// zlib counts in uLong
+		if (m_nLevel>0 && uSize>0 && uSize==(uLong)uSize)
+		{
+			std::vector<unsigned char> setZip(compressBound((uLong)uSize));
+			uLongf uLength = (uLongf)setZip.size();
+			if (compress2(&setZip[0], &uLength, &item.setData[0], (uLong)uSize, m_nLevel)==Z_OK && uLength<uSize)
+			{
+				setZip.resize(uLength);
+				item.setData.swap(setZip);
+				item.bZlib = true;
+			}
+		}
+	}
+
+	int					m_nLevel;
+	std::vector<Item>	m_setItem;
+};
+
+CPakWriter::CPakWriter()
+	:m_pFile(NULL)
+	,m_uPos(0)
+	,m_uAlignment(16)
+	,m_nLevel(0)
+	,m_uBatchSize(PAK_BATCH_SIZE)
+	,m_bFailed(false)
+{
+}
+
+CPakWriter::~CPakWriter()
+{
+	close();
+}
+
+bool CPakWriter::create(const char* szFilename, unsigned int uAlignment)
+{
+	close();
+	m_pFile = fopen(szFilename, "wb");
+	if (!m_pFile)
+	{
+		return false;
+	}
+	m_uAlignment = 1;
+	while (m_uAlignment<uAlignment && m_uAlignment<0x80000000)
+	{
+		m_uAlignment <<= 1;
+	}
+	// the index offset stays 0 until finish()
+	unsigned char header[PAK_FILE_HEADER2_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(header, PAK_FILE_HEADER, sizeof(PAK_FILE_HEADER));
+	writePakUInt(header+32, PAK_FILE_VERSION2);
+	writePakUInt(header+48, m_uAlignment);
+	if (!write(header, sizeof(header)))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool CPakWriter::openAppend(const char* szFilename)
+{
+	close();
+	m_pFile = fopen(szFilename, "r+b");
+	if (!m_pFile)
+	{
+		return false;
+	}
+	unsigned char header[PAK_FILE_HEADER2_SIZE];
+	if (fread(header, 1, sizeof(header), m_pFile)!=sizeof(header)
+		|| memcmp(header, PAK_FILE_HEADER, sizeof(PAK_FILE_HEADER))!=0
+		|| readPakUInt(header+32)!=PAK_FILE_VERSION2
+		|| !seekPakFile(m_pFile, 0, SEEK_END))
+	{
+		close();
+		return false;
+	}
+	const size_t uCount = readPakUInt(header+36);
+	const unsigned long long uIndex = readPakUInt64(header+40);
+	const unsigned long long uEnd = tellPakFile(m_pFile);
+	m_uAlignment = readPakUInt(header+48);
+	if (uIndex<PAK_FILE_HEADER2_SIZE || uIndex>uEnd || uCount>(uEnd-uIndex)/PAK_FILE_ENTRY2_SIZE
+		|| m_uAlignment==0 || (m_uAlignment&(m_uAlignment-1))!=0)
+	{
+		close();
+		return false;
+	}
+
+	std::vector<unsigned char> setIndex(uCount*PAK_FILE_ENTRY2_SIZE);
+	if (!seekPakFile(m_pFile, uIndex, SEEK_SET)
+		|| (uCount>0 && fread(&setIndex[0], 1, setIndex.size(), m_pFile)!=setIndex.size()))
+	{
+		close();
+		return false;
+	}
+	m_setEntry.resize(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		const unsigned char* p = &setIndex[i*PAK_FILE_ENTRY2_SIZE];
+		CPakFile::Entry& entry = m_setEntry[i];
+		entry.uID = readPakUInt(p);
+		entry.uFlags = readPakUInt(p+4);
+		entry.uOffset = readPakUInt64(p+8);
+		entry.uStoredSize = readPakUInt64(p+16);
+		entry.uSize = readPakUInt64(p+24);
+		entry.uTime = readPakUInt64(p+32);
+		entry.uCRC = readPakUInt(p+40);
+		if ((entry.uFlags&PAK_ENTRY_DEAD)==0 && m_mapLive.find(entry.uID)==m_mapLive.end())
+		{
+			// the pak has no names, any name with the id is taken as the same file
+			LiveFile& file = m_mapLive[entry.uID];
+			file.uEntry = i;
+		}
+	}
+	// after everything, the old index stays valid until finish() points the header past it
+	if (!seekPakFile(m_pFile, 0, SEEK_END))
+	{
+		close();
+		return false;
+	}
+	m_uPos = uEnd;
+	return true;
+}
+
+void CPakWriter::close()
+{
+	if (m_pFile)
+	{
+		fclose(m_pFile);
+	}
+	m_pFile = NULL;
+	m_uPos = 0;
+	m_bFailed = false;
+	m_setEntry.clear();
+	m_mapLive.clear();
+}
+
+void CPakWriter::setBatchSize(size_t uBytes)
+{
+	m_uBatchSize = std::max<size_t>(1, std::min<size_t>(uBytes, PAK_MAX_BATCH_SIZE));
+}
+
+bool CPakWriter::write(const void* pData, size_t uSize)
+{
+	if (uSize>0 && fwrite(pData, 1, uSize, m_pFile)!=uSize)
+	{
+		m_bFailed = true;
+		return false;
+	}
+	m_uPos += uSize;
+	return true;
+}
+
+bool CPakWriter::pad()
+{
+	static const unsigned char zero[4096] = {0};
+	size_t uPad = (size_t)((m_uAlignment-m_uPos%m_uAlignment)%m_uAlignment);
+	while (uPad>0)
+	{
+		size_t uBytes = std::min(uPad, sizeof(zero));
+		if (!write(zero, uBytes))
+		{
+			return false;
+		}
+		uPad -= uBytes;
+	}
+	return true;
+}
+
+void CPakWriter::addEntry(const std::string& strName, const CPakFile::Entry& entry)
+{
+	std::map<unsigned int, LiveFile>::iterator it = m_mapLive.find(entry.uID);
+	if (it!=m_mapLive.end())
+	{
+		m_setEntry[it->second.uEntry].uFlags |= PAK_ENTRY_DEAD;
+	}
+	LiveFile& file = m_mapLive[entry.uID];
+	file.strName = strName;
+	file.uEntry = m_setEntry.size();
+	m_setEntry.push_back(entry);
+}
+
+bool CPakWriter::copyFile(const Source& source, CPakFile::Entry& entry)
+{
+	FILE* f = fopen(source.strPath.c_str(), "rb");
+	if (!f)
+	{
+		return false;
+	}
+	if (!pad())
+	{
+		fclose(f);
+		return false;
+	}
+	entry.uOffset = m_uPos;
+	entry.uCRC = 0;
+	std::vector<unsigned char> setBuffer(PAK_COPY_SIZE);
+	unsigned long long uLeft = source.uSize;
+	while (uLeft>0)
+	{
+		size_t uBytes = (size_t)std::min(uLeft, (unsigned long long)setBuffer.size());
+		if (fread(&setBuffer[0], 1, uBytes, f)!=uBytes || !write(&setBuffer[0], uBytes))
+		{
+			fclose(f);
+			return false;
+		}
+		entry.uCRC = crc32(entry.uCRC, &setBuffer[0], (uInt)uBytes);
+		uLeft -= uBytes;
+	}
+	fclose(f);
+	entry.uStoredSize = source.uSize;
+	return true;
+}
+
+void CPakWriter::writeBatch(const std::vector<Source>& setSource, const std::vector<size_t>& setResultIndex, std::vector<PakWriteResult>& setResult)
+{
+	CPakReadTask task(m_nLevel);
+	task.m_setItem.resize(setSource.size());
+	for (size_t i=0; i<setSource.size(); ++i)
+	{
+		CPakReadTask::Item& item = task.m_setItem[i];
+		item.strPath = setSource[i].strPath;
+		item.uSize = setSource[i].uSize;
+		item.bCompare = setSource[i].bCompare;
+		item.uCompareCRC = setSource[i].uCompareCRC;
+	}
+	CThreadPool::getShared().run(task, setSource.size());
+
+	for (size_t i=0; i<setSource.size(); ++i)
+	{
+		CPakReadTask::Item& item = task.m_setItem[i];
+		PakWriteResult& result = setResult[setResultIndex[i]];
+		if (item.bSame)
+		{
+			touchEntry(setSource[i], result);
+			continue;
+		}
+		if (!item.bOk || !pad())
+		{
+			continue;
+		}
+		CPakFile::Entry entry;
+		entry.uID = setSource[i].uID;
+		entry.uFlags = item.bZlib ? PAK_ENTRY_ZLIB : 0;
+		entry.uOffset = m_uPos;
+		entry.uStoredSize = item.setData.size();
+		entry.uSize = setSource[i].uSize;
+		entry.uTime = setSource[i].uTime;
+		entry.uCRC = item.uCRC;
+		if (!write(item.setData.empty() ? NULL : &item.setData[0], item.setData.size()))
+		{
+			continue;
+		}
+		addEntry(setSource[i].strName, entry);
+		result.uStoredSize = entry.uStoredSize;
+		result.bOk = true;
+		// the batch is held until written, free what's done
+		std::vector<unsigned char>().swap(item.setData);
+	}
+}
+
+void CPakWriter::touchEntry(const Source& source, PakWriteResult& result)
+{
+	CPakFile::Entry& entry = m_setEntry[m_mapLive[source.uID].uEntry];
+	entry.uTime = source.uTime;
+	result.uStoredSize = entry.uStoredSize;
+	result.bOk = true;
+	result.bUnchanged = true;
+}
+
+size_t CPakWriter::addFiles(const std::string& strRootDir, const std::vector<std::string>& setPath, std::vector<PakWriteResult>& setResult)
+{
+	setResult.clear();
+	setResult.resize(setPath.size());
+	if (!m_pFile)
+	{
+		return 0;
+	}
+
+	std::vector<Source> setSource(setPath.size());
+	std::vector<const char*> setName(setPath.size());
+	for (size_t i=0; i<setPath.size(); ++i)
+	{
+		Source& source = setSource[i];
+		source.strPath = strRootDir.empty() ? setPath[i] : strRootDir+"/"+setPath[i];
+		source.strName = setPath[i];
+		if (!source.strName.empty())
+		{
+			NormalizePakFileName(&source.strName[0]);
+		}
+		source.uSize = 0;
+		source.uTime = 0;
+		source.bCompare = false;
+		source.uCompareCRC = 0;
+		setName[i] = source.strName.c_str();
+
+		PakWriteResult& result = setResult[i];
+		result.strName = source.strName;
+		result.uSize = 0;
+		result.uStoredSize = 0;
+		result.bOk = false;
+		result.bUnchanged = false;
+	}
+	std::vector<unsigned int> setID(setPath.size());
+	if (!setPath.empty())
+	{
+		GeneratePakFileIDs(&setName[0], setName.size(), &setID[0]);
+	}
+
+	std::map<unsigned int, std::string> mapAdded;
+	std::vector<Source> setBatch;
+	std::vector<size_t> setBatchIndex;
+	unsigned long long uBatchBytes = 0;
+	for (size_t i=0; i<setSource.size(); ++i)
+	{
+		Source& source = setSource[i];
+		source.uID = setID[i];
+		if (!getPakSourceInfo(source.strPath, source.uSize, source.uTime))
+		{
+			continue;
+		}
+		setResult[i].uSize = source.uSize;
+
+		// a different name with the same id couldn't be found again
+		std::map<unsigned int, LiveFile>::const_iterator itLive = m_mapLive.find(source.uID);
+		if (itLive!=m_mapLive.end() && !itLive->second.strName.empty() && itLive->second.strName!=source.strName)
+		{
+			continue;
+		}
+		std::map<unsigned int, std::string>::iterator itAdded = mapAdded.find(source.uID);
+		if (itAdded!=mapAdded.end() && itAdded->second!=source.strName)
+		{
+			continue;
+		}
+		mapAdded[source.uID] = source.strName;
+
+		// the same size and time is taken as unchanged, the same size and crc32 too
+		if (itLive!=m_mapLive.end())
+		{
+			const CPakFile::Entry& old = m_setEntry[itLive->second.uEntry];
+			if (old.uSize==source.uSize && old.uTime==source.uTime)
+			{
+				touchEntry(source, setResult[i]);
+				continue;
+			}
+			source.bCompare = old.uSize==source.uSize;
+			source.uCompareCRC = old.uCRC;
+		}
+
+		if (source.uSize>m_uBatchSize)
+		{
+			unsigned int uCRC = 0;
+			if (source.bCompare && getPakSourceCRC(source.strPath, source.uSize, uCRC) && uCRC==source.uCompareCRC)
+			{
+				touchEntry(source, setResult[i]);
+				continue;
+			}
+			CPakFile::Entry entry;
+			entry.uID = source.uID;
+			entry.uFlags = 0;
+			entry.uSize = source.uSize;
+			entry.uTime = source.uTime;
+			if (copyFile(source, entry))
+			{
+				addEntry(source.strName, entry);
+				setResult[i].uStoredSize = entry.uStoredSize;
+				setResult[i].bOk = true;
+			}
+			continue;
+		}
+		if (uBatchBytes+source.uSize>m_uBatchSize)
+		{
+			writeBatch(setBatch, setBatchIndex, setResult);
+			setBatch.clear();
+			setBatchIndex.clear();
+			uBatchBytes = 0;
+		}
+		setBatch.push_back(source);
+		setBatchIndex.push_back(i);
+		uBatchBytes += source.uSize;
+	}
+	writeBatch(setBatch, setBatchIndex, setResult);
+
+	size_t uWritten = 0;
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		if (setResult[i].bOk)
+		{
+			uWritten++;
+		}
+	}
+	return uWritten;
+}
+
+bool CPakWriter::finish()
+{
+	if (!m_pFile)
+	{
+		return false;
+	}
+	std::vector<CPakFile::Entry> setEntry(m_setEntry);
+	std::stable_sort(setEntry.begin(), setEntry.end(), lessPakEntry);
+
+	const unsigned long long uIndex = m_uPos;
+	std::vector<unsigned char> setIndex(setEntry.size()*PAK_FILE_ENTRY2_SIZE);
+	for (size_t i=0; i<setEntry.size(); ++i)
+	{
+		const CPakFile::Entry& entry = setEntry[i];
+		unsigned char* p = &setIndex[i*PAK_FILE_ENTRY2_SIZE];
+		writePakUInt(p, entry.uID);
+		writePakUInt(p+4, entry.uFlags);
+		writePakUInt64(p+8, entry.uOffset);
+		writePakUInt64(p+16, entry.uStoredSize);
+		writePakUInt64(p+24, entry.uSize);
+		writePakUInt64(p+32, entry.uTime);
+		writePakUInt(p+40, entry.uCRC);
+		writePakUInt(p+44, 0);
+	}
+	bool bOk = !m_bFailed && write(setIndex.empty() ? NULL : &setIndex[0], setIndex.size());
+
+	unsigned char header[12];
+	writePakUInt(header, (unsigned int)setEntry.size());
+	writePakUInt64(header+4, uIndex);
+	bOk = bOk && fflush(m_pFile)==0 && fseek(m_pFile, 36, SEEK_SET)==0
+		&& fwrite(header, 1, sizeof(header), m_pFile)==sizeof(header);
+	bOk = fclose(m_pFile)==0 && bOk;
+	m_pFile = NULL;
+	close();
+	return bOk;
+}
+
+bool CPakWriter::copyEntry(const CPakFile& pak, const CPakFile::Entry& entry)
+{
+	if (!m_pFile || !pad())
+	{
+		return false;
+	}
+	CPakFile::Entry copy = entry;
+	copy.uOffset = m_uPos;
+	const unsigned char* pData = pak.getData(entry);
+	unsigned long long uLeft = entry.uStoredSize;
+	while (uLeft>0)
+	{
+		size_t uBytes = (size_t)std::min(uLeft, (unsigned long long)PAK_COPY_SIZE);
+		if (!write(pData, uBytes))
+		{
+			return false;
+		}
+		pData += uBytes;
+		uLeft -= uBytes;
+	}
+	addEntry("", copy);
+	return true;
+}
+
+unsigned long long CPakWriter::getLiveSize()const
+{
+	unsigned long long uSize = 0;
+	for (size_t i=0; i<m_setEntry.size(); ++i)
+	{
+		if ((m_setEntry[i].uFlags&PAK_ENTRY_DEAD)==0)
+		{
+			uSize += m_setEntry[i].uStoredSize;
+		}
+	}
+	return uSize;
+}
+
+static bool lessPakOffset(const CPakFile::Entry* a, const CPakFile::Entry* b)
+{
+	return a->uOffset<b->uOffset;
+}
+
+// Puts the new file in place of the old one in one step, the old one stays if it fails.
+static bool replacePakFile(const char* szFrom, const char* szTo)
+{
+#ifdef _WIN32
+	return MoveFileExA(szFrom, szTo, MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+	return rename(szFrom, szTo)==0;
+#endif
+}
+
+bool CompactPakFile(const char* szFilename, unsigned int uAlignment)
+{
+	CPakFile pak;
+	if (!pak.open(szFilename))
+	{
+		return false;
+	}
+	if (uAlignment==0)
+	{
+		uAlignment = pak.getAlignment()>0 ? pak.getAlignment() : 16;
+	}
+	// in file order, both files are read and written front to back
+	std::vector<const CPakFile::Entry*> setEntry(pak.getFileCount());
+	for (size_t i=0; i<setEntry.size(); ++i)
+	{
+		setEntry[i] = &pak.getEntry(i);
+	}
+	std::sort(setEntry.begin(), setEntry.end(), lessPakOffset);
+
+	std::string strTemp = std::string(szFilename)+".tmp";
+	CPakWriter writer;
+	if (!writer.create(strTemp.c_str(), uAlignment))
+	{
+		return false;
+	}
+	bool bOk = true;
+	for (size_t i=0; i<setEntry.size() && bOk; ++i)
+	{
+		bOk = writer.copyEntry(pak, *setEntry[i]);
+	}
+	bOk = writer.finish() && bOk;
+	pak.close();
+	if (!bOk || !replacePakFile(strTemp.c_str(), szFilename))
+	{
+		remove(strTemp.c_str());
+		return false;
+	}
+	return true;
+}
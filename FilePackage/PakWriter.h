@@ -0,0 +1,100 @@
+#pragma once
+#include "PakFile.h"
+#include <stdio.h>
+#include <map>
+#include <string>
+
+// One file of CPakWriter::addFiles.
+struct PakWriteResult
+{
+	std::string			strName;		// as hashed
+	unsigned long long	uSize;
+	unsigned long long	uStoredSize;
+	bool				bOk;			// read and written, or unchanged
+	bool				bUnchanged;		// already in the pak as it is, nothing written
+};
+
+// Files under strDir, their paths relative to it with '/' separators, sorted. Hidden files
+// and directories are left out.
+void GetPakFileList(const std::string& strDir, std::vector<std::string>& setPath);
+
+// Writes version 1001 paks front to back, the index goes last. The files are taken in batches:
+// the shared thread pool reads, checksums and compresses a batch, then it's written in order.
+// Files larger than a batch are copied through in pieces and stored.
+// An existing pak can be updated in place: new and changed files are appended, the entries
+// they replace are marked dead and a new index is written after them. Only the changed files
+// and the index are written; CompactPakFile gives the dead space back.
+class CPakWriter
+{
+public:
+	CPakWriter();
+	~CPakWriter();
+
+	// uAlignment: power of two the file data starts at, 4096 puts each file on its own pages
+	bool create(const char* szFilename, unsigned int uAlignment=16);
+	// A version 1001 pak to add to, keeping its alignment. Until finish() the pak on disk
+	// stays as it was, its header still points at the old index.
+	bool openAppend(const char* szFilename);
+	// 0 stores, 1-9 are zlib levels; a file that doesn't get smaller is stored
+	void setCompressionLevel(int nLevel){m_nLevel=nLevel;}
+	// bytes read per batch, up to 1GB; about twice as much is held at once
+	void setBatchSize(size_t uBytes);
+
+	// Packs strRootDir/path for each path, named by the normalized path. A file the pak has
+	// with the same size and modification time, or the same size and crc32, is left as it is.
+	// A name added again replaces the earlier file, which is kept as a dead entry; a different
+	// name with an id this writer has seen is refused. Returns the number of the files that are
+	// in the pak now, unchanged ones included.
+	size_t addFiles(const std::string& strRootDir, const std::vector<std::string>& setPath, std::vector<PakWriteResult>& setResult);
+	// Writes the index and then the header's index offset, the pak can't be opened before.
+	bool finish();
+	// Copies an entry of another pak as it is stored.
+	bool copyEntry(const CPakFile& pak, const CPakFile::Entry& entry);
+	// Closes without writing the index.
+	void close();
+	bool isOpen()const{return m_pFile!=NULL;}
+	unsigned long long getPosition()const{return m_uPos;}
+	// stored bytes of the live files, the rest of getPosition() is headers, padding and dead
+	unsigned long long getLiveSize()const;
+private:
+	struct Source
+	{
+		std::string			strPath;
+		std::string			strName;
+		unsigned int		uID;
+		unsigned long long	uSize;
+		unsigned long long	uTime;
+		bool				bCompare;		// size equal to a live entry, compare crc32s
+		unsigned int		uCompareCRC;
+	};
+	struct LiveFile
+	{
+		std::string		strName;	// empty for entries of an opened pak
+		size_t			uEntry;		// in m_setEntry
+	};
+	bool write(const void* pData, size_t uSize);
+	bool pad();
+	// the entry of a name, replacing an earlier one
+	void addEntry(const std::string& strName, const CPakFile::Entry& entry);
+	// the live entry of the source is current, only its time changes
+	void touchEntry(const Source& source, PakWriteResult& result);
+	bool copyFile(const Source& source, CPakFile::Entry& entry);
+	void writeBatch(const std::vector<Source>& setSource, const std::vector<size_t>& setResultIndex, std::vector<PakWriteResult>& setResult);
+
+	FILE*									m_pFile;
+	unsigned long long						m_uPos;
+	unsigned int							m_uAlignment;
+	int										m_nLevel;
+	size_t									m_uBatchSize;
+	bool									m_bFailed;		// a write failed, finish() won't complete the pak
+	std::vector<CPakFile::Entry>			m_setEntry;
+	std::map<unsigned int, LiveFile>		m_mapLive;		// by id
+private:
+	CPakWriter(const CPakWriter&);
+	CPakWriter& operator=(const CPakWriter&);
+};
+
+// Rewrites a pak without its dead entries and old indexes, through filename.tmp. The files
+// are copied as they are stored, in the order of the old pak. An alignment of 0 keeps the
+// pak's, 16 for version 1000 paks.
+bool CompactPakFile(const char* szFilename, unsigned int uAlignment=0);
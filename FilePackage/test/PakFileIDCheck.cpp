@@ -0,0 +1,190 @@
+// Checks GeneratePakFileID and GeneratePakFileIDs against ids the original x86 assembly gave,
+// the empty name, names of 4 and 5 bytes, 8 bit characters and names of 252 to 300 bytes of
+// which only the first 256 count. The batch is given the names in groups that fill its four
+// lanes, leave some over for the scalar loop and have NULLs and lengths mixed, then both are
+// compared on random names and timed. Run by ctest.
+#include "PakFile.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+static double getSeconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER nFrequency, nCounter;
+	QueryPerformanceFrequency(&nFrequency);
+	QueryPerformanceCounter(&nCounter);
+	return (double)nCounter.QuadPart/(double)nFrequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+#endif
+}
+
+static unsigned int nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return uSeed>>8;
+}
+
+// uLength characters repeating szPattern
+static std::string repeatName(const char* szPattern, size_t uLength)
+{
+	std::string strPattern = szPattern;
+	std::string strName(uLength, ' ');
+	for (size_t i=0; i<uLength; ++i)
+	{
+		strName[i] = strPattern[i%strPattern.size()];
+	}
+	return strName;
+}
+
+struct KnownID
+{
+	std::string		strName;
+	unsigned int	uID;
+};
+
+static void makeKnownIDs(std::vector<KnownID>& setKnown)
+{
+	static const char* s_szLong = "abcdefghijklmnopqrstuvwxyz0123456789\\._";
+	const KnownID known[] =
+	{
+		{"", 0x514FF88Fu},
+		{"a", 0x9BEF998Du},
+		{"abcd", 0xBFDBDC66u},
+		{"abcde", 0x94BDF716u},
+		{"abcdefgh", 0x37D071B5u},
+		{"data\\interface\\login.tga", 0x859266A5u},
+		{"creature\\dragon\\dragon.m2", 0x925913BAu},
+		{"\xe9\xf4\x80\xff", 0x71E3F544u},
+		{"world\\maps\\azeroth\\azeroth_32_48.adt", 0x96722F54u},
+		{"x.ini", 0xF357177Du},
+		{repeatName(s_szLong, 252), 0x845C625Eu},
+		{repeatName(s_szLong, 255), 0x3F60C293u},
+		{repeatName(s_szLong, 256), 0xB2971BEDu},
+		// past 256 the characters don't count
+		{repeatName(s_szLong, 257), 0xB2971BEDu},
+		{repeatName("data\\model\\texture.dds", 300), 0xED0E594Cu},
+	};
+	setKnown.assign(known, known+sizeof(known)/sizeof(known[0]));
+}
+
+static void testScalar(const std::vector<KnownID>& setKnown)
+{
+	for (size_t i=0; i<setKnown.size(); ++i)
+	{
+		if (GeneratePakFileID(setKnown[i].strName.c_str())!=setKnown[i].uID)
+		{
+			printf("FAILED scalar id of a %u byte name\n", (unsigned int)setKnown[i].strName.size());
+			++s_nFailed;
+		}
+	}
+	CHECK(GeneratePakFileID(NULL)==0);
+}
+
+// The known names from uFirst on in groups of uGroup, every uNull-th one NULL.
+static void testBatch(const std::vector<KnownID>& setKnown, size_t uGroup, size_t uFirst, size_t uNull)
+{
+	std::vector<const char*> setName;
+	std::vector<unsigned int> setExpected;
+	for (size_t i=0; i<uGroup; ++i)
+	{
+		const KnownID& known = setKnown[(uFirst+i)%setKnown.size()];
+		bool bNull = uNull>0 && i%uNull==uNull-1;
+		setName.push_back(bNull ? NULL : known.strName.c_str());
+		setExpected.push_back(bNull ? 0 : known.uID);
+	}
+	std::vector<unsigned int> setID(uGroup+1, 0xCDCDCDCDu);
+	GeneratePakFileIDs(&setName[0], uGroup, &setID[0]);
+	for (size_t i=0; i<uGroup; ++i)
+	{
+		if (setID[i]!=setExpected[i])
+		{
+			printf("FAILED batch of %u from %u, id %u\n", (unsigned int)uGroup, (unsigned int)uFirst, (unsigned int)i);
+			++s_nFailed;
+		}
+	}
+	// nothing written past the last one
+	CHECK(setID[uGroup]==0xCDCDCDCDu);
+}
+
+// Random names of 0 to 300 bytes through both paths, then the two timed on 40 byte paths.
+static void testRandom(size_t uCount)
+{
+	unsigned int uSeed = 4242;
+	std::vector<std::string> setString(uCount);
+	std::vector<const char*> setName(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		size_t uLength = nextRandom(uSeed)%301;
+		setString[i].resize(uLength);
+		for (size_t j=0; j<uLength; ++j)
+		{
+			setString[i][j] = (char)(1+nextRandom(uSeed)%255);
+		}
+		setName[i] = setString[i].c_str();
+	}
+	std::vector<unsigned int> setID(uCount);
+	GeneratePakFileIDs(&setName[0], uCount, &setID[0]);
+	size_t uMismatch = 0;
+	for (size_t i=0; i<uCount; ++i)
+	{
+		uMismatch += setID[i]!=GeneratePakFileID(setName[i]) ? 1 : 0;
+	}
+	CHECK(uMismatch==0);
+
+	for (size_t i=0; i<uCount; ++i)
+	{
+		setString[i] = repeatName("data\\creature\\model\\", 40);
+		setString[i][39] = (char)('a'+i%26);
+		setName[i] = setString[i].c_str();
+	}
+	double fStart = getSeconds();
+	unsigned int uSum = 0;
+	for (size_t i=0; i<uCount; ++i)
+	{
+		uSum += GeneratePakFileID(setName[i]);
+	}
+	double fScalar = getSeconds()-fStart;
+	fStart = getSeconds();
+	GeneratePakFileIDs(&setName[0], uCount, &setID[0]);
+	double fBatch = getSeconds()-fStart;
+	printf("40 byte names: scalar %.0f ns, batch %.0f ns per name (%u)\n",
+		fScalar*1e9/uCount, fBatch*1e9/uCount, (unsigned int)(uSum&1));
+}
+
+int main()
+{
+	std::vector<KnownID> setKnown;
+	makeKnownIDs(setKnown);
+	testScalar(setKnown);
+	// full lanes, full lanes and the scalar rest, short of one batch, every name first once
+	static const size_t s_uGroup[] = {4, 8, 5, 7, 3, 1, 15};
+	for (size_t g=0; g<sizeof(s_uGroup)/sizeof(s_uGroup[0]); ++g)
+	{
+		for (size_t uFirst=0; uFirst<setKnown.size(); ++uFirst)
+		{
+			testBatch(setKnown, s_uGroup[g], uFirst, 0);
+			testBatch(setKnown, s_uGroup[g], uFirst, 3);
+		}
+	}
+	testRandom(200000);
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
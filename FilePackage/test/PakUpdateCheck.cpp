@@ -0,0 +1,250 @@
+// Packs a generated tree, changes it and updates the pak in place with openAppend, then
+// compacts it and reads it back each time. A file of the same size and modification time is
+// taken as unchanged, one of the same size and crc32 only gets its new time, the others are
+// appended and their old entries marked dead. Until finish() the pak must stay as it was.
+// CompactPakFile has to drop the dead entries and keep the alignment or set a new one, the
+// times and crc32s. Run by ctest.
+#include "PakWriter.h"
+#include "TestPakTree.h"
+#include <stdio.h>
+#include <string.h>
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+static const char* s_szRoot = "pakupdate_src";
+static const char* s_szPak = "pakupdate.pak";
+static const unsigned long long s_uTime0 = 1300000000ull;
+static const unsigned long long s_uTime1 = 1400000000ull;
+
+// the indexed entries, dead ones too, and the file size
+static void readPakHeader(const char* szFilename, unsigned int& uCount, unsigned long long& uSize)
+{
+	uCount = 0;
+	uSize = 0;
+	FILE* f = fopen(szFilename, "rb");
+	if (!f)
+	{
+		return;
+	}
+	unsigned char header[PAK_FILE_HEADER2_SIZE];
+	if (fread(header, 1, sizeof(header), f)==sizeof(header))
+	{
+		uCount = header[36]|(header[37]<<8)|(header[38]<<16)|((unsigned int)header[39]<<24);
+	}
+	fseek(f, 0, SEEK_END);
+	uSize = (unsigned long long)ftell(f);
+	fclose(f);
+}
+
+static bool setTimes(const std::vector<TestPakFile>& setFile, unsigned long long uTime)
+{
+	bool bOk = true;
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		bOk = setTestPakFileTime(std::string(s_szRoot)+"/"+setFile[i].strPath, uTime) && bOk;
+	}
+	return bOk;
+}
+
+static size_t findFile(const std::vector<TestPakFile>& setFile, const char* szPath)
+{
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		if (setFile[i].strPath==szPath)
+		{
+			return i;
+		}
+	}
+	return setFile.size();
+}
+
+// the file rewritten and given a time
+static void changeFile(std::vector<TestPakFile>& setFile, size_t uIndex, const std::vector<unsigned char>& setData, unsigned long long uTime)
+{
+	const std::string strPath = std::string(s_szRoot)+"/"+setFile[uIndex].strPath;
+	setFile[uIndex].setData = setData;
+	CHECK(writeTestPakFile(strPath, setData));
+	CHECK(setTestPakFileTime(strPath, uTime));
+}
+
+int main()
+{
+	std::vector<TestPakFile> setFile;
+	makeTestPakFiles(40, 20000, 77, setFile);
+	// two past the batch size, copied through in pieces
+	TestPakFile big;
+	unsigned int uSeed = 9;
+	big.setData.resize(200000);
+	for (size_t i=0; i<big.setData.size(); ++i)
+	{
+		big.setData[i] = (unsigned char)nextRandom(uSeed);
+	}
+	big.strPath = "Data/BigSame.bin";
+	setFile.push_back(big);
+	big.strPath = "Data/BigChanged.bin";
+	setFile.push_back(big);
+	CHECK(writeTestPakTree(s_szRoot, setFile));
+	CHECK(setTimes(setFile, s_uTime0));
+
+	std::vector<std::string> setPath;
+	getTestPakPaths(setFile, setPath);
+	std::vector<PakWriteResult> setResult;
+	CPakWriter writer;
+	CHECK(writer.create(s_szPak, 16));
+	writer.setCompressionLevel(6);
+	writer.setBatchSize(65536);
+	CHECK(writer.addFiles(s_szRoot, setPath, setResult)==setFile.size());
+	CHECK(writer.finish());
+	unsigned int uCount0 = 0;
+	unsigned long long uSize0 = 0;
+	readPakHeader(s_szPak, uCount0, uSize0);
+	CHECK(uCount0==setFile.size());
+
+	// the files with the same size: new data and the old time, the same data and a new time,
+	// new data and a new time; then one of another size and a new file
+	std::vector<TestPakFile> setExpected(setFile);
+	const size_t uSameTime = 1;
+	const size_t uSameCRC = 2;
+	const size_t uChanged = 3;
+	const size_t uResized = 4;
+	std::vector<unsigned char> setData(setFile[uSameTime].setData);
+	setData[0] ^= 0xFF;
+	changeFile(setFile, uSameTime, setData, s_uTime0);
+	changeFile(setFile, uSameCRC, setFile[uSameCRC].setData, s_uTime1);
+	setData = setFile[uChanged].setData;
+	setData[setData.size()/2] ^= 0xFF;
+	changeFile(setFile, uChanged, setData, s_uTime1);
+	setData = setFile[uResized].setData;
+	setData.push_back('!');
+	changeFile(setFile, uResized, setData, s_uTime1);
+	const size_t uBigSame = findFile(setFile, "Data/BigSame.bin");
+	const size_t uBigChanged = findFile(setFile, "Data/BigChanged.bin");
+	changeFile(setFile, uBigSame, setFile[uBigSame].setData, s_uTime1);
+	setData = setFile[uBigChanged].setData;
+	setData[100000] ^= 0xFF;
+	changeFile(setFile, uBigChanged, setData, s_uTime1);
+	TestPakFile added;
+	added.strPath = "Data/Interface/Added.txt";
+	added.setData.assign(5000, 'a');
+	setFile.push_back(added);
+	CHECK(writeTestPakFile(std::string(s_szRoot)+"/"+added.strPath, added.setData));
+	// the same size and time is taken as unchanged, the pak keeps the old data
+	setExpected = setFile;
+	setExpected[uSameTime].setData[0] ^= 0xFF;
+	getTestPakPaths(setFile, setPath);
+
+	// closed without finish(), the pak is as it was
+	CHECK(writer.openAppend(s_szPak));
+	writer.addFiles(s_szRoot, setPath, setResult);
+	writer.close();
+	{
+		std::vector<TestPakFile> setOld(setExpected);
+		setOld[uChanged].setData[setOld[uChanged].setData.size()/2] ^= 0xFF;
+		setOld[uResized].setData.pop_back();
+		setOld[uBigChanged].setData[100000] ^= 0xFF;
+		setOld.pop_back();
+		CPakFile pak;
+		CHECK(pak.open(s_szPak));
+		CHECK(checkTestPak(pak, setOld));
+	}
+
+	CHECK(writer.openAppend(s_szPak));
+	writer.setCompressionLevel(6);
+	writer.setBatchSize(65536);
+	CHECK(writer.addFiles(s_szRoot, setPath, setResult)==setFile.size());
+	CHECK(writer.finish());
+	size_t uUnchanged = 0;
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		bool bWritten = i==uChanged || i==uResized || i==uBigChanged || i+1==setResult.size();
+		CHECK(setResult[i].bOk);
+		if (setResult[i].bUnchanged==bWritten)
+		{
+			printf("FAILED %s %s\n", setResult[i].strName.c_str(), bWritten ? "not written" : "written again");
+			++s_nFailed;
+		}
+		uUnchanged += setResult[i].bUnchanged ? 1 : 0;
+	}
+	CHECK(uUnchanged+4==setFile.size());
+	unsigned int uCount1 = 0;
+	unsigned long long uSize1 = 0;
+	readPakHeader(s_szPak, uCount1, uSize1);
+	// the new file, and the three replaced ones stay as dead entries
+	CHECK(uCount1==uCount0+4);
+	CHECK(uSize1>uSize0);
+	{
+		CPakFile pak;
+		CHECK(pak.open(s_szPak));
+		CHECK(pak.getFileCount()==setFile.size());
+		CHECK(checkTestPak(pak, setExpected));
+		const CPakFile::Entry* pEntry = pak.findEntry(setFile[uSameCRC].strPath.c_str());
+		CHECK(pEntry && pEntry->uTime==s_uTime1);
+		pEntry = pak.findEntry(setFile[uSameTime].strPath.c_str());
+		CHECK(pEntry && pEntry->uTime==s_uTime0);
+		pEntry = pak.findEntry(setFile[uBigSame].strPath.c_str());
+		CHECK(pEntry && pEntry->uTime==s_uTime1);
+	}
+
+	// the dead entries and the old index go, the alignment stays
+	CHECK(CompactPakFile(s_szPak));
+	unsigned int uCount2 = 0;
+	unsigned long long uSize2 = 0;
+	readPakHeader(s_szPak, uCount2, uSize2);
+	CHECK(uCount2==setFile.size());
+	CHECK(uSize2<uSize1);
+	FILE* f = fopen((std::string(s_szPak)+".tmp").c_str(), "rb");
+	CHECK(f==NULL);
+	if (f)
+	{
+		fclose(f);
+	}
+	{
+		CPakFile pak;
+		CHECK(pak.open(s_szPak));
+		CHECK(pak.getAlignment()==16);
+		CHECK(countUnaligned(pak, 16)==0);
+		CHECK(checkTestPak(pak, setExpected));
+		const CPakFile::Entry* pEntry = pak.findEntry(setFile[uSameCRC].strPath.c_str());
+		CHECK(pEntry && pEntry->uTime==s_uTime1);
+	}
+	CHECK(CompactPakFile(s_szPak, 4096));
+	{
+		CPakFile pak;
+		CHECK(pak.open(s_szPak));
+		CHECK(pak.getAlignment()==4096);
+		CHECK(countUnaligned(pak, 4096)==0);
+		CHECK(checkTestPak(pak, setExpected));
+	}
+
+	// the compacted pak has no names, the files are found by id and nothing is written
+	CHECK(writer.openAppend(s_szPak));
+	CHECK(writer.addFiles(s_szRoot, setPath, setResult)==setFile.size());
+	uUnchanged = 0;
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		uUnchanged += setResult[i].bUnchanged ? 1 : 0;
+	}
+	CHECK(uUnchanged==setFile.size());
+	CHECK(writer.finish());
+	unsigned int uCount3 = 0;
+	unsigned long long uSize3 = 0;
+	readPakHeader(s_szPak, uCount3, uSize3);
+	CHECK(uCount3==setFile.size());
+	{
+		CPakFile pak;
+		CHECK(pak.open(s_szPak));
+		CHECK(checkTestPak(pak, setExpected));
+	}
+
+	remove(s_szPak);
+	removeTestPakTree(s_szRoot, setFile);
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
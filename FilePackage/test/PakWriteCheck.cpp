@@ -0,0 +1,204 @@
+// Packs a generated tree with CPakWriter and reads it back through CPakFile: stored and zlib,
+// data alignments of 1, 16, 4096 and one rounded up to a power of two, files larger than a
+// batch copied through in pieces, and an unfinished pak that must not open. Given "4g" it
+// also packs a sparse file of over 4GB with a file behind it, whose offset needs 64 bits; that
+// writes a 4GB pak. Run by ctest.
+#include "PakWriter.h"
+#include "TestPakTree.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "zlib.h"
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+static const char* s_szRoot = "pakwrite_src";
+static const char* s_szPak = "pakwrite.pak";
+
+static void testPack(int nLevel, unsigned int uAlignment, unsigned int uExpectedAlignment)
+{
+	std::vector<TestPakFile> setFile;
+	makeTestPakFiles(60, 40000, 1+nLevel+uAlignment, setFile);
+	// past the batch size, copied through in pieces and stored
+	TestPakFile big;
+	big.strPath = "Data/Big.bin";
+	unsigned int uSeed = 5;
+	big.setData.resize(300000);
+	for (size_t i=0; i<big.setData.size(); ++i)
+	{
+		big.setData[i] = (unsigned char)(i%1000<500 ? i : nextRandom(uSeed));
+	}
+	setFile.push_back(big);
+	CHECK(writeTestPakTree(s_szRoot, setFile));
+
+	std::vector<std::string> setPath, setExpected;
+	GetPakFileList(s_szRoot, setPath);
+	getTestPakPaths(setFile, setExpected);
+	std::sort(setExpected.begin(), setExpected.end());
+	CHECK(setPath==setExpected);
+
+	CPakWriter writer;
+	CHECK(writer.create(s_szPak, uAlignment));
+	writer.setCompressionLevel(nLevel);
+	writer.setBatchSize(65536);
+	std::vector<PakWriteResult> setResult;
+	CHECK(writer.addFiles(s_szRoot, setPath, setResult)==setFile.size());
+	size_t uBad = 0;
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		uBad += setResult[i].bOk && !setResult[i].bUnchanged ? 0 : 1;
+	}
+	CHECK(uBad==0);
+	CHECK(writer.finish());
+
+	CPakFile pak;
+	CHECK(pak.open(s_szPak));
+	CHECK(pak.getVersion()==PAK_FILE_VERSION2);
+	CHECK(pak.getAlignment()==uExpectedAlignment);
+	CHECK(countUnaligned(pak, uExpectedAlignment)==0);
+	CHECK(checkTestPak(pak, setFile));
+	size_t uZlib = 0;
+	size_t uBadCRC = 0;
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		const CPakFile::Entry* pEntry = pak.findEntry(setFile[i].strPath.c_str());
+		if (!pEntry)
+		{
+			continue;
+		}
+		uZlib += (pEntry->uFlags&PAK_ENTRY_ZLIB) ? 1 : 0;
+		const std::vector<unsigned char>& setData = setFile[i].setData;
+		uBadCRC += pEntry->uCRC==crc32(0, setData.empty() ? NULL : &setData[0], (uInt)setData.size()) ? 0 : 1;
+	}
+	CHECK(uBadCRC==0);
+	// the text files shrink, the random ones and the big one stay stored
+	CHECK(nLevel>0 ? uZlib>0 && uZlib<setFile.size() : uZlib==0);
+	const CPakFile::Entry* pBig = pak.findEntry("data\\big.bin");
+	CHECK(pBig && pBig->uFlags==0);
+	const unsigned char* pData = NULL;
+	size_t uSize = 0;
+	CHECK(pak.getFile("DATA/BIG.BIN", pData, uSize) && uSize==big.setData.size() && memcmp(pData, &big.setData[0], uSize)==0);
+	CHECK(!pak.findEntry("data\\missing.bin"));
+	pak.close();
+
+	// without finish() the header has no index
+	CHECK(writer.create(s_szPak, uAlignment));
+	writer.addFiles(s_szRoot, setPath, setResult);
+	writer.close();
+	CHECK(!pak.open(s_szPak));
+
+	remove(s_szPak);
+	removeTestPakTree(s_szRoot, setFile);
+}
+
+static bool seekFile(FILE* f, unsigned long long uPos)
+{
+#ifdef _WIN32
+	return _fseeki64(f, (__int64)uPos, SEEK_SET)==0;
+#else
+	return fseeko(f, (off_t)uPos, SEEK_SET)==0;
+#endif
+}
+
+// the bytes of the big file that aren't 0
+static const unsigned long long s_uLargeSize = 0x100001000ull+100;
+static const unsigned long long s_uMarker[] = {0, 0xFFFFFFFFull, 0x100000000ull, s_uLargeSize-1};
+
+static void testLarge()
+{
+	if (sizeof(size_t)<8)
+	{
+		printf("a 4GB pak can't be mapped in a 32 bit process, skipped\n");
+		return;
+	}
+	const std::string strRoot = s_szRoot;
+	const std::string strBig = strRoot+"/big.bin";
+	std::vector<TestPakFile> setFile(2);
+	setFile[0].strPath = "big.bin";
+	setFile[1].strPath = "small.txt";
+	setFile[1].setData.assign(1000, 'x');
+	CHECK(writeTestPakFile(strRoot+"/"+setFile[1].strPath, setFile[1].setData));
+	// sparse but for the markers
+	FILE* f = fopen(strBig.c_str(), "wb");
+	CHECK(f!=NULL);
+	if (!f)
+	{
+		return;
+	}
+	for (size_t i=0; i<sizeof(s_uMarker)/sizeof(s_uMarker[0]); ++i)
+	{
+		unsigned char c = (unsigned char)(0xA1+i);
+		CHECK(seekFile(f, s_uMarker[i]) && fwrite(&c, 1, 1, f)==1);
+	}
+	CHECK(fclose(f)==0);
+
+	std::vector<std::string> setPath;
+	getTestPakPaths(setFile, setPath);
+	CPakWriter writer;
+	CHECK(writer.create(s_szPak, 4096));
+	std::vector<PakWriteResult> setResult;
+	CHECK(writer.addFiles(strRoot, setPath, setResult)==2);
+	CHECK(writer.finish());
+
+	CPakFile pak;
+	CHECK(pak.open(s_szPak));
+	const CPakFile::Entry* pBig = pak.findEntry("big.bin");
+	const CPakFile::Entry* pSmall = pak.findEntry("small.txt");
+	CHECK(pBig && pBig->uSize==s_uLargeSize && pBig->uStoredSize==s_uLargeSize && pBig->uFlags==0);
+	CHECK(pSmall && pSmall->uOffset>0xFFFFFFFFull && pSmall->uOffset%4096==0);
+	std::vector<unsigned char> setData;
+	CHECK(pSmall && pak.readFile(*pSmall, setData) && setData==setFile[1].setData);
+	if (pBig && pBig->uSize==s_uLargeSize)
+	{
+		const unsigned char* pData = pak.getData(*pBig);
+		for (size_t i=0; i<sizeof(s_uMarker)/sizeof(s_uMarker[0]); ++i)
+		{
+			CHECK(pData[s_uMarker[i]]==0xA1+i);
+		}
+		// the crc32 of the mapped bytes, and of the file as it was written
+		std::vector<unsigned char> setExpected(1<<20);
+		uLong uCRC = 0;
+		uLong uExpectedCRC = 0;
+		for (unsigned long long uPos=0; uPos<s_uLargeSize; uPos+=setExpected.size())
+		{
+			size_t uBytes = (size_t)std::min<unsigned long long>(setExpected.size(), s_uLargeSize-uPos);
+			memset(&setExpected[0], 0, uBytes);
+			for (size_t i=0; i<sizeof(s_uMarker)/sizeof(s_uMarker[0]); ++i)
+			{
+				if (s_uMarker[i]>=uPos && s_uMarker[i]<uPos+uBytes)
+				{
+					setExpected[(size_t)(s_uMarker[i]-uPos)] = (unsigned char)(0xA1+i);
+				}
+			}
+			uCRC = crc32(uCRC, pData+uPos, (uInt)uBytes);
+			uExpectedCRC = crc32(uExpectedCRC, &setExpected[0], (uInt)uBytes);
+		}
+		CHECK(uCRC==uExpectedCRC && pBig->uCRC==uExpectedCRC);
+	}
+	pak.close();
+	remove(s_szPak);
+	removeTestPakTree(strRoot, setFile);
+}
+
+int main(int argc, char* argv[])
+{
+	testPack(0, 1, 1);
+	testPack(0, 16, 16);
+	testPack(6, 16, 16);
+	testPack(6, 4096, 4096);
+	// a power of two at least as large
+	testPack(1, 100, 128);
+	if (argc>1 && strcmp(argv[1], "4g")==0)
+	{
+		testLarge();
+	}
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
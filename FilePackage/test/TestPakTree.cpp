@@ -0,0 +1,182 @@
+#include "TestPakTree.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+unsigned int nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return uSeed>>8;
+}
+
+void makeTestPakFiles(size_t uCount, size_t uMaxSize, unsigned int uSeed, std::vector<TestPakFile>& setFile)
+{
+	static const char* s_szDir[] = {"", "Data/", "Data/Interface/", "Data/Model/Creature/", "Sound/"};
+	static const char* s_szWord[] = {"creature", "Model", "texture", "\r\n", "world", "spell", "0x1000", "interface"};
+	setFile.resize(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		TestPakFile& file = setFile[i];
+		char szName[64];
+		sprintf(szName, "File%u_%s.%s", (unsigned int)i, s_szWord[i%8][0]=='\r' ? "crlf" : s_szWord[i%8], i%3 ? "dat" : "TXT");
+		file.strPath = std::string(s_szDir[i%5])+szName;
+		// every seventh empty, text like or random
+		size_t uSize = i%7==0 ? 0 : 1+nextRandom(uSeed)%uMaxSize;
+		file.setData.resize(uSize);
+		bool bText = i%2==0;
+		for (size_t j=0; j<uSize;)
+		{
+			if (!bText)
+			{
+				file.setData[j++] = (unsigned char)nextRandom(uSeed);
+				continue;
+			}
+			for (const char* szWord=s_szWord[nextRandom(uSeed)%8]; *szWord&&j<uSize; ++szWord)
+			{
+				file.setData[j++] = (unsigned char)*szWord;
+			}
+		}
+	}
+}
+
+static void makeDirs(const std::string& strPath)
+{
+	for (size_t i=1; i<strPath.size(); ++i)
+	{
+		if (strPath[i]=='/')
+		{
+			std::string strDir = strPath.substr(0, i);
+#ifdef _WIN32
+			_mkdir(strDir.c_str());
+#else
+			mkdir(strDir.c_str(), 0755);
+#endif
+		}
+	}
+}
+
+bool writeTestPakFile(const std::string& strPath, const std::vector<unsigned char>& setData)
+{
+	makeDirs(strPath);
+	FILE* f = fopen(strPath.c_str(), "wb");
+	if (!f)
+	{
+		return false;
+	}
+	bool bOk = setData.empty() || fwrite(&setData[0], 1, setData.size(), f)==setData.size();
+	return fclose(f)==0 && bOk;
+}
+
+bool writeTestPakTree(const std::string& strRoot, const std::vector<TestPakFile>& setFile)
+{
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		if (!writeTestPakFile(strRoot+"/"+setFile[i].strPath, setFile[i].setData))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void removeTestPakTree(const std::string& strRoot, const std::vector<TestPakFile>& setFile)
+{
+	std::vector<std::string> setDir;
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		std::string strPath = strRoot+"/"+setFile[i].strPath;
+		remove(strPath.c_str());
+		for (size_t j=strRoot.size()+1; j<strPath.size(); ++j)
+		{
+			if (strPath[j]=='/')
+			{
+				setDir.push_back(strPath.substr(0, j));
+			}
+		}
+	}
+	// the deepest first, the root last
+	setDir.push_back(strRoot);
+	std::sort(setDir.begin(), setDir.end());
+	setDir.erase(std::unique(setDir.begin(), setDir.end()), setDir.end());
+	for (size_t i=setDir.size(); i-->0;)
+	{
+#ifdef _WIN32
+		_rmdir(setDir[i].c_str());
+#else
+		rmdir(setDir[i].c_str());
+#endif
+	}
+}
+
+bool setTestPakFileTime(const std::string& strPath, unsigned long long uTime)
+{
+#ifdef _WIN32
+	struct _utimbuf times;
+	times.actime = (time_t)uTime;
+	times.modtime = (time_t)uTime;
+	return _utime(strPath.c_str(), &times)==0;
+#else
+	struct utimbuf times;
+	times.actime = (time_t)uTime;
+	times.modtime = (time_t)uTime;
+	return utime(strPath.c_str(), &times)==0;
+#endif
+}
+
+void getTestPakPaths(const std::vector<TestPakFile>& setFile, std::vector<std::string>& setPath)
+{
+	setPath.resize(setFile.size());
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		setPath[i] = setFile[i].strPath;
+	}
+}
+
+bool checkTestPak(const CPakFile& pak, const std::vector<TestPakFile>& setFile)
+{
+	size_t uBad = 0;
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		const TestPakFile& file = setFile[i];
+		std::string strLower = file.strPath;
+		NormalizePakFileName(&strLower[0]);
+		const CPakFile::Entry* pEntry = pak.findEntry(file.strPath.c_str());
+		std::vector<unsigned char> setData;
+		if (!pEntry || pEntry!=pak.findEntry(strLower.c_str()) || !pak.readFile(*pEntry, setData) || setData!=file.setData
+			|| pEntry->uSize!=file.setData.size())
+		{
+			if (uBad++<5)
+			{
+				printf("%s: %s\n", file.strPath.c_str(), pEntry ? "different" : "missing");
+			}
+		}
+	}
+	if (pak.getFileCount()!=setFile.size())
+	{
+		printf("%u files in the pak, %u expected\n", (unsigned int)pak.getFileCount(), (unsigned int)setFile.size());
+		uBad++;
+	}
+	return uBad==0;
+}
+
+size_t countUnaligned(const CPakFile& pak, unsigned int uAlignment)
+{
+	size_t uCount = 0;
+	for (size_t i=0; i<pak.getFileCount(); ++i)
+	{
+		if (pak.getEntry(i).uOffset%uAlignment!=0)
+		{
+			uCount++;
+		}
+	}
+	return uCount;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "PakFile.h"
+#include <string>
+#include <vector>
+
+// A file of a generated tree with the contents it was written with.
+struct TestPakFile
+{
+	std::string					strPath;	// relative, '/' separated, mixed case
+	std::vector<unsigned char>	setData;
+};
+
+// uCount files of mixed sizes in a few directories, empty, text like and random, up to
+// uMaxSize bytes. The same on every run for the same uSeed.
+void makeTestPakFiles(size_t uCount, size_t uMaxSize, unsigned int uSeed, std::vector<TestPakFile>& setFile);
+// The files under strRoot, with their directories. False on failure.
+bool writeTestPakTree(const std::string& strRoot, const std::vector<TestPakFile>& setFile);
+bool writeTestPakFile(const std::string& strPath, const std::vector<unsigned char>& setData);
+// Removes the files and then the directories they were in, strRoot too.
+void removeTestPakTree(const std::string& strRoot, const std::vector<TestPakFile>& setFile);
+// modification time in seconds since 1970
+bool setTestPakFileTime(const std::string& strPath, unsigned long long uTime);
+// The paths of the files, for CPakWriter::addFiles.
+void getTestPakPaths(const std::vector<TestPakFile>& setFile, std::vector<std::string>& setPath);
+// True when the pak has each file with its contents, found by its path as given and in lower
+// case, and nothing else. Prints the first few it doesn't.
+bool checkTestPak(const CPakFile& pak, const std::vector<TestPakFile>& setFile);
+// Files of the pak that aren't aligned to uAlignment.
+size_t countUnaligned(const CPakFile& pak, unsigned int uAlignment);
+
+unsigned int nextRandom(unsigned int& uSeed);
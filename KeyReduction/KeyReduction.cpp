@@ -0,0 +1,395 @@
+#include "KeyReduction.h"
+#include <math.h>
+
+namespace
+{
+	float dotKey(const float* a, const float* b, size_t uDim)
+	{
+		float fDot = 0.0f;
+		for (size_t i=0; i<uDim; ++i)
+		{
+			fDot += a[i]*b[i];
+		}
+		return fDot;
+	}
+
+	void normalizeQuat(float* q)
+	{
+		float fLength = sqrtf(dotKey(q,q,4));
+		if (fLength>0.0f)
+		{
+			for (size_t i=0; i<4; ++i)
+			{
+				q[i] /= fLength;
+			}
+		}
+	}
+
+	void lerpKey(const float* a, const float* b, float t, size_t uDim, float* pOut)
+	{
+		for (size_t i=0; i<uDim; ++i)
+		{
+			pOut[i] = a[i]+(b[i]-a[i])*t;
+		}
+	}
+
+	void slerpQuat(const float* a, const float* b, float t, float* pOut)
+	{
+		float fCos = dotKey(a,b,4);
+		if (fCos>0.9995f)
+		{
+			lerpKey(a,b,t,4,pOut);
+			normalizeQuat(pOut);
+			return;
+		}
+		if (fCos<-1.0f)
+		{
+			fCos = -1.0f;
+		}
+		float fAngle = acosf(fCos);
+		float fSin = sinf(fAngle);
+		float fA = sinf((1.0f-t)*fAngle)/fSin;
+		float fB = sinf(t*fAngle)/fSin;
+		for (size_t i=0; i<4; ++i)
+		{
+			pOut[i] = a[i]*fA+b[i]*fB;
+		}
+	}
+
+	float errorKey(const float* a, const float* b, size_t uDim, bool bQuat)
+	{
+		if (bQuat)
+		{
+			float fDot = fabsf(dotKey(a,b,4));
+			return fDot>=1.0f?0.0f:2.0f*acosf(fDot);
+		}
+		float fSq = 0.0f;
+		for (size_t i=0; i<uDim; ++i)
+		{
+			fSq += (a[i]-b[i])*(a[i]-b[i]);
+		}
+		return sqrtf(fSq);
+	}
+
+	// Hermite segment between key a and key b, tangents are per time unit.
+	void hermiteKey(const float* a, const float* ta, const float* b, const float* tb, float fSpan, float t, size_t uDim, bool bQuat, float* pOut)
+	{
+		float t2 = t*t;
+		float t3 = t2*t;
+		float h00 = 2.0f*t3-3.0f*t2+1.0f;
+		float h10 = t3-2.0f*t2+t;
+		float h01 = -2.0f*t3+3.0f*t2;
+		float h11 = t3-t2;
+		for (size_t i=0; i<uDim; ++i)
+		{
+			pOut[i] = h00*a[i]+h10*fSpan*ta[i]+h01*b[i]+h11*fSpan*tb[i];
+		}
+		if (bQuat)
+		{
+			normalizeQuat(pOut);
+		}
+	}
+
+	void tangentKey(const int* pTime, const float* pValue, size_t uDim, size_t uPrev, size_t uNext, float* pOut)
+	{
+		float fSpan = (float)(pTime[uNext]-pTime[uPrev]);
+		for (size_t i=0; i<uDim; ++i)
+		{
+			pOut[i] = fSpan>0.0f?(pValue[uNext*uDim+i]-pValue[uPrev*uDim+i])/fSpan:0.0f;
+		}
+	}
+
+	// Max error of the samples between two kept keys; uWorst is left alone when nothing exceeds fMaxError.
+	float segmentError(const int* pTime, const float* pValue, size_t uDim, bool bQuat, KeyFitMode mode,
+		const std::vector<size_t>& setKept, size_t uSeg, float fMaxError, size_t& uWorst)
+	{
+		size_t a = setKept[uSeg];
+		size_t b = setKept[uSeg+1];
+		float fSpan = (float)(pTime[b]-pTime[a]);
+		float ta[4], tb[4], v[4];
+		if (KEY_FIT_SPLINE==mode)
+		{
+			tangentKey(pTime, pValue, uDim, uSeg>0?setKept[uSeg-1]:a, b, ta);
+			tangentKey(pTime, pValue, uDim, a, uSeg+2<setKept.size()?setKept[uSeg+2]:b, tb);
+		}
+		for (size_t i=a+1; i<b; ++i)
+		{
+			float t = fSpan>0.0f?(pTime[i]-pTime[a])/fSpan:0.0f;
+			if (KEY_FIT_SPLINE==mode)
+			{
+				hermiteKey(&pValue[a*uDim], ta, &pValue[b*uDim], tb, fSpan, t, uDim, bQuat, v);
+			}
+			else if (bQuat)
+			{
+				slerpQuat(&pValue[a*uDim], &pValue[b*uDim], t, v);
+			}
+			else
+			{
+				lerpKey(&pValue[a*uDim], &pValue[b*uDim], t, uDim, v);
+			}
+			float fError = errorKey(v, &pValue[i*uDim], uDim, bQuat);
+			if (fError>fMaxError)
+			{
+				fMaxError = fError;
+				uWorst = i;
+			}
+		}
+		return fMaxError;
+	}
+}
+
+float selectKeys(const int* pTime, const float* pValue, size_t uCount, size_t uDim, bool bQuat,
+				 KeyFitMode mode, float fTolerance, std::vector<size_t>& setKeep)
+{
+	setKeep.clear();
+	if (uCount<=2)
+	{
+		for (size_t i=0; i<uCount; ++i)
+		{
+			setKeep.push_back(i);
+		}
+		return 0.0f;
+	}
+	setKeep.push_back(0);
+	setKeep.push_back(uCount-1);
+	if (KEY_FIT_LINEAR==mode)
+	{
+		// Segments are independent, so split the worst sample recursively.
+		std::vector<unsigned char> setFlag(uCount,0);
+		setFlag[0] = 1;
+		setFlag[uCount-1] = 1;
+		std::vector<size_t> setStack;
+		setStack.push_back(0);
+		while (!setStack.empty())
+		{
+			std::vector<size_t> setSeg(2);
+			setSeg[0] = setStack.back();
+			setSeg[1] = setSeg[0]+1;
+			while (!setFlag[setSeg[1]])
+			{
+				++setSeg[1];
+			}
+			setStack.pop_back();
+			size_t uWorst = uCount;
+			segmentError(pTime, pValue, uDim, bQuat, mode, setSeg, 0, fTolerance, uWorst);
+			if (uWorst<uCount)
+			{
+				setFlag[uWorst] = 1;
+				setStack.push_back(setSeg[0]);
+				setStack.push_back(uWorst);
+			}
+		}
+		setKeep.clear();
+		for (size_t i=0; i<uCount; ++i)
+		{
+			if (setFlag[i])
+			{
+				setKeep.push_back(i);
+			}
+		}
+	}
+	else
+	{
+		// Tangents depend on the neighbour keys, so insert the worst sample of the whole curve
+		// and re-measure the segments whose tangents it changed.
+		std::vector<float> setSegError(1,0.0f);
+		std::vector<size_t> setSegWorst(1,uCount);
+		setSegError[0] = segmentError(pTime, pValue, uDim, bQuat, mode, setKeep, 0, 0.0f, setSegWorst[0]);
+		for (;;)
+		{
+			size_t uSeg = 0;
+			for (size_t i=1; i<setSegError.size(); ++i)
+			{
+				if (setSegError[i]>setSegError[uSeg])
+				{
+					uSeg = i;
+				}
+			}
+			if (setSegError[uSeg]<=fTolerance || setSegWorst[uSeg]>=uCount)
+			{
+				break;
+			}
+			setKeep.insert(setKeep.begin()+uSeg+1, setSegWorst[uSeg]);
+			setSegError.insert(setSegError.begin()+uSeg+1, 0.0f);
+			setSegWorst.insert(setSegWorst.begin()+uSeg+1, uCount);
+			size_t uFirst = uSeg>0?uSeg-1:0;
+			size_t uLast = uSeg+2<setSegError.size()?uSeg+2:setSegError.size()-1;
+			for (size_t i=uFirst; i<=uLast; ++i)
+			{
+				setSegWorst[i] = uCount;
+				setSegError[i] = segmentError(pTime, pValue, uDim, bQuat, mode, setKeep, i, 0.0f, setSegWorst[i]);
+			}
+		}
+	}
+	float fMaxError = 0.0f;
+	for (size_t i=0; i+1<setKeep.size(); ++i)
+	{
+		size_t uWorst = uCount;
+		fMaxError = segmentError(pTime, pValue, uDim, bQuat, mode, setKeep, i, fMaxError, uWorst);
+	}
+	return fMaxError;
+}
+
+void alignQuatKeys(float* pValue, size_t uCount)
+{
+	for (size_t i=1; i<uCount; ++i)
+	{
+		float* q = &pValue[i*4];
+		if (dotKey(q-4,q,4)<0.0f)
+		{
+			for (size_t j=0; j<4; ++j)
+			{
+				q[j] = -q[j];
+			}
+		}
+	}
+}
+
+void calcSplineTangents(const int* pTime, const float* pValue, size_t uCount, size_t uDim, std::vector<float>& setTangent)
+{
+	setTangent.resize(uCount*uDim);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		tangentKey(pTime, pValue, uDim, i>0?i-1:i, i+1<uCount?i+1:i, &setTangent[i*uDim]);
+	}
+}
+
+void calcBoneDepths(const std::vector<int>& setParent, std::vector<int>& setDepth)
+{
+	setDepth.assign(setParent.size(),-1);
+	std::vector<int> setChain;
+	for (size_t i=0; i<setParent.size(); ++i)
+	{
+		// Walk up until a known depth, bounded in case of a broken (cyclic) hierarchy.
+		setChain.clear();
+		int nBone = (int)i;
+		while (nBone>=0 && nBone<(int)setParent.size() && setDepth[nBone]<0 && setChain.size()<=setParent.size())
+		{
+			setChain.push_back(nBone);
+			nBone = setParent[nBone];
+		}
+		int nDepth = (nBone>=0 && nBone<(int)setParent.size() && setDepth[nBone]>=0)?setDepth[nBone]+1:0;
+		for (size_t j=setChain.size(); j>0; --j)
+		{
+			if (setDepth[setChain[j-1]]<0)
+			{
+				setDepth[setChain[j-1]] = nDepth++;
+			}
+		}
+	}
+}
+
+CKeyReducer::CKeyReducer(const KeyReduceParam& param)
+	:m_Param(param)
+{
+}
+
+void CKeyReducer::setBoneParents(const std::vector<int>& setParent)
+{
+	calcBoneDepths(setParent, m_setBoneDepth);
+}
+
+static float depthScale(const KeyReduceParam& param, const std::vector<int>& setBoneDepth, size_t uBoneID)
+{
+	float fScale = 1.0f;
+	if (uBoneID<setBoneDepth.size())
+	{
+		for (int i=0; i<setBoneDepth[uBoneID] && fScale<param.fMaxDepthScale; ++i)
+		{
+			fScale *= param.fDepthScale;
+		}
+	}
+	return fScale<param.fMaxDepthScale?fScale:param.fMaxDepthScale;
+}
+
+float CKeyReducer::getPosTolerance(size_t uBoneID)const
+{
+	return m_Param.fPosTolerance*depthScale(m_Param, m_setBoneDepth, uBoneID);
+}
+
+float CKeyReducer::getRotTolerance(size_t uBoneID)const
+{
+	return m_Param.fRotTolerance*depthScale(m_Param, m_setBoneDepth, uBoneID);
+}
+
+void CKeyReducer::beginClip(const std::string& strName)
+{
+	m_setReport.push_back(KeyReduceClipReport());
+	m_setReport.back().strName = strName;
+}
+
+bool CKeyReducer::reduceRange(size_t uBoneID, const std::vector<int>& setTime, float* pValue, size_t uDim, bool bQuat, std::vector<size_t>& setKeep)
+{
+	if (m_setReport.empty())
+	{
+		beginClip("");
+	}
+	KeyReduceClipReport& report = m_setReport.back();
+	// time + value, a spline key also stores its in and out tangents.
+	size_t uKeySize = sizeof(int)+uDim*sizeof(float);
+	size_t uReducedKeySize = KEY_FIT_SPLINE==m_Param.mode?uKeySize+2*uDim*sizeof(float):uKeySize;
+	report.uKeysBefore += setTime.size();
+	report.uBytesBefore += setTime.size()*uKeySize;
+	if (setTime.size()<=2)
+	{
+		report.uKeysAfter += setTime.size();
+		report.uBytesAfter += setTime.size()*uKeySize;
+		return false;
+	}
+	if (bQuat)
+	{
+		alignQuatKeys(pValue, setTime.size());
+	}
+	float fTolerance = bQuat?getRotTolerance(uBoneID):getPosTolerance(uBoneID);
+	float fError = selectKeys(&setTime[0], pValue, setTime.size(), uDim, bQuat, m_Param.mode, fTolerance, setKeep);
+	report.uKeysAfter += setKeep.size();
+	report.uBytesAfter += setKeep.size()*uReducedKeySize;
+	float& fMaxError = bQuat?report.fMaxRotError:report.fMaxPosError;
+	if (fError>fMaxError)
+	{
+		fMaxError = fError;
+	}
+	return true;
+}
+
+void CKeyReducer::writeReport(FILE* f)const
+{
+	if (NULL==f)
+	{
+		return;
+	}
+	std::string strReport;
+	writeReport(strReport);
+	fputs(strReport.c_str(), f);
+}
+
+void CKeyReducer::writeReport(std::string& strReport)const
+{
+	// names are cut to 64 characters so a line fits the buffer
+	char szLine[256];
+	KeyReduceClipReport total;
+	total.strName = "total";
+	sprintf(szLine, "%-24s %10s %10s %12s %12s %7s %12s %12s\n",
+		"clip","keys","reduced","bytes","reduced","saved","max pos","max rot(deg)");
+	strReport += szLine;
+	for (size_t i=0; i<=m_setReport.size(); ++i)
+	{
+		const KeyReduceClipReport& report = i<m_setReport.size()?m_setReport[i]:total;
+		float fSaved = report.uBytesBefore>0?100.0f*(1.0f-(float)report.uBytesAfter/(float)report.uBytesBefore):0.0f;
+		sprintf(szLine, "%-24.64s %10u %10u %12u %12u %6.1f%% %12.6f %12.4f\n",
+			report.strName.c_str(),
+			(unsigned int)report.uKeysBefore, (unsigned int)report.uKeysAfter,
+			(unsigned int)report.uBytesBefore, (unsigned int)report.uBytesAfter,
+			fSaved, report.fMaxPosError, report.fMaxRotError*57.29578f);
+		strReport += szLine;
+		if (i<m_setReport.size())
+		{
+			total.uKeysBefore	+= report.uKeysBefore;
+			total.uKeysAfter	+= report.uKeysAfter;
+			total.uBytesBefore	+= report.uBytesBefore;
+			total.uBytesAfter	+= report.uBytesAfter;
+			total.fMaxPosError	= report.fMaxPosError>total.fMaxPosError?report.fMaxPosError:total.fMaxPosError;
+			total.fMaxRotError	= report.fMaxRotError>total.fMaxRotError?report.fMaxRotError:total.fMaxRotError;
+		}
+	}
+}
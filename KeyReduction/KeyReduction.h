@@ -0,0 +1,166 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+// Error-bounded keyframe reduction for sampled bone tracks.
+// It doesn't depend on the engine, so the max exporter and the import plugins can share it,
+// and it builds on linux (see CMakeLists.txt) for offline batch use.
+// Values are passed as any type laid out like {x,y,z} / {x,y,z,w} (Vec3D, Quaternion, Point3, Quat).
+
+struct KeyVec3
+{
+	float x,y,z;
+};
+
+struct KeyQuat
+{
+	float x,y,z,w;
+};
+
+enum KeyFitMode
+{
+	KEY_FIT_LINEAR,		// lerp / slerp between the kept keys
+	KEY_FIT_SPLINE,		// hermite between the kept keys, tangents from calcSplineTangents
+};
+
+struct KeyReduceParam
+{
+	KeyReduceParam()
+	{
+		mode			= KEY_FIT_LINEAR;
+		fPosTolerance	= 0.001f;
+		fRotTolerance	= 0.0044f;	// ~0.25 degree
+		fDepthScale		= 1.25f;
+		fMaxDepthScale	= 4.0f;
+	}
+	KeyFitMode mode;
+	float fPosTolerance;	// max distance of a dropped sample from the curve (root bone)
+	float fRotTolerance;	// max angle in radians of a dropped sample from the curve (root bone)
+	float fDepthScale;		// the tolerance is multiplied by this per level below the root,
+	float fMaxDepthScale;	// up to this; errors near the root move the whole hierarchy.
+};
+
+struct KeyReduceClipReport
+{
+	KeyReduceClipReport()
+	{
+		uKeysBefore		= 0;
+		uKeysAfter		= 0;
+		uBytesBefore	= 0;
+		uBytesAfter		= 0;
+		fMaxPosError	= 0.0f;
+		fMaxRotError	= 0.0f;
+	}
+	std::string strName;
+	size_t uKeysBefore;
+	size_t uKeysAfter;
+	size_t uBytesBefore;
+	size_t uBytesAfter;
+	float fMaxPosError;
+	float fMaxRotError;		// radians
+};
+
+// Picks the keys to keep from uCount samples of uDim floats, so that the curve through the kept keys
+// stays within fTolerance of every sample. Quaternion samples must be hemisphere aligned (alignQuatKeys).
+// The first and last sample are always kept. Returns the max error of the reduced curve.
+float selectKeys(const int* pTime, const float* pValue, size_t uCount, size_t uDim, bool bQuat,
+				 KeyFitMode mode, float fTolerance, std::vector<size_t>& setKeep);
+
+// Flips quaternions into the hemisphere of their predecessor so that interpolation takes the short way.
+void alignQuatKeys(float* pValue, size_t uCount);
+
+// Per-key derivative (value per time unit) for KEY_FIT_SPLINE, as used by selectKeys.
+void calcSplineTangents(const int* pTime, const float* pValue, size_t uCount, size_t uDim, std::vector<float>& setTangent);
+
+// Depth of each bone in the hierarchy; parents outside the table count as roots.
+void calcBoneDepths(const std::vector<int>& setParent, std::vector<int>& setDepth);
+
+class CKeyReducer
+{
+public:
+	CKeyReducer(const KeyReduceParam& param = KeyReduceParam());
+
+	void setBoneParents(const std::vector<int>& setParent);
+	float getPosTolerance(size_t uBoneID)const;
+	float getRotTolerance(size_t uBoneID)const;
+
+	// Following reduce calls are reported under this clip.
+	void beginClip(const std::string& strName);
+
+	// Reduce the keys with nTimeBegin<=time<=nTimeEnd in place, keys outside the range are left alone.
+	template<class _Time, class _Vec3>
+	void reduceTrans(size_t uBoneID, std::vector<_Time>& setTime, std::vector<_Vec3>& setValue, int nTimeBegin, int nTimeEnd)
+	{
+		reduceTrack(uBoneID, setTime, setValue, nTimeBegin, nTimeEnd, 3, false);
+	}
+	template<class _Time, class _Quat>
+	void reduceRot(size_t uBoneID, std::vector<_Time>& setTime, std::vector<_Quat>& setValue, int nTimeBegin, int nTimeEnd)
+	{
+		reduceTrack(uBoneID, setTime, setValue, nTimeBegin, nTimeEnd, 4, true);
+	}
+	template<class _Time, class _Vec3>
+	void reduceTrans(size_t uBoneID, std::vector<_Time>& setTime, std::vector<_Vec3>& setValue)
+	{
+		if (setTime.size()>0)
+		{
+			reduceTrans(uBoneID, setTime, setValue, (int)setTime.front(), (int)setTime.back());
+		}
+	}
+	template<class _Time, class _Quat>
+	void reduceRot(size_t uBoneID, std::vector<_Time>& setTime, std::vector<_Quat>& setValue)
+	{
+		if (setTime.size()>0)
+		{
+			reduceRot(uBoneID, setTime, setValue, (int)setTime.front(), (int)setTime.back());
+		}
+	}
+
+	const std::vector<KeyReduceClipReport>& getReport()const{return m_setReport;}
+	// A table of the clips and their total: keys and bytes before and after, max errors.
+	void writeReport(FILE* f)const;
+	void writeReport(std::string& strReport)const;
+protected:
+	template<class _Time, class _Value>
+	void reduceTrack(size_t uBoneID, std::vector<_Time>& setTime, std::vector<_Value>& setValue, int nTimeBegin, int nTimeEnd, size_t uDim, bool bQuat)
+	{
+		size_t uCount = setTime.size()<setValue.size()?setTime.size():setValue.size();
+		if (sizeof(_Value)!=uDim*sizeof(float))
+		{
+			return;
+		}
+		size_t uBegin = 0;
+		while (uBegin<uCount && (int)setTime[uBegin]<nTimeBegin)
+		{
+			++uBegin;
+		}
+		size_t uEnd = uBegin;
+		while (uEnd<uCount && (int)setTime[uEnd]<=nTimeEnd)
+		{
+			++uEnd;
+		}
+		std::vector<int> setRangeTime(uEnd-uBegin);
+		for (size_t i=uBegin; i<uEnd; ++i)
+		{
+			setRangeTime[i-uBegin] = (int)setTime[i];
+		}
+		std::vector<size_t> setKeep;
+		if (false==reduceRange(uBoneID, setRangeTime, uEnd>uBegin?(float*)&setValue[uBegin]:NULL, uDim, bQuat, setKeep))
+		{
+			return;
+		}
+		// Compact the kept keys of the range in place.
+		for (size_t i=0; i<setKeep.size(); ++i)
+		{
+			setTime[uBegin+i]	= setTime[uBegin+setKeep[i]];
+			setValue[uBegin+i]	= setValue[uBegin+setKeep[i]];
+		}
+		setTime.erase(setTime.begin()+uBegin+setKeep.size(), setTime.begin()+uEnd);
+		setValue.erase(setValue.begin()+uBegin+setKeep.size(), setValue.begin()+uEnd);
+	}
+	bool reduceRange(size_t uBoneID, const std::vector<int>& setTime, float* pValue, size_t uDim, bool bQuat, std::vector<size_t>& setKeep);
+
+	KeyReduceParam						m_Param;
+	std::vector<int>					m_setBoneDepth;
+	std::vector<KeyReduceClipReport>	m_setReport;
+};
@@ -0,0 +1,192 @@
+// Checks the reduction against independently evaluated curves and prints a clip report.
+// Returns non zero when a check fails, run by ctest.
+#include "KeyReduction.h"
+#include <math.h>
+#include <stdio.h>
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+struct TestVec3
+{
+	float x,y,z;
+};
+
+struct TestQuat
+{
+	float x,y,z,w;
+};
+
+static TestQuat axisAngle(float fAngle)
+{
+	// about a fixed tilted axis
+	const float fLength = sqrtf(1.0f+4.0f+9.0f);
+	float s = sinf(fAngle*0.5f)/fLength;
+	TestQuat q = {s*1.0f, s*2.0f, s*3.0f, cosf(fAngle*0.5f)};
+	return q;
+}
+
+// Max distance of the samples from the polyline through the kept keys, measured here and not
+// through the library.
+static float linearError(const int* pTime, const float* pValue, size_t uDim, const std::vector<size_t>& setKeep)
+{
+	float fMaxError = 0.0f;
+	for (size_t k=0; k+1<setKeep.size(); ++k)
+	{
+		size_t a = setKeep[k];
+		size_t b = setKeep[k+1];
+		for (size_t i=a; i<=b; ++i)
+		{
+			float t = (float)(pTime[i]-pTime[a])/(float)(pTime[b]-pTime[a]);
+			float fSq = 0.0f;
+			for (size_t j=0; j<uDim; ++j)
+			{
+				float v = pValue[a*uDim+j]+(pValue[b*uDim+j]-pValue[a*uDim+j])*t;
+				fSq += (v-pValue[i*uDim+j])*(v-pValue[i*uDim+j]);
+			}
+			fMaxError = sqrtf(fSq)>fMaxError?sqrtf(fSq):fMaxError;
+		}
+	}
+	return fMaxError;
+}
+
+static void testLinear()
+{
+	const size_t uCount = 400;
+	std::vector<int> setTime(uCount);
+	std::vector<float> setValue(uCount*3);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		setTime[i] = (int)i*33;
+		setValue[i*3+0] = sinf(i*0.05f);
+		setValue[i*3+1] = 0.5f*cosf(i*0.02f);
+		setValue[i*3+2] = i<200?0.0f:(float)(i-200)*0.01f;	// a kink
+	}
+	const float fTolerance = 0.001f;
+	std::vector<size_t> setKeep;
+	float fError = selectKeys(&setTime[0], &setValue[0], uCount, 3, false, KEY_FIT_LINEAR, fTolerance, setKeep);
+	CHECK(setKeep.size()>2&&setKeep.size()<uCount);
+	CHECK(setKeep.front()==0&&setKeep.back()==uCount-1);
+	CHECK(fError<=fTolerance);
+	CHECK(linearError(&setTime[0], &setValue[0], 3, setKeep)<=fTolerance*1.001f);
+	printf("linear: %u of %u keys, max error %f\n", (unsigned int)setKeep.size(), (unsigned int)uCount, fError);
+}
+
+static void testSpline()
+{
+	const size_t uCount = 400;
+	std::vector<int> setTime(uCount);
+	std::vector<float> setValue(uCount*3);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		setTime[i] = (int)i*33;
+		setValue[i*3+0] = sinf(i*0.05f);
+		setValue[i*3+1] = cosf(i*0.03f);
+		setValue[i*3+2] = 0.0f;
+	}
+	std::vector<size_t> setLinear, setSpline;
+	selectKeys(&setTime[0], &setValue[0], uCount, 3, false, KEY_FIT_LINEAR, 0.001f, setLinear);
+	float fError = selectKeys(&setTime[0], &setValue[0], uCount, 3, false, KEY_FIT_SPLINE, 0.001f, setSpline);
+	CHECK(fError<=0.001f);
+	CHECK(setSpline.size()<setLinear.size());
+	printf("spline: %u keys against %u linear, max error %f\n", (unsigned int)setSpline.size(), (unsigned int)setLinear.size(), fError);
+}
+
+static void testQuat()
+{
+	// constant angular speed slerps exactly, a sign flipped sample must not count
+	const size_t uCount = 100;
+	std::vector<int> setTime(uCount);
+	std::vector<float> setValue(uCount*4);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		setTime[i] = (int)i;
+		TestQuat q = axisAngle(i*0.02f);
+		float fSign = (i%7==3)?-1.0f:1.0f;
+		setValue[i*4+0] = q.x*fSign;
+		setValue[i*4+1] = q.y*fSign;
+		setValue[i*4+2] = q.z*fSign;
+		setValue[i*4+3] = q.w*fSign;
+	}
+	alignQuatKeys(&setValue[0], uCount);
+	std::vector<size_t> setKeep;
+	float fError = selectKeys(&setTime[0], &setValue[0], uCount, 4, true, KEY_FIT_LINEAR, 0.0044f, setKeep);
+	CHECK(setKeep.size()==2);
+	CHECK(fError<=0.0044f);
+}
+
+static void testBoneDepths()
+{
+	std::vector<int> setParent;
+	setParent.push_back(-1);
+	setParent.push_back(0);
+	setParent.push_back(1);
+	setParent.push_back(255);	// outside the table, a root
+	setParent.push_back(5);		// a cycle
+	setParent.push_back(4);
+	std::vector<int> setDepth;
+	calcBoneDepths(setParent, setDepth);
+	CHECK(setDepth[0]==0&&setDepth[1]==1&&setDepth[2]==2&&setDepth[3]==0);
+	CHECK(setDepth[4]>=0&&setDepth[5]>=0);
+}
+
+static void testReducer()
+{
+	std::vector<int> setParent;
+	setParent.push_back(-1);
+	setParent.push_back(0);
+	KeyReduceParam param;
+	CKeyReducer keyReducer(param);
+	keyReducer.setBoneParents(setParent);
+	CHECK(keyReducer.getPosTolerance(1)>keyReducer.getPosTolerance(0));
+
+	std::vector<int> setTime;
+	std::vector<TestVec3> setTrans;
+	std::vector<TestQuat> setRot;
+	for (int i=0; i<200; ++i)
+	{
+		setTime.push_back(i*33);
+		TestVec3 v = {sinf(i*0.05f), (float)i*0.1f, 0.0f};
+		setTrans.push_back(v);
+		setRot.push_back(axisAngle(sinf(i*0.03f)));
+	}
+	std::vector<int> setRotTime = setTime;
+
+	// the first half only, the keys after it stay as they are
+	keyReducer.beginClip("walk");
+	keyReducer.reduceTrans(0, setTime, setTrans, 0, 99*33);
+	keyReducer.reduceRot(1, setRotTime, setRot);
+	CHECK(setTime.size()==setTrans.size()&&setTime.size()<200&&setTime.size()>100);
+	CHECK(setTime.back()==199*33);
+	CHECK(setRotTime.size()==setRot.size()&&setRotTime.size()<200);
+
+	const std::vector<KeyReduceClipReport>& setReport = keyReducer.getReport();
+	CHECK(setReport.size()==1);
+	CHECK(setReport[0].uKeysBefore==100+200);
+	CHECK(setReport[0].uKeysAfter==(setTime.size()-100)+setRotTime.size());
+	CHECK(setReport[0].uBytesAfter<setReport[0].uBytesBefore);
+	CHECK(setReport[0].fMaxPosError<=keyReducer.getPosTolerance(0));
+	CHECK(setReport[0].fMaxRotError<=keyReducer.getRotTolerance(1));
+
+	std::string strReport;
+	keyReducer.writeReport(strReport);
+	CHECK(strReport.find("walk")!=std::string::npos&&strReport.find("total")!=std::string::npos);
+	keyReducer.writeReport(stdout);
+}
+
+int main()
+{
+	testLinear();
+	testSpline();
+	testQuat();
+	testBoneDepths();
+	testReducer();
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
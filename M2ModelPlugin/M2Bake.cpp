@@ -0,0 +1,130 @@
+// M2Bake.cpp : bakes M2 models of the game archives to the engine's model format.
+//
+#include "M2Baker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+// after the C++ headers, it defines min
+#include "../MPQFilePlugin/mpq_libmpq.h"
+
+static void printUsage()
+{
+	std::cout<<"usage: M2Bake [-d data dir] [-o output dir] [-e ext] [-l list] [pattern ...]"<<std::endl;
+	std::cout<<"  bakes the models of the archives matching the patterns, '*' matches any run of"<<std::endl;
+	std::cout<<"  characters and '?' any one, \"creature\\*\\*.m2\" (default *.m2)"<<std::endl;
+	std::cout<<"  -d  the game's Data directory with the MPQs"<<std::endl;
+	std::cout<<"  -o  output directory, the models keep their archive paths under it (default .)"<<std::endl;
+	std::cout<<"  -e  extension of the baked files (default .sm)"<<std::endl;
+	std::cout<<"  -l  text file of model paths, one per line, baked with the pattern matches"<<std::endl;
+}
+
+// Paths of a list file, the blank lines skipped.
+static bool readModelList(const char* szFilename, std::vector<std::string>& setModel)
+{
+	FILE* f = fopen(szFilename, "rb");
+	if (f==NULL)
+	{
+		return false;
+	}
+	char szLine[512];
+	while (fgets(szLine, sizeof(szLine), f))
+	{
+		size_t uLength = strlen(szLine);
+		while (uLength>0 && (szLine[uLength-1]=='\r'||szLine[uLength-1]=='\n'||szLine[uLength-1]==' '))
+		{
+			szLine[--uLength] = 0;
+		}
+		if (uLength>0)
+		{
+			setModel.push_back(MPQIndex::normalize(szLine));
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string strDataDir;
+	std::string strOutputDir = ".";
+	std::string strExt = ".sm";
+	std::vector<std::string> setPattern;
+	std::vector<std::string> setModel;
+	for (int i=1; i<argc; ++i)
+	{
+		std::string strArg = argv[i];
+		if ((strArg=="-d"||strArg=="-o"||strArg=="-e"||strArg=="-l") && i+1<argc)
+		{
+			const char* szValue = argv[++i];
+			if (strArg=="-d")
+			{
+				strDataDir = szValue;
+			}
+			else if (strArg=="-o")
+			{
+				strOutputDir = szValue;
+			}
+			else if (strArg=="-e")
+			{
+				strExt = szValue[0]=='.' ? szValue : std::string(".")+szValue;
+			}
+			else if (!readModelList(szValue, setModel))
+			{
+				std::cout<<"can't read "<<szValue<<std::endl;
+				return 1;
+			}
+		}
+		else if (strArg.size()>0 && strArg[0]=='-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			setPattern.push_back(strArg);
+		}
+	}
+	if (setPattern.empty() && setModel.empty())
+	{
+		setPattern.push_back("*.m2");
+	}
+
+	if (!strDataDir.empty())
+	{
+		char cLast = strDataDir[strDataDir.size()-1];
+		SetGamePath(cLast=='/'||cLast=='\\' ? strDataDir : strDataDir+"\\");
+	}
+	InitMPQArchives();
+	if (GetOpenArchives().empty())
+	{
+		std::cout<<"no archives found, see -d"<<std::endl;
+		return 1;
+	}
+	for (size_t i=0; i<setPattern.size(); ++i)
+	{
+		FindM2Models(setPattern[i].c_str(), setModel);
+	}
+	// a model matched by several patterns or listed too is baked once
+	std::sort(setModel.begin(), setModel.end());
+	setModel.erase(std::unique(setModel.begin(), setModel.end()), setModel.end());
+	if (setModel.empty())
+	{
+		std::cout<<"no models match"<<std::endl;
+		return 1;
+	}
+
+	std::cout<<"baking "<<setModel.size()<<" models to "<<strOutputDir<<std::endl;
+	std::vector<M2BakeResult> setResult;
+	size_t uBaked = BakeM2Models(setModel, strOutputDir, setResult, strExt.c_str());
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		if (!setResult[i].bOk)
+		{
+			std::cout<<"failed: "<<setResult[i].strModel<<std::endl;
+		}
+	}
+	std::cout<<uBaked<<" of "<<setResult.size()<<" models baked"<<std::endl;
+	return uBaked==setResult.size() ? 0 : 1;
+}
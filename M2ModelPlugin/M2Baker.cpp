@@ -0,0 +1,156 @@
+#include "M2Baker.h"
+#include "M2Model.h"
+#include "database.h"
+#include "../Common/ThreadPool.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+void FindM2Models(const char* szPattern, std::vector<std::string>& setModel)
+{
+	GetMPQIndex().enumWildcard(szPattern, setModel);
+}
+
+std::string GetM2BakePath(const std::string& strModel, const std::string& strOutputDir, const char* szExt)
+{
+	std::string strPath = MPQIndex::normalize(strModel.c_str());
+	for (size_t i=0; i<strPath.size(); ++i)
+	{
+		if (strPath[i]=='\\')
+		{
+			strPath[i] = '/';
+		}
+	}
+	size_t uDot = strPath.find_last_of('.');
+	if (uDot!=std::string::npos && strPath.find('/',uDot)==std::string::npos)
+	{
+		strPath.erase(uDot);
+	}
+	strPath.append(szExt);
+	if (strOutputDir.empty())
+	{
+		return strPath;
+	}
+	char cLast = strOutputDir[strOutputDir.size()-1];
+	return strOutputDir + (cLast=='/'||cLast=='\\' ? "" : "/") + strPath;
+}
+
+// Creates the directories on the way to a file, the ones already there are fine.
+static void makeParentDirs(const std::string& strPath)
+{
+	for (size_t i=1; i<strPath.size(); ++i)
+	{
+		if (strPath[i]=='/'||strPath[i]=='\\')
+		{
+			std::string strDir(strPath, 0, i);
+#ifdef _WIN32
+			_mkdir(strDir.c_str());
+#else
+			mkdir(strDir.c_str(), 0755);
+#endif
+		}
+	}
+}
+
+static bool fileWritten(const std::string& strPath)
+{
+	FILE* f = fopen(strPath.c_str(), "rb");
+	if (f==NULL)
+	{
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	long nSize = ftell(f);
+	fclose(f);
+	return nSize>0;
+}
+
+// InitSkins looks the model up by file name and selects its skins by model id. The records,
+// the index and the column are made here on the calling thread, the workers only read them.
+static void prepareDatabases()
+{
+	if (!modeldb.isOpen())
+	{
+		modeldb.open(true);
+	}
+	if (!skindb.isOpen())
+	{
+		skindb.open(true);
+	}
+	if (modeldb.isOpen())
+	{
+		modeldb.prepareFind(CreatureModelDB::Filename, true);
+	}
+	if (skindb.isOpen())
+	{
+		skindb.getColumn(CreatureSkinDB::ModelID);
+	}
+}
+
+class CM2BakeTask: public iThreadTask
+{
+public:
+	CM2BakeTask(const std::vector<std::string>& setModel, const std::string& strOutputDir, const char* szExt, std::vector<M2BakeResult>& setResult)
+		:m_setModel(setModel)
+		,m_strOutputDir(strOutputDir)
+		,m_szExt(szExt)
+		,m_setResult(setResult)
+	{
+	}
+
+	virtual void runTask(size_t uIndex)
+	{
+		M2BakeResult& result = m_setResult[uIndex];
+		result.strModel = m_setModel[uIndex];
+		result.strOutput = GetM2BakePath(result.strModel, m_strOutputDir, m_szExt);
+		result.bOk = false;
+
+		// LoadFile deletes the model when it fails, with no cache size it copies every sequence
+		CM2Model* pModel = new CM2Model;
+		pModel->SetSequenceCacheSize(0);
+		if (!pModel->LoadFile(result.strModel))
+		{
+			return;
+		}
+		// a random phase from frand(), the engine picks its own per instance
+		for (size_t i=0; i<pModel->m_setParticleEmitter.size(); ++i)
+		{
+			pModel->m_setParticleEmitter[i].tofs = 0.0f;
+		}
+		makeParentDirs(result.strOutput);
+		// the file of an earlier run would pass for this one's
+		remove(result.strOutput.c_str());
+		pModel->SaveFile(result.strOutput.c_str());
+		delete pModel;
+		result.bOk = fileWritten(result.strOutput);
+	}
+private:
+	const std::vector<std::string>&	m_setModel;
+	const std::string&				m_strOutputDir;
+	const char*						m_szExt;
+	std::vector<M2BakeResult>&		m_setResult;
+};
+
+size_t BakeM2Models(const std::vector<std::string>& setModel, const std::string& strOutputDir,
+	std::vector<M2BakeResult>& setResult, const char* szExt)
+{
+	prepareDatabases();
+	setResult.clear();
+	setResult.resize(setModel.size());
+	CM2BakeTask task(setModel, strOutputDir, szExt, setResult);
+	CThreadPool::getShared().run(task, setModel.size());
+
+	size_t uBaked = 0;
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		if (setResult[i].bOk)
+		{
+			uBaked++;
+		}
+	}
+	return uBaked;
+}
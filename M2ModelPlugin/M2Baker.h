@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// One model of a BakeM2Models call.
+struct M2BakeResult
+{
+	std::string	strModel;	// archive path
+	std::string	strOutput;	// the baked file
+	bool		bOk;		// loaded and written
+};
+
+// Models of the open archives matching the pattern, '*' matches any run of characters and '?'
+// any one, "creature\*\*.m2". Sorted, see MPQIndex::enumWildcard.
+void FindM2Models(const char* szPattern, std::vector<std::string>& setModel);
+
+// Output file of a model, its lower case archive path under strOutputDir with szExt in place
+// of its extension.
+std::string GetM2BakePath(const std::string& strModel, const std::string& strOutputDir, const char* szExt);
+
+// Loads each model with all its sequences and saves it in the engine's model format, the models
+// in parallel on the shared thread pool. The databases the loader reads are prepared first and
+// shared by the workers. The output of a model only depends on the model and the databases,
+// and the results are in the order of setModel. Returns the number of models baked.
+size_t BakeM2Models(const std::vector<std::string>& setModel, const std::string& strOutputDir,
+	std::vector<M2BakeResult>& setResult, const char* szExt = ".sm");
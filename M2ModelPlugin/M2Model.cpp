@@ -1,6 +1,7 @@
 #include "M2Model.h"
 #include "database.h"
 #include "RenderSystem.h"
+#include <float.h>
 
 #define NEW_POINTER_AT_BUFFER(_name, _type, _address)	_type *##_name = (_type##*)(f.getBuffer() + _address##.offset);
 #define NEW_MEMCPY_FROM_BUFFER(_pointer, _type, _address) _pointer = new _type[ _address##.count ]; memcpy(_pointer, f.getBuffer() + _address##.offset, _address##.count*sizeof(_type));
@@ -24,8 +25,148 @@ inline Quaternion fixCoordSystemQuat(Quaternion v)
 	//return Quaternion(v.y, -v.z, v.x, v.w);
 }
 
+// Key indices [begin, end) of an animated track.
+struct M2KeyRun
+{
+	uint32 begin, end;
+	bool operator<(const M2KeyRun& r) const { return begin<r.begin; }
+	bool operator==(const M2KeyRun& r) const { return begin==r.begin && end==r.end; }
+};
+typedef std::vector<M2KeyRun> M2KeyRuns;
+
+// Builds into result the keys of newRuns, one run after the other, from vec holding the keys of
+// oldRuns the same way. Keys vec already has are copied over, only the others are read from
+// the stream at uOffset.
+template <typename FileType, typename Vec>
+bool SpliceKeyRuns(const Vec& vec, Vec& result, const M2KeyRuns& oldRuns, const M2KeyRuns& newRuns,
+	MPQStream& stream, uint32 uOffset, FileType fixfunc(FileType))
+{
+	size_t uCount = 0;
+	for (size_t i=0; i<newRuns.size(); i++)
+	{
+		uCount += newRuns[i].end-newRuns[i].begin;
+	}
+	result.reserve(uCount);
+	std::vector<FileType> buffer;
+	size_t uOld = 0;	// first old run not before the key
+	size_t uOldPos = 0;	// where it starts in vec
+	for (size_t i=0; i<newRuns.size(); i++)
+	{
+		uint32 uKey = newRuns[i].begin;
+		while (uKey<newRuns[i].end)
+		{
+			while (uOld<oldRuns.size() && oldRuns[uOld].end<=uKey)
+			{
+				uOldPos += oldRuns[uOld].end-oldRuns[uOld].begin;
+				uOld++;
+			}
+			uint32 uEnd = newRuns[i].end;
+			if (uOld<oldRuns.size() && oldRuns[uOld].begin<=uKey)
+			{
+				if (oldRuns[uOld].end<uEnd)
+				{
+					uEnd = oldRuns[uOld].end;
+				}
+				size_t uFrom = uOldPos+uKey-oldRuns[uOld].begin;
+				result.insert(result.end(), vec.begin()+uFrom, vec.begin()+uFrom+(uEnd-uKey));
+			}
+			else
+			{
+				if (uOld<oldRuns.size() && oldRuns[uOld].begin<uEnd)
+				{
+					uEnd = oldRuns[uOld].begin;
+				}
+				buffer.resize(uEnd-uKey);
+				size_t uBytes = buffer.size()*sizeof(FileType);
+				if (stream.read(uOffset+uKey*sizeof(FileType), &buffer[0], uBytes)!=uBytes)
+				{
+					return false;
+				}
+				for (size_t j=0; j<buffer.size(); j++)
+				{
+					result.push_back(fixfunc ? fixfunc(buffer[j]) : buffer[j]);
+				}
+			}
+			uKey = uEnd;
+		}
+	}
+	return true;
+}
+
+// Key 0 is always kept, so outside of the loaded sequences the track still has a value.
+template <typename T>
+class CM2AnimTrackT: public CM2AnimTrack
+{
+public:
+	CM2AnimTrackT(Animated<T>& animated, const AnimationBlock& block, T fixfunc(T))
+		:m_pAnimated(&animated)
+		,m_Block(block)
+		,m_FixFunc(fixfunc)
+	{
+	}
+
+	// The keys of the sequences and key 0, in order, overlapping runs merged.
+	M2KeyRuns getRuns(const std::vector<int>& setSeq) const
+	{
+		M2KeyRuns setRun;
+		M2KeyRun first = {0, 1};
+		setRun.push_back(first);
+		for (size_t i=0; i<setSeq.size(); i++)
+		{
+			if ((size_t)setSeq[i]<m_setSeqRun.size() && m_setSeqRun[setSeq[i]].begin<m_setSeqRun[setSeq[i]].end)
+			{
+				setRun.push_back(m_setSeqRun[setSeq[i]]);
+			}
+		}
+		std::sort(setRun.begin(), setRun.end());
+		size_t uMerged = 0;
+		for (size_t i=1; i<setRun.size(); i++)
+		{
+			if (setRun[i].begin<=setRun[uMerged].end)
+			{
+				if (setRun[i].end>setRun[uMerged].end)
+				{
+					setRun[uMerged].end = setRun[i].end;
+				}
+			}
+			else
+			{
+				setRun[++uMerged] = setRun[i];
+			}
+		}
+		setRun.resize(uMerged+1);
+		return setRun;
+	}
+
+	virtual bool setSequences(MPQStream& stream, const std::vector<int>& setSeq)
+	{
+		M2KeyRuns setRun = getRuns(setSeq);
+		if (setRun==m_setResident)
+		{
+			return true;
+		}
+		Animated<T> loaded;
+		if (!SpliceKeyRuns(m_pAnimated->m_KeyTimes, loaded.m_KeyTimes, m_setResident, setRun, stream, m_Block.aTimes.offset, (uint32(*)(uint32))NULL)
+			|| !SpliceKeyRuns(m_pAnimated->m_KeyData, loaded.m_KeyData, m_setResident, setRun, stream, m_Block.aKeys.offset, m_FixFunc))
+		{
+			return false;
+		}
+		m_pAnimated->m_KeyTimes.swap(loaded.m_KeyTimes);
+		m_pAnimated->m_KeyData.swap(loaded.m_KeyData);
+		m_setResident.swap(setRun);
+		return true;
+	}
+
+	M2KeyRuns		m_setSeqRun;	// keys of each sequence, empty if it has none
+	M2KeyRuns		m_setResident;	// keys in the track, in order
+private:
+	Animated<T>*	m_pAnimated;
+	AnimationBlock	m_Block;
+	T				(*m_FixFunc)(T);
+};
+
 template <typename T >
-inline void AnimatedInit(Animated<T>& animated, MPQFile& f, AnimationBlock &b, int *gs)
+inline void AnimatedInit(Animated<T>& animated, MPQFile& f, AnimationBlock &b, int *gs, M2AnimTrackList* tracks, T fixfunc(T) = NULL)
 {
 	animated.globals = gs;
 	animated.type = b.type;
@@ -56,26 +197,56 @@ inline void AnimatedInit(Animated<T>& animated, MPQFile& f, AnimationBlock &b, i
 		// times
 		assert(b.aTimes.count == b.aKeys.count);
 		uint32 *ptimes = (uint32*)(f.getBuffer() + b.aTimes.offset);
-		for (size_t i=0; i<b.aTimes.count; i++)
-		{
-			animated.m_KeyTimes.push_back(ptimes[i]);
-		}
 
 		// keyframes
 		assert((T*)(b.aKeys.offset));
 		T *keys = (T*)(f.getBuffer() + b.aKeys.offset);
 
-		for (size_t i=0; i<b.aKeys.count; i++) 
+		if (tracks && animated.seq==-1 && b.aRanges.count > 0)
 		{
-			animated.m_KeyData.push_back(keys[i]);
+			// the sequences are read as they are played, see CM2Model::LoadSequence
+			CM2AnimTrackT<T>* pTrack = new CM2AnimTrackT<T>(animated, b, fixfunc);
+			uint32 *pRanges = (uint32*)(f.getBuffer() + b.aRanges.offset);
+			pTrack->m_setSeqRun.resize(b.aRanges.count);
+			for (size_t i=0; i<b.aRanges.count; i++)
+			{
+				// the ranges are inclusive
+				M2KeyRun& run = pTrack->m_setSeqRun[i];
+				run.begin = run.end = 0;
+				if (pRanges[i*2]<=pRanges[i*2+1] && pRanges[i*2+1]<b.aKeys.count)
+				{
+					run.begin = pRanges[i*2];
+					run.end = pRanges[i*2+1]+1;
+				}
+			}
+			// the first sequence, which LoadFile keeps, while the file is read anyway
+			pTrack->m_setResident = pTrack->getRuns(std::vector<int>(1, 0));
+			tracks->push_back(pTrack);
+			for (size_t r=0; r<pTrack->m_setResident.size(); r++)
+			{
+				for (uint32 i=pTrack->m_setResident[r].begin; i<pTrack->m_setResident[r].end; i++)
+				{
+					animated.m_KeyTimes.push_back(ptimes[i]);
+					animated.m_KeyData.push_back(fixfunc ? fixfunc(keys[i]) : keys[i]);
+				}
+			}
+		}
+		else
+		{
+			for (size_t i=0; i<b.aTimes.count; i++)
+			{
+				animated.m_KeyTimes.push_back(ptimes[i]);
+			}
+			for (size_t i=0; i<b.aKeys.count; i++) 
+			{
+				animated.m_KeyData.push_back(fixfunc ? fixfunc(keys[i]) : keys[i]);
+			}
 		}
-
-		if (animated.m_KeyData.size()==0) 
-			animated.m_KeyData.push_back(T());
 	}
 }
 
 CM2Model::CM2Model()
+	:m_uSequenceCacheSize(8)
 {
 	for (int i=0; i<32; i++)
 	{
@@ -87,6 +258,10 @@ CM2Model::CM2Model()
 
 CM2Model::~CM2Model()
 {
+	for (size_t i=0; i<m_setAnimTrack.size(); i++)
+	{
+		delete m_setAnimTrack[i];
+	}
 }
 
 void CM2Model::LoadVertices(MPQFile &f, const Lump& lump)
@@ -161,6 +336,14 @@ bool CM2Model::LoadFile(const std::string& strFilename)
 	// mpq ļر
 	f.close();
 
+	// InitAnimated copied the keys of the first sequence, usually the stand loop, or without a
+	// cache size of all of them
+	m_strFilename = strTempname.c_str();
+	if (m_uSequenceCacheSize>0 && !m_AnimList.empty())
+	{
+		m_setSequence.assign(1, 0);
+	}
+
 	//D3DXCreateEffectFromFile(GetRenderSystem().GetDevice(),L"model.fx", NULL, NULL, dwShaderFlags, 
 
 	return true;
@@ -181,31 +364,32 @@ void CM2Model::InitSkins(const std::string& strFilename)
 
 	if (1)
 	{
-		try
+		CreatureModelDB::OptionalRecord rec = modeldb.getByFilename(fn);
+		if (rec.isValid())
 		{
-			CreatureModelDB::Record rec = modeldb.getByFilename(fn);
 			// for character models, don't use skins
-			if (rec.getUInt(CreatureModelDB::Type) != 4) {
+			if (rec->getUInt(CreatureModelDB::Type) != 4) {
 				//TextureSet skins;
-				unsigned int modelid = rec.getUInt(CreatureModelDB::ModelID);
+				unsigned int modelid = rec->getUInt(CreatureModelDB::ModelID);
 
 				std::set<TextureGroup> skins;
-				for (CreatureSkinDB::Iterator it = skindb.begin();  it!=skindb.end();  ++it)
+				const DBCFile::Predicate where = DBCFile::equal(CreatureSkinDB::ModelID, modelid);
+				DBCFile::RowSet rows;
+				skindb.select(&where, 1, rows);
+				for (int row = DBCFile::nextRow(rows, 0); row != -1; row = DBCFile::nextRow(rows, row+1))
 				{
-					if (it->getUInt(CreatureSkinDB::ModelID) == modelid)
+					CreatureSkinDB::Record skinRec = skindb.getRecord(row);
+					TextureGroup grp;
+					for (int i=0; i<TextureGroup::num; i++)
 					{
-						TextureGroup grp;
-						for (int i=0; i<TextureGroup::num; i++)
-						{
-							//const char *skin = it->getString(CreatureSkinDB::Skin + i);
-							std::string skin(it->getString(CreatureSkinDB::Skin + i));
-							grp.tex[i] = skin;
-						}
-						grp.base = 11;
-						grp.count = 3;
-						if (grp.tex[0].length() > 0) 
-							skins.insert(grp);
+						//const char *skin = skinRec.getString(CreatureSkinDB::Skin + i);
+						std::string skin(skinRec.getString(CreatureSkinDB::Skin + i));
+						grp.tex[i] = skin;
 					}
+					grp.base = 11;
+					grp.count = 3;
+					if (grp.tex[0].length() > 0) 
+						skins.insert(grp);
 				}
 
 				// Hard coded skin additions - missing from DBC ?
@@ -397,7 +581,7 @@ void CM2Model::InitSkins(const std::string& strFilename)
 					Skins.push_back(*it);
 				}
 			}
-		}catch (CreatureModelDB::NotFound) {
+		} else {
 			// Try hardcoding some fixes for missing model info from the DBC
 			if(fn == "Creature\\Dwarfmalewarriorlight\\dwarfmalewarriorlight_ghost.mdx") {
 				TextureGroup grp;
@@ -525,6 +709,35 @@ void CM2Model::LoadBoundIndex(MPQFile &f, const Lump& lump)
 	}
 }
 
+void CM2Model::BuildBoundBVH()
+{
+	m_BoundBVH.clear();
+	const std::vector<Vec3D>& setPos = m_BoundMesh.pos;
+	const std::vector<uint16>& setIndex = m_BoundMesh.indices;
+	for (size_t i=0; i+2<setIndex.size(); i+=3)
+	{
+		if (setIndex[i]<setPos.size()&&setIndex[i+1]<setPos.size()&&setIndex[i+2]<setPos.size())
+		{
+			m_BoundBVH.addTriangle(&setPos[setIndex[i]].x, &setPos[setIndex[i+1]].x, &setPos[setIndex[i+2]].x, (unsigned int)(i/3));
+		}
+	}
+	m_BoundBVH.build();
+}
+
+bool CM2Model::Pick(const Vec3D& vRayPos, const Vec3D& vRayDir, Vec3D* pPos) const
+{
+	CTriangleBVH::RayHit hit;
+	if (!m_BoundBVH.intersectRay(&vRayPos.x, &vRayDir.x, FLT_MAX, hit))
+	{
+		return false;
+	}
+	if (pPos)
+	{
+		*pPos = vRayDir*hit.fDist+vRayPos;
+	}
+	return true;
+}
+
 void CM2Model::LoadTexChannel(MPQFile &f, const Lump& lump)
 {
 	/*if (lump.count)
@@ -554,6 +767,7 @@ void CM2Model::InitCommon(MPQFile &f)
 	// Bounds
 	LoadBoundPos(f, m_M2Header.lumps[M2_LUMP_BOUND_VERTICES]);
 	LoadBoundIndex(f, m_M2Header.lumps[M2_LUMP_BOUND_INDICES]);
+	BuildBoundBVH();
 	LoadTexChannel(f, m_M2Header.lumps[M2_LUMP_TEXTURES]);
 	// replacable textures - it seems to be better to get this info from the texture types
 	//if (m_M2Header.lumps[M2_LUMP_TexReplaces.count) {
@@ -739,7 +953,7 @@ void CM2Model::LoadSkeleton(MPQFile &f, const Lump& lump)
 		for (size_t i=0; i<lump.count; i++)
 		{
 			//if (i==0) mb[i].rotation.aRanges.offset = 1.0f;
-			mb[i].Init(f, m_Skeleton.m_BoneAnims[i], globalSequences);
+			mb[i].Init(f, m_Skeleton.m_BoneAnims[i], globalSequences, GetSequenceTracks());
 		}
 	}
 }
@@ -752,7 +966,7 @@ void CM2Model::LoadColorAnim(MPQFile &f, const Lump& lump)
 		NEW_POINTER_AT_BUFFER(colorDefs, ModelColorDef, lump);
 		for (size_t i=0; i<lump.count; i++)
 		{
-			colorDefs[i].Init(f, m_ColorAnims[i], globalSequences);
+			colorDefs[i].Init(f, m_ColorAnims[i], globalSequences, GetSequenceTracks());
 		}
 	}
 }
@@ -765,7 +979,7 @@ void CM2Model::LoadTransAnim(MPQFile &f, const Lump& lump)
 		NEW_POINTER_AT_BUFFER(trDefs, ModelTransDef, lump);
 		for (size_t i=0; i<lump.count; i++)
 		{
-			trDefs[i].Init(f, m_TransAnims[i], globalSequences);
+			trDefs[i].Init(f, m_TransAnims[i], globalSequences, GetSequenceTracks());
 		}
 	}
 }
@@ -778,7 +992,7 @@ void CM2Model::LoadTexAnim(MPQFile &f, const Lump& lump)
 		NEW_POINTER_AT_BUFFER(ta, ModelTexAnimDef, lump);
 		for (size_t i=0; i<lump.count; i++)
 		{
-			ta[i].Init(f, m_TexAnims[i], globalSequences);
+			ta[i].Init(f, m_TexAnims[i], globalSequences, GetSequenceTracks());
 		}
 	}
 }
@@ -791,7 +1005,7 @@ void CM2Model::LoadParticleEmitter(MPQFile &f, const Lump& lump)
 		m_setParticleEmitter.resize(lump.count);
 		for (size_t i = 0; i <lump.count; i++)
 		{
-			pdefs[i].Init(f, m_setParticleEmitter[i], globalSequences);
+			pdefs[i].Init(f, m_setParticleEmitter[i], globalSequences, GetSequenceTracks());
 		}
 	}
 }
@@ -804,7 +1018,7 @@ void CM2Model::LoadRibbonEmitter(MPQFile &f, const Lump& lump)
 		//ribbons = new RibbonEmitter[lump.count];
 		//for (size_t i=0; i<lump.count; i++) {
 		//	ribbons[i].model = this;
-		//	ribbons[i].Init(f, rdefs[i], globalSequences);
+		//	ribbons[i].Init(f, rdefs[i], globalSequences, GetSequenceTracks());
 		//}
 	}
 }
@@ -814,7 +1028,7 @@ void CM2Model::LoadCamera(MPQFile &f, const Lump& lump)
 	if (lump.count)
 	{
 		NEW_POINTER_AT_BUFFER(camDefs, ModelCameraDef, lump);
-		camDefs[0].Init(f, m_Camera, globalSequences);
+		camDefs[0].Init(f, m_Camera, globalSequences, GetSequenceTracks());
 	}
 }
 
@@ -826,7 +1040,7 @@ void CM2Model::LoadLightAnim(MPQFile &f, const Lump& lump)
 		NEW_POINTER_AT_BUFFER(lDefs, ModelLightDef, lump);
 		for (uint32 i = 0; i < m_LightAnims.size(); i++)
 		{
-			lDefs[i].Init(f, m_LightAnims[i], globalSequences);
+			lDefs[i].Init(f, m_LightAnims[i], globalSequences, GetSequenceTracks());
 		}
 	}
 }
@@ -861,7 +1075,79 @@ void CM2Model::InitAnimated(MPQFile &f)
 	LoadAnimAtion(f, m_M2Header.lumps[M2_LUMP_ANIM_ATIONS]);
 }
 
-void ModelCameraDef::Init(MPQFile &f, ModelCamera & modelCamera, int *global)
+bool CM2Model::LoadSequence(size_t uAnim)
+{
+	if (uAnim>=m_AnimList.size())
+	{
+		return false;
+	}
+	std::vector<int>::iterator it = std::find(m_setSequence.begin(), m_setSequence.end(), (int)uAnim);
+	if (it!=m_setSequence.end())
+	{
+		// already loaded, now the most recently used
+		m_setSequence.erase(it);
+		m_setSequence.insert(m_setSequence.begin(), (int)uAnim);
+		return true;
+	}
+	std::vector<int> setOld(m_setSequence);
+	m_setSequence.insert(m_setSequence.begin(), (int)uAnim);
+	if (m_uSequenceCacheSize>0 && m_setSequence.size()>m_uSequenceCacheSize)
+	{
+		m_setSequence.resize(m_uSequenceCacheSize);
+	}
+	if (!ReloadSequences())
+	{
+		// back to the old sequences, the tracks that did load it read the evicted one again
+		m_setSequence.swap(setOld);
+		ReloadSequences();
+		return false;
+	}
+	return true;
+}
+
+bool CM2Model::LoadAllSequences()
+{
+	m_setSequence.clear();
+	for (size_t i=0; i<m_AnimList.size(); i++)
+	{
+		m_setSequence.push_back((int)i);
+	}
+	m_uSequenceCacheSize = 0;
+	return ReloadSequences();
+}
+
+void CM2Model::SetSequenceCacheSize(size_t uSize)
+{
+	m_uSequenceCacheSize = uSize;
+	if (m_uSequenceCacheSize>0 && m_setSequence.size()>m_uSequenceCacheSize)
+	{
+		m_setSequence.resize(m_uSequenceCacheSize);
+		ReloadSequences();
+	}
+}
+
+bool CM2Model::ReloadSequences()
+{
+	if (m_setAnimTrack.empty())
+	{
+		return true;
+	}
+	MPQStream stream(m_strFilename.c_str());
+	if (!stream.isOpen())
+	{
+		return false;
+	}
+	std::vector<int> setSeq(m_setSequence);
+	std::sort(setSeq.begin(), setSeq.end());
+	bool bLoaded = true;
+	for (size_t i=0; i<m_setAnimTrack.size(); i++)
+	{
+		bLoaded = m_setAnimTrack[i]->setSequences(stream, setSeq) && bLoaded;
+	}
+	return bLoaded;
+}
+
+void ModelCameraDef::Init(MPQFile &f, ModelCamera & modelCamera, int *global, M2AnimTrackList* tracks)
 {
 	modelCamera.ok = true;
 	modelCamera.nearclip = nearclip;
@@ -870,55 +1156,50 @@ void ModelCameraDef::Init(MPQFile &f, ModelCamera & modelCamera, int *global)
 	modelCamera.pos = fixCoordSystem(pos);
 	modelCamera.target = fixCoordSystem(target);
 
-	AnimatedInit(modelCamera.tPos,		f, transPos, global);
-	AnimatedInit(modelCamera.tTarget,	f, transTarget, global);
-	AnimatedInit(modelCamera.rot,		f, rot, global);
-	modelCamera.tPos.fix(fixCoordSystem);
-	modelCamera.tTarget.fix(fixCoordSystem);
+	AnimatedInit(modelCamera.tPos,		f, transPos, global, tracks, fixCoordSystem);
+	AnimatedInit(modelCamera.tTarget,	f, transTarget, global, tracks, fixCoordSystem);
+	AnimatedInit(modelCamera.rot,		f, rot, global, tracks);
 }
 
-void ModelTexAnimDef::Init(MPQFile &f, TexAnim& texAnim, int *global)
+void ModelTexAnimDef::Init(MPQFile &f, TexAnim& texAnim, int *global, M2AnimTrackList* tracks)
 {//unsigned char* 
-	AnimatedInit(texAnim.trans,	f, trans, global);
-	AnimatedInit(texAnim.rot,	f, rot, global);
-	AnimatedInit(texAnim.scale,	f, scale, global);
+	AnimatedInit(texAnim.trans,	f, trans, global, tracks);
+	AnimatedInit(texAnim.rot,	f, rot, global, tracks);
+	AnimatedInit(texAnim.scale,	f, scale, global, tracks);
 }
 
-void ModelBoneDef::Init(MPQFile &f, BoneAnim &boneAnim, int *global)
+void ModelBoneDef::Init(MPQFile &f, BoneAnim &boneAnim, int *global, M2AnimTrackList* tracks)
 {
 	boneAnim.parent = (uint8)parent;
 	boneAnim.pivot = fixCoordSystem(pivot);
 	boneAnim.billboard = (flags & 8) != 0;
 	//billboard = false;
-	AnimatedInit(boneAnim.trans,	f, translation, global);
-	AnimatedInit(boneAnim.rot,	f, rotation, global);
-	AnimatedInit(boneAnim.scale,	f, scaling, global);
-	boneAnim.trans.fix(fixCoordSystem);
-	boneAnim.rot.fix(fixCoordSystemQuat);
-	boneAnim.scale.fix(fixCoordSystem2);
+	AnimatedInit(boneAnim.trans,	f, translation, global, tracks, fixCoordSystem);
+	AnimatedInit(boneAnim.rot,	f, rotation, global, tracks, fixCoordSystemQuat);
+	AnimatedInit(boneAnim.scale,	f, scaling, global, tracks, fixCoordSystem2);
 }
 
-void ModelColorDef::Init(MPQFile &f, ColorAnim &colorAnim, int *global)
+void ModelColorDef::Init(MPQFile &f, ColorAnim &colorAnim, int *global, M2AnimTrackList* tracks)
 {
-	AnimatedInit(colorAnim.color, f, color, global);
-	AnimatedInit(colorAnim.opacity, f, opacity, global);
+	AnimatedInit(colorAnim.color, f, color, global, tracks);
+	AnimatedInit(colorAnim.opacity, f, opacity, global, tracks);
 }
 
-void ModelTransDef::Init(MPQFile &f, TransAnim& transAnim, int *global)
+void ModelTransDef::Init(MPQFile &f, TransAnim& transAnim, int *global, M2AnimTrackList* tracks)
 {
-	AnimatedInit(transAnim.trans, f, trans, global);
+	AnimatedInit(transAnim.trans, f, trans, global, tracks);
 }
 
-void ModelLightDef::Init(MPQFile &f, LightAnim &lightAnim, int *global)
+void ModelLightDef::Init(MPQFile &f, LightAnim &lightAnim, int *global, M2AnimTrackList* tracks)
 {
 	lightAnim.tpos = lightAnim.pos = fixCoordSystem(pos);
 	lightAnim.tdir = lightAnim.dir = Vec3D(0,1,0); // no idea
 	lightAnim.type = type;
 	lightAnim.parent = bone;
-	AnimatedInit(lightAnim.ambColor,		f,ambColor, global);
-	AnimatedInit(lightAnim.ambIntensity,	f,ambIntensity, global);
-	AnimatedInit(lightAnim.diffColor,		f,color, global);
-	AnimatedInit(lightAnim.diffIntensity,	f,intensity, global);
+	AnimatedInit(lightAnim.ambColor,		f,ambColor, global, tracks);
+	AnimatedInit(lightAnim.ambIntensity,	f,ambIntensity, global, tracks);
+	AnimatedInit(lightAnim.diffColor,		f,color, global, tracks);
+	AnimatedInit(lightAnim.diffIntensity,	f,intensity, global, tracks);
 }
 
 void ModelAttachmentDef::Init(MPQFile &f, ModelAttachment &attachment, int *global)
@@ -929,19 +1210,19 @@ void ModelAttachmentDef::Init(MPQFile &f, ModelAttachment &attachment, int *glob
 }
 
 
-void ModelParticleEmitterDef::Init(MPQFile &f, CParticleEmitter &particleEmitter, int *globals)
+void ModelParticleEmitterDef::Init(MPQFile &f, CParticleEmitter &particleEmitter, int *globals, M2AnimTrackList* tracks)
 {
-	AnimatedInit(particleEmitter.m_Speed,			f, params[0], globals);
-	AnimatedInit(particleEmitter.m_Variation,		f, params[1], globals);
-	AnimatedInit(particleEmitter.m_Spread,			f, params[2], globals);
-	AnimatedInit(particleEmitter.m_Lat,				f, params[3], globals);
-	AnimatedInit(particleEmitter.m_Gravity,			f, params[4], globals);
-	AnimatedInit(particleEmitter.m_Lifespan,		f, params[5], globals);
-	AnimatedInit(particleEmitter.m_Rate,			f, params[6], globals);
-	AnimatedInit(particleEmitter.m_Areal,			f, params[7], globals);
-	AnimatedInit(particleEmitter.m_Areaw,			f, params[8], globals);
-	AnimatedInit(particleEmitter.m_Deacceleration,	f, params[9], globals);
-	AnimatedInit(particleEmitter.m_Enabled,			f, en, globals);
+	AnimatedInit(particleEmitter.m_Speed,			f, params[0], globals, tracks);
+	AnimatedInit(particleEmitter.m_Variation,		f, params[1], globals, tracks);
+	AnimatedInit(particleEmitter.m_Spread,			f, params[2], globals, tracks);
+	AnimatedInit(particleEmitter.m_Lat,				f, params[3], globals, tracks);
+	AnimatedInit(particleEmitter.m_Gravity,			f, params[4], globals, tracks);
+	AnimatedInit(particleEmitter.m_Lifespan,		f, params[5], globals, tracks);
+	AnimatedInit(particleEmitter.m_Rate,			f, params[6], globals, tracks);
+	AnimatedInit(particleEmitter.m_Areal,			f, params[7], globals, tracks);
+	AnimatedInit(particleEmitter.m_Areaw,			f, params[8], globals, tracks);
+	AnimatedInit(particleEmitter.m_Deacceleration,	f, params[9], globals, tracks);
+	AnimatedInit(particleEmitter.m_Enabled,			f, en, globals, tracks);
 
 	for (size_t i=0; i<3; i++) {
 		particleEmitter.m_Colors[i] = *(Color32*)&p.colors[i];
@@ -1036,13 +1317,13 @@ void ModelParticleEmitterDef::Init(MPQFile &f, CParticleEmitter &particleEmitter
 	}
 }
 
-void ModelRibbonEmitterDef::Init(MPQFile &f, RibbonEmitter &ribbonEmitter, int *globals)
+void ModelRibbonEmitterDef::Init(MPQFile &f, RibbonEmitter &ribbonEmitter, int *globals, M2AnimTrackList* tracks)
 {
 	//
-	AnimatedInit(ribbonEmitter.color,	f, color, globals);
-	AnimatedInit(ribbonEmitter.opacity,	f, opacity, globals);
-	AnimatedInit(ribbonEmitter.above,	f, above, globals);
-	AnimatedInit(ribbonEmitter.below,	f, below, globals);
+	AnimatedInit(ribbonEmitter.color,	f, color, globals, tracks);
+	AnimatedInit(ribbonEmitter.opacity,	f, opacity, globals, tracks);
+	AnimatedInit(ribbonEmitter.above,	f, above, globals, tracks);
+	AnimatedInit(ribbonEmitter.below,	f, below, globals, tracks);
 
 	//gfhfghfghfghfghfg//m_pParentBone = model->bones + bone;
 	int *texlist = (int*)(f.getBuffer() + aTextures.offset);
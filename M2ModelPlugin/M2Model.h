@@ -1,6 +1,7 @@
 #pragma once
 #include "ModelData.h"
-#include "mpq/mpq_libmpq.h"
+#include "../MPQFilePlugin/mpq_libmpq.h"
+#include "../Common/TriangleBVH.h"
 
 struct Lump //addressing
 {
@@ -43,6 +44,18 @@ struct AnimationBlock {
 	Lump aKeys;
 };
 
+// An animated track whose keys are read per sequence, see CM2Model::LoadSequence. The Init
+// functions get the model's list of them, or NULL when every key is copied at load.
+class CM2AnimTrack
+{
+public:
+	virtual ~CM2AnimTrack() {}
+	// Keeps the keys of the given sequences, sorted, in the track and drops the others.
+	// False if the keys could not be read, the track is left as it was.
+	virtual bool setSequences(MPQStream& stream, const std::vector<int>& setSeq) = 0;
+};
+typedef std::vector<CM2AnimTrack*> M2AnimTrackList;
+
 struct ModelPass
 {
 	// probably the texture units
@@ -160,7 +173,7 @@ struct ModelBoneDef
 	AnimationBlock rotation;
 	AnimationBlock scaling;
 	Vec3D pivot;
-	void Init(MPQFile &f, BoneAnim &boneAnim, int *global);
+	void Init(MPQFile &f, BoneAnim &boneAnim, int *global, M2AnimTrackList* tracks);
 };
 
 // block G - color defs
@@ -168,20 +181,20 @@ struct ModelColorDef
 {
 	AnimationBlock color;
 	AnimationBlock opacity;
-	void Init(MPQFile &f, ColorAnim &colorAnim, int *global);
+	void Init(MPQFile &f, ColorAnim &colorAnim, int *global, M2AnimTrackList* tracks);
 };
 
 // block H - transp defs
 struct ModelTransDef
 {
 	AnimationBlock trans;
-	void Init(MPQFile &f, TransAnim& transAnim, int *global);
+	void Init(MPQFile &f, TransAnim& transAnim, int *global, M2AnimTrackList* tracks);
 };
 
 struct ModelTexAnimDef
 {
 	AnimationBlock trans, rot, scale;
-	void Init(MPQFile &f, TexAnim& texAnim, int *global);
+	void Init(MPQFile &f, TexAnim& texAnim, int *global, M2AnimTrackList* tracks);
 };
 
 struct ModelLightDef
@@ -196,7 +209,7 @@ struct ModelLightDef
 	AnimationBlock attStart;
 	AnimationBlock attEnd;
 	AnimationBlock unk1;
-	void Init(MPQFile &f, LightAnim &lightAnim, int *global);
+	void Init(MPQFile &f, LightAnim &lightAnim, int *global, M2AnimTrackList* tracks);
 };
 
 struct ModelCameraDef
@@ -208,7 +221,7 @@ struct ModelCameraDef
 	AnimationBlock transTarget;
 	Vec3D target;
 	AnimationBlock rot;
-	void Init(MPQFile &f, ModelCamera & modelCamera, int *global);
+	void Init(MPQFile &f, ModelCamera & modelCamera, int *global, M2AnimTrackList* tracks);
 };
 
 struct ModelAttachmentDef
@@ -240,7 +253,7 @@ struct ModelParticleEmitterDef
 	AnimationBlock params[10];
 	ModelParticleParams p;
 	AnimationBlock en;
-	void Init(MPQFile &f, CParticleEmitter &particleEmitter, int *globals);
+	void Init(MPQFile &f, CParticleEmitter &particleEmitter, int *globals, M2AnimTrackList* tracks);
 };
 
 
@@ -260,7 +273,7 @@ struct ModelRibbonEmitterDef
 	int16 s1, s2;
 	AnimationBlock unk1;
 	AnimationBlock unk2;
-	void Init(MPQFile &f, RibbonEmitter &ribbonEmitter, int *globals);
+	void Init(MPQFile &f, RibbonEmitter &ribbonEmitter, int *globals, M2AnimTrackList* tracks);
 };
 
 // ûõ
@@ -423,6 +436,20 @@ public:
 	void InitSkins(const std::string& strFilename);
 	void InitCommon(MPQFile &f);
 	void InitAnimated(MPQFile &f);
+	// over the bound mesh, the triangle ids are their numbers in m_BoundMesh.indices
+	void BuildBoundBVH();
+
+	// LoadFile keeps the keys of sequence 0 only, the player calls LoadSequence before it plays
+	// another one: its keys are read then, the last few played stay loaded and the least
+	// recently used one is dropped past the cache size. Global sequences and tracks without
+	// ranges are loaded whole. A cache size of 0 set before LoadFile copies every key at load
+	// instead, for a caller that needs them all, such as the baker.
+	bool LoadSequence(size_t uAnim);
+	// every sequence, for saving the whole model, and no cache size
+	bool LoadAllSequences();
+	// 0 keeps every sequence, 8 by default
+	void SetSequenceCacheSize(size_t uSize);
+	size_t GetSequenceCacheSize() const { return m_uSequenceCacheSize; }
 	//// 
 	//bool SaveToFile(std::string name);
 
@@ -439,6 +466,21 @@ public:
 	int replaceTextures[32];
 	bool useReplaceTextures[32];
 
+	// picking and collision against the bound mesh
+	CTriangleBVH m_BoundBVH;
+	// The bound mesh hit first by the ray, in model space, through m_BoundBVH. pPos gets the
+	// point hit.
+	bool Pick(const Vec3D& vRayPos, const Vec3D& vRayDir, Vec3D* pPos = NULL) const;
+
 	//// Ƥ TextureGroups
 	//std::vector<TextureGroup> m_skins;
+private:
+	bool ReloadSequences();
+	// the list of the Init functions, NULL for no cache size
+	M2AnimTrackList* GetSequenceTracks() { return m_uSequenceCacheSize>0 ? &m_setAnimTrack : NULL; }
+
+	std::string			m_strFilename;		// the .m2 the keys are read from
+	M2AnimTrackList		m_setAnimTrack;
+	std::vector<int>	m_setSequence;		// loaded sequences, most recently used first
+	size_t				m_uSequenceCacheSize;	// 0 for no limit, every key read at load
 };
\ No newline at end of file
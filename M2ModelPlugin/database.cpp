@@ -1,5 +1,7 @@
 
 #include "database.h"
+#include <ctype.h>
+#include <string.h>
 
 // dbs
 ItemDatabase		items;
@@ -54,15 +56,9 @@ AnimDB::~AnimDB()
 {
 }
 
-AnimDB::Record AnimDB::getByAnimID(unsigned int id)
+AnimDB::OptionalRecord AnimDB::getByAnimID(unsigned int id)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if(i->getUInt(AnimID) == id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(AnimID, id);
 }
 // --
 
@@ -71,132 +67,89 @@ AnimDB::Record AnimDB::getByAnimID(unsigned int id)
 // CHARDB.H
 // HairGeosets
 
-CharHairGeosetsDB::Record CharHairGeosetsDB::getByParams(unsigned int race, unsigned int gender, unsigned int section)
+CharHairGeosetsDB::OptionalRecord CharHairGeosetsDB::getByParams(unsigned int race, unsigned int gender, unsigned int section)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender && i->getUInt(Section)==section)
-			return (*i);
-	}
-	throw NotFound();
+	const size_t fields[] = {Race, Gender, Section};
+	const unsigned int key[] = {race, gender, section};
+	return find(fields, 3, key);
 }
 
 int CharHairGeosetsDB::getGeosetsFor(unsigned int race, unsigned int gender)
 {
-	int n = 0;
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender) {
-			n++;
-		}
-	}
-    return n;
+	const Predicate where[] = {equal(Race, race), equal(Gender, gender)};
+	RowSet rows;
+	select(where, 2, rows);
+	return (int)countRows(rows);
 }
 
 // Sections
 
 int CharSectionsDB::getColorsFor(unsigned int race, unsigned int gender, unsigned int type, unsigned int section, unsigned int npc)
 {
-	int n = 0;
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		// don't allow NPC skins ;(
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender && i->getUInt(Type)==type && i->getUInt(Section)==section && i->getUInt(IsNPC)==npc) {
-			n++;
-		}
-	}
-    return n;
+	// don't allow NPC skins ;(
+	const Predicate where[] = {equal(Race, race), equal(Gender, gender), equal(Type, type), equal(Section, section), equal(IsNPC, npc)};
+	RowSet rows;
+	select(where, 5, rows);
+	return (int)countRows(rows);
 }
 
 int CharSectionsDB::getSectionsFor(unsigned int race, unsigned int gender, unsigned int type, unsigned int color, unsigned int npc)
 {
-	int n = 0;
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender && i->getUInt(Type)==type && i->getUInt(Color)==color && i->getUInt(IsNPC)==npc) {
-			n++;
-		}
-	}
-    return n;
+	const Predicate where[] = {equal(Race, race), equal(Gender, gender), equal(Type, type), equal(Color, color), equal(IsNPC, npc)};
+	RowSet rows;
+	select(where, 5, rows);
+	return (int)countRows(rows);
 }
 
-CharSectionsDB::Record CharSectionsDB::getByParams(unsigned int race, unsigned int gender, unsigned int type, unsigned int section, unsigned int color, unsigned int npc)
+CharSectionsDB::OptionalRecord CharSectionsDB::getByParams(unsigned int race, unsigned int gender, unsigned int type, unsigned int section, unsigned int color, unsigned int npc)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender && i->getUInt(Type)==type && i->getUInt(Section)==section && i->getUInt(Color)==color && i->getUInt(IsNPC)==npc)
-			return (*i);
-	}
-	throw NotFound();
+	const size_t fields[] = {Race, Gender, Type, Section, Color, IsNPC};
+	const unsigned int key[] = {race, gender, type, section, color, npc};
+	return find(fields, 6, key);
 }
 
 // Races
-CharRacesDB::Record CharRacesDB::getByName(std::string name)
+CharRacesDB::OptionalRecord CharRacesDB::getByName(std::string name)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (stricmp(name.c_str(),i->getString(Name)) == 0)
-			return (*i);
-	}
-	throw NotFound();
+	return findString(Name, name.c_str());
 }
 
-CharRacesDB::Record CharRacesDB::getById(unsigned int id)
+CharRacesDB::OptionalRecord CharRacesDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(RaceID)==id) return (*i);
-	}
-	throw NotFound();
+	return find(RaceID, id);
 }
 
 
 // FacialHair
 
-CharFacialHairDB::Record CharFacialHairDB::getByParams(unsigned int race, unsigned int gender, unsigned int style)
+CharFacialHairDB::OptionalRecord CharFacialHairDB::getByParams(unsigned int race, unsigned int gender, unsigned int style)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender && i->getUInt(Style)==style)
-			return (*i);
-	}
-	throw NotFound();
+	const size_t fields[] = {Race, Gender, Style};
+	const unsigned int key[] = {race, gender, style};
+	return find(fields, 3, key);
 }
 
 int CharFacialHairDB::getStylesFor(unsigned int race, unsigned int gender)
 {
-	int n = 0;
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(Race)==race && i->getUInt(Gender)==gender) {
-			n++;
-		}
-	}
-    return n;
+	const Predicate where[] = {equal(Race, race), equal(Gender, gender)};
+	RowSet rows;
+	select(where, 2, rows);
+	return (int)countRows(rows);
 }
 
 
 // Classes
 
-CharClassesDB::Record CharClassesDB::getById(unsigned int id)
+CharClassesDB::OptionalRecord CharClassesDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(ClassID)==id) return (*i);
-	}
-	throw NotFound();
+	return find(ClassID, id);
 }
 
 
 // Head and Helmet display info
-HelmGeosetDB::Record HelmGeosetDB::getById(unsigned int id)
+HelmGeosetDB::OptionalRecord HelmGeosetDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(TypeID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(TypeID, id);
 }
 // --
 
@@ -215,26 +168,14 @@ CreatureModelDB::~CreatureModelDB()
 
 }
 
-CreatureModelDB::Record CreatureModelDB::getByFilename(std::string fn)
+CreatureModelDB::OptionalRecord CreatureModelDB::getByFilename(std::string fn)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		std::string str(i->getString(Filename));
-		if(stricmp(str.c_str(),fn.c_str()) == 0)
-			return (*i);
-	}
-	throw NotFound();
+	return findString(Filename, fn.c_str());
 }
 
-CreatureModelDB::Record CreatureModelDB::getByID(unsigned int id)
+CreatureModelDB::OptionalRecord CreatureModelDB::getByID(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(ModelID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(ModelID, id);
 }
 
 CreatureSkinDB::CreatureSkinDB(): DBCFile("DBFilesClient\\CreatureDisplayInfo.dbc")
@@ -247,26 +188,14 @@ CreatureSkinDB::~CreatureSkinDB()
 
 }
 
-CreatureSkinDB::Record CreatureSkinDB::getByModelID(unsigned int id)
+CreatureSkinDB::OptionalRecord CreatureSkinDB::getByModelID(unsigned int id)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if(i->getUInt(ModelID) == id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(ModelID, id);
 }
 
-CreatureSkinDB::Record CreatureSkinDB::getBySkinID(unsigned int id)
+CreatureSkinDB::OptionalRecord CreatureSkinDB::getBySkinID(unsigned int id)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if(i->getUInt(SkinID) == id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(SkinID, id);
 }
 
 CreatureTypeDB::CreatureTypeDB(): DBCFile("DBFilesClient\\CreatureType.dbc")
@@ -279,15 +208,9 @@ CreatureTypeDB::~CreatureTypeDB()
 
 }
 
-CreatureTypeDB::Record CreatureTypeDB::getByID(unsigned int id)
+CreatureTypeDB::OptionalRecord CreatureTypeDB::getByID(unsigned int id)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if(i->getUInt(ID) == id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(ID, id);
 }
 
 NPCDB::NPCDB(): DBCFile("DBFilesClient\\CreatureDisplayInfoExtra.dbc")
@@ -298,28 +221,14 @@ NPCDB::~NPCDB()
 {
 }
 
-NPCDB::Record NPCDB::getByFilename(std::string fn)
+NPCDB::OptionalRecord NPCDB::getByFilename(std::string fn)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if(i->getString(Filename) == fn) {
-			std::cout << i->getString(Filename) << "\n";
-			return (*i);
-		}
-	}
-	throw NotFound();
+	return findString(Filename, fn.c_str());
 }
 
-NPCDB::Record NPCDB::getByNPCID(unsigned int id)
+NPCDB::OptionalRecord NPCDB::getByNPCID(unsigned int id)
 {
-	/// Brute force search for now
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if(i->getUInt(NPCID) == id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(NPCID, id);
 }
 // --
 
@@ -363,45 +272,30 @@ char* ItemTypeNames[NUM_ITEM_TYPES] = {
 
 // ItemDisplayInfo
 
-ItemDisplayDB::Record ItemDisplayDB::getById(unsigned int id)
+ItemDisplayDB::OptionalRecord ItemDisplayDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(ItemDisplayID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(ItemDisplayID, id);
+}
+
+bool ItemDisplayDB::hasId(unsigned int id)
+{
+	return find(ItemDisplayID, id).isValid();
 }
 
 
-ItemVisualDB::Record ItemVisualDB::getById(unsigned int id)
+ItemVisualDB::OptionalRecord ItemVisualDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(VisualID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(VisualID, id);
 }
 
-ItemVisualEffectDB::Record ItemVisualEffectDB::getById(unsigned int id)
+ItemVisualEffectDB::OptionalRecord ItemVisualEffectDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(EffectID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(EffectID, id);
 }
 
-ItemSetDB::Record ItemSetDB::getById(unsigned int id)
+ItemSetDB::OptionalRecord ItemSetDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(SetID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(SetID, id);
 }
 
 void ItemSetDB::cleanup(ItemDatabase &itemdb)
@@ -426,14 +320,9 @@ bool ItemSetDB::available(unsigned int id)
 }
 
 
-StartOutfitDB::Record StartOutfitDB::getById(unsigned int id)
+StartOutfitDB::OptionalRecord StartOutfitDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(StartOutfitID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(StartOutfitID, id);
 }
 
 
@@ -442,10 +331,46 @@ StartOutfitDB::Record StartOutfitDB::getById(unsigned int id)
 
 ItemRecord::ItemRecord(const char* line)
 {
-	sscanf(line, "%u,%u,%u,%u,%u,%u,%u", &id, &model, &itemclass, &subclass, &type, &sheath, &quality);
-	for (size_t i=strlen(line)-2; i>1; i--) {
-		if (line[i]==',') {
-			name = (line + i + 1);
+	parse(line, line + strlen(line));
+}
+
+ItemRecord::ItemRecord(const char* line, const char* end)
+{
+	parse(line, end);
+}
+
+// Number at p as sscanf's "%u" reads it, a '-' wraps it around, then past the next comma.
+// A field that isn't a number reads as 0.
+static const char* parseField(const char* p, const char* end, int& value)
+{
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+	unsigned int n = 0;
+	while (p < end && *p >= '0' && *p <= '9')
+		n = n*10 + (*p++ - '0');
+	value = (int)(negative ? 0u - n : n);
+	while (p < end && *p != ',')
+		p++;
+	return p < end ? p + 1 : p;
+}
+
+// "id,model,class,subclass,type,sheath,quality,...,name", the name follows the last comma
+void ItemRecord::parse(const char* line, const char* end)
+{
+	const char* p = line;
+	p = parseField(p, end, id);
+	p = parseField(p, end, model);
+	p = parseField(p, end, itemclass);
+	p = parseField(p, end, subclass);
+	p = parseField(p, end, type);
+	p = parseField(p, end, sheath);
+	p = parseField(p, end, quality);
+	for (const char* c = end - 2; c > line + 1; c--) {
+		if (*c == ',') {
+			name.assign(c + 1, end);
 			break;
 		}
 	}
@@ -454,78 +379,97 @@ ItemRecord::ItemRecord(const char* line)
 
 ItemDatabase::ItemDatabase(const char* filename)
 {
-	ItemRecord all("---- None ----", IT_ALL);
-	items.push_back(all);
-	std::ifstream fin(filename);
-	char line[512];
-	while (fin.getline(line,512)) {
-		ItemRecord rec(line);
-		if (rec.type > 0) {
-			items.push_back(rec);
-		}
-	}
-	fin.close();
-	sort(items.begin(), items.end());
+	open(filename);
 }
 
 void ItemDatabase::open(const char* filename)
 {
 	ItemRecord all("---- None ----", IT_ALL);
 	items.push_back(all);
-	std::ifstream fin(filename);
-	char line[512];
-	while (fin.getline(line,512)) {
-		ItemRecord rec(line);
-		if (rec.type > 0) {
-			items.push_back(rec);
+
+	// the whole file in one read, parsed in place line by line
+	std::vector<char> text;
+	FILE* f = fopen(filename, "rb");
+	if (f) {
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		if (size > 0) {
+			text.resize(size);
+			text.resize(fread(&text[0], 1, size, f));
+		}
+		fclose(f);
+	}
+	if (!text.empty()) {
+		const char* p = &text[0];
+		const char* end = p + text.size();
+		items.reserve(items.size() + std::count(p, end, '\n') + 1);
+		while (p < end) {
+			const char* eol = (const char*)memchr(p, '\n', end - p);
+			if (eol == NULL)
+				eol = end;
+			const char* lineEnd = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+			ItemRecord rec(p, lineEnd);
+			if (rec.type > 0) {
+				items.push_back(rec);
+			}
+			p = eol + 1;
 		}
 	}
-	fin.close();
 	sort(items.begin(), items.end());
+	buildLookups();
 }
 
 void ItemDatabase::cleanup(ItemDisplayDB &itemdb)
 {
-	std::set<unsigned int> itemset;
-	for (ItemDisplayDB::Iterator it = itemdb.begin(); it != itemdb.end(); ++it) {
-		itemset.insert(it->getUInt(ItemDisplayDB::ItemDisplayID));
-	}
-	for (unsigned int i=0; i<items.size();) {
-		bool keepItem = (items[i].type==0) || (itemset.find(items[i].model)!=itemset.end());
-		if (keepItem) {
-			itemLookup[items[i].id] = i;
-			i++;
+	// keep the items with a display record, moving them down in one pass
+	size_t kept = 0;
+	for (size_t i=0; i<items.size(); i++) {
+		if (items[i].type==0 || itemdb.hasId(items[i].model)) {
+			if (kept != i)
+				items[kept] = items[i];
+			kept++;
 		}
-		else items.erase(items.begin() + i);
+	}
+	items.erase(items.begin() + kept, items.end());
+	buildLookups();
+}
+
+void ItemDatabase::buildLookups()
+{
+	itemLookup.clear();
+	modelLookup.clear();
+	for (size_t i=0; i<items.size(); i++) {
+		itemLookup[items[i].id] = (int)i;
+		modelLookup.insert(std::make_pair(items[i].model, items[i].id));
 	}
 }
 
 const ItemRecord& ItemDatabase::get(int id)
 {
-    if (itemLookup.find(id)!=itemLookup.end()) 
-		return items[itemLookup[id]];
+	std::map<int, int>::const_iterator it = itemLookup.find(id);
+	if (it != itemLookup.end())
+		return items[it->second];
 	else 
 		return items[0];
 }
 
 int ItemDatabase::getItemNum(int id)
 {
-	for (std::vector<ItemRecord>::iterator it = items.begin(); it != items.end(); ++it)
-		if(it->model == id) return it->id;
+	std::map<int, int>::const_iterator it = modelLookup.find(id);
+	if (it != modelLookup.end())
+		return it->second;
 
 	return 0;
 }
 
 ///////////////////
 
-ItemSubClassDB::Record ItemSubClassDB::getById(int id, int subid)
+ItemSubClassDB::OptionalRecord ItemSubClassDB::getById(int id, int subid)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getInt(ClassID)==id && i->getInt(SubClassID)==subid)
-			return (*i);
-	}
-	throw NotFound();
+	const size_t fields[] = {ClassID, SubClassID};
+	const unsigned int key[] = {(unsigned int)id, (unsigned int)subid};
+	return find(fields, 2, key);
 }
 // ============================================================
 // =============================================================
@@ -557,6 +501,7 @@ NPCDatabase::NPCDatabase(const char* filename)
 	}
 	fin.close();
 	sort(npcs.begin(), npcs.end());
+	buildLookup();
 }
 
 void NPCDatabase::open(const char* filename)
@@ -571,6 +516,7 @@ void NPCDatabase::open(const char* filename)
 	}
 	fin.close();
 	sort(npcs.begin(), npcs.end());
+	buildLookup();
 }
 
 
@@ -579,13 +525,18 @@ const NPCRecord& NPCDatabase::get(int id)
 	return npcs[id];
 }
 
+void NPCDatabase::buildLookup()
+{
+	npcLookup.clear();
+	for (size_t i=npcs.size(); i-->0; )
+		npcLookup[npcs[i].id] = (int)i;	// backwards, so the first of an id wins
+}
+
 const NPCRecord& NPCDatabase::getByID(int id)
 {
-	for (std::vector<NPCRecord>::iterator it=npcs.begin();  it!=npcs.end(); ++it) {
-		if (it->id == id) {
-			return (*it);
-		}
-	}
+	std::map<int, int>::const_iterator it = npcLookup.find(id);
+	if (it != npcLookup.end())
+		return npcs[it->second];
 
 	return npcs[0];
 }
@@ -615,23 +566,13 @@ Column5 is either Spell Type,  or Spell slot or something similar
 */
 
 
-SpellEffectsDB::Record SpellEffectsDB::getByName(const std::string name)
+SpellEffectsDB::OptionalRecord SpellEffectsDB::getByName(const std::string name)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (stricmp(name.c_str(),i->getString(EffectName)) == 0) 
-			return (*i);
-	}
-	throw NotFound();
+	return findString(EffectName, name.c_str());
 }
 
-SpellEffectsDB::Record SpellEffectsDB::getById(unsigned int id)
+SpellEffectsDB::OptionalRecord SpellEffectsDB::getById(unsigned int id)
 {
-	for(Iterator i=begin(); i!=end(); ++i)
-	{
-		if (i->getUInt(ID)==id)
-			return (*i);
-	}
-	throw NotFound();
+	return find(ID, id);
 }
 // --
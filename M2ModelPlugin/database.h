@@ -93,7 +93,7 @@ public:
 	static const size_t AnimID = 0;		// uint
 	static const size_t Name = 1;		// string
 
-	Record getByAnimID(unsigned int id);
+	OptionalRecord getByAnimID(unsigned int id);
 };
 
 // ============
@@ -112,7 +112,7 @@ public:
 	static const size_t Geoset = 4;				// uint
 	static const size_t Flags = 5;				// uint
 
-	Record getByParams(unsigned int race, unsigned int gender, unsigned int section);
+	OptionalRecord getByParams(unsigned int race, unsigned int gender, unsigned int section);
 	int getGeosetsFor(unsigned int race, unsigned int gender);
 };
 
@@ -141,7 +141,7 @@ public:
 	static const size_t HairType = 3;
 	static const size_t UnderwearType = 4;
 
-	Record getByParams(unsigned int race, unsigned int gender, unsigned int type, unsigned int section, unsigned int color, unsigned int npc);
+	OptionalRecord getByParams(unsigned int race, unsigned int gender, unsigned int type, unsigned int section, unsigned int color, unsigned int npc);
 	int getColorsFor(unsigned int race, unsigned int gender, unsigned int type, unsigned int section, unsigned int npc);
 	int getSectionsFor(unsigned int race, unsigned int gender, unsigned int type, unsigned int color, unsigned int npc);
 };
@@ -162,8 +162,8 @@ public:
 	static const size_t GeoType2 = 27;	// string
 	static const size_t GeoType3 = 28;	// string
 
-	Record getByName(std::string name);
-	Record getById(unsigned int id);
+	OptionalRecord getByName(std::string name);
+	OptionalRecord getById(unsigned int id);
 };
 
 
@@ -181,7 +181,7 @@ public:
 	static const size_t Geoset300 = 7;			// uint
 	static const size_t Geoset200 = 8;			// uint
 
-	Record getByParams(unsigned int race, unsigned int gender, unsigned int style);
+	OptionalRecord getByParams(unsigned int race, unsigned int gender, unsigned int style);
 	int getStylesFor(unsigned int race, unsigned int gender);
 
 private:
@@ -201,7 +201,7 @@ public:
 	//static const size_t Name = 4;		// string - french name
 	static const size_t RawName = 14;	// string
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 };
 
 
@@ -219,7 +219,7 @@ public:
 	static const size_t Field4 = 4;		// uint
 	static const size_t Field5 = 5;		// uint
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 };
 
 // ==============================================
@@ -263,7 +263,7 @@ public:
 	static const size_t TexFeet = 21;		// string
 	static const size_t Visuals = 22;		// uint
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 	bool hasId(unsigned int id);
 
 private:
@@ -285,7 +285,7 @@ public:
 	static const size_t Effect4 = 4;	// uint
 	static const size_t Effect5 = 5;	// uint
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 };
 
 class DLL_EXPORT ItemVisualEffectDB: public DBCFile
@@ -298,7 +298,7 @@ public:
 	static const size_t EffectID = 0;	// uint
 	static const size_t Model = 1;		// string
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 };
 
 
@@ -319,7 +319,7 @@ public:
 	static const size_t ItemDisplayIDBase = 66; // 8 * uint
 	static const size_t ItemTypeBase = 74; // 8 * uint
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 	void cleanup(ItemDatabase &itemdb);
 	bool available(unsigned int id);
 };
@@ -341,7 +341,7 @@ public:
 	static const size_t ItemDisplayIDBase = 14; // 12 * uint
 	static const size_t ItemTypeBase = 26; // 12 * uint
 
-	Record getById(unsigned int id);
+	OptionalRecord getById(unsigned int id);
 };
 
 struct ItemRecord {
@@ -349,6 +349,7 @@ struct ItemRecord {
 	int id, itemclass, subclass, type, model, sheath, quality;
 
 	ItemRecord(const char* line);
+	ItemRecord(const char* line, const char* end);
 	ItemRecord(std::string name, int type): id(0), name(name), type(type), itemclass(-1), subclass(-1), model(0), sheath(0), quality(0)
 	{}
 	ItemRecord(const ItemRecord &r): id(r.id), name(r.name), itemclass(r.itemclass), subclass(r.subclass), type(r.type), model(r.model), sheath(r.sheath), quality(r.quality)
@@ -361,6 +362,8 @@ struct ItemRecord {
 		else 
 			return type < r.type;
 	}
+private:
+	void parse(const char* line, const char* end);
 };
 
 class DLL_EXPORT ItemDatabase {
@@ -369,13 +372,16 @@ public:
 	ItemDatabase() { }
 
 	std::vector<ItemRecord> items;
-	std::map<int, int> itemLookup;
+	std::map<int, int> itemLookup;		// id -> index in items
+	std::map<int, int> modelLookup;		// display id -> id of the first item showing it
 
 	void cleanup(ItemDisplayDB &itemdb);
 	void open(const char* filename);
 
 	const ItemRecord& get(int id);
 	int getItemNum(int id);
+private:
+	void buildLookups();
 };
 
 /*
@@ -408,7 +414,7 @@ public:
 	static const size_t Name = 10;		// string
 
 
-	Record getById(int id, int subid);
+	OptionalRecord getById(int id, int subid);
 };
 
 // ============/////////////////=================/////////////////
@@ -445,6 +451,8 @@ public:
 
 	const NPCRecord& get(int id);
 	const NPCRecord& getByID(int id);
+private:
+	void buildLookup();
 };
 
 // =========================================
@@ -462,8 +470,8 @@ public:
 	static const size_t SpellType = 3;		// uint
 	static const size_t UnknownValue2 = 4;	// uint
 
-	Record getById(unsigned int id);
-	Record getByName(std::string name);
+	OptionalRecord getById(unsigned int id);
+	OptionalRecord getByName(std::string name);
 };
 
 
@@ -481,8 +489,8 @@ public:
 	static const size_t Filename = 2;		// string
 
 	// filenames need to end in mdx though ;(
-	Record getByFilename(std::string fn);
-	Record getByID(unsigned int id);
+	OptionalRecord getByFilename(std::string fn);
+	OptionalRecord getByID(unsigned int id);
 private:
 
 };
@@ -502,8 +510,8 @@ public:
 	static const size_t Skin2 = 7;			// string
 	static const size_t Skin3 = 8;			// string
 
-	Record getByModelID(unsigned int id);
-	Record getBySkinID(unsigned int id);
+	OptionalRecord getByModelID(unsigned int id);
+	OptionalRecord getBySkinID(unsigned int id);
 };
 
 class DLL_EXPORT CreatureTypeDB: public DBCFile
@@ -516,7 +524,7 @@ public:
 	static const size_t ID = 0;			// uint
 	static const size_t Name = 1;		// string
 
-	Record getByID(unsigned int id);
+	OptionalRecord getByID(unsigned int id);
 };
 
 class DLL_EXPORT NPCDB: public DBCFile
@@ -546,8 +554,8 @@ public:
 	static const size_t TabardID = 17;		// uint
 	static const size_t Filename = 18;		// string
 
-	Record getByFilename(std::string fn);
-	Record getByNPCID(unsigned int id);
+	OptionalRecord getByFilename(std::string fn);
+	OptionalRecord getByNPCID(unsigned int id);
 
 };
 //#endif
@@ -1,73 +1,347 @@
 #include "dbcfile.h"
-#include "mpq/mpq_libmpq.h"
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "../MPQFilePlugin/mpq_libmpq.h"
+
+static unsigned int hashValues(const unsigned int *values, size_t count)
+{
+	unsigned int hash = 0x811C9DC5;
+	for (size_t i=0; i<count; i++) {
+		hash = (hash ^ values[i]) * 0x9E3779B1;
+		hash ^= hash >> 16;
+	}
+	return hash;
+}
+
+static unsigned int hashString(const char *str)
+{
+	unsigned int hash = 0x811C9DC5;
+	for (; *str; str++)
+		hash = (hash ^ (unsigned char)tolower((unsigned char)*str)) * 0x01000193;
+	return hash ^ (hash >> 16);
+}
+
+// Bits of the 32 values with lo <= value <= lo+span.
+static unsigned int matchWord(const unsigned int *values, unsigned int lo, unsigned int span)
+{
+	unsigned int bits = 0;
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+	// value-lo <= span unsigned, as a signed compare once the sign bits are flipped
+	const __m128i sign = _mm_set1_epi32((int)0x80000000);
+	const __m128i first = _mm_set1_epi32((int)lo);
+	const __m128i last = _mm_set1_epi32((int)(span ^ 0x80000000));
+	for (int i=0; i<32; i+=4)
+	{
+		__m128i v = _mm_xor_si128(_mm_sub_epi32(_mm_loadu_si128((const __m128i*)(values+i)), first), sign);
+		int above = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, last)));
+		bits |= (unsigned int)(~above & 15) << i;
+	}
+#else
+	for (int i=0; i<32; i++)
+	{
+		if (values[i]-lo <= span)
+			bits |= 1u << i;
+	}
+#endif
+	return bits;
+}
 
 DBCFile::DBCFile(const std::string &filename) : filename(filename)
 {
+	recordSize = recordCount = fieldCount = stringSize = 0;
 	data = NULL;
+	stringTable = NULL;
+	payload = NULL;
+	payloadView = false;
+	opened = false;
 }
 
-bool DBCFile::open()
+bool DBCFile::open(bool loadRecords)
 {
-	MPQFile f(filename.c_str(),false);
+	clearIndices();
+	columns.clear();
+	freePayload();
+	opened = false;
+
+	// only the header, a stream decompresses just the first sector of it
+	MPQStream f(filename.c_str());
 
 	// Need some error checking, otherwise an unhandled exception error occurs
 	// if people screw with the data path.
-	if (f.isEof() == true)
+	if (!f.isOpen())
 		return false;
 
-	unsigned char header[4];
-	unsigned int na,nb,es,ss;
-
-	f.read(header,4); // File Header
-
-	if (header[0]!='W' || header[1]!='D' || header[2]!='B' || header[3] != 'C') {
-
-		f.close();
-		data = NULL;
+	unsigned int header[5];
+	if (f.read(0, header, sizeof(header)) != sizeof(header) || memcmp(header, "WDBC", 4) != 0) {
 		//wxLogMessage(_T("Critical Error: An error occured while trying to read the DBCFile %s."), filename.c_str());
 		return false;
 	}
 
-	//assert(header[0]=='W' && header[1]=='D' && header[2]=='B' && header[3] == 'C');
-
-	f.read(&na,4); // Number of records
-	f.read(&nb,4); // Number of fields
-	f.read(&es,4); // Size of a record
-	f.read(&ss,4); // String size
-
-	recordSize = es;
-	recordCount = na;
-	fieldCount = nb;
-	stringSize = ss;
+	recordCount = header[1];
+	fieldCount = header[2];
+	recordSize = header[3];
+	stringSize = header[4];
 	//assert(fieldCount*4 == recordSize);
 	assert(fieldCount*4 >= recordSize);
 
-	data = new unsigned char[recordSize*recordCount+stringSize];
+	if (sizeof(header) + recordSize*recordCount + stringSize > f.getSize())
+		return false;
+	opened = true;
+	if (loadRecords && !load())
+		opened = false;
+	return opened;
+}
+
+// False if the records can't be read, the file is then empty.
+bool DBCFile::load()
+{
+	if (data)
+		return true;
+	assert(opened);
+
+	// The records stay where MPQFile put them: the archive mapping for stored files, its
+	// buffer for compressed ones.
+	static unsigned char empty[4] = {0};
+	MPQFile f(filename.c_str(),false);
+	if (!opened || f.isEof() || f.getSize() < 20 + recordSize*recordCount + stringSize) {
+		recordCount = 0;
+		stringSize = 0;
+		data = stringTable = empty;
+		return false;
+	}
+	payloadView = f.isView();
+	payload = f.release();
+	data = payload + 20;
 	stringTable = data + recordSize*recordCount;
-	f.read(data,recordSize*recordCount+stringSize);
-	f.close();
 	return true;
 }
 
+void DBCFile::freePayload()
+{
+	if (!payloadView)
+		delete [] payload;
+	payload = NULL;
+	payloadView = false;
+	data = NULL;
+	stringTable = NULL;
+}
+
 DBCFile::~DBCFile()
 {
-	delete [] data;
+	clearIndices();
+	freePayload();
 }
 
 DBCFile::Record DBCFile::getRecord(size_t id)
 {
-	assert(data);
+	load();
 	return Record(*this, data + id*recordSize);
 }
 
 DBCFile::Iterator DBCFile::begin()
 {
-	assert(data);
+	load();
 	return Iterator(*this, data);
 }
 DBCFile::Iterator DBCFile::end()
 {
-	assert(data);
+	load();
 	return Iterator(*this, stringTable);
 }
 
+DBCFile::OptionalRecord DBCFile::find(size_t field, unsigned int key)
+{
+	return find(&field, 1, &key);
+}
+
+DBCFile::OptionalRecord DBCFile::find(const size_t *fields, size_t count, const unsigned int *key)
+{
+	load();
+	Index &index = getIndex(fields, count, false);
+	size_t mask = index.slots.size()-1;
+	for (size_t i = hashValues(key, count) & mask; index.slots[i] != -1; i = (i+1) & mask)
+	{
+		unsigned char *row = data + index.slots[i]*recordSize;
+		size_t k = 0;
+		while (k < count && reinterpret_cast<const unsigned int*>(row)[fields[k]] == key[k])
+			k++;
+		if (k == count)
+			return OptionalRecord(*this, row);
+	}
+	return OptionalRecord(*this, NULL);
+}
+
+DBCFile::OptionalRecord DBCFile::findString(size_t field, const char *key)
+{
+	load();
+	Index &index = getIndex(&field, 1, true);
+	size_t mask = index.slots.size()-1;
+	for (size_t i = hashString(key) & mask; index.slots[i] != -1; i = (i+1) & mask)
+	{
+		unsigned char *row = data + index.slots[i]*recordSize;
+		if (stricmp(getRowString(row, field), key) == 0)
+			return OptionalRecord(*this, row);
+	}
+	return OptionalRecord(*this, NULL);
+}
+
+void DBCFile::prepareFind(size_t field, bool string)
+{
+	load();
+	getIndex(&field, 1, string);
+}
+
+DBCFile::Index &DBCFile::getIndex(const size_t *fields, size_t count, bool string)
+{
+	assert(count > 0 && count <= MaxKeyFields);
+	for (size_t i=0; i<indices.size(); i++)
+	{
+		Index &index = *indices[i];
+		if (index.count == count && index.string == string && std::equal(fields, fields+count, index.fields))
+			return index;
+	}
+
+	Index *index = new Index;
+	std::copy(fields, fields+count, index->fields);
+	index->count = count;
+	index->string = string;
+	size_t size = 16;
+	while (size < recordCount*2)
+		size <<= 1;
+	index->slots.assign(size, -1);
+	for (size_t row=0; row<recordCount; row++)
+	{
+		const unsigned char *p = data + row*recordSize;
+		size_t i = hashRow(*index, p) & (size-1);
+		while (index->slots[i] != -1 && !sameKey(*index, data + index->slots[i]*recordSize, p))
+			i = (i+1) & (size-1);
+		// the first row of a key keeps the slot, as the scans found the first one
+		if (index->slots[i] == -1)
+			index->slots[i] = (int)row;
+	}
+	indices.push_back(index);
+	return *index;
+}
+
+void DBCFile::clearIndices()
+{
+	for (size_t i=0; i<indices.size(); i++)
+		delete indices[i];
+	indices.clear();
+}
+
+unsigned int DBCFile::hashRow(const Index &index, const unsigned char *row) const
+{
+	if (index.string)
+		return hashString(getRowString(row, index.fields[0]));
+	unsigned int values[MaxKeyFields];
+	for (size_t k=0; k<index.count; k++)
+		values[k] = reinterpret_cast<const unsigned int*>(row)[index.fields[k]];
+	return hashValues(values, index.count);
+}
+
+bool DBCFile::sameKey(const Index &index, const unsigned char *row, const unsigned char *other) const
+{
+	if (index.string)
+		return stricmp(getRowString(row, index.fields[0]), getRowString(other, index.fields[0])) == 0;
+	for (size_t k=0; k<index.count; k++)
+	{
+		if (reinterpret_cast<const unsigned int*>(row)[index.fields[k]] != reinterpret_cast<const unsigned int*>(other)[index.fields[k]])
+			return false;
+	}
+	return true;
+}
+
+DBCFile::Predicate DBCFile::equal(size_t field, unsigned int value)
+{
+	return range(field, value, value);
+}
+
+DBCFile::Predicate DBCFile::range(size_t field, unsigned int lo, unsigned int hi)
+{
+	assert(lo <= hi);
+	Predicate predicate = {field, lo, hi};
+	return predicate;
+}
+
+void DBCFile::select(const Predicate *predicates, size_t count, RowSet &rows)
+{
+	load();
+	size_t words = (recordCount+31)/32;
+	rows.assign(words, 0xFFFFFFFF);
+	if (recordCount & 31)
+		rows[words-1] = (1u << (recordCount & 31)) - 1;
+	for (size_t p=0; p<count; p++)
+	{
+		const unsigned int *column = getColumn(predicates[p].field);
+		unsigned int lo = predicates[p].lo;
+		unsigned int span = predicates[p].hi - lo;
+		for (size_t w=0; w<words; w++)
+		{
+			if (rows[w] != 0)
+				rows[w] &= matchWord(column + w*32, lo, span);
+		}
+	}
+}
+
+size_t DBCFile::countRows(const RowSet &rows)
+{
+	size_t count = 0;
+	for (size_t w=0; w<rows.size(); w++)
+	{
+		unsigned int bits = rows[w];
+		bits = bits - ((bits >> 1) & 0x55555555);
+		bits = (bits & 0x33333333) + ((bits >> 2) & 0x33333333);
+		count += (((bits + (bits >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+	}
+	return count;
+}
+
+int DBCFile::nextRow(const RowSet &rows, int row)
+{
+	if (row < 0)
+		row = 0;
+	for (size_t w=row >> 5; w<rows.size(); w++)
+	{
+		unsigned int bits = rows[w];
+		if (w == (size_t)(row >> 5))
+			bits &= 0xFFFFFFFF << (row & 31);
+		if (bits == 0)
+			continue;
+		int bit = 0;
+		while ((bits & 1) == 0)
+		{
+			bits >>= 1;
+			bit++;
+		}
+		return (int)(w*32) + bit;
+	}
+	return -1;
+}
+
+const unsigned int *DBCFile::getColumn(size_t field)
+{
+	assert(field < fieldCount);
+	load();
+	if (columns.size() != fieldCount)
+		columns.resize(fieldCount);
+	std::vector<unsigned int> &column = columns[field];
+	if (column.empty())
+	{
+		column.assign((recordCount+31)/32*32 + (recordCount ? 0 : 32), 0);
+		for (size_t row=0; row<recordCount; row++)
+			column[row] = reinterpret_cast<const unsigned int*>(data + row*recordSize)[field];
+	}
+	return &column[0];
+}
+
+const char *DBCFile::getRowString(const unsigned char *row, size_t field) const
+{
+	size_t stringOffset = reinterpret_cast<const unsigned int*>(row)[field];
+	return stringOffset < stringSize ? reinterpret_cast<const char*>(stringTable + stringOffset) : "";
+}
+
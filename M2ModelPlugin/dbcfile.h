@@ -3,6 +3,7 @@
 
 #include <cassert>
 #include <string>
+#include <vector>
 #include "common.h"
 
 class DLL_EXPORT DBCFile
@@ -11,8 +12,11 @@ public:
 	DBCFile(const std::string &filename);
 	~DBCFile();
 
-	// Open database. It must be openened before it can be used.
-	bool open();
+	// Open database. It must be openened before it can be used. Only the header is read, the
+	// records are loaded by the first access to them, which isn't thread safe. With loadRecords
+	// they are read here, so threads can share the records once open() returned.
+	bool open(bool loadRecords = false);
+	bool isOpen() const { return opened; }
 
 	// TODO: Add a close function?
 
@@ -84,6 +88,29 @@ public:
 
 		friend class DBCFile;
 		friend class Iterator;
+		friend class OptionalRecord;
+	};
+
+	// A record or none, what the find functions return instead of throwing NotFound.
+	class OptionalRecord
+	{
+	public:
+		bool isValid() const { return record.offset != NULL; }
+		const Record& operator*() const
+		{
+			assert(isValid());
+			return record;
+		}
+		const Record* operator->() const
+		{
+			assert(isValid());
+			return &record;
+		}
+	private:
+		OptionalRecord(DBCFile &file, unsigned char *offset): record(file, offset) {}
+		Record record;
+
+		friend class DBCFile;
 	};
 
 	/* Iterator that iterates over records */
@@ -125,7 +152,57 @@ public:
 	size_t getRecordCount() const { return recordCount;}
 	size_t getFieldCount() const { return fieldCount; }
 
+	// First record, in file order, whose uint fields hold the key values. The first query over
+	// a set of fields builds a hash index of them, later ones are a probe. Indices are dropped
+	// by open(), and building one isn't thread safe.
+	OptionalRecord find(size_t field, unsigned int key);
+	OptionalRecord find(const size_t *fields, size_t count, const unsigned int *key);
+	// The same over a string field, compared without case.
+	OptionalRecord findString(size_t field, const char *key);
+	// Loads the records and builds the index of find(field) / findString(field) up front.
+	// Lookups on prepared indices and columns only read, so threads can share the file.
+	void prepareFind(size_t field, bool string = false);
+
+	static const size_t MaxKeyFields = 8;
+
+	// Rows of a select, bit (row & 31) of word (row >> 5).
+	typedef std::vector<unsigned int> RowSet;
+	// lo <= field <= hi, compared unsigned.
+	struct Predicate
+	{
+		size_t			field;
+		unsigned int	lo;
+		unsigned int	hi;
+	};
+	static Predicate equal(size_t field, unsigned int value);
+	static Predicate range(size_t field, unsigned int lo, unsigned int hi);
+
+	// Rows where every predicate holds. The fields they test are copied into dense columns on
+	// first use, then each predicate is one pass over its column, four rows per SSE2 compare.
+	// Columns are dropped by open().
+	void select(const Predicate *predicates, size_t count, RowSet &rows);
+	static size_t countRows(const RowSet &rows);
+	// First row of the set at or after row, -1 if none.
+	static int nextRow(const RowSet &rows, int row);
+	// The field of every record, padded with zeros to a multiple of 32 rows.
+	const unsigned int *getColumn(size_t field);
+
 private:
+	struct Index
+	{
+		size_t				fields[MaxKeyFields];
+		size_t				count;
+		bool				string;		// one string field
+		std::vector<int>	slots;		// first row of each key, -1 if free, power of two sized
+	};
+	Index &getIndex(const size_t *fields, size_t count, bool string);
+	void clearIndices();
+	unsigned int hashRow(const Index &index, const unsigned char *row) const;
+	bool sameKey(const Index &index, const unsigned char *row, const unsigned char *other) const;
+	const char *getRowString(const unsigned char *row, size_t field) const;
+	bool load();
+	void freePayload();
+
 	std::string filename;
 	size_t recordSize;
 	size_t recordCount;
@@ -133,6 +210,11 @@ private:
 	size_t stringSize;
 	unsigned char *data;
 	unsigned char *stringTable;
+	unsigned char *payload;		// the whole file, data is 20 bytes in
+	bool payloadView;			// payload is the read only archive mapping, not owned
+	bool opened;
+	std::vector<Index*> indices;
+	std::vector< std::vector<unsigned int> > columns;	// by field, empty until used
 };
 
 #endif
@@ -0,0 +1,78 @@
+// Checks that ItemRecord reads the fields of items.csv as the sscanf("%u,...") it replaced did,
+// signs and leading blanks included, and that the name is what follows the last comma. Returns
+// non zero when a check fails, run by ctest.
+#include "database.h"
+#include <stdio.h>
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+// The loader before the one buffer parse, for the lines it read completely.
+static void checkAgainstScanf(const char* szLine)
+{
+	unsigned int uField[7];
+	if (sscanf(szLine, "%u,%u,%u,%u,%u,%u,%u", &uField[0], &uField[1], &uField[2], &uField[3], &uField[4], &uField[5], &uField[6])!=7)
+	{
+		printf("FAILED sscanf doesn't read %s\n", szLine);
+		++s_nFailed;
+		return;
+	}
+	ItemRecord record(szLine);
+	int nField[7] = {record.id, record.model, record.itemclass, record.subclass, record.type, record.sheath, record.quality};
+	for (int i=0; i<7; ++i)
+	{
+		if (nField[i]!=(int)uField[i])
+		{
+			printf("FAILED field %d of %s is %d, not %d\n", i, szLine, nField[i], (int)uField[i]);
+			++s_nFailed;
+		}
+	}
+}
+
+int main()
+{
+	static const char* s_szLine[] = {
+		"25,1542,2,7,13,3,1,Worn Shortsword",
+		"-1,0,-2,+3,4,-0,4294967295,Negative",
+		" 7, 8,\t9,10,11,12,13,Blanks",
+		"2147483648,-2147483648,0,1,2,3,4,Halves",
+		"0,0,0,0,0,0,0,",
+	};
+	for (size_t i=0; i<sizeof(s_szLine)/sizeof(s_szLine[0]); ++i)
+	{
+		checkAgainstScanf(s_szLine[i]);
+	}
+
+	ItemRecord record("-1,0,-2,+3,4,-0,4294967295,Negative");
+	CHECK(record.id==-1);
+	CHECK(record.itemclass==-2);
+	CHECK(record.subclass==3);
+	CHECK(record.sheath==0);
+	CHECK(record.quality==-1);
+	CHECK(record.name=="Negative");
+
+	// a field that isn't a number reads as 0, the ones after it are still read
+	ItemRecord text("12,abc,3,-,5,6,7,Sword, of Commas");
+	CHECK(text.id==12);
+	CHECK(text.model==0);
+	CHECK(text.itemclass==3);
+	CHECK(text.subclass==0);
+	CHECK(text.type==5);
+	CHECK(text.quality==7);
+	CHECK(text.name==" of Commas");
+
+	// the buffer parse stops at end, not at a terminator
+	const char szBuffer[] = "1,2,3,4,5,6,7,Name9,9,9";
+	ItemRecord part(szBuffer, szBuffer+18);
+	CHECK(part.quality==7);
+	CHECK(part.name=="Name");
+
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
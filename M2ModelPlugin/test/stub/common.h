@@ -0,0 +1,10 @@
+#pragma once
+// The engine's common.h as far as the database code uses it, for the checks.
+#include <string.h>
+#ifdef _WIN32
+#define DLL_EXPORT
+#else
+#include <strings.h>
+#define DLL_EXPORT
+#define stricmp strcasecmp
+#endif
@@ -0,0 +1,91 @@
+// MPQVerify.cpp : reads back every file of MPQ archives and reports the ones that don't match
+// their block table sizes or stored checksums.
+//
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <iostream>
+// after the C++ headers, it defines min
+#include "mpq_libmpq.h"
+
+static void printUsage()
+{
+	std::cout<<"usage: MPQVerify [-d data dir] [-r report] [archive ...]"<<std::endl;
+	std::cout<<"  checks the given archives, or the game's archives of the data dir"<<std::endl;
+	std::cout<<"  -d  the game's Data directory with the MPQs"<<std::endl;
+	std::cout<<"  -r  file for the bad files, one per line: archive, name, problem, compressed and"<<std::endl;
+	std::cout<<"      uncompressed size, tab separated (default the console)"<<std::endl;
+	std::cout<<"  returns 1 when a file is bad or no archive could be opened"<<std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string strDataDir;
+	std::string strReport;
+	std::vector<std::string> setArchive;
+	for (int i=1; i<argc; ++i)
+	{
+		std::string strArg = argv[i];
+		if ((strArg=="-d"||strArg=="-r") && i+1<argc)
+		{
+			(strArg=="-d" ? strDataDir : strReport) = argv[++i];
+		}
+		else if (strArg.size()>0 && strArg[0]=='-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			setArchive.push_back(strArg);
+		}
+	}
+
+	bool bMissing = false;
+	if (setArchive.empty())
+	{
+		if (!strDataDir.empty())
+		{
+			char cLast = strDataDir[strDataDir.size()-1];
+			SetGamePath(cLast=='/'||cLast=='\\' ? strDataDir : strDataDir+"\\");
+		}
+		InitMPQArchives();
+	}
+	else
+	{
+		// the names of archives of no install, they stay out of the game's cache
+		SetMPQIndexCache("");
+		for (size_t i=0; i<setArchive.size(); ++i)
+		{
+			// open to the end, as InitMPQArchives keeps its archives
+			size_t uOpen = GetOpenArchives().size();
+			MPQArchive* pArchive = new MPQArchive(setArchive[i].c_str());
+			if (GetOpenArchives().size()==uOpen)
+			{
+				std::cout<<"can't open "<<setArchive[i]<<std::endl;
+				delete pArchive;
+				bMissing = true;
+			}
+		}
+	}
+	if (GetOpenArchives().empty())
+	{
+		std::cout<<"no archives found, see -d"<<std::endl;
+		return 1;
+	}
+
+	FILE* pReport = stdout;
+	if (!strReport.empty() && (pReport = fopen(strReport.c_str(), "w"))==NULL)
+	{
+		std::cout<<"can't write "<<strReport<<std::endl;
+		return 1;
+	}
+	std::vector<MPQVerifyProblem> setProblem;
+	size_t uChecked = VerifyMPQArchives(setProblem, pReport);
+	if (pReport!=stdout)
+	{
+		fclose(pReport);
+	}
+	std::cout<<uChecked<<" files of "<<GetOpenArchives().size()<<" archives checked, "<<setProblem.size()<<" bad"<<std::endl;
+	return setProblem.empty() && !bMissing ? 0 : 1;
+}
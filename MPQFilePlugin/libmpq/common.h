@@ -25,6 +25,8 @@
 #define LIBMPQ_CONF_HEADER		"LIBMPQ_VERSION"	/* listdb file must include this entry to be valid */
 #define LIBMPQ_CONF_BUFSIZE		4096			/* maximum number of bytes a line in the file could contain */
 
+#define LIBMPQ_PARALLEL_MIN_BYTES	0x40000			/* reads from this size decompress their blocks on the thread pool */
+
 #define LIBMPQ_CONF_TYPE_CHAR		1			/* value in config file is from type char */
 #define LIBMPQ_CONF_TYPE_INT		2			/* value in config file is from type int */
 
@@ -34,5 +36,8 @@
 extern int libmpq_init_buffer(mpq_archive *mpq_a);
 extern int libmpq_read_hashtable(mpq_archive *mpq_a);
 extern int libmpq_read_blocktable(mpq_archive *mpq_a);
+extern int libmpq_pread(mpq_archive *mpq_a, void *buffer, unsigned int size, unsigned int offset);
+extern int libmpq_pwrite(mpq_archive *mpq_a, const void *buffer, unsigned int size, unsigned int offset);
+extern int libmpq_encrypt_block(mpq_archive *mpq_a, unsigned int *block, unsigned int length, unsigned int seed1);
 extern int libmpq_file_read_block(mpq_archive *mpq_a, mpq_file *mpq_f, unsigned int blockpos, char *buffer, unsigned int blockbytes);
 extern int libmpq_file_read_file(mpq_archive *mpq_a, mpq_file *mpq_f, unsigned int filepos, char *buffer, unsigned int toread);
\ No newline at end of file
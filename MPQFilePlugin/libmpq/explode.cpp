@@ -24,6 +24,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "mpq.h"
@@ -115,6 +116,139 @@ static unsigned short pkzip_code_asc[] = {
 	0x1C00, 0x0C00, 0x1400, 0x0400, 0x1800, 0x0800, 0x1000, 0x0000  
 };
 
+/* Decode tables of libmpq_pkzip_explode_span, as the callback version builds them in its work buffer */
+/* Length code of the next 8 bits */
+static const unsigned char pkzip_len_index[] = {
+	0x0F, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0C, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0D, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0B, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0E, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0C, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0D, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0B, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0F, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0C, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0D, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0B, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0E, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0C, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0D, 0x02, 0x05, 0x01, 0x08, 0x00, 0x03, 0x01, 0x0A, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01,
+	0x0B, 0x02, 0x05, 0x01, 0x07, 0x00, 0x03, 0x01, 0x09, 0x02, 0x04, 0x01, 0x06, 0x00, 0x03, 0x01
+};
+
+/* Distance code of the next 8 bits */
+static const unsigned char pkzip_dist_index[] = {
+	0x3F, 0x06, 0x17, 0x00, 0x27, 0x02, 0x0E, 0x00, 0x2F, 0x04, 0x12, 0x00, 0x1F, 0x01, 0x0A, 0x00,
+	0x37, 0x05, 0x14, 0x00, 0x23, 0x02, 0x0C, 0x00, 0x2B, 0x03, 0x10, 0x00, 0x1B, 0x01, 0x08, 0x00,
+	0x3B, 0x06, 0x15, 0x00, 0x25, 0x02, 0x0D, 0x00, 0x2D, 0x04, 0x11, 0x00, 0x1D, 0x01, 0x09, 0x00,
+	0x33, 0x05, 0x13, 0x00, 0x21, 0x02, 0x0B, 0x00, 0x29, 0x03, 0x0F, 0x00, 0x19, 0x01, 0x07, 0x00,
+	0x3D, 0x06, 0x16, 0x00, 0x26, 0x02, 0x0E, 0x00, 0x2E, 0x04, 0x12, 0x00, 0x1E, 0x01, 0x0A, 0x00,
+	0x35, 0x05, 0x14, 0x00, 0x22, 0x02, 0x0C, 0x00, 0x2A, 0x03, 0x10, 0x00, 0x1A, 0x01, 0x08, 0x00,
+	0x39, 0x06, 0x15, 0x00, 0x24, 0x02, 0x0D, 0x00, 0x2C, 0x04, 0x11, 0x00, 0x1C, 0x01, 0x09, 0x00,
+	0x31, 0x05, 0x13, 0x00, 0x20, 0x02, 0x0B, 0x00, 0x28, 0x03, 0x0F, 0x00, 0x18, 0x01, 0x07, 0x00,
+	0x3E, 0x06, 0x17, 0x00, 0x27, 0x02, 0x0E, 0x00, 0x2F, 0x04, 0x12, 0x00, 0x1F, 0x01, 0x0A, 0x00,
+	0x36, 0x05, 0x14, 0x00, 0x23, 0x02, 0x0C, 0x00, 0x2B, 0x03, 0x10, 0x00, 0x1B, 0x01, 0x08, 0x00,
+	0x3A, 0x06, 0x15, 0x00, 0x25, 0x02, 0x0D, 0x00, 0x2D, 0x04, 0x11, 0x00, 0x1D, 0x01, 0x09, 0x00,
+	0x32, 0x05, 0x13, 0x00, 0x21, 0x02, 0x0B, 0x00, 0x29, 0x03, 0x0F, 0x00, 0x19, 0x01, 0x07, 0x00,
+	0x3C, 0x06, 0x16, 0x00, 0x26, 0x02, 0x0E, 0x00, 0x2E, 0x04, 0x12, 0x00, 0x1E, 0x01, 0x0A, 0x00,
+	0x34, 0x05, 0x14, 0x00, 0x22, 0x02, 0x0C, 0x00, 0x2A, 0x03, 0x10, 0x00, 0x1A, 0x01, 0x08, 0x00,
+	0x38, 0x06, 0x15, 0x00, 0x24, 0x02, 0x0D, 0x00, 0x2C, 0x04, 0x11, 0x00, 0x1C, 0x01, 0x09, 0x00,
+	0x30, 0x05, 0x13, 0x00, 0x20, 0x02, 0x0B, 0x00, 0x28, 0x03, 0x0F, 0x00, 0x18, 0x01, 0x07, 0x00
+};
+
+/* ASCII literal of the next 8 bits, 0xFF if the code is longer */
+static const unsigned char pkzip_asc_index[] = {
+	0x00, 0x49, 0x29, 0x6E, 0x6B, 0x74, 0x63, 0x61, 0x76, 0x31, 0x68, 0x69, 0x37, 0x72, 0x52, 0x20,
+	0xFF, 0x43, 0x70, 0x6C, 0x46, 0x73, 0x54, 0x45, 0x36, 0x75, 0x66, 0x65, 0x32, 0x6F, 0x4E, 0x20,
+	0xFF, 0x44, 0x0D, 0x6E, 0x50, 0x74, 0x62, 0x61, 0x48, 0x2D, 0x67, 0x69, 0x34, 0x72, 0x4F, 0x20,
+	0xFF, 0x41, 0x6D, 0x6C, 0x3D, 0x73, 0x53, 0x45, 0x22, 0x75, 0x64, 0x65, 0x2E, 0x6F, 0x4C, 0x20,
+	0xFF, 0x49, 0x28, 0x6E, 0x55, 0x74, 0x63, 0x61, 0x5B, 0x31, 0x68, 0x69, 0x35, 0x72, 0x52, 0x20,
+	0xFF, 0x43, 0x70, 0x6C, 0x42, 0x73, 0x54, 0x45, 0x2A, 0x75, 0x66, 0x65, 0x30, 0x6F, 0x4E, 0x20,
+	0xFF, 0x44, 0x0A, 0x6E, 0x4D, 0x74, 0x62, 0x61, 0x3A, 0x2D, 0x67, 0x69, 0x33, 0x72, 0x4F, 0x20,
+	0x79, 0x41, 0x6D, 0x6C, 0x38, 0x73, 0x53, 0x45, 0x77, 0x75, 0x64, 0x65, 0x2C, 0x6F, 0x4C, 0x20,
+	0xFF, 0x49, 0x29, 0x6E, 0x6B, 0x74, 0x63, 0x61, 0x5F, 0x31, 0x68, 0x69, 0x37, 0x72, 0x52, 0x20,
+	0xFF, 0x43, 0x70, 0x6C, 0x46, 0x73, 0x54, 0x45, 0x2F, 0x75, 0x66, 0x65, 0x32, 0x6F, 0x4E, 0x20,
+	0xFF, 0x44, 0x0D, 0x6E, 0x50, 0x74, 0x62, 0x61, 0x47, 0x2D, 0x67, 0x69, 0x34, 0x72, 0x4F, 0x20,
+	0xFF, 0x41, 0x6D, 0x6C, 0x3D, 0x73, 0x53, 0x45, 0x09, 0x75, 0x64, 0x65, 0x2E, 0x6F, 0x4C, 0x20,
+	0xFF, 0x49, 0x28, 0x6E, 0x55, 0x74, 0x63, 0x61, 0x57, 0x31, 0x68, 0x69, 0x35, 0x72, 0x52, 0x20,
+	0xFF, 0x43, 0x70, 0x6C, 0x42, 0x73, 0x54, 0x45, 0x27, 0x75, 0x66, 0x65, 0x30, 0x6F, 0x4E, 0x20,
+	0xFF, 0x44, 0x0A, 0x6E, 0x4D, 0x74, 0x62, 0x61, 0x39, 0x2D, 0x67, 0x69, 0x33, 0x72, 0x4F, 0x20,
+	0x78, 0x41, 0x6D, 0x6C, 0x38, 0x73, 0x53, 0x45, 0x77, 0x75, 0x64, 0x65, 0x2C, 0x6F, 0x4C, 0x20
+};
+
+/* ASCII literal of the 8 bits after the first 4, when the low 6 bits are not zero */
+static const unsigned char pkzip_asc_index4[] = {
+	0x00, 0x7C, 0xCB, 0x56, 0x00, 0x24, 0x5E, 0x00, 0x00, 0x3C, 0xBB, 0x3E, 0x00, 0x59, 0x13, 0x00,
+	0x00, 0x5A, 0xC3, 0x4B, 0x00, 0x5D, 0x1C, 0x00, 0x00, 0x71, 0xB3, 0x2B, 0x00, 0x58, 0x08, 0x00,
+	0x00, 0x6A, 0xC7, 0x56, 0x00, 0x21, 0x23, 0x00, 0x00, 0x7A, 0xB7, 0x3E, 0x00, 0x59, 0x0F, 0x00,
+	0x00, 0x4A, 0xBF, 0x4B, 0x00, 0x5D, 0x17, 0x00, 0x00, 0x26, 0x7F, 0x2B, 0x00, 0x58, 0x04, 0x00,
+	0x00, 0x7B, 0xC9, 0x56, 0x00, 0x24, 0x3B, 0x00, 0x00, 0x00, 0xB9, 0x3E, 0x00, 0x59, 0x11, 0x00,
+	0x00, 0x51, 0xC1, 0x4B, 0x00, 0x5D, 0x19, 0x00, 0x00, 0x71, 0xB1, 0x2B, 0x00, 0x58, 0x06, 0x00,
+	0x00, 0x5C, 0xC5, 0x56, 0x00, 0x21, 0x1E, 0x00, 0x00, 0x7A, 0xB5, 0x3E, 0x00, 0x59, 0x0C, 0x00,
+	0x00, 0x3F, 0xBD, 0x4B, 0x00, 0x5D, 0x15, 0x00, 0x00, 0x26, 0x7D, 0x2B, 0x00, 0x58, 0x02, 0x00,
+	0x00, 0x7C, 0xCA, 0x56, 0x00, 0x24, 0x40, 0x00, 0x00, 0x3C, 0xBA, 0x3E, 0x00, 0x59, 0x12, 0x00,
+	0x00, 0x5A, 0xC2, 0x4B, 0x00, 0x5D, 0x1B, 0x00, 0x00, 0x71, 0xB2, 0x2B, 0x00, 0x58, 0x07, 0x00,
+	0x00, 0x6A, 0xC6, 0x56, 0x00, 0x21, 0x1F, 0x00, 0x00, 0x7A, 0xB6, 0x3E, 0x00, 0x59, 0x0E, 0x00,
+	0x00, 0x4A, 0xBE, 0x4B, 0x00, 0x5D, 0x16, 0x00, 0x00, 0x26, 0x7E, 0x2B, 0x00, 0x58, 0x03, 0x00,
+	0x00, 0x7B, 0xC8, 0x56, 0x00, 0x24, 0x25, 0x00, 0x00, 0x00, 0xB8, 0x3E, 0x00, 0x59, 0x10, 0x00,
+	0x00, 0x51, 0xC0, 0x4B, 0x00, 0x5D, 0x18, 0x00, 0x00, 0x71, 0xB0, 0x2B, 0x00, 0x58, 0x05, 0x00,
+	0x00, 0x5C, 0xC4, 0x56, 0x00, 0x21, 0x1D, 0x00, 0x00, 0x7A, 0xB4, 0x3E, 0x00, 0x59, 0x0B, 0x00,
+	0x00, 0x3F, 0xBC, 0x4B, 0x00, 0x5D, 0x14, 0x00, 0x00, 0x26, 0x60, 0x2B, 0x00, 0x58, 0x01, 0x00
+};
+
+/* ASCII literal of the 7 bits after the first 6, when the low 6 bits are zero */
+static const unsigned char pkzip_asc_index6[] = {
+	0x00, 0x88, 0xA8, 0xDB, 0x00, 0xEE, 0x98, 0xD3, 0x00, 0x80, 0xA0, 0xD7, 0x00, 0xDF, 0x90, 0xCF,
+	0x00, 0x84, 0xA4, 0xD9, 0x00, 0xE5, 0x94, 0xD1, 0x00, 0xF3, 0x9C, 0xD5, 0x00, 0xDD, 0x8C, 0xCD,
+	0x00, 0x86, 0xA6, 0xDA, 0x00, 0xE9, 0x96, 0xD2, 0x00, 0xF4, 0x9E, 0xD6, 0x00, 0xDE, 0x8E, 0xCE,
+	0x00, 0x82, 0xA2, 0xD8, 0x00, 0xE1, 0x92, 0xD0, 0x00, 0xF2, 0x9A, 0xD4, 0x00, 0xDC, 0x8A, 0xCC,
+	0x00, 0x87, 0xA7, 0xDB, 0x00, 0xEE, 0x97, 0xD3, 0x00, 0x1A, 0x9F, 0xD7, 0x00, 0xDF, 0x8F, 0xCF,
+	0x00, 0x83, 0xA3, 0xD9, 0x00, 0xE5, 0x93, 0xD1, 0x00, 0xF3, 0x9B, 0xD5, 0x00, 0xDD, 0x8B, 0xCD,
+	0x00, 0x85, 0xA5, 0xDA, 0x00, 0xE9, 0x95, 0xD2, 0x00, 0xF4, 0x9D, 0xD6, 0x00, 0xDE, 0x8D, 0xCE,
+	0x00, 0x81, 0xA1, 0xD8, 0x00, 0xE1, 0x91, 0xD0, 0x00, 0xF2, 0x99, 0xD4, 0x00, 0xDC, 0x89, 0xCC
+};
+
+/* ASCII literal of the 8 bits after the first 8, when those are zero */
+static const unsigned char pkzip_asc_index8[] = {
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9,
+	0xFF, 0xEB, 0xF7, 0xE0, 0xFB, 0xE6, 0xF0, 0xAC, 0xFD, 0xE8, 0xF5, 0xAE, 0xF9, 0xE3, 0xED, 0xAA,
+	0xFE, 0xEA, 0xF6, 0xAF, 0xFA, 0xE4, 0xEF, 0xAB, 0xFC, 0xE7, 0xF1, 0xAD, 0xF8, 0xE2, 0xEC, 0xA9
+};
+
+/* Bits of the ASCII literals left after the lookup above */
+static const unsigned char pkzip_asc_bits[] = {
+	0x07, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x07, 0x08, 0x08, 0x07, 0x08, 0x08,
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x07, 0x08, 0x08, 0x08, 0x08, 0x08,
+	0x04, 0x06, 0x08, 0x08, 0x06, 0x08, 0x06, 0x08, 0x07, 0x07, 0x08, 0x05, 0x07, 0x06, 0x07, 0x08,
+	0x07, 0x06, 0x07, 0x07, 0x07, 0x07, 0x08, 0x07, 0x07, 0x08, 0x08, 0x08, 0x07, 0x07, 0x05, 0x07,
+	0x08, 0x06, 0x07, 0x06, 0x06, 0x05, 0x07, 0x08, 0x08, 0x06, 0x07, 0x05, 0x06, 0x07, 0x06, 0x06,
+	0x07, 0x07, 0x06, 0x06, 0x06, 0x07, 0x05, 0x08, 0x05, 0x05, 0x07, 0x08, 0x07, 0x05, 0x08, 0x08,
+	0x08, 0x05, 0x06, 0x06, 0x06, 0x05, 0x06, 0x06, 0x06, 0x05, 0x07, 0x07, 0x05, 0x06, 0x05, 0x05,
+	0x06, 0x06, 0x05, 0x05, 0x05, 0x05, 0x08, 0x07, 0x08, 0x08, 0x06, 0x07, 0x07, 0x08, 0x08, 0x08,
+	0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+	0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07,
+	0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08,
+	0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x06, 0x06, 0x06, 0x06,
+	0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
+	0x05, 0x06, 0x05, 0x05, 0x05, 0x06, 0x05, 0x05, 0x05, 0x06, 0x05, 0x05, 0x05, 0x05, 0x06, 0x05,
+	0x05, 0x05, 0x06, 0x06, 0x06, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05
+};
+
 /* Local variables */
 static char copyright[] = "PKWARE Data Compression Library for Win32\r\n"
                           "Copyright 1989-1995 PKWARE Inc.  All Rights Reserved\r\n"
@@ -364,8 +498,8 @@ static unsigned long libmpq_pkzip_expand(pkzip_data_cmp *mpq_pkzip) {
 			copy_bytes = 0x1000;
 			mpq_pkzip->write_buf((char *)&mpq_pkzip->out_buf[0x1000], &copy_bytes, mpq_pkzip->param);
 
-			/* If there are some data left, keep them alive */
-			memcpy(mpq_pkzip->out_buf, &mpq_pkzip->out_buf[0x1000], mpq_pkzip->out_pos - 0x1000);
+			/* If there are some data left, keep them alive, the ranges overlap past 0x2000 */
+			memmove(mpq_pkzip->out_buf, &mpq_pkzip->out_buf[0x1000], mpq_pkzip->out_pos - 0x1000);
 			mpq_pkzip->out_pos -= 0x1000;
 		}
 	}
@@ -426,3 +560,340 @@ unsigned int libmpq_pkzip_explode(
 	}
 	return LIBMPQ_PKZIP_CMP_ABORT;
 }
+
+/* Bit reader of libmpq_pkzip_explode_span, the next bit is bit 0 of bit_buf. */
+typedef struct {
+	const unsigned char	*in_pos;		/* Next byte to load */
+	const unsigned char	*in_end;		/* End of the input data */
+	unsigned long long	bit_buf;		/* Loaded bits, zero above 'bits' */
+	unsigned int		bits;			/* Number of bits in bit_buf */
+} pkzip_bit_stream;
+
+/*
+ *  Loads the input a word at a time while it fits, then byte by byte
+ *  up to 57 bits or the end. The word is copied out, the input has no
+ *  alignment, and its first byte goes to the low bits on any host.
+ */
+static void libmpq_pkzip_fill_bits(pkzip_bit_stream *bs) {
+	unsigned int word;
+
+	while (bs->bits <= 32 && bs->in_end - bs->in_pos >= 4) {
+		memcpy(&word, bs->in_pos, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		word = __builtin_bswap32(word);
+#endif
+		bs->bit_buf |= (unsigned long long)word << bs->bits;
+		bs->in_pos  += 4;
+		bs->bits    += 32;
+	}
+	while (bs->bits <= 56 && bs->in_pos < bs->in_end) {
+		bs->bit_buf |= (unsigned long long)*bs->in_pos++ << bs->bits;
+		bs->bits    += 8;
+	}
+}
+
+/*
+ *  Skips given number of bits. Like libmpq_pkzip_skip_bits it wants
+ *  8 more bits to follow, so a truncated stream ends at the same code.
+ *  If not enough data in input, returns true
+ */
+static int libmpq_pkzip_take_bits(pkzip_bit_stream *bs, unsigned int bits) {
+	if (bs->bits < bits + 8) {
+		libmpq_pkzip_fill_bits(bs);
+		if (bs->bits < bits + 8) {
+			return 1;
+		}
+	}
+	bs->bit_buf >>= bits;
+	bs->bits     -= bits;
+	return 0;
+}
+
+/*
+ *  Explodes from an input buffer straight into an output buffer,
+ *  without the work buffer, the callbacks and the sliding window
+ *  of libmpq_pkzip_explode. The output is the same, up to the
+ *  size of out_buf given in *out_length, which is set to the number
+ *  of bytes written. Copies from before the start of the output
+ *  give zeros, as they hit the cleared window there.
+ */
+unsigned int libmpq_pkzip_explode_span(const unsigned char *in_buf, unsigned int in_length, unsigned char *out_buf, unsigned int *out_length) {
+	pkzip_bit_stream bs;
+	unsigned char *out_pos = out_buf;
+	unsigned char *out_end = out_buf + *out_length;
+	unsigned int cmp_type;
+	unsigned int dsize_bits;
+	unsigned int dsize_mask;
+	unsigned int result = LIBMPQ_PKZIP_CMP_ABORT;
+	unsigned int value;
+	unsigned int bits;
+	unsigned int extra;
+	unsigned int copy_length;
+	unsigned int move_back;
+	unsigned char *source;
+
+	*out_length = 0;
+	if (in_length <= 4) {
+		return LIBMPQ_PKZIP_CMP_BAD_DATA;
+	}
+	cmp_type   = in_buf[0];
+	dsize_bits = in_buf[1];
+	if (4 > dsize_bits || dsize_bits > 6) {
+		return LIBMPQ_PKZIP_CMP_INV_DICTSIZE;
+	}
+	if (cmp_type != LIBMPQ_PKZIP_CMP_BINARY && cmp_type != LIBMPQ_PKZIP_CMP_ASCII) {
+		return LIBMPQ_PKZIP_CMP_INV_MODE;
+	}
+	dsize_mask = 0xFFFF >> (0x10 - dsize_bits);
+
+	bs.in_pos  = in_buf + 2;
+	bs.in_end  = in_buf + in_length;
+	bs.bit_buf = 0;
+	bs.bits    = 0;
+
+	while (out_pos < out_end) {
+
+		/* A whole code with its extra bits is at most 30 bits, so one refill covers it. */
+		if (bs.bits < 40) {
+			libmpq_pkzip_fill_bits(&bs);
+		}
+
+		if ((bs.bit_buf & 1) == 0) {
+			if (cmp_type == LIBMPQ_PKZIP_CMP_BINARY) {
+				value = (unsigned int)(bs.bit_buf >> 1) & 0xFF;
+				bits  = 9;
+			} else if ((extra = (unsigned int)(bs.bit_buf >> 1) & 0xFF) != 0) {
+				value = pkzip_asc_index[extra];
+				bits  = 1;
+				if (value == 0xFF) {
+					if (extra & 0x3F) {
+						value = pkzip_asc_index4[(bs.bit_buf >> 5) & 0xFF];
+						bits  = 5;
+					} else {
+						value = pkzip_asc_index6[(bs.bit_buf >> 7) & 0x7F];
+						bits  = 7;
+					}
+				}
+				bits += pkzip_asc_bits[value];
+			} else {
+				value = pkzip_asc_index8[(bs.bit_buf >> 9) & 0xFF];
+				bits  = 9 + pkzip_asc_bits[value];
+			}
+			if (libmpq_pkzip_take_bits(&bs, bits)) {
+				break;
+			}
+			*out_pos++ = (unsigned char)value;
+			continue;
+		}
+
+		/* Length of the block to repeat, 0x205 ends the stream. */
+		value = pkzip_len_index[(bs.bit_buf >> 1) & 0xFF];
+		if (libmpq_pkzip_take_bits(&bs, 1 + pkzip_slen_bits[value])) {
+			break;
+		}
+		if ((bits = pkzip_clen_bits[value]) != 0) {
+			extra = (unsigned int)bs.bit_buf & ((1 << bits) - 1);
+			if (libmpq_pkzip_take_bits(&bs, bits)) {
+				if ((value + extra) == 0x10E) {
+					result = LIBMPQ_PKZIP_CMP_NO_ERROR;
+				}
+				break;
+			}
+			value = pkzip_len_base[value] + extra;
+		}
+		if (value == 0x205) {
+			result = LIBMPQ_PKZIP_CMP_NO_ERROR;
+			break;
+		}
+		copy_length = value + 2;
+
+		/* Distance, 2 low bits for blocks of 2 bytes and dsize_bits for longer ones. */
+		move_back = pkzip_dist_index[bs.bit_buf & 0xFF];
+		bits      = pkzip_dist_bits[move_back];
+		if (copy_length == 2) {
+			move_back = (move_back << 2) | ((unsigned int)(bs.bit_buf >> bits) & 0x03);
+			bits     += 2;
+		} else {
+			move_back = (move_back << dsize_bits) | ((unsigned int)(bs.bit_buf >> bits) & dsize_mask);
+			bits     += dsize_bits;
+		}
+		if (libmpq_pkzip_take_bits(&bs, bits)) {
+			break;
+		}
+		move_back++;
+
+		if (copy_length > (unsigned int)(out_end - out_pos)) {
+			copy_length = (unsigned int)(out_end - out_pos);
+		}
+		for (; copy_length > 0 && (unsigned int)(out_pos - out_buf) < move_back; copy_length--) {
+			*out_pos++ = 0;
+		}
+		source = out_pos - move_back;
+		if (move_back >= copy_length) {
+			memcpy(out_pos, source, copy_length);
+			out_pos += copy_length;
+		} else {
+			while (copy_length-- > 0) {
+				*out_pos++ = *source++;
+			}
+		}
+	}
+	if (out_pos == out_end) {
+		result = LIBMPQ_PKZIP_CMP_NO_ERROR;
+	}
+	*out_length = (unsigned int)(out_pos - out_buf);
+	return result;
+}
+
+/* Bit writer of libmpq_pkzip_implode_span, bits go in from bit 0 as the reader takes them. */
+typedef struct {
+	unsigned char	*out_pos;		/* Next byte to store */
+	unsigned char	*out_end;		/* End of the output buffer */
+	unsigned int	bit_buf;		/* Bits not stored yet */
+	unsigned int	bits;			/* Number of bits in bit_buf */
+	int		full;			/* Set when the output didn't fit */
+} pkzip_bit_writer;
+
+static void libmpq_pkzip_put_bits(pkzip_bit_writer *bw, unsigned int value, unsigned int bits) {
+	bw->bit_buf |= value << bw->bits;
+	bw->bits    += bits;
+	while (bw->bits >= 8) {
+		if (bw->out_pos == bw->out_end) {
+			bw->full = 1;
+			bw->bits = 0;
+			return;
+		}
+		*bw->out_pos++ = (unsigned char)bw->bit_buf;
+		bw->bit_buf >>= 8;
+		bw->bits     -= 8;
+	}
+}
+
+/* Writes a repeat of copy_length bytes, 2 - 0x204 or 0x207 for the end of the stream. */
+static void libmpq_pkzip_put_length(pkzip_bit_writer *bw, unsigned int copy_length) {
+	unsigned int value = copy_length - 2;
+	unsigned int index = 0x0F;
+
+	while (pkzip_len_base[index] > value) {
+		index--;
+	}
+	libmpq_pkzip_put_bits(bw, 1, 1);
+	libmpq_pkzip_put_bits(bw, pkzip_len_code[index], pkzip_slen_bits[index]);
+	libmpq_pkzip_put_bits(bw, value - pkzip_len_base[index], pkzip_clen_bits[index]);
+}
+
+#define LIBMPQ_PKZIP_HASH_BITS		12		/* Heads of the match chains of the implode */
+#define LIBMPQ_PKZIP_MAX_CHAIN		64		/* Earlier positions tried for a match */
+#define LIBMPQ_PKZIP_MAX_REPEAT		0x204		/* Longest repeat, 0x205 is the end code */
+
+/*
+ *  Implodes in_buf into out_buf in binary mode, as
+ *  libmpq_pkzip_explode_span reads it. Repeats are found
+ *  greedily through hash chains of 3 byte strings. Returns
+ *  the compressed length, or 0 if it doesn't fit in
+ *  out_length bytes.
+ */
+unsigned int libmpq_pkzip_implode_span(const unsigned char *in_buf, unsigned int in_length, unsigned char *out_buf, unsigned int out_length) {
+	pkzip_bit_writer bw;
+	int head[1 << LIBMPQ_PKZIP_HASH_BITS];
+	int *prev = NULL;
+	unsigned int dsize_bits = 6;
+	unsigned int dsize_mask;
+	unsigned int dict_size;
+	unsigned int pos = 0;
+	unsigned int i;
+
+	if (out_length < 2) {
+		return 0;
+	}
+
+	/* The smallest dictionary holding the whole input keeps the distances short. */
+	if (in_length <= 0x400) {
+		dsize_bits = 4;
+	} else if (in_length <= 0x800) {
+		dsize_bits = 5;
+	}
+	dsize_mask = 0xFFFF >> (0x10 - dsize_bits);
+	dict_size  = 0x40 << dsize_bits;
+
+	if (in_length > 0 && (prev = (int *)malloc(sizeof(int) * in_length)) == NULL) {
+		return 0;
+	}
+	for (i = 0; i < (1 << LIBMPQ_PKZIP_HASH_BITS); i++) {
+		head[i] = -1;
+	}
+
+	out_buf[0]  = LIBMPQ_PKZIP_CMP_BINARY;
+	out_buf[1]  = (unsigned char)dsize_bits;
+	bw.out_pos  = out_buf + 2;
+	bw.out_end  = out_buf + out_length;
+	bw.bit_buf  = 0;
+	bw.bits     = 0;
+	bw.full     = 0;
+
+	while (pos < in_length && !bw.full) {
+		unsigned int best_length = 0;
+		unsigned int best_back   = 0;
+		unsigned int max_length  = in_length - pos;
+		unsigned int step        = 1;
+		unsigned int hash        = 0;
+
+		if (max_length > LIBMPQ_PKZIP_MAX_REPEAT + 2) {
+			max_length = LIBMPQ_PKZIP_MAX_REPEAT + 2;
+		}
+		if (max_length >= 3) {
+			int chain = LIBMPQ_PKZIP_MAX_CHAIN;
+			int cand;
+
+			hash = ((in_buf[pos] << 8) ^ (in_buf[pos + 1] << 4) ^ in_buf[pos + 2]) & ((1 << LIBMPQ_PKZIP_HASH_BITS) - 1);
+			for (cand = head[hash]; cand >= 0 && pos - cand <= dict_size && chain-- > 0; cand = prev[cand]) {
+				unsigned int length = 0;
+
+				if (in_buf[cand + best_length] != in_buf[pos + best_length]) {
+					continue;
+				}
+				while (length < max_length && in_buf[cand + length] == in_buf[pos + length]) {
+					length++;
+				}
+				if (length > best_length) {
+					best_length = length;
+					best_back   = pos - cand;
+					if (length == max_length) {
+						break;
+					}
+				}
+			}
+		}
+
+		if (best_length >= 3) {
+			unsigned int distance = best_back - 1;
+
+			libmpq_pkzip_put_length(&bw, best_length);
+			libmpq_pkzip_put_bits(&bw, pkzip_dist_code[distance >> dsize_bits], pkzip_dist_bits[distance >> dsize_bits]);
+			libmpq_pkzip_put_bits(&bw, distance & dsize_mask, dsize_bits);
+			step = best_length;
+		} else {
+			libmpq_pkzip_put_bits(&bw, (unsigned int)in_buf[pos] << 1, 9);
+		}
+
+		/* Chain every position passed, the ones near the end can't start a repeat. */
+		for (i = 0; i < step; i++, pos++) {
+			if (pos + 3 <= in_length) {
+				hash = ((in_buf[pos] << 8) ^ (in_buf[pos + 1] << 4) ^ in_buf[pos + 2]) & ((1 << LIBMPQ_PKZIP_HASH_BITS) - 1);
+				prev[pos]  = head[hash];
+				head[hash] = pos;
+			}
+		}
+	}
+	free(prev);
+
+	/* End code, then the last bits padded to a byte */
+	libmpq_pkzip_put_length(&bw, LIBMPQ_PKZIP_MAX_REPEAT + 3);
+	if (bw.bits > 0) {
+		libmpq_pkzip_put_bits(&bw, 0, 8 - bw.bits);
+	}
+	if (bw.full) {
+		return 0;
+	}
+	return (unsigned int)(bw.out_pos - out_buf);
+}
@@ -68,18 +68,25 @@ typedef struct {
 #pragma pack(pop)
 
 
-typedef struct {
-	char		*in_buf;	/* Pointer to input data buffer */
-	unsigned int	in_pos;		/* Current offset in input data buffer */
-	int		in_bytes;	/* Number of bytes in the input buffer */
-	char		*out_buf;	/* Pointer to output data buffer */
-	unsigned int	out_pos;	/* Position in the output buffer */
-	int		max_out;	/* Maximum number of bytes in the output buffer */
-} pkzip_data;
-
 extern unsigned int libmpq_pkzip_explode(
 	unsigned int	(*read_buf)(char *buf, unsigned int *size, void *param),
 	void		(*write_buf)(char *buf, unsigned int *size, void *param),
 	char		*work_buf,
 	void		*param
 );
+
+/* Explodes in_buf into out_buf, *out_length is the size of out_buf and gets the bytes written. */
+extern unsigned int libmpq_pkzip_explode_span(
+	const unsigned char	*in_buf,
+	unsigned int		in_length,
+	unsigned char		*out_buf,
+	unsigned int		*out_length
+);
+
+/* Implodes in_buf into out_buf (binary mode), returns the compressed length or 0 if it needs more than out_length bytes. */
+extern unsigned int libmpq_pkzip_implode_span(
+	const unsigned char	*in_buf,
+	unsigned int		in_length,
+	unsigned char		*out_buf,
+	unsigned int		out_length
+);
@@ -33,75 +33,12 @@
 #include "huffman.h"
 #include "wave.h"
 
-/*
- *  Support functions for PKWARE data compression library.
- *
- *  Function loads data from the input buffer. Used by mpq_pkzip
- *  "implode" and "explode" function as user-defined callback.
- *  Returns number of bytes loaded.
- *
- *  char * buf          - Pointer to a buffer where to store loaded data
- *  unsigned int * size - Max. number of bytes to read
- *  void * param        - Custom pointer, parameter of implode/explode
- */
-static unsigned int libmpq_pkzip_read_input_data(char *buf, unsigned int *size, void *param) {
-	pkzip_data *info = (pkzip_data *)param;
-	unsigned int max_avail = (info->in_bytes - info->in_pos);
-	unsigned int to_read = *size;
-
-	/* Check the case when not enough data available */
-	if (to_read > max_avail) {
-		to_read = max_avail;
-	}
-
-	/* Load data and increment offsets */
-	memcpy(buf, info->in_buf + info->in_pos, to_read);
-	info->in_pos += to_read;
-
-	return to_read;
-}
-
-/*
- *  Support functions for PKWARE data compression library.
- *
- *  Function for store output data. Used by mpq_pkzip "implode" and
- *  "explode" as user-defined callback.
- *
- *  char * buf          - Pointer to data to be written
- *  unsigned int * size - Number of bytes to write
- *  void * param        - Custom pointer, parameter of implode/explode
- */
-static void libmpq_pkzip_write_output_data(char *buf, unsigned int *size, void *param) {
-	pkzip_data *info = (pkzip_data *)param;
-	unsigned int max_write = (info->max_out - info->out_pos);
-	unsigned int to_write = *size;
-
-	/* Check the case when not enough space in the output buffer */
-	if (to_write > max_write) {
-		to_write = max_write;
-	}
-
-	/* Write output data and increments offsets */
-	memcpy(info->out_buf + info->out_pos, buf, to_write);
-	info->out_pos += to_write;
-}
-
 int libmpq_pkzip_decompress(char *out_buf, int *out_length, char *in_buf, int in_length) {
-	pkzip_data info;					/* Data information */
-	char *work_buf = (char*)malloc(LIBMPQ_PKZIP_EXP_BUFFER_SIZE);	/* mpq_pkzip work buffer */
-
-	/* Fill data information structure */
-	info.in_buf   = in_buf;
-	info.in_pos   = 0;
-	info.in_bytes = in_length;
-	info.out_buf  = out_buf;
-	info.out_pos  = 0;
-	info.max_out  = *out_length;
+	unsigned int length = *out_length;
 
 	/* Do the decompression */
-	libmpq_pkzip_explode(libmpq_pkzip_read_input_data, libmpq_pkzip_write_output_data, work_buf, &info);
-	*out_length = info.out_pos;
-	free(work_buf);
+	libmpq_pkzip_explode_span((unsigned char *)in_buf, in_length, (unsigned char *)out_buf, &length);
+	*out_length = length;
 	return 0;
 }
 
@@ -141,32 +78,28 @@ int libmpq_zlib_decompress(char *out_buf, int *out_length, char *in_buf, int in_
 }
 
 /*
- *  Huffmann decompression routine. The in_length parameter is not used, but needs
- *  to be specified due to compatibility reasons.
+ *  Huffmann decompression routine. Reading stops at the end of the
+ *  input, the bits past it are taken as zero.
  *
  *  1500F5F0
  */
 int libmpq_huff_decompress(char *out_buf, int *out_length, char *in_buf, int in_length) {
 	struct huffman_tree		*ht = (huffman_tree*)malloc(sizeof(struct huffman_tree));
-	struct huffman_input_stream	*is = (huffman_input_stream	*)malloc(sizeof(struct huffman_input_stream));
-	struct huffman_tree_item	*hi = (huffman_tree_item	*)malloc(sizeof(struct huffman_tree_item));
-	memset(ht, 0, sizeof(struct huffman_tree));
-	memset(is, 0, sizeof(struct huffman_input_stream));
-	memset(hi, 0, sizeof(struct huffman_tree_item));
+	struct huffman_input_stream	is;
 
-	/* Initialize input stream */
-	is->bit_buf  = *(unsigned long *)in_buf;
-	in_buf      += sizeof(unsigned long);
-	is->in_buf   = (unsigned char *)in_buf;
-	is->bits     = 32;
+	if (ht == NULL) {
+		*out_length = 0;
+		return LIBMPQ_EALLOCMEM;
+	}
 
-	/* Initialize the Huffmann tree for decompression */
-	libmpq_huff_init_tree(ht, hi, LIBMPQ_HUFF_DECOMPRESS);
+	/* Initialize input stream */
+	is.in_buf  = (unsigned char *)in_buf;
+	is.in_end  = (unsigned char *)in_buf + in_length;
+	is.bit_buf = 0;
+	is.bits    = 0;
 
-	*out_length = libmpq_huff_do_decompress(ht, is, (unsigned char *)out_buf, *out_length);
+	*out_length = libmpq_huff_do_decompress(ht, &is, (unsigned char *)out_buf, *out_length);
 
-	free(hi);
-	free(is);
 	free(ht);
 	return 0;
 }
@@ -211,6 +144,7 @@ int libmpq_multi_decompress(char *out_buf, int *pout_length, char *in_buf, int i
 	 */
 	if (fDecompressions2 != 0) {
 		printf("Unknown Compression\n");
+		*pout_length = 0;
 		return 0;
 	}
 
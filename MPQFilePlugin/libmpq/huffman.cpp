@@ -8,6 +8,16 @@
  *
  *    - Removed the object oriented stuff.
  *    - Replaced the goto things with some better C code.
+ *    - Items link by index instead of tagged pointers, so it works
+ *      with 64 bit pointers and a tree can be copied with memcpy.
+ *    - The tree of every compression type is built once and copied
+ *      for each stream, with its quick table already filled.
+ *    - The quick table is also dropped when a leaf is split.
+ *
+ *  The gain is in short, sector sized streams, which no longer build
+ *  the tree each time. Long streams decode at about the old speed:
+ *  once the old 7 bit cache was warm, both walk the same tree the same
+ *  way, and every new byte or swap drops the quick table again.
  *
  *  This source was adepted from the C++ version of huffman.cpp included
  *  in stormlib. The C++ version belongs to the following authors,
@@ -34,6 +44,9 @@
 #include "mpq.h"
 #include "huffman.h"
 #include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 unsigned char table1502A630[] = {
 
@@ -209,624 +222,339 @@ unsigned char table1502A630[] = {
 	0x00, 0x00
 };
 
-/* Gets previous Huffman tree item (?) */
-struct huffman_tree_item *libmpq_huff_get_prev_item(struct huffman_tree_item *hi, __int32 value) {
-	if (PTR_INT(hi->prev) < 0) {
-		return PTR_NOT(hi->prev);
-	}
-	if (value < 0) {
-		value = __int32(hi - hi->next->prev);
-	}
-	return hi->prev + value;
-}
-
-/* 1500BC90 */
-static void libmpq_huff_remove_item(struct huffman_tree_item *hi) {
-	struct huffman_tree_item *temp;			/* EDX */
+/* Trees as built from the weight tables, made on first use and copied for every stream. */
+static struct huffman_tree *libmpq_huff_template[LIBMPQ_HUFF_TYPES];
 
-	if (hi->next != NULL) {
-		temp = hi->prev;
-		if (PTR_INT(temp) <= 0) {
-			temp = PTR_NOT(temp);
-		} else {
-			temp += (hi - hi->next->prev);
-		}
-		temp->next          = hi->next;
-		hi->next->prev      = hi->prev;
-		hi->next = hi->prev = NULL;
-	}
+/* Removes an item from the weight list. */
+static void libmpq_huff_unlink(struct huffman_tree_item *item, unsigned int n) {
+	item[item[n].prev].next = item[n].next;
+	item[item[n].next].prev = item[n].prev;
 }
 
-static void libmpq_huff_insert_item(struct huffman_tree_item **p_item, struct huffman_tree_item *item, unsigned long where, struct huffman_tree_item *item2) {
-	struct huffman_tree_item *next = item->next;	/* EDI - next to the first item */
-	struct huffman_tree_item *prev = item->prev;	/* ESI - prev to the first item */
-	struct huffman_tree_item *prev2;		/* Pointer to previous item */
-	long next2;					/* Pointer to the next item */
-
-	/* The same code like in mpq_huff_remove_item(); */
-	if (next != 0) {				/* If the first item already has next one */
-		if (PTR_INT(prev) < 0) {
-			prev = PTR_NOT(prev);
-		} else {
-			prev += (item - next->prev);
-		}
-
-		/*
-		 * 150083C1
-		 * Remove the item from the tree
-		 */
-		prev->next = next;
-		next->prev = prev;
-
-		/* Invalidate 'prev' and 'next' pointer */
-		item->next = 0;
-		item->prev = 0;
-	}
+/* Links an item into the weight list behind 'where', 0 makes it the first one. */
+static void libmpq_huff_link_after(struct huffman_tree_item *item, unsigned int where, unsigned int n) {
+	item[n].prev = where;
+	item[n].next = item[where].next;
+	item[item[where].next].prev = n;
+	item[where].next = n;
+}
 
-	if (item2 == NULL) {				/* EDX - If the second item is not entered, */
-		item2 = PTR_PTR(&p_item[1]);		/* take the first tree item */
-	}
+/* Takes the next unused item, 0 if there is none left. */
+static unsigned int libmpq_huff_new_item(struct huffman_tree *ht, unsigned int value, unsigned int weight) {
+	struct huffman_tree_item *hi;
 
-	switch (where) {
-		case SWITCH_ITEMS:			/* Switch the two items */
-			item->next  = item2->next;	/* item2->next (Pointer to pointer to first) */
-			item->prev  = item2->next->prev;
-			item2->next->prev = item;
-			item2->next = item;		/* Set the first item */
-			return;
-		case INSERT_ITEM:			/* Insert as the last item */
-			item->next = item2;		/* Set next item (or pointer to pointer to first item) */
-			item->prev = item2->prev;	/* Set prev item (or last item in the tree) */
-			next2 = PTR_INT(p_item[0]);	/* Usually NULL */
-			prev2 = item2->prev;		/* Prev item to the second (or last tree item) */
-			if (PTR_INT(prev2) < 0) {
-				prev2 = PTR_NOT(prev);
-				prev2->next = item;
-				item2->prev = item;	/* Next after last item */
-				return;
-			}
-			if (next2 < 0) {
-				next2 = long(item2 - item2->next->prev);
-			}
-			prev2 += next2;
-			prev2->next = item;
-			item2->prev = item;		/* Set the next/last item */
-			return;
-		default:
-			return;
+	if (ht->items >= LIBMPQ_HUFF_ITEMS) {
+		return 0;
 	}
+	hi         = &ht->item[ht->items];
+	hi->value  = value;
+	hi->weight = weight;
+	hi->parent = 0;
+	hi->child  = 0;
+	return ht->items++;
 }
 
-/* Builds Huffman tree. Called with the first 8 bits loaded from input stream. */
-static void libmpq_huff_build_tree(struct huffman_tree *ht, unsigned int cmp_type) {
-	unsigned long max_byte;				/* [ESP+10] - The greatest character found in table */
-	unsigned char *byte_array;			/* [ESP+1C] - Pointer to unsigned char in table1502A630 */
-	unsigned long i;				/* egcs in linux doesn't like multiple for loops without an explicit i */
-	unsigned int found;				/* Thats needed to replace the goto stuff from original source :) */
-	struct huffman_tree_item **p_item;		/* [ESP+14] - Pointer to Huffman tree item pointer array */
-	struct huffman_tree_item *child1;
-
-	/* Loop while pointer has a negative value. */
-	while (PTR_INT(ht->last) > 0) {			/* ESI - Last entry */
-		struct huffman_tree_item *temp;		/* EAX */
-
-		if (ht->last->next != NULL) {		/* ESI->next */
-			libmpq_huff_remove_item(ht->last);
-		}
-		ht->item3058   = PTR_PTR(&ht->item3054);/* [EDI+4] */
-		ht->last->prev = ht->item3058;		/* EAX */
-		temp           = libmpq_huff_get_prev_item(PTR_PTR(&ht->item3054), PTR_INT(&ht->item3050));
-		temp->next     = ht->last;
-		ht->item3054   = ht->last;
-	}
-
-	/* Clear all pointers in huffman tree item array. */
-	memset(ht->items306C, 0, sizeof(ht->items306C));
-
-	max_byte = 0;					/* Greatest character found init to zero. */
-	p_item = (struct huffman_tree_item **)&ht->items306C;	/* Pointer to current entry in huffman tree item pointer array */
-
-	/* Ensure we have low 8 bits only */
-	cmp_type   &= 0xFF;
-	byte_array  = table1502A630 + cmp_type * 258;	/* EDI also */
-
-	for (i = 0; i < 0x100; i++, p_item++) {
-		struct huffman_tree_item *item = ht->item3058;	/* Item to be created */
-		struct huffman_tree_item *p_item3 = ht->item3058;
-		unsigned char one_byte = byte_array[i];
-
-		/* Skip all the bytes which are zero. */
-		if (byte_array[i] == 0) {
-			continue;
-		}
-
-		/* If not valid pointer, take the first available item in the array. */
-		if (PTR_INT(item) <= 0) {
-			item = &ht->items0008[ht->items++];
-		}
-
-		/* Insert this item as the top of the tree. */
-		libmpq_huff_insert_item(&ht->item305C, item, SWITCH_ITEMS, NULL);
-
-		item->parent    = NULL;			/* Invalidate child and parent */
-		item->child     = NULL;
-		*p_item         = item;			/* Store pointer into pointer array */
-
-		item->dcmp_byte  = i;			/* Store counter */
-		item->byte_value = one_byte;		/* Store byte value */
-		if (one_byte >= max_byte) {
-			max_byte = one_byte;
-			continue;
-		}
-
-		/* Find the first item which has byte value greater than current one byte */
-		found = 0;
-		if (PTR_INT((p_item3 = ht->last)) > 0) {/* EDI - Pointer to the last item */
-
-			/* 15006AF7 */
-			if (p_item3 != NULL) {
-				do {			/* 15006AFB */
-					if (p_item3->byte_value >= one_byte) {
-						found = 1;
-						break;
-					}
-					p_item3 = p_item3->prev;
-				} while (PTR_INT(p_item3) > 0);
-			}
-		}
-
-		if (found == 0) {
-			p_item3 = NULL;
-		}
-
-		/* 15006B09 */
-		if (item->next != NULL) {
-			libmpq_huff_remove_item(item);
-		}
-
-		/* 15006B15 */
-		if (p_item3 == NULL) {
-			p_item3 = PTR_PTR(&ht->first);
-		}
-
-		/* 15006B1F */
-		item->next = p_item3->next;
-		item->prev = p_item3->next->prev;
-		p_item3->next->prev = item;
-		p_item3->next = item;
+/*
+ *  Links an item of the tree being built. An item at least as heavy
+ *  as all before goes first, any other one behind the last item which
+ *  is at least as heavy as itself.
+ */
+static void libmpq_huff_link_sorted(struct huffman_tree *ht, unsigned int n, unsigned int *max_weight) {
+	struct huffman_tree_item *item = ht->item;
+	unsigned int where;
+
+	if (item[n].weight >= *max_weight) {
+		*max_weight = item[n].weight;
+		libmpq_huff_link_after(item, 0, n);
+		return;
 	}
-
-	/* 15006B4A */
-	for (; i < 0x102; i++) {
-		struct huffman_tree_item **p_item2 = &ht->items306C[i];	/* EDI */
-
-		/* 15006B59  */
-		struct huffman_tree_item *item2 = ht->item3058;	/* ESI */
-		if (PTR_INT(item2) <= 0) {
-			item2 = &ht->items0008[ht->items++];
-		}
-		libmpq_huff_insert_item(&ht->item305C, item2, INSERT_ITEM, NULL);
-
-		/* 15006B89 */
-		item2->dcmp_byte  = i;
-		item2->byte_value = 1;
-		item2->parent     = NULL;
-		item2->child      = NULL;
-		*p_item2++        = item2;
+	for (where = item[0].prev; where != 0 && item[where].weight < item[n].weight; where = item[where].prev) {
 	}
+	libmpq_huff_link_after(item, where, n);
+}
 
-	/* 15006BAA */
-	if (PTR_INT((child1 = ht->last)) > 0) {		/* EDI - last item (first child to item */
-		struct huffman_tree_item *child2;	/* EBP */
-		struct huffman_tree_item *item;		/* ESI */
-
-		/* 15006BB8 */
-		while (PTR_INT((child2 = child1->prev)) > 0) {
-			if (PTR_INT((item = ht->item3058)) <= 0) {
-				item = &ht->items0008[ht->items++];
-			}
-			/* 15006BE3 */
-			libmpq_huff_insert_item(&ht->item305C, item, SWITCH_ITEMS, NULL);
-
-			/* 15006BF3 */
-			item->parent = NULL;
-			item->child  = NULL;
-
-			/*
-			 * EDX = child2->byte_value + child1->byte_value;
-			 * EAX = child1->byte_value;
-			 * ECX = max_byte;		The greatest character (0xFF usually)
-			 */
-			item->byte_value = child1->byte_value + child2->byte_value;	/* 0x02 */
-			item->child      = child1;	/* Prev item in the */
-			child1->parent   = item;
-			child2->parent   = item;
-
-			/* EAX = item->byte_value; */
-			if (item->byte_value >= max_byte) {
-				max_byte = item->byte_value;
-			} else {
-				struct huffman_tree_item *p_item2 = child2->prev;	/* EDI */
-				found = 0;
-				if (PTR_INT(p_item2) > 0) {
-
-					/* 15006C2D */
-					do {
-						if (p_item2->byte_value >= item->byte_value) {
-							found = 1;
-							break;
-						}
-						p_item2 = p_item2->prev;
-					} while (PTR_INT(p_item2) > 0);
-				}
-				if (found == 0) {
-					p_item2 = NULL;
-				}
-				if (item->next != 0) {
-					struct huffman_tree_item *temp4 = libmpq_huff_get_prev_item(item, -1);
-					temp4->next      = item->next;	/* The first item changed */
-					item->next->prev = item->prev;	/* First->prev changed to negative value */
-					item->next = NULL;
-					item->prev = NULL;
-				}
-
-				/* 15006C62 */
-				if (p_item2 == NULL) {
-					p_item2 = PTR_PTR(&ht->first);
-				}
-				item->next = p_item2->next;		/* Set item with 0x100 byte value */
-				item->prev = p_item2->next->prev;	/* Set item with 0x17 byte value */
-				p_item2->next->prev = item;		/* Changed prev of item with */
-				p_item2->next = item;
-			}
+/* Sets the quick table entries starting with the 'bits' bits of 'code', which lead to item 'n'. */
+static void libmpq_huff_set_quick(struct huffman_tree *ht, unsigned int code, unsigned int bits, unsigned int n) {
+	struct huffman_quick_link *ql;
 
-			/* 15006C7B */
-			if (PTR_INT((child1 = child2->prev)) <= 0) {
-				break;
-			}
-		}
+	for (; code < LIBMPQ_HUFF_QUICK_SIZE; code += (1 << bits)) {
+		ql          = &ht->quick[code];
+		ql->version = ht->version;
+		ql->bits    = (unsigned short)bits;
+		ql->item    = (unsigned short)n;
 	}
-
-	/* 15006C88 */
-	ht->offs0004 = 1;
 }
 
-/* Gets the whole byte from the input stream. */
-static unsigned long libmpq_huff_get_8bits(struct huffman_input_stream *is) {
-	unsigned long one_byte;
+/* Fills the quick table for all codes below item 'n', which is reached by the 'bits' bits of 'code'. */
+static void libmpq_huff_fill_quick(struct huffman_tree *ht, unsigned int n, unsigned int code, unsigned int bits) {
+	unsigned int child = ht->item[n].child;
 
-	if (is->bits <= 8) {
-		is->bit_buf |= *(unsigned short *)is->in_buf << is->bits;
-		is->in_buf  += sizeof(unsigned short);
-		is->bits    += 16;
+	if (child == 0 || bits == LIBMPQ_HUFF_QUICK_BITS) {
+		libmpq_huff_set_quick(ht, code, bits, n);
+		return;
 	}
-
-	one_byte      = (is->bit_buf & 0xFF);
-	is->bit_buf >>= 8;
-	is->bits     -= 8;
-
-	return one_byte;
+	libmpq_huff_fill_quick(ht, child, code, bits + 1);
+	libmpq_huff_fill_quick(ht, ht->item[child].prev, code | (1 << bits), bits + 1);
 }
 
-/* Gets 7 bits from the stream. */
-static unsigned long libmpq_huff_get_7bits(struct huffman_input_stream *is) {
-	if (is->bits <= 7) {
-		is->bit_buf |= *(unsigned short *)is->in_buf << is->bits;
-		is->in_buf  += sizeof(unsigned short);
-		is->bits    += 16;
+/* Builds the Huffman tree from the weight table of the compression type. */
+static void libmpq_huff_build_tree(struct huffman_tree *ht, unsigned int cmp_type) {
+	struct huffman_tree_item *item = ht->item;
+	unsigned char *weights = table1502A630 + cmp_type * 258;
+	unsigned int max_weight = 0;
+	unsigned int i;
+	unsigned int n;
+	unsigned int lo;
+	unsigned int hi;
+
+	memset(ht, 0, sizeof(struct huffman_tree));
+	ht->version = 1;
+	ht->items   = 1;
+	ht->cmp0    = (cmp_type == 0) ? 1 : 0;
+
+	/* One leaf for every byte with a weight, sorted by weight. */
+	for (i = 0; i < 0x100; i++) {
+		if (weights[i] != 0) {
+			n = libmpq_huff_new_item(ht, i, weights[i]);
+			ht->by_value[i] = (unsigned short)n;
+			libmpq_huff_link_sorted(ht, n, &max_weight);
+		}
 	}
 
-	/* Get 7 bits from input stream. */
-	return (is->bit_buf & 0x7F);
-}
-
-/* Gets one bit from input stream. */
-unsigned long libmpq_huff_get_bit(struct huffman_input_stream *is) {
-	unsigned long bit = (is->bit_buf & 1);
+	/* End of stream and new byte codes go last. */
+	for (; i < 0x102; i++) {
+		n = libmpq_huff_new_item(ht, i, 1);
+		ht->by_value[i] = (unsigned short)n;
+		libmpq_huff_link_after(item, item[0].prev, n);
+	}
 
-	is->bit_buf >>= 1;
-	if (--is->bits == 0) {
-		is->bit_buf  = *(unsigned long *)is->in_buf;
-		is->in_buf  += sizeof(unsigned long);
-		is->bits     = 32;
+	/* Join the two items at the end of the list until only the root is left. */
+	for (lo = item[0].prev; lo != 0 && (hi = item[lo].prev) != 0; lo = item[hi].prev) {
+		n = libmpq_huff_new_item(ht, 0, item[lo].weight + item[hi].weight);
+		item[n].child  = (unsigned short)lo;
+		item[lo].parent = (unsigned short)n;
+		item[hi].parent = (unsigned short)n;
+		libmpq_huff_link_sorted(ht, n, &max_weight);
 	}
-	return bit;
+	libmpq_huff_fill_quick(ht, item[0].next, 0, 0);
 }
 
-static struct huffman_tree_item *libmpq_huff_call1500E740(struct huffman_tree *ht, unsigned int value) {
-	struct huffman_tree_item *p_item1 = ht->item3058;	/* EDX */
-	struct huffman_tree_item *p_item2;			/* EAX */
-	struct huffman_tree_item *p_next;
-	struct huffman_tree_item *p_prev;
-	struct huffman_tree_item **pp_item;
+/*
+ *  Returns the tree built for the compression type. Threads racing
+ *  here keep the first tree and drop their own. The trees live until
+ *  the process ends.
+ */
+static const struct huffman_tree *libmpq_huff_get_template(unsigned int cmp_type) {
+	struct huffman_tree *ht = libmpq_huff_template[cmp_type];
+	void *prev = NULL;
 
-	if (PTR_INT(p_item1) <= 0 || (p_item2 = p_item1) == NULL) {
-		if((p_item2 = &ht->items0008[ht->items++]) != NULL) {
-			p_item1 = p_item2;
-		} else {
-			p_item1 = ht->first;
-		}
-	} else {
-		p_item1 = p_item2;
+	if (ht != NULL) {
+		return ht;
 	}
-
-	p_next = p_item1->next;
-	if (p_next != NULL) {
-		p_prev = p_item1->prev;
-		if (PTR_INT(p_prev) <= 0) {
-			p_prev = PTR_NOT(p_prev);
-		} else {
-			p_prev += (p_item1 - p_item1->next->prev);
-		}
-
-		p_prev->next = p_next;
-		p_next->prev = p_prev;
-		p_item1->next = NULL;
-		p_item1->prev = NULL;
+	if ((ht = (struct huffman_tree *)malloc(sizeof(struct huffman_tree))) == NULL) {
+		return NULL;
 	}
-	pp_item = &ht->first;				/* ESI */
-	if (value > 1) {
-
-		/* ECX = ht->first->next; */
-		p_item1->next = *pp_item;
-		p_item1->prev = (*pp_item)->prev;
-
-		(*pp_item)->prev = p_item2;
-		*pp_item = p_item1;
-
-		p_item2->parent = NULL;
-		p_item2->child  = NULL;
-	} else {
-		p_item1->next = (struct huffman_tree_item *)pp_item;
-		p_item1->prev = pp_item[1];
-		/* EDI = ht->item305C; */
-		p_prev = pp_item[1];			/* ECX */
-		if (p_prev <= 0) {
-			p_prev = PTR_NOT(p_prev);
-			p_prev->next = p_item1;
-			p_prev->prev = p_item2;
-
-			p_item2->parent = NULL;
-			p_item2->child  = NULL;
-		} else {
-			if (PTR_INT(ht->item305C) < 0) {
-				p_prev += (struct huffman_tree_item *)pp_item - (*pp_item)->prev;
-			} else {
-				p_prev += PTR_INT(ht->item305C);
-			}
-
-			p_prev->next    = p_item1;
-			pp_item[1]      = p_item2;
-			p_item2->parent = NULL;
-			p_item2->child  = NULL;
-		}
+	libmpq_huff_build_tree(ht, cmp_type);
+#ifdef _WIN32
+	prev = InterlockedCompareExchangePointer((PVOID volatile*)&libmpq_huff_template[cmp_type], ht, NULL);
+#else
+	prev = __sync_val_compare_and_swap((void**)&libmpq_huff_template[cmp_type], (void*)NULL, (void*)ht);
+#endif
+	if (prev != NULL) {
+		free(ht);
+		return (struct huffman_tree *)prev;
 	}
-	return p_item2;
+	return ht;
 }
 
-static void libmpq_huff_call1500E820(struct huffman_tree *ht, struct huffman_tree_item *p_item) {
-	struct huffman_tree_item *p_item1;		/* EDI */
-	struct huffman_tree_item *p_item2 = NULL;	/* EAX */
-	struct huffman_tree_item *p_item3;		/* EDX */
-	struct huffman_tree_item *p_prev;		/* EBX */
-
-	for (; p_item != NULL; p_item = p_item->parent) {
-		p_item->byte_value++;
-
-		for (p_item1 = p_item; ; p_item1 = p_prev) {
-			p_prev = p_item1->prev;
-			if (PTR_INT(p_prev) <= 0) {
-				p_prev = NULL;
-				break;
-			}
-			if (p_prev->byte_value >= p_item->byte_value) {
+/*
+ *  Adds one to the weight of an item and all its parents. An item
+ *  which got heavier than the ones before it in the list swaps place
+ *  and parent with the first of them, so the list stays sorted and
+ *  the children of an item stay neighbours.
+ */
+static void libmpq_huff_inc_weight(struct huffman_tree *ht, unsigned int n) {
+	struct huffman_tree_item *item = ht->item;
+	unsigned int weight;
+	unsigned int swap;
+	unsigned int where;
+	unsigned int parent;
+
+	for (; n != 0; n = item[n].parent) {
+		weight = ++item[n].weight;
+
+		/* Find the first item lighter than this one, and the one in front of it. */
+		for (swap = n; ; swap = where) {
+			where = item[swap].prev;
+			if (where == 0 || item[where].weight >= weight) {
 				break;
 			}
 		}
-
-		if (p_item1 == p_item) {
+		if (swap == n) {
 			continue;
 		}
 
-		if (p_item1->next != NULL) {
-			p_item2 = libmpq_huff_get_prev_item(p_item1, -1);
-			p_item2->next = p_item1->next;
-			p_item1->next->prev = p_item1->prev;
-			p_item1->next = NULL;
-			p_item1->prev = NULL;
-		}
-		p_item2 = p_item->next;
-		p_item1->next = p_item2;
-		p_item1->prev = p_item2->prev;
-		p_item2->prev = p_item1;
-		p_item->next = p_item1;
-		if ((p_item2 = p_item1) != NULL) {
-			p_item2 = libmpq_huff_get_prev_item(p_item, -1);
-			p_item2->next = p_item->next;
-			p_item->next->prev = p_item->prev;
-			p_item->next = NULL;
-			p_item->prev = NULL;
-		}
+		/* Exchange the places in the list. */
+		libmpq_huff_unlink(item, swap);
+		libmpq_huff_link_after(item, n, swap);
+		libmpq_huff_unlink(item, n);
+		libmpq_huff_link_after(item, where, n);
 
-		if (p_prev == NULL) {
-			p_prev = PTR_PTR(&ht->first);
+		/* Exchange the parents, the child link of a parent goes to the item now at its place. */
+		parent = item[item[swap].parent].child;
+		if (item[item[n].parent].child == n) {
+			item[item[n].parent].child = (unsigned short)swap;
 		}
-		p_item2       = p_prev->next;
-		p_item->next  = p_item2;
-		p_item->prev  = p_item2->prev;
-		p_item2->prev = p_item;
-		p_prev->next  = p_item;
-
-		p_item3 = p_item1->parent->child;
-		p_item2 = p_item->parent;
-		if (p_item2->child == p_item) {
-			p_item2->child = p_item1;
+		if (parent == swap) {
+			item[item[swap].parent].child = (unsigned short)n;
 		}
+		parent           = item[n].parent;
+		item[n].parent    = item[swap].parent;
+		item[swap].parent = (unsigned short)parent;
+		ht->version++;
+	}
+}
 
-		if (p_item3 == p_item1) {
-			p_item1->parent->child = p_item;
-		}
+/*
+ *  Adds a byte to the tree. The last (lightest) leaf becomes an inner
+ *  item with itself and the new byte as children, the new byte starts
+ *  without weight.
+ */
+static int libmpq_huff_add_value(struct huffman_tree *ht, unsigned int value) {
+	struct huffman_tree_item *item = ht->item;
+	unsigned int last = item[0].prev;
+	unsigned int hi;
+	unsigned int lo;
+
+	if ((hi = libmpq_huff_new_item(ht, item[last].value, item[last].weight)) == 0 ||
+	    (lo = libmpq_huff_new_item(ht, value, 0)) == 0) {
+		return LIBMPQ_EFILE_CORRUPT;
+	}
+	libmpq_huff_link_after(item, last, hi);
+	libmpq_huff_link_after(item, hi, lo);
+	item[hi].parent   = (unsigned short)last;
+	item[lo].parent   = (unsigned short)last;
+	item[last].child  = (unsigned short)lo;
+	ht->by_value[item[hi].value] = (unsigned short)hi;
+	ht->by_value[value]          = (unsigned short)lo;
+	ht->version++;
+
+	libmpq_huff_inc_weight(ht, lo);
+	if (ht->cmp0 == 0) {
+		libmpq_huff_inc_weight(ht, lo);
+	}
+	return LIBMPQ_TOOLS_SUCCESS;
+}
 
-		p_item2 = p_item->parent;
-		p_item->parent  = p_item1->parent;
-		p_item1->parent = p_item2;
-		ht->offs0004++;
+/* Loads bytes until at least 25 bits are buffered. */
+static void libmpq_huff_fill_bits(struct huffman_input_stream *is) {
+	while (is->bits <= 24) {
+		if (is->in_buf < is->in_end) {
+			is->bit_buf |= (unsigned int)*is->in_buf++ << is->bits;
+		}
+		is->bits += 8;
 	}
 }
 
-__int32 libmpq_huff_do_decompress(struct huffman_tree *ht, struct huffman_input_stream *is, unsigned char *out_buf, unsigned int out_length) {
-	unsigned int n8bits;				/* 8 bits loaded from input stream */
-	unsigned int n7bits;				/* 7 bits loaded from input stream */
-	unsigned int found;				/* Thats needed to replace the goto stuff from original source :) */
-	unsigned int dcmp_byte = 0;
-	unsigned long bit_count;
-	struct huffman_decompress *qd;
-	unsigned int has_qd;				/* Can we use quick decompression? */
-	struct huffman_tree_item *p_item1 = NULL;
-	struct huffman_tree_item *p_item2 = NULL;
+/* Gets the whole byte from the input stream. */
+static unsigned int libmpq_huff_get_8bits(struct huffman_input_stream *is) {
+	unsigned int one_byte;
+
+	libmpq_huff_fill_bits(is);
+	one_byte      = (is->bit_buf & 0xFF);
+	is->bit_buf >>= 8;
+	is->bits     -= 8;
+	return one_byte;
+}
+
+int libmpq_huff_do_decompress(struct huffman_tree *ht, struct huffman_input_stream *is, unsigned char *out_buf, unsigned int out_length) {
+	struct huffman_tree_item *item = ht->item;
+	struct huffman_quick_link *ql;
 	unsigned char *out_pos = out_buf;
+	unsigned char *out_end = out_buf + out_length;
+	unsigned int code;
+	unsigned int bits;
+	unsigned int value;
+	unsigned int n;
 
 	/* Test the output length. Must not be non zero. */
 	if (out_length == 0) {
 		return 0;
 	}
 
-	/* Get the compression type from the input stream. */
-	n8bits = libmpq_huff_get_8bits(is);
-
-	/* Build the Huffman tree */
-	libmpq_huff_build_tree(ht, n8bits);
-	ht->cmp0 = (n8bits == 0) ? TRUE : FALSE;
-
-	for(;;) {
-		n7bits = libmpq_huff_get_7bits(is);	/* Get 7 bits from input stream */
-
-		/*
-		 * Try to use quick decompression. Check huffman_decompress array for corresponding item.
-		 * If found, use the result byte instead.
-		 */
-		qd = &ht->qd3474[n7bits];
-
-		/* If there is a quick-pass possible (ebx) */
-		has_qd = (qd->offs00 >= ht->offs0004) ? TRUE : FALSE;
-
-		/* If we can use quick decompress, use it. */
-		if (has_qd) {
-			found = 0;
-			if (qd->bits > 7) {
-				is->bit_buf >>= 7;
-				is->bits -= 7;
-				p_item1 = qd->p_item;
-				found = 1;
-			}
-			if (found == 0) {
-				is->bit_buf >>= qd->bits;
-				is->bits     -= qd->bits;
-				dcmp_byte     = qd->dcmp_byte;
-			}
+	/* Get the compression type from the input stream and copy its tree. */
+	if (libmpq_huff_init_tree(ht, libmpq_huff_get_8bits(is)) != LIBMPQ_TOOLS_SUCCESS) {
+		return 0;
+	}
+
+	for (;;) {
+		libmpq_huff_fill_bits(is);
+		code = is->bit_buf & (LIBMPQ_HUFF_QUICK_SIZE - 1);
+		ql   = &ht->quick[code];
+
+		/* Look up the next bits, walk from the root and remember the result if the entry is outdated. */
+		if (ql->version == ht->version) {
+			n    = ql->item;
+			bits = ql->bits;
 		} else {
-			found = 1;
-			p_item1 = ht->first->next->prev;
-			if (PTR_INT(p_item1) <= 0) {
-				p_item1 = NULL;
+			n = item[0].next;
+			for (bits = 0; item[n].child != 0 && bits < LIBMPQ_HUFF_QUICK_BITS; bits++) {
+				n = item[n].child;
+				if (code & (1 << bits)) {
+					n = item[n].prev;
+				}
 			}
+			libmpq_huff_set_quick(ht, code & ((1 << bits) - 1), bits, n);
 		}
+		is->bit_buf >>= bits;
+		is->bits     -= bits;
 
-		if (found == 1) {
-			bit_count = 0;
-			p_item2 = NULL;
-			do {
-				p_item1 = p_item1->child;	/* Move down by one level */
-				if (libmpq_huff_get_bit(is)) {	/* If current bit is set, move to previous */
-					p_item1 = p_item1->prev;
-				}
-				if (++bit_count == 7) {		/* If we are at 7th bit, save current huffman tree item. */
-					p_item2 = p_item1;
-				}
-			} while (p_item1->child != NULL);	/* Walk until tree has no deeper level */
-
-			if (has_qd == FALSE) {
-				if (bit_count > 7) {
-					qd->offs00 = ht->offs0004;
-					qd->bits   = bit_count;
-					qd->p_item = p_item2;
-				} else {
-					unsigned long index = n7bits & (0xFFFFFFFF >> (32 - bit_count));
-					unsigned long add   = (1 << bit_count);
-
-					for (qd = &ht->qd3474[index]; index <= 0x7F; index += add, qd += add) {
-						qd->offs00    = ht->offs0004;
-						qd->bits      = bit_count;
-						qd->dcmp_byte = p_item1->dcmp_byte;
-					}
-				}
+		/* Longer codes go on bit by bit. */
+		while (item[n].child != 0) {
+			if (is->bits == 0) {
+				libmpq_huff_fill_bits(is);
 			}
-			dcmp_byte = p_item1->dcmp_byte;
+			n = item[n].child;
+			if (is->bit_buf & 1) {
+				n = item[n].prev;
+			}
+			is->bit_buf >>= 1;
+			is->bits--;
 		}
+		value = item[n].value;
 
-		if (dcmp_byte == 0x101)	{		/* Huffman tree needs to be modified */
-			n8bits  = libmpq_huff_get_8bits(is);
-			p_item1 = (ht->last <= 0) ? NULL : ht->last;
-
-			p_item2 = libmpq_huff_call1500E740(ht, 1);
-			p_item2->parent     = p_item1;
-			p_item2->dcmp_byte  = p_item1->dcmp_byte;
-			p_item2->byte_value = p_item1->byte_value;
-			ht->items306C[p_item2->dcmp_byte] = p_item2;
-
-			p_item2 = libmpq_huff_call1500E740(ht, 1);
-			p_item2->parent     = p_item1;
-			p_item2->dcmp_byte  = n8bits;
-			p_item2->byte_value = 0;
-			ht->items306C[p_item2->dcmp_byte] = p_item2;
-
-			p_item1->child = p_item2;
-			libmpq_huff_call1500E820(ht, p_item2);
-			if (ht->cmp0 == 0) {
-				libmpq_huff_call1500E820(ht, ht->items306C[n8bits]);
+		/* Huffman tree needs to be modified, the new byte follows in plain. */
+		if (value == 0x101) {
+			value = libmpq_huff_get_8bits(is);
+			if (libmpq_huff_add_value(ht, value) != LIBMPQ_TOOLS_SUCCESS) {
+				break;
 			}
-			dcmp_byte = n8bits;
 		}
-
-		if (dcmp_byte == 0x100) {
+		if (value == 0x100) {
 			break;
 		}
 
-		*out_pos++ = (unsigned char)dcmp_byte;
-		if (--out_length == 0) {
+		*out_pos++ = (unsigned char)value;
+		if (out_pos == out_end) {
 			break;
 		}
 		if (ht->cmp0) {
-			libmpq_huff_call1500E820(ht, ht->items306C[dcmp_byte]);
+			libmpq_huff_inc_weight(ht, ht->by_value[value]);
 		}
 	}
-	return __int32(out_pos - out_buf);
+	return (int)(out_pos - out_buf);
 }
 
-int libmpq_huff_init_tree(struct huffman_tree *ht, struct huffman_tree_item *hi, unsigned int cmp) {
-	int count;
+/* Copies the tree of the compression type, the items past the used ones are left as they are. */
+int libmpq_huff_init_tree(struct huffman_tree *ht, unsigned int cmp_type) {
+	const struct huffman_tree *tree;
 
-	/* Clear links for all the items in the tree */
-	for (hi = ht->items0008, count = 0x203; count != 0; hi++, count--) {
-		hi->next = hi->prev = NULL;
+	if (cmp_type >= LIBMPQ_HUFF_TYPES) {
+		return LIBMPQ_EFILE_CORRUPT;
 	}
-
-	ht->item3050 = NULL;
-	ht->item3054 = PTR_PTR(&ht->item3054);
-	ht->item3058 = PTR_NOT(ht->item3054);
-
-	ht->item305C = NULL;
-	ht->first    = PTR_PTR(&ht->first);
-	ht->last     = PTR_NOT(ht->first);
-
-	ht->offs0004 = 1;
-	ht->items    = 0;
-
-	/* Clear all huffman_decompress items. Do this only if preparing for decompression */
-	if (cmp == LIBMPQ_HUFF_DECOMPRESS) {
-		for (count = 0; count < sizeof(ht->qd3474) / sizeof(struct huffman_decompress); count++) {
-			ht->qd3474[count].offs00 = 0;
-		}
+	if ((tree = libmpq_huff_get_template(cmp_type)) == NULL) {
+		return LIBMPQ_EALLOCMEM;
 	}
-	return 0;
+	memcpy(ht, tree, (char *)&tree->item[tree->items] - (char *)tree);
+	return LIBMPQ_TOOLS_SUCCESS;
 }
@@ -25,77 +25,62 @@
  */
 #pragma once
 
-#define PTR_NOT(ptr)	(struct huffman_tree_item *)(~(unsigned long)(ptr))
-#define PTR_PTR(ptr)	((struct huffman_tree_item *)(ptr))
-#define PTR_INT(ptr)	(long)(ptr)
-
-#define INSERT_ITEM	1
-#define SWITCH_ITEMS	2				/* Switch the item1 and item2 */
+#define LIBMPQ_HUFF_TYPES	9				/* Number of weight tables, selected by the first byte of the stream */
+#define LIBMPQ_HUFF_ITEMS	0x204				/* Item 0 is the list head, 0x203 items fit every tree of the format */
+#define LIBMPQ_HUFF_QUICK_BITS	7				/* Bits resolved by one lookup in the quick table */
+#define LIBMPQ_HUFF_QUICK_SIZE	(1 << LIBMPQ_HUFF_QUICK_BITS)
 
 /*
- *  Input stream for Huffmann decompression
+ *  Input stream for Huffmann decompression. Bits are taken from
+ *  bit 0 of bit_buf, which is refilled bytewise. Past in_end it
+ *  reads zero bits instead of running off the buffer.
  */
 struct huffman_input_stream {
-	unsigned char *in_buf;				/* 00 - Input data */
-	unsigned long bit_buf;				/* 04 - Input bit buffer */
-	unsigned int bits;				/* 08 - Number of bits remaining in 'byte' */
+	unsigned char *in_buf;				/* Next byte to load */
+	unsigned char *in_end;				/* End of the input data */
+	unsigned int bit_buf;				/* Loaded bits */
+	unsigned int bits;				/* Number of bits in 'bit_buf' */
 };
 
 /*
- *  Huffmann tree item.
+ *  Huffmann tree item. All items are in one list sorted by weight,
+ *  the heaviest (the root) first. The two children of an inner item
+ *  are neighbours in that list, 'child' is the one taken for a zero
+ *  bit and the item before it the one for a one bit. Links are
+ *  indices into huffman_tree.item, so the tree can be copied as is.
  */
 struct huffman_tree_item {
-	struct huffman_tree_item *next;			/* 00 - Pointer to next huffman_tree_item */
-	struct huffman_tree_item *prev;			/* 04 - Pointer to prev huffman_tree_item (< 0 if none) */
-	unsigned long dcmp_byte;			/* 08 - Index of this item in item pointer array, decompressed byte value */
-	unsigned long byte_value;			/* 0C - Some byte value */
-	struct huffman_tree_item *parent;		/* 10 - Pointer to parent huffman_tree_item (NULL if none) */
-	struct huffman_tree_item *child;		/* 14 - Pointer to child huffman_tree_item */
+	unsigned short next;				/* Next (lighter) item in the list, 0 if last */
+	unsigned short prev;				/* Previous (heavier) item in the list, 0 if first */
+	unsigned short parent;				/* Parent item, 0 for the root */
+	unsigned short child;				/* Child for a zero bit, 0 for leaves */
+	unsigned int value;				/* Decompressed byte of leaves, 0x100 ends the stream, 0x101 adds a byte */
+	unsigned int weight;				/* Number of times the item has been seen */
 };
 
 /*
- *  Structure used for quick decompress. The 'bits' contains
- *  number of bits and dcmp_byte contains result decompressed byte
- *  value. After each walk through Huffman tree are filled all entries
- *  which are multiplies of number of bits loaded from input stream.
- *  These entries contain number of bits and result value. At the next
- *  7 bits is tested this structure first. If corresponding entry found,
- *  decompression routine will not walk through Huffman tree and
- *  directly stores output byte to output stream.
+ *  Entry of the quick table, indexed by the next LIBMPQ_HUFF_QUICK_BITS
+ *  bits of the stream. It holds the leaf those bits lead to, or the
+ *  inner item reached after all of them when the code is longer.
+ *  Entries are used while 'version' matches the one of the tree,
+ *  which changes every time the shape of the tree does.
  */
-struct huffman_decompress {
-	unsigned long offs00;				/* 00 - 1 if resolved */
-	unsigned long bits;				/* 04 - Bit count */
-	union {
-		unsigned long dcmp_byte;		/* 08 - Byte value for decompress (if bitCount <= 7) */
-		struct huffman_tree_item *p_item;	/* 08 - THTreeItem (if number of bits is greater than 7 */
-	};
+struct huffman_quick_link {
+	unsigned int version;				/* Tree version the entry was made for */
+	unsigned short bits;				/* Bits to skip */
+	unsigned short item;				/* Leaf or inner item reached */
 };
 
 /*
  *  Structure for Huffman tree.
  */
 struct huffman_tree {
-	unsigned long cmp0;				/* 0000 - 1 if compression type 0 */
-	unsigned long offs0004;				/* 0004 - Some flag */
-
-	struct huffman_tree_item items0008[0x203];	/* 0008 - huffman tree items */
-
-	/* Sometimes used as huffman tree item */
-	struct huffman_tree_item *item3050;		/* 3050 - Always NULL (?) */
-	struct huffman_tree_item *item3054;		/* 3054 - Pointer to huffman_tree_item */
-	struct huffman_tree_item *item3058;		/* 3058 - Pointer to huffman_tree_item (< 0 if invalid) */
-
-	/* Sometimes used as huffman tree item */
-	struct huffman_tree_item *item305C;		/* 305C - Usually NULL */
-	struct huffman_tree_item *first;		/* 3060 - Pointer to top (first) Huffman tree item */
-	struct huffman_tree_item *last;			/* 3064 - Pointer to bottom (last) Huffman tree item (< 0 if invalid) */
-	unsigned long items;				/* 3068 - Number of used huffman tree items */
-
-	struct huffman_tree_item *items306C[0x102];	/* 306C - huffman_tree_item pointer array */
-	struct huffman_decompress qd3474[0x80];		/* 3474 - Array for quick decompression */
-
-	unsigned char table1502A630[];			/* Some table to make struct size flexible */
+	unsigned int version;				/* Changed with every swap or split of items */
+	unsigned int items;				/* Number of used items, including the list head */
+	unsigned int cmp0;				/* 1 if compression type 0, the weights adapt to every byte */
+	unsigned short by_value[0x102];			/* Leaf of every decompressed value */
+	struct huffman_quick_link quick[LIBMPQ_HUFF_QUICK_SIZE];
+	struct huffman_tree_item item[LIBMPQ_HUFF_ITEMS];	/* Last, only the used items are copied */
 };
 
-extern int libmpq_huff_init_tree(struct huffman_tree *ht, struct huffman_tree_item *hi, unsigned int cmp);
+extern int libmpq_huff_init_tree(struct huffman_tree *ht, unsigned int cmp_type);
@@ -27,6 +27,11 @@
 #include <string.h>
 #include "mpq.h"
 #include "common.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 /*
  *  This function returns version information.
@@ -38,6 +43,48 @@ char *libmpq_version() {
 	return version;
 }
 
+/*
+ *  This function fills the block to hash entry index, so that looking
+ *  up a file by number doesn't scan the whole hash table. Like the old
+ *  scan, the first hash entry pointing at a block wins.
+ */
+static int libmpq_build_blockhash(mpq_archive *mpq_a) {
+	unsigned int i = 0;
+	unsigned int blockindex = 0;
+
+	mpq_a->blockhash = (int*)malloc(sizeof(int) * (mpq_a->header->blocktablesize + 1));
+	if (!mpq_a->blockhash) {
+		return LIBMPQ_EALLOCMEM;
+	}
+	for (i = 0; i < mpq_a->header->blocktablesize; i++) {
+		mpq_a->blockhash[i] = -1;
+	}
+	for (i = 0; i < mpq_a->header->hashtablesize; i++) {
+		blockindex = (mpq_a->hashtable[i]).blockindex;
+		if (blockindex < mpq_a->header->blocktablesize && mpq_a->blockhash[blockindex] == -1) {
+			mpq_a->blockhash[blockindex] = i;
+		}
+	}
+	return LIBMPQ_TOOLS_SUCCESS;
+}
+
+/*
+ *  This function returns the hash table entry of the given file
+ *  number, or NULL if no entry points at it.
+ */
+static mpq_hash *libmpq_file_hash(mpq_archive *mpq_a, const int number) {
+	int hashindex = -1;
+
+	if (number < 1 || (unsigned int)number > mpq_a->header->blocktablesize) {
+		return NULL;
+	}
+	hashindex = mpq_a->blockhash[number - 1];
+	if (hashindex == -1) {
+		return NULL;
+	}
+	return &(mpq_a->hashtable[hashindex]);
+}
+
 /*
  *  This function reads a file and verify if it is a legit MPQ archive
  *  or not. Then it fills the mpq_header structure and reads the hash
@@ -104,6 +151,9 @@ int libmpq_archive_open(mpq_archive *mpq_a, unsigned char *mpq_filename) {
 	mpq_a->blocksize = (0x200 << mpq_a->header->blocksize);
 	fstat(mpq_a->fd, &fileinfo);
 
+	/* the whole file can be mapped later on */
+	mpq_a->mapsize = fileinfo.st_size;
+
 	/* Normal MPQs must have position of */
 	if ((mpq_a->header->hashtablepos + mpq_a->mpqpos < (unsigned int)fileinfo.st_size) && (mpq_a->header->blocktablepos + mpq_a->mpqpos < (unsigned int)fileinfo.st_size)) {
 		mpq_a->header->hashtablepos  += mpq_a->mpqpos;
@@ -122,6 +172,11 @@ int libmpq_archive_open(mpq_archive *mpq_a, unsigned char *mpq_filename) {
 		return LIBMPQ_EBLOCKTABLE;
 	}
 
+	/* Index the hash entries by block */
+	if (libmpq_build_blockhash(mpq_a) != 0) {
+		return LIBMPQ_EALLOCMEM;
+	}
+
 	return LIBMPQ_TOOLS_SUCCESS;
 }
 
@@ -152,6 +207,21 @@ int libmpq_archive_close(mpq_archive *mpq_a) {
 		mpq_a->blocktable = NULL;
 	}
 
+	if (mpq_a->blockhash) {
+		free(mpq_a->blockhash);	/* Block to hash entry index */
+		mpq_a->blockhash = NULL;
+	}
+
+	if (mpq_a->map) {
+#ifdef _WIN32
+		UnmapViewOfFile(mpq_a->map);
+		CloseHandle((HANDLE)mpq_a->maphandle);
+#else
+		munmap(mpq_a->map, mpq_a->mapsize);
+#endif
+		mpq_a->map = NULL;
+	}
+
 	/* Check if file descriptor is valid. */
 	if ((close(mpq_a->fd)) == LIBMPQ_EFILE) {
 		return LIBMPQ_EFILE;
@@ -213,7 +283,6 @@ int libmpq_archive_info(mpq_archive *mpq_a, unsigned int infotype) {
  */
 int libmpq_file_info(mpq_archive *mpq_a, unsigned int infotype, const int number) {
 	int blockindex = -1;
-	unsigned int i = 0;
 	mpq_block *mpq_b = NULL;
 	mpq_hash *mpq_h = NULL;
 
@@ -222,19 +291,14 @@ int libmpq_file_info(mpq_archive *mpq_a, unsigned int infotype, const int number
 		return LIBMPQ_EINV_RANGE;
 	}
 
-	/* search for correct hashtable */
-	for (i = 0; i < mpq_a->header->hashtablesize; i++) {
-		if ((number - 1) == (int)(mpq_a->hashtable[i]).blockindex) {
-			blockindex = (mpq_a->hashtable[i]).blockindex;
-			mpq_h = &(mpq_a->hashtable[i]);
-			break;
-		}
-	}
+	/* get the hashtable entry of the block */
+	mpq_h = libmpq_file_hash(mpq_a, number);
 
 	/* check if file was found */
-	if (blockindex == -1 || blockindex > (int)mpq_a->header->blocktablesize) {
+	if (mpq_h == NULL) {
 		return LIBMPQ_EFILE_NOT_FOUND;
 	}
+	blockindex = number - 1;
 
 	/* check if sizes are correct */
 	mpq_b = mpq_a->blocktable + blockindex;
@@ -274,11 +338,12 @@ int libmpq_file_info(mpq_archive *mpq_a, unsigned int infotype, const int number
  */
 int libmpq_file_number(mpq_archive *mpq_a, const char *name) {
 	int i;
-    unsigned int hash1, hash2;
+    unsigned int hash0, hash1, hash2;
 
-    // Search by hash first
+    // Probe the hash table from the slot of the name
+    hash0 = libmpq_hash_string(mpq_a, 0, (unsigned char*)name);
     libmpq_hash_filename(mpq_a, (unsigned char*)name, &hash1, &hash2);
-    i = libmpq_file_number_from_hash(mpq_a, hash1, hash2);
+    i = libmpq_file_number_probe(mpq_a, hash0, hash1, hash2);
     if(i >= 0)
         return i;
 
@@ -288,7 +353,9 @@ int libmpq_file_number(mpq_archive *mpq_a, const char *name) {
 
 /*
  *  This function returns the number to the given
- *  file.
+ *  file. Without the offset hash of the name it has
+ *  to scan the whole table, use libmpq_file_number_probe
+ *  when the name is known.
  */
 int libmpq_file_number_from_hash(mpq_archive *mpq_a, unsigned int hash1, unsigned int hash2) {
 	/* search for correct hashtable */
@@ -303,6 +370,43 @@ int libmpq_file_number_from_hash(mpq_archive *mpq_a, unsigned int hash1, unsigne
 	return LIBMPQ_EFILE_NOT_FOUND;
 }
 
+/*
+ *  This function returns the number to the given file
+ *  hashes. The table is open addressed, the search starts
+ *  at the slot of the offset hash (type 0) and stops at the
+ *  first entry that was never used. Deleted entries don't
+ *  stop it.
+ */
+int libmpq_file_number_probe(mpq_archive *mpq_a, unsigned int hash0, unsigned int hash1, unsigned int hash2) {
+	unsigned int size = mpq_a->header->hashtablesize;
+	unsigned int start = 0;
+	unsigned int i = 0;
+	unsigned int n = 0;
+	mpq_hash *mpq_h = NULL;
+
+	if (size == 0) {
+		return LIBMPQ_EFILE_NOT_FOUND;
+	}
+
+	/* the size is a power of two in all valid archives */
+	start = (size & (size - 1)) == 0 ? (hash0 & (size - 1)) : (hash0 % size);
+	for (n = 0, i = start; n < size; n++) {
+		mpq_h = &(mpq_a->hashtable[i]);
+		if (mpq_h->blockindex == LIBMPQ_HASH_ENTRY_FREE) {
+			break;
+		}
+		if (mpq_h->name1 == hash1 && mpq_h->name2 == hash2 && mpq_h->blockindex != LIBMPQ_HASH_ENTRY_DELETED) {
+			return mpq_h->blockindex + 1;
+		}
+		if (++i == size) {
+			i = 0;
+		}
+	}
+
+	/* if no matching entry found return LIBMPQ_EFILE_NOT_FOUND */
+	return LIBMPQ_EFILE_NOT_FOUND;
+}
+
 /*
  *  This function verifies if a given file (by number
  *  or name) is in the opened mpq archive. On success
@@ -310,7 +414,6 @@ int libmpq_file_number_from_hash(mpq_archive *mpq_a, unsigned int hash1, unsigne
  */
 int libmpq_file_check(mpq_archive *mpq_a, void *file, int type) {
 	int found = 0;
-    unsigned int hash1, hash2;
 
 	switch (type) {
 		case LIBMPQ_FILE_TYPE_INT:
@@ -323,8 +426,7 @@ int libmpq_file_check(mpq_archive *mpq_a, void *file, int type) {
 			}
 		case LIBMPQ_FILE_TYPE_CHAR:
             // Search by hash
-            libmpq_hash_filename(mpq_a, (unsigned char*)file, &hash1, &hash2);
-            if(libmpq_file_number_from_hash(mpq_a, hash1, hash2)>=0)
+            if(libmpq_file_number(mpq_a, (const char*)file)>=0)
                 found = 1;
 
 			/* if a file was found return 0 */
@@ -442,31 +544,29 @@ int libmpq_file_extract(mpq_archive *mpq_a, const int number) {
 	return LIBMPQ_TOOLS_SUCCESS;
 }
 #endif
-int libmpq_file_getdata(mpq_archive *mpq_a, const int number, unsigned char *dest) {
+/*
+ *  This function prepares a file of the archive for reading,
+ *  on success *mpq_f must be freed with libmpq_file_close.
+ */
+int libmpq_file_open(mpq_archive *mpq_a, const int number, mpq_file **pmpq_f) {
 	int blockindex = -1;
-	unsigned int i=0;
 	mpq_file *mpq_f = NULL;
 	mpq_block *mpq_b = NULL;
 	mpq_hash *mpq_h = NULL;
-    int success = 0;
 
+	*pmpq_f = NULL;
 	if (number < 1 || (unsigned int)number > mpq_a->header->blocktablesize) {
 		return LIBMPQ_EINV_RANGE;
 	}
 
-	/* search for correct hashtable */
-	for (i=0; i<mpq_a->header->hashtablesize; i++) {
-		if ((number - 1) == (mpq_a->hashtable[i]).blockindex) {
-			blockindex = (mpq_a->hashtable[i]).blockindex;
-			mpq_h = &(mpq_a->hashtable[i]);
-			break;
-		}
-	}
+	/* get the hashtable entry of the block */
+	mpq_h = libmpq_file_hash(mpq_a, number);
 
 	/* check if file was found */
-	if (blockindex == -1 || (unsigned int)blockindex > mpq_a->header->blocktablesize) {
+	if (mpq_h == NULL) {
 		return LIBMPQ_EFILE_NOT_FOUND;
 	}
+	blockindex = number - 1;
 
 	/* check if sizes are correct */
 	mpq_b = mpq_a->blocktable + blockindex;
@@ -507,15 +607,117 @@ int libmpq_file_getdata(mpq_archive *mpq_a, const int number, unsigned char *des
 		}
 	}
 
-    if(libmpq_file_read_file(mpq_a, mpq_f, 0, (char*)dest, mpq_b->fsize) == mpq_b->fsize)
-        success = 1;
+	*pmpq_f = mpq_f;
+	return LIBMPQ_TOOLS_SUCCESS;
+}
 
+void libmpq_file_close(mpq_file *mpq_f) {
     if (mpq_f->mpq_b->flags & LIBMPQ_FILE_COMPRESSED) {
         // Free buffer for block positions
 
 	       free(mpq_f->blockpos);
 	}
+	if (mpq_f->blockbuf) {
+		free(mpq_f->blockbuf);
+	}
 	/* freeing the file structure */
 	free(mpq_f);
+}
+
+int libmpq_file_getdata(mpq_archive *mpq_a, const int number, unsigned char *dest) {
+	mpq_file *mpq_f = NULL;
+    int success = 0;
+	int result = libmpq_file_open(mpq_a, number, &mpq_f);
+
+	if (result != LIBMPQ_TOOLS_SUCCESS) {
+		return result;
+	}
+
+	if ((unsigned int)libmpq_file_read_file(mpq_a, mpq_f, 0, (char*)dest, mpq_f->mpq_b->fsize) == mpq_f->mpq_b->fsize) {
+		success = 1;
+	}
+
+	libmpq_file_close(mpq_f);
 	return success?LIBMPQ_TOOLS_SUCCESS:LIBMPQ_EFILE_CORRUPT;
 }
+
+/*
+ *  This function reads one block of an opened file, only the
+ *  block itself gets decompressed.
+ */
+int libmpq_file_read_sector(mpq_archive *mpq_a, mpq_file *mpq_f, unsigned int sector, unsigned char *dest) {
+	if (sector >= mpq_f->nblocks) {
+		return 0;
+	}
+	return libmpq_file_read_block(mpq_a, mpq_f, sector * mpq_a->blocksize, (char*)dest, mpq_a->blocksize);
+}
+
+/*
+ *  This function maps the whole archive file read only. The
+ *  mapping lives until the archive is closed. Threads racing
+ *  here keep the first mapping and drop their own.
+ */
+const unsigned char *libmpq_archive_map(mpq_archive *mpq_a) {
+	void *map = NULL;
+	void *prev = NULL;
+
+	if (mpq_a->map) {
+		return mpq_a->map;
+	}
+	if (mpq_a->mapsize == 0) {
+		return NULL;
+	}
+#ifdef _WIN32
+	HANDLE hMap = CreateFileMapping((HANDLE)_get_osfhandle(mpq_a->fd), NULL, PAGE_READONLY, 0, 0, NULL);
+	if (hMap == NULL) {
+		return NULL;
+	}
+	map = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (map == NULL) {
+		CloseHandle(hMap);
+		return NULL;
+	}
+	prev = InterlockedCompareExchangePointer((PVOID volatile*)&mpq_a->map, map, NULL);
+	if (prev != NULL) {
+		UnmapViewOfFile(map);
+		CloseHandle(hMap);
+		return (unsigned char*)prev;
+	}
+	mpq_a->maphandle = hMap;
+#else
+	map = mmap(NULL, mpq_a->mapsize, PROT_READ, MAP_SHARED, mpq_a->fd, 0);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	prev = __sync_val_compare_and_swap((void**)&mpq_a->map, (void*)NULL, map);
+	if (prev != NULL) {
+		munmap(map, mpq_a->mapsize);
+		return (unsigned char*)prev;
+	}
+#endif
+	return mpq_a->map;
+}
+
+/*
+ *  This function returns the bytes of a stored file inside the
+ *  archive mapping, so they don't need to be copied. Compressed
+ *  and encrypted files return NULL.
+ */
+const unsigned char *libmpq_file_view(mpq_archive *mpq_a, const int number) {
+	mpq_block *mpq_b = NULL;
+
+	if (number < 1 || (unsigned int)number > mpq_a->header->blocktablesize) {
+		return NULL;
+	}
+	mpq_b = mpq_a->blocktable + (number - 1);
+	if ((mpq_b->flags & LIBMPQ_FILE_EXISTS) == 0 || (mpq_b->flags & (LIBMPQ_FILE_COMPRESSED|LIBMPQ_FILE_ENCRYPTED)) != 0) {
+		return NULL;
+	}
+	if (libmpq_archive_map(mpq_a) == NULL) {
+		return NULL;
+	}
+	if (mpq_b->filepos > mpq_a->mapsize || mpq_b->fsize > mpq_a->mapsize - mpq_b->filepos) {
+		return NULL;
+	}
+	return mpq_a->map + mpq_b->filepos;
+}
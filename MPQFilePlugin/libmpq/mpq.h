@@ -69,11 +69,13 @@ extern "C" {
 #define LIBMPQ_EINV_RANGE		-8		/* Given filenumber is out of range */
 #define LIBMPQ_EHASHTABLE		-9		/* error in reading hashtable */
 #define LIBMPQ_EBLOCKTABLE		-10		/* error in reading blocktable */
+#define LIBMPQ_EARCHIVE_FULL		-11		/* no free hash or block table entry left for a new file */
 
 #define LIBMPQ_ID_MPQ			0x1A51504D	/* MPQ archive header ID ('MPQ\x1A') */
 #define LIBMPQ_HEADER_W3M		0x6D9E4B86	/* special value used by W3M Map Protector */
 #define LIBMPQ_FLAG_PROTECTED		0x00000002	/* Set on protected MPQs (like W3M maps) */
 #define LIBMPQ_HASH_ENTRY_DELETED	0xFFFFFFFE	/* Block index for deleted hash entry */
+#define LIBMPQ_HASH_ENTRY_FREE		0xFFFFFFFF	/* Block index for never used hash entry, ends a probe */
 #define LIBMPQ_LISTFILE_HASH1		0xfd657910 /* Hashes of files that are in any mpq */
 #define LIBMPQ_LISTFILE_HASH2		0x4e9b98a7
 #define LIBMPQ_ATTRFILE_HASH1		0xd38437cb
@@ -84,6 +86,7 @@ extern "C" {
 #define LIBMPQ_FILE_COMPRESSED		0x0000FF00	/* File is compressed */
 #define LIBMPQ_FILE_EXISTS		0x80000000	/* Set if file exists, reset when the file was deleted */
 #define LIBMPQ_FILE_ENCRYPTED		0x00010000	/* Indicates whether file is encrypted */
+#define LIBMPQ_FILE_SECTOR_CRC		0x04000000	/* Adler32 of each sector follows the last sector */
 
 #define LIBMPQ_FILE_COMPRESSED_SIZE	1		/* MPQ compressed filesize of given file */
 #define LIBMPQ_FILE_UNCOMPRESSED_SIZE	2		/* MPQ uncompressed filesize of given file */
@@ -101,7 +104,12 @@ extern "C" {
 #define LIBMPQ_MPQ_COMPRESSED_SIZE	6		/* Compressed archive size */
 #define LIBMPQ_MPQ_UNCOMPRESSED_SIZE	7		/* Uncompressed archive size */
 
-#define LIBMPQ_HUFF_DECOMPRESS		0		/* Defines that we want to decompress using huffman trees. */
+#define LIBMPQ_VERIFY_OK		0		/* file read back and its checksums match */
+#define LIBMPQ_VERIFY_UNUSED		1		/* free or deleted block, or no hash entry refers to it */
+#define LIBMPQ_VERIFY_ENCRYPTED		2		/* encrypted, not checked as the key isn't known */
+#define LIBMPQ_VERIFY_UNREADABLE	3		/* outside the archive, bad block positions or a failed read */
+#define LIBMPQ_VERIFY_BAD_SIZE		4		/* doesn't decompress to the size in the block table */
+#define LIBMPQ_VERIFY_BAD_CRC		5		/* a sector checksum, or the CRC32 or MD5 of (attributes), differs */
 
 #define LIBMPQ_CONF_EFILE_OPEN		-1		/* error if a specific listfile was forced and could not be opened. */
 #define LIBMPQ_CONF_EFILE_CORRUPT	-2		/* listfile seems to be corrupt */
@@ -176,18 +184,25 @@ typedef struct {
 	/* Non-Storm.dll members */
 
 	unsigned int	accessed;	/* Was something from the file already read? */
+	unsigned char	*blockbuf;	/* Cache of the last partly read block */
+	unsigned int	blockbufpos;	/* Position of the cached block in the file */
+	unsigned int	blockbufsize;	/* Bytes in the cached block */
 } mpq_file;
 
-/* Archive handle structure used since Diablo 1.00 */
+/*
+ *  Archive handle structure used since Diablo 1.00. It doesn't
+ *  change once opened, so threads can read one archive at the
+ *  same time, each through its own mpq_file.
+ */
 typedef struct {
 	char	filename[PATH_MAX];	/* Opened archive file name */
-	int		fd;		/* File handle */
-	unsigned int	blockpos;	/* Position of loaded block in the file */
+	int		fd;		/* File handle, only read with libmpq_pread */
+	unsigned int	blockpos;	/* Unused, the block cache is in mpq_file */
 	unsigned int	blocksize;	/* Size of file block */
-	unsigned char	*blockbuf;	/* Buffer (cache) for file block */
-	unsigned int	bufpos;		/* Position in block buffer */
+	unsigned char	*blockbuf;	/* Unused, the block cache is in mpq_file */
+	unsigned int	bufpos;		/* Unused, the block cache is in mpq_file */
 	unsigned int	mpqpos;		/* MPQ archive position in the file */
-	unsigned int	filepos;	/* Current file pointer */
+	unsigned int	filepos;	/* Unused, reads are positioned */
 	unsigned int	openfiles;	/* Number of open files + 1 */
 	mpq_buffer	buf;			/* MPQ buffer */
 	mpq_header	*header;		/* MPQ file header */
@@ -198,8 +213,33 @@ typedef struct {
 
 	unsigned int	flags;		/* See LIBMPQ_TOOLS_FLAG_XXXXX */
 	unsigned int	maxblockindex;	/* The highest block table entry */
+	int		*blockhash;	/* Hash table entry of each block, -1 if none (blocktablesize entries) */
+	unsigned char	*map;		/* Read only mapping of the archive file, see libmpq_archive_map */
+	unsigned int	mapsize;	/* Size of the mapping */
+	void		*maphandle;	/* File mapping handle (win32) */
 } mpq_archive;
 
+/* File for libmpq_archive_add_files */
+typedef struct {
+	const char		*filename;	/* Name in the archive */
+	const unsigned char	*data;		/* Contents of the file */
+	unsigned int		size;		/* Bytes of data */
+	unsigned int		flags;		/* 0 to store, LIBMPQ_FILE_COMPRESS_MULTI (zlib) or LIBMPQ_FILE_COMPRESS_PKWARE */
+} mpq_add_file;
+
+/*
+ *  Archive opened for writing by libmpq_archive_create or
+ *  libmpq_archive_append. The tables are kept in mpq_a and
+ *  written by libmpq_archive_finish.
+ */
+typedef struct {
+	mpq_archive	*mpq_a;		/* Header, tables and crypt buffer, fd is open for writing */
+	unsigned int	datapos;	/* End of the file data relative to mpqpos, the tables go there */
+	char		*listfile;	/* Names for the (listfile), one per line */
+	unsigned int	listsize;	/* Bytes used in listfile */
+	unsigned int	listmax;	/* Bytes allocated for listfile */
+} mpq_writer;
+
 char *libmpq_version();
 int libmpq_archive_open(mpq_archive *mpq_a, unsigned char *mpq_filename);
 int libmpq_archive_close(mpq_archive *mpq_a);
@@ -207,11 +247,34 @@ int libmpq_archive_info(mpq_archive *mpq_a, unsigned int infotype);
 //int libmpq_file_extract(mpq_archive *mpq_a, const int number);\
 /// *dest must have enough space
 int libmpq_file_getdata(mpq_archive *mpq_a, const int number, unsigned char *dest);
+/// keeps the block positions of a file between reads, close with libmpq_file_close
+int libmpq_file_open(mpq_archive *mpq_a, const int number, mpq_file **mpq_f);
+void libmpq_file_close(mpq_file *mpq_f);
+/// *dest must hold a whole block (LIBMPQ_MPQ_BLOCKSIZE), returns the bytes of the block or 0
+int libmpq_file_read_sector(mpq_archive *mpq_a, mpq_file *mpq_f, unsigned int sector, unsigned char *dest);
+/// maps the archive file on first use, NULL if it can't be mapped
+const unsigned char *libmpq_archive_map(mpq_archive *mpq_a);
+/// bytes of a stored (not compressed or encrypted) file in the mapping, NULL otherwise
+const unsigned char *libmpq_file_view(mpq_archive *mpq_a, const int number);
 int libmpq_file_info(mpq_archive *mpq_a, unsigned int infotype, const int number);
 int libmpq_file_number(mpq_archive *mpq_a, const char *name);
 int libmpq_file_number_from_hash(mpq_archive *mpq_a, unsigned int hash1, unsigned int hash2);
+int libmpq_file_number_probe(mpq_archive *mpq_a, unsigned int hash0, unsigned int hash1, unsigned int hash2);
 int libmpq_file_check(mpq_archive *mpq_a, void *file, int type);
 int libmpq_hash_filename(mpq_archive *mpq_a, const unsigned char *pbKey, unsigned int *seed1, unsigned int*seed2);
+unsigned int libmpq_hash_string(mpq_archive *mpq_a, unsigned int type, const unsigned char *pbKey);
+
+/// new archive for up to maxfiles files, sectors of 0x200 << blockshift bytes
+int libmpq_archive_create(mpq_writer *mpq_w, const char *filename, unsigned int maxfiles, unsigned int blockshift);
+/// opens an archive to add files to it, files of the same name are replaced
+int libmpq_archive_append(mpq_writer *mpq_w, const char *filename);
+/// compresses the sectors of all files on the thread pool, then writes the files in order
+int libmpq_archive_add_files(mpq_writer *mpq_w, const mpq_add_file *files, unsigned int count);
+/// writes the (listfile), the tables and the header, and closes the archive
+int libmpq_archive_finish(mpq_writer *mpq_w);
+
+/// checks every file on the thread pool, *result gets a LIBMPQ_VERIFY_* value per block table entry
+int libmpq_archive_verify(mpq_archive *mpq_a, int *result);
 
 int libmpq_pkzip_decompress(char *out_buf, int *out_length, char *in_buf, int in_length);
 int libmpq_zlib_decompress(char *out_buf, int *out_length, char *in_buf, int in_length);
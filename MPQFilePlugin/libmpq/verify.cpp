@@ -0,0 +1,344 @@
+/*
+ *  verify.cpp -- checks the files of an MPQ archive.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include "zlib.h"
+#include "mpq.h"
+#include "common.h"
+#include "../../Common/ThreadPool.h"
+
+#define LIBMPQ_ATTRIBUTES_VERSION	100		/* Version of the (attributes) format */
+#define LIBMPQ_ATTRIBUTES_CRC32		0x00000001	/* (attributes) has the CRC32 of each file */
+#define LIBMPQ_ATTRIBUTES_FILETIME	0x00000002	/* (attributes) has the FILETIME of each file */
+#define LIBMPQ_ATTRIBUTES_MD5		0x00000004	/* (attributes) has the MD5 of each file */
+
+/* Checksums of the (attributes) file, one per block table entry */
+typedef struct {
+	unsigned char	*data;		/* Contents of the (attributes) file */
+	unsigned int	*crc32;		/* CRC32 of the uncompressed files, NULL if not stored */
+	unsigned char	*md5;		/* MD5 of the uncompressed files, 16 bytes each, NULL if not stored */
+} libmpq_attributes;
+
+static const unsigned int libmpq_md5_k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const unsigned char libmpq_md5_shift[16] = {
+	7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21
+};
+
+/*
+ *  This function adds one 64 byte block to the MD5 state
+ *  (RFC 1321).
+ */
+static void libmpq_md5_block(unsigned int *state, const unsigned char *block) {
+	unsigned int w[16];
+	unsigned int a = state[0];
+	unsigned int b = state[1];
+	unsigned int c = state[2];
+	unsigned int d = state[3];
+	unsigned int f, g, t;
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = block[i * 4] | (block[i * 4 + 1] << 8) | (block[i * 4 + 2] << 16) | ((unsigned int)block[i * 4 + 3] << 24);
+	}
+	for (i = 0; i < 64; i++) {
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		} else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) & 15;
+		} else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) & 15;
+		} else {
+			f = c ^ (b | ~d);
+			g = (7 * i) & 15;
+		}
+		t = a + f + libmpq_md5_k[i] + w[g];
+		t = (t << libmpq_md5_shift[(i >> 4) * 4 + (i & 3)]) | (t >> (32 - libmpq_md5_shift[(i >> 4) * 4 + (i & 3)]));
+		a = d;
+		d = c;
+		c = b;
+		b += t;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+/*
+ *  This function computes the MD5 digest of a buffer, as
+ *  stored in the (attributes) file.
+ */
+static void libmpq_md5(const unsigned char *data, unsigned int length, unsigned char *digest) {
+	unsigned int state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+	unsigned char tail[128];
+	unsigned int rest = length & 63;
+	unsigned int tailsize = rest < 56 ? 64 : 128;
+	unsigned int i;
+
+	for (i = 0; i + 64 <= length; i += 64) {
+		libmpq_md5_block(state, data + i);
+	}
+
+	/* The last bytes, a 0x80, zeros and the bit count fill one or two blocks. */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, data + length - rest, rest);
+	tail[rest] = 0x80;
+	for (i = 0; i < 4; i++) {
+		tail[tailsize - 8 + i] = (unsigned char)((length << 3) >> (i * 8));
+	}
+	tail[tailsize - 4] = (unsigned char)(length >> 29);
+	libmpq_md5_block(state, tail);
+	if (tailsize == 128) {
+		libmpq_md5_block(state, tail + 64);
+	}
+	for (i = 0; i < 16; i++) {
+		digest[i] = (unsigned char)(state[i >> 2] >> ((i & 3) * 8));
+	}
+}
+
+/*
+ *  This function loads the checksums of the (attributes) file.
+ *  Archives without one, or with one that doesn't match the
+ *  block table, are checked without them.
+ */
+static void libmpq_attributes_load(mpq_archive *mpq_a, libmpq_attributes *attr) {
+	unsigned int count = mpq_a->header->blocktablesize;
+	unsigned int needed = 8;
+	unsigned int size, flags;
+	int number;
+
+	memset(attr, 0, sizeof(libmpq_attributes));
+	number = libmpq_file_number_from_hash(mpq_a, LIBMPQ_ATTRFILE_HASH1, LIBMPQ_ATTRFILE_HASH2);
+	if (number < 1 || (unsigned int)number > count) {
+		return;
+	}
+	size = mpq_a->blocktable[number - 1].fsize;
+	if (size < 8 || (attr->data = (unsigned char *)malloc(size)) == NULL) {
+		return;
+	}
+	if (libmpq_file_getdata(mpq_a, number, attr->data) != LIBMPQ_TOOLS_SUCCESS
+		|| *(unsigned int *)attr->data != LIBMPQ_ATTRIBUTES_VERSION) {
+		free(attr->data);
+		attr->data = NULL;
+		return;
+	}
+
+	/* The arrays follow each other, in the order of their flags. */
+	flags = *(unsigned int *)(attr->data + 4);
+	if (flags & LIBMPQ_ATTRIBUTES_CRC32) {
+		if (size >= needed + count * 4) {
+			attr->crc32 = (unsigned int *)(attr->data + needed);
+		}
+		needed += count * 4;
+	}
+	if (flags & LIBMPQ_ATTRIBUTES_FILETIME) {
+		needed += count * 8;
+	}
+	if ((flags & LIBMPQ_ATTRIBUTES_MD5) && size >= needed + count * 16) {
+		attr->md5 = attr->data + needed;
+	}
+}
+
+/*
+ *  This function checks the sector checksums of a compressed
+ *  file. They are the adler32 of each sector as stored in the
+ *  archive, in a block behind the last sector, 0 means none.
+ */
+static int libmpq_verify_sector_crc(mpq_archive *mpq_a, mpq_block *mpq_b, const unsigned int *blockpos, unsigned int nblocks) {
+	std::vector<unsigned char> raw(blockpos[nblocks + 1] - blockpos[0]);
+	std::vector<unsigned int> crc(nblocks);
+	unsigned int crcsize = blockpos[nblocks + 1] - blockpos[nblocks];
+	int outlength = nblocks * sizeof(int);
+	unsigned int i;
+
+	if (raw.empty() || libmpq_pread(mpq_a, &raw[0], raw.size(), mpq_b->filepos + blockpos[0]) != (int)raw.size()) {
+		return LIBMPQ_VERIFY_UNREADABLE;
+	}
+
+	/* The checksum block is compressed like the sectors, when that makes it smaller. */
+	if (crcsize == nblocks * sizeof(int)) {
+		memcpy(&crc[0], &raw[blockpos[nblocks] - blockpos[0]], crcsize);
+	} else if (crcsize == 0 || crcsize > nblocks * sizeof(int)) {
+		return LIBMPQ_VERIFY_UNREADABLE;
+	} else {
+		if (mpq_b->flags & LIBMPQ_FILE_COMPRESS_PKWARE) {
+			libmpq_pkzip_decompress((char *)&crc[0], &outlength, (char *)&raw[blockpos[nblocks] - blockpos[0]], crcsize);
+		} else {
+			libmpq_multi_decompress((char *)&crc[0], &outlength, (char *)&raw[blockpos[nblocks] - blockpos[0]], crcsize);
+		}
+		if (outlength != (int)(nblocks * sizeof(int))) {
+			return LIBMPQ_VERIFY_UNREADABLE;
+		}
+	}
+	for (i = 0; i < nblocks; i++) {
+		if (crc[i] != 0 && crc[i] != adler32(0, &raw[blockpos[i] - blockpos[0]], blockpos[i + 1] - blockpos[i])) {
+			return LIBMPQ_VERIFY_BAD_CRC;
+		}
+	}
+	return LIBMPQ_VERIFY_OK;
+}
+
+/*
+ *  This function checks one block table entry: the file must
+ *  lie inside the archive, its block positions must be sane,
+ *  every sector must decompress to its size and the stored
+ *  checksums must match.
+ */
+static int libmpq_verify_block(mpq_archive *mpq_a, unsigned int index, const libmpq_attributes *attr) {
+	static const unsigned char nomd5[16] = {0};
+	mpq_block *mpq_b = mpq_a->blocktable + index;
+	mpq_file *mpq_f = NULL;
+	unsigned int blocksize = mpq_a->blocksize;
+	unsigned int nblocks = (mpq_b->fsize + blocksize - 1) / blocksize;
+	unsigned int tablesize = nblocks + 1;
+	std::vector<unsigned int> blockpos;
+	std::vector<unsigned char> data;
+	unsigned char digest[16];
+	int result = LIBMPQ_VERIFY_OK;
+	unsigned int i;
+
+	if ((mpq_b->flags & LIBMPQ_FILE_EXISTS) == 0 || mpq_a->blockhash[index] == -1) {
+		return LIBMPQ_VERIFY_UNUSED;
+	}
+	if (mpq_b->flags & LIBMPQ_FILE_ENCRYPTED) {
+		return LIBMPQ_VERIFY_ENCRYPTED;
+	}
+	if (mpq_b->filepos > mpq_a->mapsize || mpq_b->csize > mpq_a->mapsize - mpq_b->filepos) {
+		return LIBMPQ_VERIFY_UNREADABLE;
+	}
+
+	if ((mpq_b->flags & LIBMPQ_FILE_COMPRESSED) == 0) {
+		if (mpq_b->csize != mpq_b->fsize) {
+			return LIBMPQ_VERIFY_BAD_SIZE;
+		}
+	} else {
+		/* The reader trusts the block positions, so they are checked first. */
+		if (mpq_b->flags & LIBMPQ_FILE_SECTOR_CRC) {
+			tablesize++;
+		}
+		if (tablesize > mpq_b->csize / sizeof(int)) {
+			return LIBMPQ_VERIFY_UNREADABLE;
+		}
+		blockpos.resize(tablesize);
+		if (libmpq_pread(mpq_a, &blockpos[0], tablesize * sizeof(int), mpq_b->filepos) != (int)(tablesize * sizeof(int))
+			|| blockpos[0] != tablesize * sizeof(int)) {
+			return LIBMPQ_VERIFY_UNREADABLE;
+		}
+		for (i = 0; i + 1 < tablesize; i++) {
+			if (blockpos[i + 1] < blockpos[i] || blockpos[i + 1] > mpq_b->csize) {
+				return LIBMPQ_VERIFY_UNREADABLE;
+			}
+
+			/*
+			 *  Compression never makes a sector bigger. The files
+			 *  of patch.MPQ that give 1 for their size end up here.
+			 */
+			if (i < nblocks && blockpos[i + 1] - blockpos[i] > min(blocksize, mpq_b->fsize - i * blocksize)) {
+				return LIBMPQ_VERIFY_BAD_SIZE;
+			}
+		}
+	}
+
+	if (libmpq_file_open(mpq_a, index + 1, &mpq_f) != LIBMPQ_TOOLS_SUCCESS) {
+		return LIBMPQ_VERIFY_UNREADABLE;
+	}
+	if (mpq_b->flags & LIBMPQ_FILE_COMPRESSED) {
+		memcpy(mpq_f->blockpos, &blockpos[0], (nblocks + 1) * sizeof(int));
+		mpq_f->blockposloaded = TRUE;
+	}
+
+	/* Sector by sector, so a sector that decompresses short is noticed. */
+	data.resize(nblocks * blocksize + 1);
+	for (i = 0; i < nblocks && result == LIBMPQ_VERIFY_OK; i++) {
+		int bytes = libmpq_file_read_sector(mpq_a, mpq_f, i, &data[i * blocksize]);
+		if (bytes <= 0) {
+			result = LIBMPQ_VERIFY_UNREADABLE;
+		} else if ((unsigned int)bytes != min(blocksize, mpq_b->fsize - i * blocksize)) {
+			result = LIBMPQ_VERIFY_BAD_SIZE;
+		}
+	}
+	libmpq_file_close(mpq_f);
+
+	if (result == LIBMPQ_VERIFY_OK && nblocks > 0 && (mpq_b->flags & LIBMPQ_FILE_COMPRESSED) && (mpq_b->flags & LIBMPQ_FILE_SECTOR_CRC)) {
+		result = libmpq_verify_sector_crc(mpq_a, mpq_b, &blockpos[0], nblocks);
+	}
+	if (result == LIBMPQ_VERIFY_OK && attr->crc32 && attr->crc32[index] != 0
+		&& attr->crc32[index] != crc32(0, &data[0], mpq_b->fsize)) {
+		result = LIBMPQ_VERIFY_BAD_CRC;
+	}
+	if (result == LIBMPQ_VERIFY_OK && attr->md5 && memcmp(attr->md5 + index * 16, nomd5, 16) != 0) {
+		libmpq_md5(&data[0], mpq_b->fsize, digest);
+		if (memcmp(attr->md5 + index * 16, digest, 16) != 0) {
+			result = LIBMPQ_VERIFY_BAD_CRC;
+		}
+	}
+	return result;
+}
+
+/*
+ *  Checks the block table entries of libmpq_archive_verify,
+ *  one per index. Each one reads through its own mpq_file.
+ */
+class CVerifyBlockTask : public iThreadTask
+{
+public:
+	virtual void runTask(size_t uIndex) {
+		result[uIndex] = libmpq_verify_block(mpq_a, (unsigned int)uIndex, attr);
+	}
+
+	mpq_archive		*mpq_a;
+	const libmpq_attributes	*attr;
+	int			*result;
+};
+
+/*
+ *  This function checks every file of the archive on the
+ *  thread pool. result gets a LIBMPQ_VERIFY_* value for each
+ *  block table entry.
+ */
+int libmpq_archive_verify(mpq_archive *mpq_a, int *result) {
+	libmpq_attributes attr;
+	CVerifyBlockTask verify;
+
+	if (mpq_a->flags & LIBMPQ_FLAG_PROTECTED) {
+		return LIBMPQ_EFILE_FORMAT;
+	}
+	libmpq_attributes_load(mpq_a, &attr);
+	verify.mpq_a  = mpq_a;
+	verify.attr   = &attr;
+	verify.result = result;
+	CThreadPool::getShared().run(verify, mpq_a->header->blocktablesize);
+	free(attr.data);
+	return LIBMPQ_TOOLS_SUCCESS;
+}
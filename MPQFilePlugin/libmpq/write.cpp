@@ -0,0 +1,483 @@
+/*
+ *  write.cpp -- creates MPQ archives and adds files to them.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <vector>
+#include "zlib.h"
+#include "mpq.h"
+#include "common.h"
+#include "explode.h"
+#include "../../Common/ThreadPool.h"
+
+#ifdef _WIN32
+#define LIBMPQ_WRITE_MODE	(S_IREAD|S_IWRITE)
+#else
+#define LIBMPQ_WRITE_MODE	0644
+#endif
+
+#define LIBMPQ_LISTFILE_NAME	"(listfile)"
+#define LIBMPQ_ATTRFILE_NAME	"(attributes)"
+
+/*
+ *  This function frees the writer, also after a failed
+ *  open or create. A fd of 0 was never opened.
+ */
+static void libmpq_writer_free(mpq_writer *mpq_w) {
+	mpq_archive *mpq_a = mpq_w->mpq_a;
+
+	if (mpq_a) {
+		if (mpq_a->fd > 0) {
+			close(mpq_a->fd);
+		}
+		free(mpq_a->header);
+		free(mpq_a->hashtable);
+		free(mpq_a->blocktable);
+		free(mpq_a->blockhash);
+		free(mpq_a);
+	}
+	free(mpq_w->listfile);
+	memset(mpq_w, 0, sizeof(mpq_writer));
+}
+
+/*
+ *  This function adds a line to the (listfile) written by
+ *  libmpq_archive_finish.
+ */
+static int libmpq_writer_list(mpq_writer *mpq_w, const char *filename) {
+	unsigned int length = strlen(filename);
+	char *listfile = NULL;
+
+	if (mpq_w->listsize + length + 2 > mpq_w->listmax) {
+		unsigned int listmax = mpq_w->listmax ? mpq_w->listmax * 2 : 0x1000;
+		while (listmax < mpq_w->listsize + length + 2) {
+			listmax *= 2;
+		}
+		if ((listfile = (char *)realloc(mpq_w->listfile, listmax)) == NULL) {
+			return LIBMPQ_EALLOCMEM;
+		}
+		mpq_w->listfile = listfile;
+		mpq_w->listmax  = listmax;
+	}
+	memcpy(mpq_w->listfile + mpq_w->listsize, filename, length);
+	memcpy(mpq_w->listfile + mpq_w->listsize + length, "\r\n", 2);
+	mpq_w->listsize += length + 2;
+	return LIBMPQ_TOOLS_SUCCESS;
+}
+
+/*
+ *  This function returns the hash table entry of a file
+ *  to write. It is the entry of the same name when there
+ *  is one, to be replaced, else the first free or deleted
+ *  entry on the probe of the name. NULL if the table is
+ *  full.
+ */
+static mpq_hash *libmpq_writer_hash(mpq_archive *mpq_a, const char *filename, unsigned int *hash1, unsigned int *hash2) {
+	unsigned int size   = mpq_a->header->hashtablesize;
+	unsigned int hash0  = libmpq_hash_string(mpq_a, 0, (const unsigned char *)filename);
+	unsigned int i      = (size & (size - 1)) == 0 ? (hash0 & (size - 1)) : (hash0 % size);
+	unsigned int n      = 0;
+	mpq_hash *unused    = NULL;
+	mpq_hash *mpq_h     = NULL;
+
+	libmpq_hash_filename(mpq_a, (const unsigned char *)filename, hash1, hash2);
+	for (n = 0; n < size; n++) {
+		mpq_h = &(mpq_a->hashtable[i]);
+		if (mpq_h->blockindex == LIBMPQ_HASH_ENTRY_FREE) {
+			return unused ? unused : mpq_h;
+		}
+		if (mpq_h->blockindex == LIBMPQ_HASH_ENTRY_DELETED) {
+			if (unused == NULL) {
+				unused = mpq_h;
+			}
+		} else if (mpq_h->name1 == *hash1 && mpq_h->name2 == *hash2) {
+			return mpq_h;
+		}
+		if (++i == size) {
+			i = 0;
+		}
+	}
+	return unused;
+}
+
+/* One block (sector) of a compressed file for CWriteBlockTask */
+typedef struct {
+	unsigned int	file;		/* Index in the files */
+	unsigned int	offset;		/* Position of the block in the file */
+	unsigned int	bytes;		/* Uncompressed size of the block */
+} mpq_write_block;
+
+/*
+ *  Compresses the blocks given to libmpq_archive_add_files,
+ *  each one into its own buffer. Blocks which don't get
+ *  smaller are stored as they are, like the reader expects.
+ */
+class CWriteBlockTask : public iThreadTask
+{
+public:
+	virtual void runTask(size_t uIndex) {
+		const mpq_write_block *block = &blocks[uIndex];
+		const mpq_add_file *file     = &files[block->file];
+		const unsigned char *in      = file->data + block->offset;
+		std::vector<unsigned char> &out = outbuf[uIndex];
+		unsigned int length = 0;
+
+		out.resize(block->bytes);
+		if (file->flags & LIBMPQ_FILE_COMPRESS_PKWARE) {
+			length = libmpq_pkzip_implode_span(in, block->bytes, &out[0], block->bytes - 1);
+		} else if (block->bytes > 2) {
+			/* Multiple compression, the first byte tells which ones were applied */
+			uLongf zlength = block->bytes - 2;
+			out[0] = 0x02;
+			if (compress2(&out[1], &zlength, in, block->bytes, Z_DEFAULT_COMPRESSION) == Z_OK) {
+				length = 1 + zlength;
+			}
+		}
+		if (length == 0 || length >= block->bytes) {
+			memcpy(&out[0], in, block->bytes);
+			length = block->bytes;
+		}
+		out.resize(length);
+	}
+
+	const mpq_add_file				*files;
+	std::vector<mpq_write_block>			blocks;
+	std::vector<std::vector<unsigned char> >	outbuf;	/* Compressed blocks */
+};
+
+/*
+ *  This function creates a new archive. The hash table
+ *  gets room for maxfiles files and the (listfile).
+ */
+int libmpq_archive_create(mpq_writer *mpq_w, const char *filename, unsigned int maxfiles, unsigned int blockshift) {
+	mpq_archive *mpq_a = NULL;
+	unsigned int size  = 0x10;
+
+	memset(mpq_w, 0, sizeof(mpq_writer));
+
+	/* The size of the hash table must be a power of two */
+	while (size < maxfiles + 1 && size < 0x80000000) {
+		size <<= 1;
+	}
+
+	if ((mpq_a = (mpq_archive *)malloc(sizeof(mpq_archive))) == NULL) {
+		return LIBMPQ_EALLOCMEM;
+	}
+	memset(mpq_a, 0, sizeof(mpq_archive));
+	mpq_w->mpq_a      = mpq_a;
+	mpq_a->header     = (mpq_header *)malloc(sizeof(mpq_header));
+	mpq_a->hashtable  = (mpq_hash *)malloc(sizeof(mpq_hash) * size);
+	mpq_a->blocktable = (mpq_block *)malloc(sizeof(mpq_block) * size);
+	if (!mpq_a->header || !mpq_a->hashtable || !mpq_a->blocktable) {
+		libmpq_writer_free(mpq_w);
+		return LIBMPQ_EALLOCMEM;
+	}
+
+	mpq_a->fd = open(filename, O_RDWR|O_CREAT|O_TRUNC|O_BINARY, LIBMPQ_WRITE_MODE);
+	if (mpq_a->fd == LIBMPQ_EFILE) {
+		mpq_a->fd = 0;
+		libmpq_writer_free(mpq_w);
+		return LIBMPQ_EFILE;
+	}
+	strncpy(mpq_a->filename, filename, PATH_MAX - 1);
+	libmpq_init_buffer(mpq_a);
+
+	memset(mpq_a->header, 0, sizeof(mpq_header));
+	mpq_a->header->id             = LIBMPQ_ID_MPQ;
+	mpq_a->header->offset         = sizeof(mpq_header);
+	mpq_a->header->blocksize      = blockshift;
+	mpq_a->header->hashtablesize  = size;
+	mpq_a->header->blocktablesize = 0;
+	mpq_a->blocksize              = 0x200 << blockshift;
+
+	/* Unused hash entries are all ones */
+	memset(mpq_a->hashtable, 0xFF, sizeof(mpq_hash) * size);
+	mpq_w->datapos = sizeof(mpq_header);
+	return LIBMPQ_TOOLS_SUCCESS;
+}
+
+/*
+ *  This function opens an archive to add files to it, as
+ *  for a patch. The new files are written behind the old
+ *  ones, which stay where they are. The hash table keeps
+ *  its size, since the names of the old files to rehash
+ *  them aren't known.
+ */
+int libmpq_archive_append(mpq_writer *mpq_w, const char *filename) {
+	mpq_archive *mpq_a    = NULL;
+	unsigned int i        = 0;
+	unsigned int tableend = 0;
+	int fileno            = 0;
+	int result            = 0;
+
+	memset(mpq_w, 0, sizeof(mpq_writer));
+	if ((mpq_a = (mpq_archive *)malloc(sizeof(mpq_archive))) == NULL) {
+		return LIBMPQ_EALLOCMEM;
+	}
+	mpq_w->mpq_a = mpq_a;
+	if ((result = libmpq_archive_open(mpq_a, (unsigned char *)filename)) != LIBMPQ_TOOLS_SUCCESS) {
+		libmpq_writer_free(mpq_w);
+		return result;
+	}
+
+	/* Keep the names of the old files for the new (listfile) */
+	fileno = libmpq_file_number(mpq_a, LIBMPQ_LISTFILE_NAME);
+	if (fileno != LIBMPQ_EFILE_NOT_FOUND && mpq_a->blocktable[fileno - 1].fsize > 0) {
+		unsigned int size = mpq_a->blocktable[fileno - 1].fsize;
+		if ((mpq_w->listfile = (char *)malloc(size + 2)) == NULL) {
+			libmpq_writer_free(mpq_w);
+			return LIBMPQ_EALLOCMEM;
+		}
+		mpq_w->listmax = size + 2;
+		if (libmpq_file_getdata(mpq_a, fileno, (unsigned char *)mpq_w->listfile) == LIBMPQ_TOOLS_SUCCESS) {
+			mpq_w->listsize = size;
+			if (mpq_w->listfile[size - 1] != '\n') {
+				memcpy(mpq_w->listfile + size, "\r\n", 2);
+				mpq_w->listsize += 2;
+			}
+		}
+	}
+
+	/* Reopen for writing, libmpq_archive_open is done reading */
+	close(mpq_a->fd);
+	mpq_a->fd = open(filename, O_RDWR|O_BINARY);
+	if (mpq_a->fd == LIBMPQ_EFILE) {
+		mpq_a->fd = 0;
+		libmpq_writer_free(mpq_w);
+		return LIBMPQ_EFILE;
+	}
+
+	/*
+	 *  Back to positions relative to the archive, as they are
+	 *  written. libmpq_read_blocktable moved the blocks up to
+	 *  maxblockindex only.
+	 */
+	for (i = 0; i <= mpq_a->maxblockindex && i < mpq_a->header->blocktablesize; i++) {
+		mpq_a->blocktable[i].filepos -= mpq_a->mpqpos;
+	}
+
+	/*
+	 *  New data goes behind the last file and the old tables. Until
+	 *  libmpq_archive_finish writes the new header, the old one still
+	 *  points at them, so an append that fails leaves the archive as
+	 *  it was.
+	 */
+	mpq_w->datapos = mpq_a->header->hashtablepos - mpq_a->mpqpos + mpq_a->header->hashtablesize * sizeof(mpq_hash);
+	tableend       = mpq_a->header->blocktablepos - mpq_a->mpqpos + mpq_a->header->blocktablesize * sizeof(mpq_block);
+	if (tableend > mpq_w->datapos) {
+		mpq_w->datapos = tableend;
+	}
+	for (i = 0; i < mpq_a->header->blocktablesize; i++) {
+		const mpq_block *mpq_b = &(mpq_a->blocktable[i]);
+		if ((mpq_b->flags & LIBMPQ_FILE_EXISTS) && mpq_b->filepos + mpq_b->csize > mpq_w->datapos) {
+			mpq_w->datapos = mpq_b->filepos + mpq_b->csize;
+		}
+	}
+
+	/* The (attributes) would keep the CRCs of the replaced files */
+	fileno = libmpq_file_number(mpq_a, LIBMPQ_ATTRFILE_NAME);
+	if (fileno != LIBMPQ_EFILE_NOT_FOUND) {
+		mpq_a->hashtable[mpq_a->blockhash[fileno - 1]].blockindex = LIBMPQ_HASH_ENTRY_DELETED;
+		mpq_a->blocktable[fileno - 1].flags = 0;
+	}
+	return LIBMPQ_TOOLS_SUCCESS;
+}
+
+/*
+ *  This function adds files to the archive. The blocks of
+ *  all given files are compressed on the thread pool first,
+ *  then the files are written one after the other, so
+ *  passing many files at once keeps all cores busy.
+ */
+int libmpq_archive_add_files(mpq_writer *mpq_w, const mpq_add_file *files, unsigned int count) {
+	mpq_archive *mpq_a = mpq_w->mpq_a;
+	CWriteBlockTask task;
+	std::vector<unsigned int> firstblock(count + 1);
+	std::vector<unsigned char> data;
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	/* Split the compressed files into blocks */
+	for (i = 0; i < count; i++) {
+		firstblock[i] = (unsigned int)task.blocks.size();
+		if ((files[i].flags & (LIBMPQ_FILE_COMPRESS_PKWARE|LIBMPQ_FILE_COMPRESS_MULTI)) == 0) {
+			continue;
+		}
+		for (j = 0; j < files[i].size; j += mpq_a->blocksize) {
+			mpq_write_block block;
+			block.file   = i;
+			block.offset = j;
+			block.bytes  = files[i].size - j < mpq_a->blocksize ? files[i].size - j : mpq_a->blocksize;
+			task.blocks.push_back(block);
+		}
+	}
+	firstblock[count] = (unsigned int)task.blocks.size();
+	task.files = files;
+	task.outbuf.resize(task.blocks.size());
+	CThreadPool::getShared().run(task, task.blocks.size());
+
+	for (i = 0; i < count; i++) {
+		const mpq_add_file *file = &files[i];
+		unsigned int nblocks     = firstblock[i + 1] - firstblock[i];
+		unsigned int csize       = file->size;
+		unsigned int flags       = LIBMPQ_FILE_EXISTS;
+		unsigned int hash1       = 0;
+		unsigned int hash2       = 0;
+		unsigned int blockindex  = mpq_a->header->blocktablesize;
+		const unsigned char *out = file->data;
+		mpq_hash *mpq_h          = NULL;
+		mpq_block *mpq_b         = NULL;
+
+		/* The reader keeps as many blocks as hash entries */
+		if (blockindex >= mpq_a->header->hashtablesize) {
+			return LIBMPQ_EARCHIVE_FULL;
+		}
+		if ((mpq_h = libmpq_writer_hash(mpq_a, file->filename, &hash1, &hash2)) == NULL) {
+			return LIBMPQ_EARCHIVE_FULL;
+		}
+
+		/* Compressed files start with the positions of their blocks */
+		if (nblocks > 0) {
+			unsigned int *blockpos = NULL;
+
+			csize = (nblocks + 1) * sizeof(unsigned int);
+			for (j = 0; j < nblocks; j++) {
+				csize += (unsigned int)task.outbuf[firstblock[i] + j].size();
+			}
+			data.resize(csize);
+			blockpos    = (unsigned int *)&data[0];
+			blockpos[0] = (nblocks + 1) * sizeof(unsigned int);
+			for (j = 0; j < nblocks; j++) {
+				const std::vector<unsigned char> &block = task.outbuf[firstblock[i] + j];
+				memcpy(&data[blockpos[j]], &block[0], block.size());
+				blockpos[j + 1] = blockpos[j] + (unsigned int)block.size();
+			}
+			out    = &data[0];
+			flags |= (file->flags & LIBMPQ_FILE_COMPRESS_PKWARE) ? LIBMPQ_FILE_COMPRESS_PKWARE : LIBMPQ_FILE_COMPRESS_MULTI;
+		}
+
+		/* Positions are 32 bit */
+		if ((unsigned long long)mpq_w->datapos + csize + mpq_a->mpqpos > 0xFFFFFFFF) {
+			return LIBMPQ_EFILE;
+		}
+		if (csize > 0 && libmpq_pwrite(mpq_a, out, csize, mpq_a->mpqpos + mpq_w->datapos) != (int)csize) {
+			return LIBMPQ_EFILE;
+		}
+
+		/* A replaced file keeps its block entry, cleared */
+		if (mpq_h->blockindex < LIBMPQ_HASH_ENTRY_DELETED) {
+			if (mpq_h->blockindex < mpq_a->header->blocktablesize) {
+				mpq_a->blocktable[mpq_h->blockindex].flags = 0;
+			}
+		} else if (strcmp(file->filename, LIBMPQ_LISTFILE_NAME) != 0) {
+			if (libmpq_writer_list(mpq_w, file->filename) != LIBMPQ_TOOLS_SUCCESS) {
+				return LIBMPQ_EALLOCMEM;
+			}
+		}
+
+		mpq_b = &(mpq_a->blocktable[blockindex]);
+		mpq_b->filepos = mpq_w->datapos;
+		mpq_b->csize   = csize;
+		mpq_b->fsize   = file->size;
+		mpq_b->flags   = flags;
+		mpq_a->header->blocktablesize++;
+
+		mpq_h->name1      = hash1;
+		mpq_h->name2      = hash2;
+		mpq_h->locale     = 0;
+		mpq_h->blockindex = blockindex;
+
+		mpq_w->datapos += csize;
+	}
+	return LIBMPQ_TOOLS_SUCCESS;
+}
+
+/*
+ *  This function writes the (listfile) with the names of
+ *  all files, then the encrypted hash and block tables
+ *  and the header. The writer is freed, also on errors.
+ */
+int libmpq_archive_finish(mpq_writer *mpq_w) {
+	mpq_archive *mpq_a = mpq_w->mpq_a;
+	std::vector<mpq_hash> hashtable;
+	std::vector<mpq_block> blocktable;
+	mpq_header header;
+	unsigned int hashbytes  = 0;
+	unsigned int blockbytes = 0;
+	unsigned int end        = 0;
+	int result = LIBMPQ_TOOLS_SUCCESS;
+
+	/* Already freed by a failed create or append */
+	if (mpq_a == NULL) {
+		return LIBMPQ_EFILE;
+	}
+
+	if (mpq_w->listsize > 0) {
+		mpq_add_file listfile;
+		listfile.filename = LIBMPQ_LISTFILE_NAME;
+		listfile.data     = (const unsigned char *)mpq_w->listfile;
+		listfile.size     = mpq_w->listsize;
+		listfile.flags    = LIBMPQ_FILE_COMPRESS_MULTI;
+		result = libmpq_archive_add_files(mpq_w, &listfile, 1);
+	}
+
+	if (result == LIBMPQ_TOOLS_SUCCESS) {
+		hashbytes  = mpq_a->header->hashtablesize * sizeof(mpq_hash);
+		blockbytes = mpq_a->header->blocktablesize * sizeof(mpq_block);
+		end        = mpq_w->datapos + hashbytes + blockbytes;
+
+		hashtable.assign(mpq_a->hashtable, mpq_a->hashtable + mpq_a->header->hashtablesize);
+		libmpq_encrypt_block(mpq_a, (unsigned int *)&hashtable[0], hashbytes, libmpq_hash_string(mpq_a, 3, (const unsigned char *)"(hash table)"));
+		if (blockbytes > 0) {
+			blocktable.assign(mpq_a->blocktable, mpq_a->blocktable + mpq_a->header->blocktablesize);
+			libmpq_encrypt_block(mpq_a, (unsigned int *)&blocktable[0], blockbytes, libmpq_hash_string(mpq_a, 3, (const unsigned char *)"(block table)"));
+		}
+
+		header                = *mpq_a->header;
+		header.id             = LIBMPQ_ID_MPQ;
+		header.offset         = sizeof(mpq_header);
+		header.offsetsc       = 0;	/* format 1, the extended tables of later formats aren't written */
+		header.archivesize    = end;
+		header.hashtablepos   = mpq_w->datapos;
+		header.blocktablepos  = mpq_w->datapos + hashbytes;
+
+		if ((unsigned long long)end + mpq_a->mpqpos > 0xFFFFFFFF
+			|| libmpq_pwrite(mpq_a, &hashtable[0], hashbytes, mpq_a->mpqpos + header.hashtablepos) != (int)hashbytes
+			|| (blockbytes > 0 && libmpq_pwrite(mpq_a, &blocktable[0], blockbytes, mpq_a->mpqpos + header.blocktablepos) != (int)blockbytes)
+			|| libmpq_pwrite(mpq_a, &header, sizeof(mpq_header), mpq_a->mpqpos) != sizeof(mpq_header)) {
+			result = LIBMPQ_EFILE;
+		}
+	}
+
+	/* Cut off what a failed earlier write may have left behind the tables */
+	if (result == LIBMPQ_TOOLS_SUCCESS) {
+#ifdef _WIN32
+		if (_chsize_s(mpq_a->fd, (__int64)mpq_a->mpqpos + end) != 0) {
+#else
+		if (ftruncate(mpq_a->fd, (off_t)mpq_a->mpqpos + end) != 0) {
+#endif
+			result = LIBMPQ_EFILE;
+		}
+	}
+
+	libmpq_writer_free(mpq_w);
+	return result;
+}
@@ -2,6 +2,9 @@
 
 #include <vector>
 #include <algorithm> 
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #define S_REL(p) { if(p) p->Release(); p = NULL; }
 #define S_DEL(p) { if(p) delete p; p = NULL; }
@@ -14,12 +17,20 @@ ArchiveSet& GetOpenArchives()
 {
 	return gOpenArchives;
 }
+
+MPQIndex gMPQIndex;
+
+MPQIndex& GetMPQIndex()
+{
+	return gMPQIndex;
+}
 //bool useLocalFiles = false;
 bool bUseTestPatch = false;
 bool bUsePatch = true;
 
 std::string testPath = "D:\\World of Warcraft\\Data\\";
 std::string gamePath = "D:\\World of Warcraft\\Data\\";
+std::string indexCache = "mpqindex.cache";
 
 std::vector<MPQArchive*> archives;
 
@@ -50,6 +61,8 @@ MPQArchive::~MPQArchive()
 
 void MPQArchive::close()
 {
+	// the index points into the archive
+	gMPQIndex.clear();
 	libmpq_archive_close(&mpq_a);
 	for(ArchiveSet::iterator it=gOpenArchives.begin(); it!=gOpenArchives.end();++it)
 	{
@@ -63,11 +76,457 @@ void MPQArchive::close()
 
 }
 
+MPQIndex::MPQIndex():
+	m_pArchive(NULL),
+	m_uCount(0)
+{
+}
+
+void MPQIndex::clear()
+{
+	m_pArchive = NULL;
+	m_setSlot.clear();
+	m_uCount = 0;
+	m_setNameChar.clear();
+	m_setName.clear();
+	m_setNameByExt.clear();
+}
+
+std::string MPQIndex::normalize(const char* filename)
+{
+	std::string str = filename;
+	for (size_t i=0; i<str.length(); ++i)
+	{
+		if (str[i] == '/')
+			str[i] = '\\';
+		else
+			str[i] = tolower((unsigned char)str[i]);
+	}
+	return str;
+}
+
+size_t MPQIndex::findSlot(unsigned int name1, unsigned int name2) const
+{
+	// name1 is already a good hash, probe linearly from it
+	size_t mask = m_setSlot.size() - 1;
+	size_t i = name1 & mask;
+	while (m_setSlot[i].archive != NULL)
+	{
+		if (m_setSlot[i].name1 == name1 && m_setSlot[i].name2 == name2)
+			break;
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+void MPQIndex::add(mpq_archive* archive, int priority)
+{
+	for (unsigned int i=0; i<archive->header->hashtablesize; ++i)
+	{
+		const mpq_hash &mpq_h = archive->hashtable[i];
+		// free and deleted entries are out of range too
+		if (mpq_h.blockindex >= archive->header->blocktablesize)
+			continue;
+		const mpq_block &mpq_b = archive->blocktable[mpq_h.blockindex];
+		if ((mpq_b.flags & LIBMPQ_FILE_EXISTS) == 0)
+			continue;
+
+		MPQIndexEntry &entry = m_setSlot[findSlot(mpq_h.name1, mpq_h.name2)];
+		if (entry.archive == NULL)
+			++m_uCount;
+		else if (entry.priority <= priority)
+			continue;
+		entry.name1		= mpq_h.name1;
+		entry.name2		= mpq_h.name2;
+		entry.archive	= archive;
+		entry.fileno	= mpq_h.blockindex + 1;
+		entry.size		= mpq_b.fsize;
+		entry.priority	= priority;
+	}
+}
+
+void MPQIndex::addListFile(mpq_archive* archive, std::vector<std::string>& names)
+{
+	int fileno = libmpq_file_number(archive, "(listfile)");
+	if (fileno == LIBMPQ_EFILE_NOT_FOUND)
+		return;
+	int size = libmpq_file_info(archive, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
+	if (size <= 0)
+		return;
+
+	std::vector<char> buffer(size);
+	if (libmpq_file_getdata(archive, fileno, (unsigned char*)&buffer[0]) != LIBMPQ_TOOLS_SUCCESS)
+		return;
+
+	// one name per line, some listfiles use ';'
+	size_t begin = 0;
+	for (size_t i=0; i<=buffer.size(); ++i)
+	{
+		if (i < buffer.size() && buffer[i] != '\r' && buffer[i] != '\n' && buffer[i] != ';')
+			continue;
+		if (i > begin)
+		{
+			std::string name = normalize(std::string(&buffer[begin], i - begin).c_str());
+			// only names a lookup can find
+			if (find(name.c_str()))
+				names.push_back(name);
+		}
+		begin = i + 1;
+	}
+}
+
+// the extension of a normalized name, "" if it has none
+static const char* getExtension(const char* name)
+{
+	const char* ext = "";
+	for (const char* p=name; *p; ++p)
+	{
+		if (*p == '.')
+			ext = p + 1;
+		else if (*p == '\\')
+			ext = "";
+	}
+	return ext;
+}
+
+struct NameByExtLess
+{
+	const char* chars;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		int cmp = strcmp(getExtension(chars + a), getExtension(chars + b));
+		// the names are packed in order
+		return cmp != 0 ? cmp < 0 : a < b;
+	}
+};
+
+void MPQIndex::setNames(std::vector<std::string>& names)
+{
+	std::sort(names.begin(), names.end());
+	names.erase(std::unique(names.begin(), names.end()), names.end());
+
+	size_t chars = 0;
+	for (size_t i=0; i<names.size(); ++i)
+		chars += names[i].length() + 1;
+	m_setNameChar.resize(chars);
+	m_setName.resize(names.size());
+	size_t pos = 0;
+	for (size_t i=0; i<names.size(); ++i)
+	{
+		m_setName[i] = (unsigned int)pos;
+		memcpy(&m_setNameChar[pos], names[i].c_str(), names[i].length() + 1);
+		pos += names[i].length() + 1;
+	}
+
+	m_setNameByExt = m_setName;
+	if (!m_setNameChar.empty())
+	{
+		NameByExtLess less = { &m_setNameChar[0] };
+		std::sort(m_setNameByExt.begin(), m_setNameByExt.end(), less);
+	}
+}
+
+static void appendUInt(std::vector<char>& data, unsigned int value)
+{
+	data.insert(data.end(), (const char*)&value, (const char*)&value + sizeof(value));
+}
+
+void MPQIndex::getSignature(const ArchiveSet& archives, std::vector<char>& signature)
+{
+	signature.clear();
+	for (size_t i=0; i<archives.size(); ++i)
+	{
+		const mpq_archive* archive = archives[i];
+		signature.insert(signature.end(), archive->filename, archive->filename + strlen(archive->filename) + 1);
+		// a patched archive may keep its size
+		long long mtime = 0;
+		struct stat fileStat;
+		if (stat(archive->filename, &fileStat) == 0)
+			mtime = (long long)fileStat.st_mtime;
+		appendUInt(signature, (unsigned int)mtime);
+		appendUInt(signature, (unsigned int)(mtime >> 32));
+		appendUInt(signature, archive->mapsize);
+		appendUInt(signature, archive->header->hashtablesize);
+		appendUInt(signature, archive->header->blocktablesize);
+	}
+}
+
+// names cache layout, native byte order:
+// "MPQN", version, signature size, signature, name chars size, name count, chars, names, names by extension
+static const char MPQ_NAMES_MAGIC[4] = { 'M', 'P', 'Q', 'N' };
+static const unsigned int MPQ_NAMES_VERSION = 2;
+
+static bool readUInt(FILE* f, unsigned int& value)
+{
+	return fread(&value, sizeof(value), 1, f) == 1;
+}
+
+bool MPQIndex::loadNames(const char* cacheFile, const std::vector<char>& signature)
+{
+	FILE* f = fopen(cacheFile, "rb");
+	if (f == NULL)
+		return false;
+
+	bool ok = false;
+	char magic[4];
+	unsigned int version = 0, signatureSize = 0, chars = 0, count = 0;
+	std::vector<char> fileSignature;
+	if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, MPQ_NAMES_MAGIC, sizeof(magic)) == 0
+		&& readUInt(f, version) && version == MPQ_NAMES_VERSION
+		&& readUInt(f, signatureSize) && signatureSize == signature.size())
+	{
+		fileSignature.resize(signatureSize);
+		ok = signatureSize == 0 || fread(&fileSignature[0], signatureSize, 1, f) == 1;
+		ok = ok && fileSignature == signature;
+		ok = ok && readUInt(f, chars) && readUInt(f, count) && count <= chars;
+	}
+	if (ok)
+	{
+		m_setNameChar.resize(chars);
+		m_setName.resize(count);
+		m_setNameByExt.resize(count);
+		if (count > 0)
+		{
+			ok = fread(&m_setNameChar[0], chars, 1, f) == 1
+				&& fread(&m_setName[0], sizeof(unsigned int), count, f) == count
+				&& fread(&m_setNameByExt[0], sizeof(unsigned int), count, f) == count
+				&& m_setNameChar[chars - 1] == '\0';
+		}
+		for (size_t i=0; ok && i<count; ++i)
+			ok = m_setName[i] < chars && m_setNameByExt[i] < chars;
+	}
+	fclose(f);
+
+	if (!ok)
+	{
+		m_setNameChar.clear();
+		m_setName.clear();
+		m_setNameByExt.clear();
+	}
+	return ok;
+}
+
+void MPQIndex::saveNames(const char* cacheFile, const std::vector<char>& signature) const
+{
+	std::vector<char> data(MPQ_NAMES_MAGIC, MPQ_NAMES_MAGIC + sizeof(MPQ_NAMES_MAGIC));
+	appendUInt(data, MPQ_NAMES_VERSION);
+	appendUInt(data, (unsigned int)signature.size());
+	data.insert(data.end(), signature.begin(), signature.end());
+	appendUInt(data, (unsigned int)m_setNameChar.size());
+	appendUInt(data, (unsigned int)m_setName.size());
+	data.insert(data.end(), m_setNameChar.begin(), m_setNameChar.end());
+	for (size_t i=0; i<m_setName.size(); ++i)
+		appendUInt(data, m_setName[i]);
+	for (size_t i=0; i<m_setNameByExt.size(); ++i)
+		appendUInt(data, m_setNameByExt[i]);
+
+	FILE* f = fopen(cacheFile, "wb");
+	if (f == NULL)
+		return;
+	bool ok = fwrite(&data[0], data.size(), 1, f) == 1;
+	if (fclose(f) != 0 || !ok)
+		remove(cacheFile);
+}
+
+void MPQIndex::build(const ArchiveSet& archives, const char* cacheFile)
+{
+	clear();
+	if (archives.empty())
+		return;
+
+	// the hash buffer is the same in every archive
+	m_pArchive = archives[0];
+
+	size_t count = 0;
+	for (size_t i=0; i<archives.size(); ++i)
+		count += archives[i]->header->blocktablesize;
+	size_t slots = 16;
+	while (slots < count * 2)
+		slots <<= 1;
+	MPQIndexEntry empty;
+	memset(&empty, 0, sizeof(empty));
+	m_setSlot.resize(slots, empty);
+
+	for (size_t i=0; i<archives.size(); ++i)
+		add(archives[i], (int)i);
+
+	if (cacheFile && cacheFile[0] == '\0')
+		cacheFile = NULL;
+	std::vector<char> signature;
+	if (cacheFile)
+	{
+		getSignature(archives, signature);
+		if (loadNames(cacheFile, signature))
+			return;
+	}
+
+	std::vector<std::string> names;
+	for (size_t i=0; i<archives.size(); ++i)
+		addListFile(archives[i], names);
+	setNames(names);
+
+	if (cacheFile)
+		saveNames(cacheFile, signature);
+}
+
+const MPQIndexEntry* MPQIndex::find(const char* filename) const
+{
+	if (m_pArchive == NULL)
+		return NULL;
+	unsigned int name1, name2;
+	std::string name = normalize(filename);
+	libmpq_hash_filename(m_pArchive, (const unsigned char*)name.c_str(), &name1, &name2);
+	const MPQIndexEntry &entry = m_setSlot[findSlot(name1, name2)];
+	return entry.archive ? &entry : NULL;
+}
+
+int MPQIndex::getSize(const char* filename) const
+{
+	const MPQIndexEntry* entry = find(filename);
+	return entry ? (int)entry->size : 0;
+}
+
+void MPQIndex::findPrefix(const std::string& prefix, size_t& begin, size_t& end) const
+{
+	// names starting with the prefix are a run of the sorted names, comparing only the
+	// first prefix.length() characters orders them before it, in it and after it
+	const size_t length = prefix.length();
+	size_t lo = 0, hi = m_setName.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (strncmp(getName(mid), prefix.c_str(), length) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	begin = lo;
+	hi = m_setName.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (strncmp(getName(mid), prefix.c_str(), length) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	end = lo;
+}
+
+void MPQIndex::enumPrefix(const char* prefix, std::vector<std::string>& names) const
+{
+	size_t begin, end;
+	findPrefix(normalize(prefix), begin, end);
+	for (size_t i=begin; i<end; ++i)
+		names.push_back(getName(i));
+}
+
+void MPQIndex::enumExtension(const char* ext, std::vector<std::string>& names) const
+{
+	std::string strExt = normalize(ext[0] == '.' ? ext + 1 : ext);
+	const char* chars = m_setNameChar.empty() ? NULL : &m_setNameChar[0];
+	size_t lo = 0, hi = m_setNameByExt.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (strcmp(getExtension(chars + m_setNameByExt[mid]), strExt.c_str()) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	// same extension, sorted by name
+	for (; lo < m_setNameByExt.size(); ++lo)
+	{
+		const char* name = chars + m_setNameByExt[lo];
+		if (strcmp(getExtension(name), strExt.c_str()) != 0)
+			break;
+		names.push_back(name);
+	}
+}
+
+bool MPQIndex::matchWildcard(const char* pattern, const char* name)
+{
+	// on a mismatch the last '*' takes one more character and the match goes on from there
+	const char* star = NULL;
+	const char* retry = NULL;
+	while (*name)
+	{
+		if (*pattern == '*')
+		{
+			star = ++pattern;
+			retry = name;
+		}
+		else if (*pattern == '?' || *pattern == *name)
+		{
+			++pattern;
+			++name;
+		}
+		else if (star)
+		{
+			pattern = star;
+			name = ++retry;
+		}
+		else
+			return false;
+	}
+	while (*pattern == '*')
+		++pattern;
+	return *pattern == '\0';
+}
+
+void MPQIndex::enumWildcard(const char* pattern, std::vector<std::string>& names) const
+{
+	std::string strPattern = normalize(pattern);
+	// only the names starting with the text before the first wildcard can match
+	size_t begin, end;
+	findPrefix(strPattern.substr(0, strPattern.find_first_of("*?")), begin, end);
+	for (size_t i=begin; i<end; ++i)
+	{
+		if (matchWildcard(strPattern.c_str(), getName(i)))
+			names.push_back(getName(i));
+	}
+}
+
+void MPQIndex::enumFilter(bool filterfunc(std::string), std::vector<std::string>& names) const
+{
+	for (size_t i=0; i<m_setName.size(); ++i)
+	{
+		if (filterfunc(getName(i)))
+			names.push_back(getName(i));
+	}
+}
+
+// Finds the archive holding a file, through the index once InitMPQArchives built it.
+static bool findArchiveFile(const char* filename, mpq_archive*& mpq_a, int& fileno)
+{
+	if (gMPQIndex.isBuilt())
+	{
+		const MPQIndexEntry* entry = gMPQIndex.find(filename);
+		if (entry == NULL)
+			return false;
+		mpq_a	= entry->archive;
+		fileno	= entry->fileno;
+		return true;
+	}
+
+	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i)
+	{
+		fileno = libmpq_file_number(*i, filename);
+		if (fileno != LIBMPQ_EFILE_NOT_FOUND)
+		{
+			mpq_a = *i;
+			return true;
+		}
+	}
+	return false;
+}
+
 MPQFile::MPQFile(const char* filename, bool bUseLocalFiles):
 	eof(false),
 	buffer(0),
 	pointer(0),
-	size(0)
+	size(0),
+	m_bView(false)
 {
 	m_bUseLocalFiles = bUseLocalFiles;
 	if(m_bUseLocalFiles) {
@@ -118,25 +577,30 @@ MPQFile::MPQFile(const char* filename, bool bUseLocalFiles):
 		//}
 	}
 
-	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end(); ++i)
+	mpq_archive *mpq_a = NULL;
+	int fileno = 0;
+	if (findArchiveFile(filename, mpq_a, fileno))
 	{
-		mpq_archive &mpq_a = **i;
-		int fileno = libmpq_file_number(&mpq_a, filename);
-		if(fileno == LIBMPQ_EFILE_NOT_FOUND)
-			continue;
-
 		// Found!
-		size = libmpq_file_info(&mpq_a, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
+		size = libmpq_file_info(mpq_a, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
 
-		// HACK: in patch.mpq some files don't want to open and give 1 for filesize
+		// HACK: in patch.mpq some files don't want to open and give 1 for filesize,
+		// VerifyMPQArchives lists them as size mismatches
 		if (size<=1) {
 			eof = true;
 			buffer = 0;
 			return;
 		}
 
+		// stored files are used in place, the buffer must not be written to
+		buffer = (unsigned char*)libmpq_file_view(mpq_a, fileno);
+		if (buffer) {
+			m_bView = true;
+			return;
+		}
+
 		buffer = new unsigned char[size];
- 		libmpq_file_getdata(&mpq_a, fileno, buffer);
+ 		libmpq_file_getdata(mpq_a, fileno, buffer);
 		return;
 	}
 
@@ -158,15 +622,9 @@ bool MPQFile::exists(const char* filename)
 //		//	return true;
 //	}
 
-	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
-	{
-		mpq_archive &mpq_a = **i;
-		int fileno = libmpq_file_number(&mpq_a, filename);
-		if (fileno != LIBMPQ_EFILE_NOT_FOUND) 
-			return true;
-	}
-
-	return false;
+	mpq_archive *mpq_a = NULL;
+	int fileno = 0;
+	return findArchiveFile(filename, mpq_a, fileno);
 }
 
 size_t MPQFile::read(void* dest, size_t bytes)
@@ -206,7 +664,10 @@ void MPQFile::seekRelative(int offset)
 
 void MPQFile::close()
 {
-	S_DEL(buffer);
+	if (!m_bView)
+		S_DELS(buffer);
+	buffer = NULL;
+	m_bView = false;
 	eof = true;
 }
 
@@ -215,6 +676,15 @@ size_t MPQFile::getSize()
 	return size;
 }
 
+unsigned char* MPQFile::release()
+{
+	unsigned char* released = buffer;
+	buffer = NULL;
+	m_bView = false;
+	eof = true;
+	return released;
+}
+
 int MPQFile::getSize(const char* filename)
 {
 	//if(m_bUseLocalFiles) {
@@ -226,15 +696,142 @@ int MPQFile::getSize(const char* filename)
 		//}
 	//}
 
-	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
+	if (gMPQIndex.isBuilt())
+		return gMPQIndex.getSize(filename);
+
+	mpq_archive *mpq_a = NULL;
+	int fileno = 0;
+	if (findArchiveFile(filename, mpq_a, fileno))
+		return libmpq_file_info(mpq_a, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
+
+	return 0;
+}
+
+MPQStream::MPQStream(const char* filename):
+	m_pArchive(NULL),
+	m_pFile(NULL),
+	m_pView(NULL),
+	m_uSize(0),
+	m_uSectorSize(0),
+	m_uTick(0)
+{
+	for (int i=0; i<SECTOR_CACHE_SIZE; ++i)
 	{
-		mpq_archive &mpq_a = **i;
-		int fileno = libmpq_file_number(&mpq_a, filename);
-		if (fileno != LIBMPQ_EFILE_NOT_FOUND)
-			return libmpq_file_info(&mpq_a, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
+		m_Cache[i].index	= -1;
+		m_Cache[i].bytes	= 0;
+		m_Cache[i].used		= 0;
+		m_Cache[i].data		= NULL;
 	}
 
-	return 0;
+	int fileno = 0;
+	if (!findArchiveFile(filename, m_pArchive, fileno))
+		return;
+	int result = libmpq_file_info(m_pArchive, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
+	if (result <= 0)
+		return;
+	m_uSize			= result;
+	m_uSectorSize	= m_pArchive->blocksize;
+
+	m_pView = libmpq_file_view(m_pArchive, fileno);
+	if (m_pView == NULL)
+		libmpq_file_open(m_pArchive, fileno, &m_pFile);
+}
+
+MPQStream::~MPQStream()
+{
+	close();
+}
+
+void MPQStream::close()
+{
+	for (int i=0; i<SECTOR_CACHE_SIZE; ++i)
+	{
+		S_DELS(m_Cache[i].data);
+		m_Cache[i].data		= NULL;
+		m_Cache[i].index	= -1;
+	}
+	if (m_pFile)
+	{
+		libmpq_file_close(m_pFile);
+		m_pFile = NULL;
+	}
+	m_pView = NULL;
+	m_uSize = 0;
+}
+
+const MPQStream::Sector* MPQStream::getSector(int index)
+{
+	Sector* pSector = &m_Cache[0];
+	for (int i=0; i<SECTOR_CACHE_SIZE; ++i)
+	{
+		if (m_Cache[i].index == index)
+		{
+			m_Cache[i].used = ++m_uTick;
+			return &m_Cache[i];
+		}
+		// replace the least recently used
+		if (m_Cache[i].used < pSector->used)
+			pSector = &m_Cache[i];
+	}
+
+	if (pSector->data == NULL)
+		pSector->data = new unsigned char[m_uSectorSize];
+	int bytes = libmpq_file_read_sector(m_pArchive, m_pFile, index, pSector->data);
+	if (bytes <= 0)
+	{
+		pSector->index	= -1;
+		pSector->used	= 0;
+		return NULL;
+	}
+	pSector->index	= index;
+	pSector->bytes	= bytes;
+	pSector->used	= ++m_uTick;
+	return pSector;
+}
+
+size_t MPQStream::read(size_t offset, void* dest, size_t bytes)
+{
+	if (offset >= m_uSize)
+		return 0;
+	if (bytes > m_uSize - offset)
+		bytes = m_uSize - offset;
+
+	if (m_pView)
+	{
+		memcpy(dest, m_pView + offset, bytes);
+		return bytes;
+	}
+	if (m_pFile == NULL)
+		return 0;
+
+	unsigned char* out = (unsigned char*)dest;
+	size_t done = 0;
+	while (done < bytes)
+	{
+		size_t pos		= offset + done;
+		int index		= (int)(pos / m_uSectorSize);
+		size_t start	= pos - (size_t)index * m_uSectorSize;
+
+		// whole blocks go straight to the caller
+		if (start == 0 && bytes - done >= m_uSectorSize)
+		{
+			int loaded = libmpq_file_read_sector(m_pArchive, m_pFile, index, out + done);
+			if (loaded <= 0)
+				break;
+			done += loaded;
+			continue;
+		}
+
+		const Sector* pSector = getSector(index);
+		if (pSector == NULL || start >= pSector->bytes)
+			break;
+		size_t count = pSector->bytes - start;
+		if (count > bytes - done)
+			count = bytes - done;
+		memcpy(out + done, pSector->data + start, count);
+		done += count;
+	}
+	return done;
 }
 
 size_t MPQFile::getPos()
@@ -242,84 +839,54 @@ size_t MPQFile::getPos()
 	return pointer;
 }
 
-unsigned char* MPQFile::getBuffer()
+const unsigned char* MPQFile::getBuffer()
 {
 	return buffer;
 }
 
-unsigned char* MPQFile::getPointer()
+const unsigned char* MPQFile::getPointer()
 {
 	return buffer + pointer;
 }
 
+// colour of a file in the tree, by the archive it is read from
+static int getArchiveColour(const mpq_archive* mpq_a)
+{
+	std::string temp = mpq_a->filename;
+	transform(temp.begin(),   temp.end(),   temp.begin(),   tolower);   
+	if (temp.find("wowtest") != std::string::npos)
+		return 3;
+	if (temp.find("patch.mpq") != std::string::npos)
+		return 1;
+	if (temp.find("patch-2.mpq") != std::string::npos)
+		return 2;
+	return 0;
+}
+
 void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(std::string))
 {
-	for(ArchiveSet::iterator i=gOpenArchives.begin(); i!=gOpenArchives.end();++i)
+	// the index has the listfiles of all archives merged already, the filter only runs on its names
+	if (!gMPQIndex.isBuilt())
+		gMPQIndex.build(gOpenArchives, indexCache.c_str());
+
+	for (size_t i=0; i<gMPQIndex.getNameCount(); ++i)
 	{
-		mpq_archive &mpq_a = **i;
-		int fileno = libmpq_file_number(&mpq_a, "(listfile)");
-
-		if(fileno != LIBMPQ_EFILE_NOT_FOUND) {
-			// Found!
-			size_t size = libmpq_file_info(&mpq_a, LIBMPQ_FILE_UNCOMPRESSED_SIZE, fileno);
-			int retVal = libmpq_file_info(&mpq_a, LIBMPQ_FILE_COMPRESSION_TYPE, fileno);
-
-			std::string temp = mpq_a.filename;
-			//temp = temp.MakeLower();
-			transform(temp.begin(),   temp.end(),   temp.begin(),   tolower);   
-			int col = 0;
-			if (temp.find("patch.mpq") != std::string::npos)
-				col = 1;
-			else if (temp.find("patch-2.mpq") != std::string::npos)
-				col = 2;
-
-			if (temp.find("wowtest") > -1)
-				col = 3;
-
-			// TODO: Add handling for uncompressed files.
-			//if () {
-			if (size > 0 && retVal != 0) {
-				unsigned char *buffer = new unsigned char[size];
-				libmpq_file_getdata(&mpq_a, fileno, buffer);
-				unsigned char *p = buffer, *end = buffer + size;
-
-				while (p <= end) {
-					unsigned char *q=p;
-					do {
-						if (*q==13) 
-							break;
-					} while (q++<=end);
-
-					std::string line((char*)p,q-p);
-					if (line.length()==0) 
-						break;
-
-					//p += line.length();
-					p = q + 2;
-					//line.erase(line.length()-2, 2); // delete \r\n
-
-					if (filterfunc(line.c_str())) {
-
-						// This is just to help cleanup Duplicates
-						// Ideally I should tokenise the string and clean it up automatically
-						transform(line.begin(),   line.end(),   line.begin(),   tolower);   
-						line[0] -= 32;
-						int ret = line.find('\\');
-						if (ret>-1)
-							line[ret+1] -= 32;
-
-						FileTreeItem tmp;
-						tmp.fn = line;
-						tmp.col = col;
-						dest.insert(tmp);
-					}
-				}
-
-				S_DEL(buffer);
-				p = NULL;
-				end = NULL;
-			}
-		}
+		const char* name = gMPQIndex.getName(i);
+		if (!filterfunc(name))
+			continue;
+		const MPQIndexEntry* entry = gMPQIndex.find(name);
+		if (entry == NULL)
+			continue;
+
+		// names are lower case, capitalize the first letter and the one after the first folder
+		FileTreeItem tmp;
+		tmp.fn = name;
+		tmp.fn[0] = toupper((unsigned char)tmp.fn[0]);
+		size_t ret = tmp.fn.find('\\');
+		if (ret != std::string::npos && ret + 1 < tmp.fn.length())
+			tmp.fn[ret+1] = toupper((unsigned char)tmp.fn[ret+1]);
+		tmp.col = getArchiveColour(entry->archive);
+		dest.insert(tmp);
 	}
 }
 void SetGamePath(std::string strGamePath)
@@ -327,6 +894,10 @@ void SetGamePath(std::string strGamePath)
 	testPath = strGamePath;
 	gamePath = strGamePath;
 }
+void SetMPQIndexCache(std::string strCacheFile)
+{
+	indexCache = strCacheFile;
+}
 void InitMPQArchives()
 {
 	const std::string dataArchives[] = {"texture.MPQ", "model.MPQ", "wmo.MPQ", "misc.MPQ"}; //, "terrain.MPQ"
@@ -414,6 +985,9 @@ void InitMPQArchives()
 			archives.push_back(new MPQArchive(path.c_str()));
 	}
 
+	// merge the archives, patches were opened first and take precedence
+	gMPQIndex.build(gOpenArchives, indexCache.c_str());
+
 	// Checks and logs the "TOC" version of the files that were loaded
 	MPQFile f("Interface\\FrameXML\\FrameXML.TOC",false);
 	if (!f.isEof()) {
@@ -425,6 +999,73 @@ void InitMPQArchives()
 	}
 }
 
+static const char* getVerifyText(int result)
+{
+	switch (result)
+	{
+	case LIBMPQ_VERIFY_ENCRYPTED:	return "encrypted";
+	case LIBMPQ_VERIFY_UNREADABLE:	return "unreadable";
+	case LIBMPQ_VERIFY_BAD_SIZE:	return "size mismatch";
+	case LIBMPQ_VERIFY_BAD_CRC:		return "checksum mismatch";
+	}
+	return "ok";
+}
+
+size_t VerifyMPQArchives(std::vector<MPQVerifyProblem>& problems, FILE* report)
+{
+	if (!gMPQIndex.isBuilt())
+		gMPQIndex.build(gOpenArchives, indexCache.c_str());
+
+	size_t checked = 0;
+	for (size_t a=0; a<gOpenArchives.size(); ++a)
+	{
+		mpq_archive* mpq_a = gOpenArchives[a];
+		std::vector<int> result(mpq_a->header->blocktablesize);
+		if (result.empty() || libmpq_archive_verify(mpq_a, &result[0]) != LIBMPQ_TOOLS_SUCCESS)
+			continue;
+
+		size_t first = problems.size();
+		for (size_t i=0; i<result.size(); ++i)
+		{
+			if (result[i] == LIBMPQ_VERIFY_UNUSED)
+				continue;
+			++checked;
+			if (result[i] == LIBMPQ_VERIFY_OK)
+				continue;
+			char name[16];
+			sprintf(name, "#%u", (unsigned int)i);
+			MPQVerifyProblem problem;
+			problem.archive = mpq_a;
+			problem.block = (int)i;
+			problem.result = result[i];
+			problem.name = name;
+			problems.push_back(problem);
+		}
+		if (problems.size() == first)
+			continue;
+
+		// blocks have no names, hash every listed name to find the ones of the bad blocks
+		std::vector<int> problemOfBlock(result.size(), -1);
+		for (size_t i=first; i<problems.size(); ++i)
+			problemOfBlock[problems[i].block] = (int)i;
+		for (size_t i=0; i<gMPQIndex.getNameCount(); ++i)
+		{
+			int fileno = libmpq_file_number(mpq_a, gMPQIndex.getName(i));
+			if (fileno > 0 && (size_t)fileno <= problemOfBlock.size() && problemOfBlock[fileno-1] >= 0)
+				problems[problemOfBlock[fileno-1]].name = gMPQIndex.getName(i);
+		}
+
+		if (report) {
+			for (size_t i=first; i<problems.size(); ++i) {
+				const mpq_block& block = mpq_a->blocktable[problems[i].block];
+				fprintf(report, "%s\t%s\t%s\t%u\t%u\n", mpq_a->filename, problems[i].name.c_str(),
+					getVerifyText(problems[i].result), block.csize, block.fsize);
+			}
+		}
+	}
+	return checked;
+}
+
 bool filterModels(std::string s)
 {
 	//s.LowerCase();
@@ -443,5 +1084,5 @@ bool filterNpcs(std::string s)
 {
 	// textures\BakedNpcTextures\*.*
 	if (s.length() < 18) return false;
-	return (s.substr(9, 8) == "BakedNpc");
+	return (MPQIndex::normalize(s.substr(9, 8).c_str()) == "bakednpc");
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 //#include "SFmpqapi.h"
-#include "libmpq/mpq.h"
+#include <stdio.h>
 
 // C++ files
 #include <string>
 #include <set>
 #include <vector>
+#include <algorithm>
+
+// after the C++ headers, it defines min
+#include "libmpq/mpq.h"
 
 struct FileTreeItem {
 	std::string fn;
@@ -17,7 +21,7 @@ struct FileTreeItem {
 	}
 
 	bool operator>(const FileTreeItem &i) const {
-		return fn < i.fn;
+		return fn > i.fn;
 	}
 };
 
@@ -36,6 +40,74 @@ public:
 typedef std::vector<mpq_archive*> ArchiveSet;
 ArchiveSet& GetOpenArchives();
 
+// A file of the merged index.
+struct MPQIndexEntry
+{
+	unsigned int	name1;		// name hashes, 0/0 on free slots
+	unsigned int	name2;
+	mpq_archive*	archive;
+	int				fileno;
+	unsigned int	size;		// uncompressed
+	int				priority;	// position in the archive set, lower wins
+};
+
+// All open archives merged into one open addressed table of name hashes, so a lookup hashes
+// the name once and probes once instead of once per archive. An archive earlier in the set
+// shadows the same file in later ones, InitMPQArchives adds the patches first.
+// Names for enumeration come from the (listfile)s, normalized to lower case with backslashes.
+// They are kept in one buffer, ordered by name and by extension, so prefix, extension and
+// wildcard queries are a binary search plus a walk over the matches. Parsing the listfiles is
+// the slow part of a start, so build() can keep the names in a cache file, which is used as
+// long as the archives it was made from are unchanged.
+class MPQIndex
+{
+public:
+	MPQIndex();
+
+	void build(const ArchiveSet& archives, const char* cacheFile = NULL);
+	void clear();
+	bool isBuilt() const { return m_pArchive != NULL; }
+
+	const MPQIndexEntry* find(const char* filename) const;
+	bool exists(const char* filename) const { return find(filename) != NULL; }
+	int getSize(const char* filename) const;
+
+	// Listed files, sorted.
+	size_t getNameCount() const { return m_setName.size(); }
+	const char* getName(size_t i) const { return &m_setNameChar[m_setName[i]]; }
+	// The enum functions append the matching listed files, sorted by name.
+	void enumPrefix(const char* prefix, std::vector<std::string>& names) const;
+	// "m2" or ".m2"
+	void enumExtension(const char* ext, std::vector<std::string>& names) const;
+	// '*' matches any run of characters, '?' any one, "creature\*\*.m2"
+	void enumWildcard(const char* pattern, std::vector<std::string>& names) const;
+	// The filter is called on the normalized names at query time.
+	void enumFilter(bool filterfunc(std::string), std::vector<std::string>& names) const;
+
+	static std::string normalize(const char* filename);
+	static bool matchWildcard(const char* pattern, const char* name);
+private:
+	void add(mpq_archive* archive, int priority);
+	void addListFile(mpq_archive* archive, std::vector<std::string>& names);
+	void setNames(std::vector<std::string>& names);
+	size_t findSlot(unsigned int name1, unsigned int name2) const;
+	// range of m_setName starting with the prefix
+	void findPrefix(const std::string& prefix, size_t& begin, size_t& end) const;
+
+	// names cache, tied to the archives by their names, times, sizes and table sizes
+	static void getSignature(const ArchiveSet& archives, std::vector<char>& signature);
+	bool loadNames(const char* cacheFile, const std::vector<char>& signature);
+	void saveNames(const char* cacheFile, const std::vector<char>& signature) const;
+
+	mpq_archive*				m_pArchive;	// any archive, for its hash buffer
+	std::vector<MPQIndexEntry>	m_setSlot;	// power of two sized
+	size_t						m_uCount;
+	std::vector<char>			m_setNameChar;	// '\0' terminated names
+	std::vector<unsigned int>	m_setName;		// offsets into m_setNameChar, sorted, unique
+	std::vector<unsigned int>	m_setNameByExt;	// the same, sorted by extension then name
+};
+MPQIndex& GetMPQIndex();
+
 class MPQFile
 {
 	//MPQHANDLE handle;
@@ -43,6 +115,7 @@ class MPQFile
 	unsigned char *buffer;
 	size_t pointer, size;
 	bool m_bUseLocalFiles;
+	bool m_bView;	// buffer points into the read only archive mapping
 
 	// disable copying
 	//MPQFile(const MPQFile &f) {}
@@ -54,8 +127,14 @@ public:
 	size_t read(void* dest, size_t bytes);
 	size_t getSize();
 	size_t getPos();
-	unsigned char* getBuffer();
-	unsigned char* getPointer();
+	// const, the buffer of a view is the read only archive mapping
+	const unsigned char* getBuffer();
+	const unsigned char* getPointer();
+	// The buffer is the read only archive mapping, see release().
+	bool isView() const { return m_bView; }
+	// Hands the buffer over and leaves the file empty. The caller delete[]s it, unless it was
+	// a view, which lives as long as the archive.
+	unsigned char* release();
 	bool isEof();
 	void seek(int offset);
 	void seekRelative(int offset);
@@ -65,6 +144,46 @@ public:
 	static int getSize(const char* filename); // Used to do a quick check to see if a file is corrupted
 };
 
+// Reads parts of an archived file without unpacking all of it. Stored files are read in place
+// from the mapped archive, compressed ones decompress only the blocks a read covers and keep
+// the last few in a small cache.
+class MPQStream
+{
+public:
+	MPQStream(const char* filename);
+	~MPQStream();
+
+	bool isOpen() const { return m_pView != NULL || m_pFile != NULL; }
+	size_t getSize() const { return m_uSize; }
+	// The whole file in the archive mapping, NULL if it is compressed or encrypted.
+	const unsigned char* getView() const { return m_pView; }
+	size_t read(size_t offset, void* dest, size_t bytes);
+	void close();
+
+private:
+	enum { SECTOR_CACHE_SIZE = 4 };
+	struct Sector
+	{
+		int				index;	// -1 when empty
+		unsigned int	bytes;
+		unsigned int	used;	// tick of the last use
+		unsigned char*	data;
+	};
+	const Sector* getSector(int index);
+
+	mpq_archive*			m_pArchive;
+	mpq_file*				m_pFile;
+	const unsigned char*	m_pView;
+	size_t					m_uSize;
+	unsigned int			m_uSectorSize;
+	unsigned int			m_uTick;
+	Sector					m_Cache[SECTOR_CACHE_SIZE];
+
+	// disable copying
+	MPQStream(const MPQStream&);
+	void operator=(const MPQStream&);
+};
+
 inline void flipcc(char *fcc)
 {
 	char t;
@@ -79,7 +198,22 @@ inline void flipcc(char *fcc)
 inline bool defaultFilterFunc(std::string) { return true; }
 void getFileLists(std::set<FileTreeItem> &dest, bool filterfunc(std::string) = defaultFilterFunc);
 void SetGamePath(std::string);
+// Cache file of the listed names, relative to the working directory, "" to parse the listfiles on every start.
+void SetMPQIndexCache(std::string);
 void InitMPQArchives();
 
+// A file of the open archives that failed VerifyMPQArchives.
+struct MPQVerifyProblem
+{
+	mpq_archive*	archive;
+	int				block;		// block table index
+	int				result;		// LIBMPQ_VERIFY_*
+	std::string		name;		// from the listfiles, "#<block>" if not listed
+};
+// Reads back every file of the open archives and checks it against the block table sizes and
+// the stored checksums, the files of one archive in parallel. The ones that fail are added to
+// problems and written to the report, one per line. Returns the number of files checked.
+size_t VerifyMPQArchives(std::vector<MPQVerifyProblem>& problems, FILE* report = NULL);
+
 bool filterModels(std::string);
 bool filterNpcs(std::string);
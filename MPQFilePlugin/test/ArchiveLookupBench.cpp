@@ -0,0 +1,117 @@
+// Looks up and opens every (listfile) entry of an archive, through the hash table probe of
+// libmpq_file_number and through the full table scan it replaced, and checks both find the
+// same files. Without an archive argument it writes and uses a generated one. Run by ctest.
+#include "TestArchive.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int lookupScan(mpq_archive* pArchive, const char* szName)
+{
+	unsigned int uHash1, uHash2;
+	libmpq_hash_filename(pArchive, (const unsigned char*)szName, &uHash1, &uHash2);
+	return libmpq_file_number_from_hash(pArchive, uHash1, uHash2);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* szArchive = "lookup_test.mpq";
+	if (argc>1)
+	{
+		szArchive = argv[1];
+	}
+	else
+	{
+		std::vector<TestArchiveFile> setFile;
+		makeTestFiles(4000, setFile);
+		if (!writeTestArchive(szArchive, setFile))
+		{
+			printf("FAILED to write %s\n", szArchive);
+			return 1;
+		}
+	}
+
+	// libmpq_archive_close frees it
+	mpq_archive* pArchive = (mpq_archive*)malloc(sizeof(mpq_archive));
+	if (libmpq_archive_open(pArchive, (unsigned char*)szArchive)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		printf("FAILED to open %s\n", szArchive);
+		return 1;
+	}
+	std::vector<std::string> setName;
+	readListFile(pArchive, setName);
+	printf("%s: %u listed files, hash table of %u\n", szArchive, (unsigned int)setName.size(),
+		(unsigned int)libmpq_archive_info(pArchive, LIBMPQ_MPQ_HASHTABLE_SIZE));
+
+	int nFailed = 0;
+	size_t uMissing = 0;
+	for (size_t i=0; i<setName.size(); ++i)
+	{
+		int nProbe = libmpq_file_number(pArchive, setName[i].c_str());
+		int nScan = lookupScan(pArchive, setName[i].c_str());
+		// a scan may also find a deleted entry of the same name, the probe skips those
+		if (nProbe!=nScan&&!(nProbe==LIBMPQ_EFILE_NOT_FOUND&&nScan==(int)LIBMPQ_HASH_ENTRY_DELETED+1))
+		{
+			printf("FAILED %s: probe %d, scan %d\n", setName[i].c_str(), nProbe, nScan);
+			++nFailed;
+		}
+		uMissing += nProbe==LIBMPQ_EFILE_NOT_FOUND?1:0;
+	}
+	if (argc<=1&&uMissing>0)
+	{
+		printf("FAILED %u listed files not found\n", (unsigned int)uMissing);
+		++nFailed;
+	}
+
+	// the name lookups alone, repeated to get past the timer resolution
+	const int nRepeat = 20;
+	int nSum = 0;
+	double fStart = getSeconds();
+	for (int r=0; r<nRepeat; ++r)
+	{
+		for (size_t i=0; i<setName.size(); ++i)
+		{
+			nSum += libmpq_file_number(pArchive, setName[i].c_str());
+		}
+	}
+	double fProbe = getSeconds()-fStart;
+	fStart = getSeconds();
+	for (int r=0; r<nRepeat; ++r)
+	{
+		for (size_t i=0; i<setName.size(); ++i)
+		{
+			nSum -= lookupScan(pArchive, setName[i].c_str());
+		}
+	}
+	double fScan = getSeconds()-fStart;
+
+	// what a loader does with each name: find it, ask for its size and load its block positions
+	fStart = getSeconds();
+	for (size_t i=0; i<setName.size(); ++i)
+	{
+		int nFileNo = libmpq_file_number(pArchive, setName[i].c_str());
+		if (nFileNo<0)
+		{
+			continue;
+		}
+		nSum += libmpq_file_info(pArchive, LIBMPQ_FILE_UNCOMPRESSED_SIZE, nFileNo);
+		mpq_file* pFile = NULL;
+		if (libmpq_file_open(pArchive, nFileNo, &pFile)==LIBMPQ_TOOLS_SUCCESS)
+		{
+			libmpq_file_close(pFile);
+		}
+	}
+	double fOpen = getSeconds()-fStart;
+	libmpq_archive_close(pArchive);
+
+	double fCount = (double)(setName.size()>0?setName.size():1);
+	printf("lookup: probe %.3f us, scan %.3f us per name (%.1fx)\n", fProbe*1e6/(fCount*nRepeat),
+		fScan*1e6/(fCount*nRepeat), fProbe>0.0?fScan/fProbe:0.0);
+	printf("open: %.3f us per name, %.1f ms for all (%d)\n", fOpen*1e6/fCount, fOpen*1e3, nSum&1);
+	if (nFailed)
+	{
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,238 @@
+// Reads every file of one open archive from several threads at once, each with its own mpq_file,
+// and checks the checksums against a single threaded read. The threads read whole files, in
+// unaligned chunks, sector by sector backwards and through the mapping, so the partial block
+// cache, the positioned reads, the mapping race and the pooled decompression of big reads all
+// run concurrently. Without an archive argument it writes and uses a generated one. Run by ctest.
+#include "TestArchive.h"
+#include "common.h"
+#include "ThreadPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct StressFile
+{
+	int				nFileNo;
+	std::string		strName;
+	unsigned int	uSize;
+	unsigned int	uChecksum;	// single threaded read
+};
+
+static bool readWhole(mpq_archive* pArchive, const StressFile& file, std::vector<unsigned char>& setData)
+{
+	setData.resize(file.uSize+1);
+	return libmpq_file_getdata(pArchive, file.nFileNo, &setData[0])==LIBMPQ_TOOLS_SUCCESS;
+}
+
+static bool readChunks(mpq_archive* pArchive, const StressFile& file, unsigned int uChunk, std::vector<unsigned char>& setData)
+{
+	mpq_file* pFile = NULL;
+	if (libmpq_file_open(pArchive, file.nFileNo, &pFile)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		return false;
+	}
+	setData.resize(file.uSize+1);
+	bool bRead = true;
+	for (unsigned int uPos=0; uPos<file.uSize&&bRead; uPos+=uChunk)
+	{
+		unsigned int uBytes = file.uSize-uPos<uChunk?file.uSize-uPos:uChunk;
+		bRead = libmpq_file_read_file(pArchive, pFile, uPos, (char*)&setData[uPos], uBytes)==(int)uBytes;
+	}
+	libmpq_file_close(pFile);
+	return bRead;
+}
+
+static bool readSectorsBackwards(mpq_archive* pArchive, const StressFile& file, std::vector<unsigned char>& setData)
+{
+	mpq_file* pFile = NULL;
+	if (libmpq_file_open(pArchive, file.nFileNo, &pFile)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		return false;
+	}
+	unsigned int uBlockSize = pArchive->blocksize;
+	unsigned int uSectors = (file.uSize+uBlockSize-1)/uBlockSize;
+	std::vector<unsigned char> setSector(uBlockSize);
+	setData.resize(file.uSize+1);
+	bool bRead = true;
+	for (unsigned int s=uSectors; s>0&&bRead; --s)
+	{
+		unsigned int uPos = (s-1)*uBlockSize;
+		unsigned int uBytes = file.uSize-uPos<uBlockSize?file.uSize-uPos:uBlockSize;
+		bRead = libmpq_file_read_sector(pArchive, pFile, s-1, &setSector[0])==(int)uBytes;
+		memcpy(&setData[uPos], &setSector[0], uBytes);
+	}
+	libmpq_file_close(pFile);
+	return bRead;
+}
+
+class CStressTask:public iThreadTask
+{
+public:
+	mpq_archive*					m_pArchive;
+	const std::vector<StressFile>*	m_pFile;
+	size_t							m_uRounds;
+	std::vector<size_t>				m_setFailed;	// per reader
+	std::vector<size_t>				m_setBytes;
+
+	virtual void runTask(size_t uReader)
+	{
+		const std::vector<StressFile>& setFile = *m_pFile;
+		std::vector<unsigned char> setData;
+		size_t uFailed = 0;
+		size_t uBytes = 0;
+		for (size_t r=0; r<m_uRounds; ++r)
+		{
+			for (size_t k=0; k<setFile.size(); ++k)
+			{
+				// every reader starts somewhere else in the archive
+				const StressFile& file = setFile[(k+uReader*37)%setFile.size()];
+				bool bRead = false;
+				const unsigned char* pData = NULL;
+				switch ((k+uReader+r)%4)
+				{
+				case 0:
+					bRead = readWhole(m_pArchive, file, setData);
+					break;
+				case 1:
+					bRead = readChunks(m_pArchive, file, 0x1000+(unsigned int)((uReader*0x2b7+k)%0x3000), setData);
+					break;
+				case 2:
+					bRead = readSectorsBackwards(m_pArchive, file, setData);
+					break;
+				default:
+					// stored files are read in place, the others as a whole
+					pData = libmpq_file_view(m_pArchive, file.nFileNo);
+					bRead = pData!=NULL||readWhole(m_pArchive, file, setData);
+					break;
+				}
+				if (pData==NULL&&!setData.empty())
+				{
+					pData = &setData[0];
+				}
+				if (!bRead||getChecksum(pData, file.uSize)!=file.uChecksum)
+				{
+					printf("FAILED reader %u, %s, mode %u\n", (unsigned int)uReader, file.strName.c_str(), (unsigned int)((k+uReader+r)%4));
+					++uFailed;
+				}
+				uBytes += file.uSize;
+			}
+		}
+		m_setFailed[uReader] = uFailed;
+		m_setBytes[uReader] = uBytes;
+	}
+};
+
+int main(int argc, char* argv[])
+{
+	const char* szArchive = "stress_test.mpq";
+	size_t uThreads = 8;
+	std::vector<TestArchiveFile> setGenerated;
+	if (argc>1)
+	{
+		szArchive = argv[1];
+	}
+	if (argc>2)
+	{
+		uThreads = (size_t)atoi(argv[2]);
+		uThreads = uThreads>0?uThreads:1;
+	}
+	if (argc<=1)
+	{
+		makeTestFiles(300, setGenerated);
+		if (!writeTestArchive(szArchive, setGenerated))
+		{
+			printf("FAILED to write %s\n", szArchive);
+			return 1;
+		}
+	}
+
+	// libmpq_archive_close frees it
+	mpq_archive* pArchive = (mpq_archive*)malloc(sizeof(mpq_archive));
+	if (libmpq_archive_open(pArchive, (unsigned char*)szArchive)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		printf("FAILED to open %s\n", szArchive);
+		return 1;
+	}
+	int nFailed = 0;
+
+	// the reference read, one thread
+	std::vector<std::string> setName;
+	readListFile(pArchive, setName);
+	std::vector<StressFile> setFile;
+	std::vector<unsigned char> setData;
+	size_t uTotal = 0;
+	for (size_t i=0; i<setName.size(); ++i)
+	{
+		StressFile file;
+		file.nFileNo = libmpq_file_number(pArchive, setName[i].c_str());
+		if (file.nFileNo<0)
+		{
+			continue;
+		}
+		file.strName = setName[i];
+		file.uSize = (unsigned int)libmpq_file_info(pArchive, LIBMPQ_FILE_UNCOMPRESSED_SIZE, file.nFileNo);
+		if (!readWhole(pArchive, file, setData))
+		{
+			printf("skipped %s, unreadable\n", file.strName.c_str());
+			continue;
+		}
+		file.uChecksum = getChecksum(&setData[0], file.uSize);
+		setFile.push_back(file);
+		uTotal += file.uSize;
+	}
+	// a generated archive must give back what was written
+	for (size_t i=0; i<setGenerated.size(); ++i)
+	{
+		const TestArchiveFile& generated = setGenerated[i];
+		int nFileNo = libmpq_file_number(pArchive, generated.strName.c_str());
+		size_t j = 0;
+		while (j<setFile.size()&&setFile[j].nFileNo!=nFileNo)
+		{
+			++j;
+		}
+		if (j==setFile.size()||setFile[j].uSize!=generated.setData.size()||
+			setFile[j].uChecksum!=getChecksum(generated.setData.empty()?NULL:&generated.setData[0], generated.setData.size()))
+		{
+			printf("FAILED %s reads back different\n", generated.strName.c_str());
+			++nFailed;
+		}
+	}
+	printf("%s: %u files, %.1f MB\n", szArchive, (unsigned int)setFile.size(), uTotal/1048576.0);
+
+	CStressTask task;
+	task.m_pArchive = pArchive;
+	task.m_pFile = &setFile;
+	task.m_uRounds = 2;
+	task.m_setFailed.resize(uThreads);
+	task.m_setBytes.resize(uThreads);
+	double fStart = getSeconds();
+	if (uThreads>1)
+	{
+		// the calling thread reads too
+		CThreadPool pool(uThreads-1);
+		pool.run(task, uThreads);
+	}
+	else
+	{
+		task.runTask(0);
+	}
+	double fTime = getSeconds()-fStart;
+	size_t uBytes = 0;
+	for (size_t i=0; i<uThreads; ++i)
+	{
+		nFailed += (int)task.m_setFailed[i];
+		uBytes += task.m_setBytes[i];
+	}
+	printf("%u threads read %.1f MB in %.2f s, %.1f MB/s\n", (unsigned int)uThreads, uBytes/1048576.0, fTime,
+		fTime>0.0?uBytes/1048576.0/fTime:0.0);
+	libmpq_archive_close(pArchive);
+	CThreadPool::destroyShared();
+
+	if (nFailed)
+	{
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
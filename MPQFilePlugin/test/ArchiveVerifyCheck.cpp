@@ -0,0 +1,208 @@
+// Writes generated archives with an (attributes) of their CRC32s, corrupts a sector, a size in the
+// block table and a stored CRC, and checks libmpq_archive_verify reports each as its own kind of
+// problem and every other file as ok. Then VerifyMPQArchives, which MPQVerify runs, must name the
+// bad files from the (listfile). The archives are left for the MPQVerify tests. Run by ctest.
+#include "../mpq_libmpq.h"
+#include "TestArchive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+// The test files, an (attributes) behind them with the CRC32 of each and the (listfile) that
+// writeTestArchive adds last, so file i is block i. uBadCrc gets a wrong CRC.
+static void makeVerifyFiles(std::vector<TestArchiveFile>& setFile, size_t uBadCrc=(size_t)-1)
+{
+	makeTestFiles(40, setFile);
+	size_t uBlocks = setFile.size()+2;
+	TestArchiveFile attributes;
+	attributes.strName = "(attributes)";
+	attributes.uFlags = LIBMPQ_FILE_COMPRESS_MULTI;
+	attributes.setData.assign(8+uBlocks*4, 0);
+	unsigned int* pAttributes = (unsigned int*)&attributes.setData[0];
+	pAttributes[0] = 100;	// version
+	pAttributes[1] = 1;		// CRC32 only
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		pAttributes[2+i] = getChecksum(setFile[i].setData.empty()?NULL:&setFile[i].setData[0], setFile[i].setData.size());
+		if (i==uBadCrc)
+		{
+			pAttributes[2+i] ^= 1;
+		}
+	}
+	setFile.push_back(attributes);
+}
+
+// The first file of the compression of at most one sector, so its data can be found.
+static size_t findFile(const std::vector<TestArchiveFile>& setFile, unsigned int uFlags)
+{
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		if (setFile[i].uFlags==uFlags&&setFile[i].setData.size()>16&&setFile[i].setData.size()<0x1000)
+		{
+			return i;
+		}
+	}
+	return 0;
+}
+
+// LIBMPQ_VERIFY_* of every block, empty if the archive doesn't open.
+static std::vector<int> verifyArchive(const char* szArchive)
+{
+	std::vector<int> setResult;
+	// libmpq_archive_close frees it
+	mpq_archive* pArchive = (mpq_archive*)malloc(sizeof(mpq_archive));
+	if (libmpq_archive_open(pArchive, (unsigned char*)szArchive)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		return setResult;
+	}
+	setResult.resize(pArchive->header->blocktablesize);
+	if (libmpq_archive_verify(pArchive, &setResult[0])!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		setResult.clear();
+	}
+	libmpq_archive_close(pArchive);
+	return setResult;
+}
+
+// Every block ok, but for the bad ones.
+static void checkResult(const std::vector<int>& setResult, size_t uBlocks, const size_t* pBad, const int* pExpected, size_t uBad)
+{
+	CHECK(setResult.size()==uBlocks);
+	for (size_t i=0; i<setResult.size(); ++i)
+	{
+		int nExpected = LIBMPQ_VERIFY_OK;
+		for (size_t j=0; j<uBad; ++j)
+		{
+			if (pBad[j]==i)
+			{
+				nExpected = pExpected[j];
+			}
+		}
+		if (setResult[i]!=nExpected)
+		{
+			printf("FAILED block %u is %d, not %d\n", (unsigned int)i, setResult[i], nExpected);
+			++s_nFailed;
+		}
+	}
+}
+
+// Inverts the byte at the middle of the data of a block.
+static bool corruptBlock(const char* szArchive, size_t uBlock)
+{
+	mpq_archive* pArchive = (mpq_archive*)malloc(sizeof(mpq_archive));
+	if (libmpq_archive_open(pArchive, (unsigned char*)szArchive)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		return false;
+	}
+	const mpq_block& block = pArchive->blocktable[uBlock];
+	// compressed ones start with the positions of their blocks, two for a single sector
+	unsigned int uFirst = (block.flags&LIBMPQ_FILE_COMPRESSED)?8:0;
+	long nPos = (long)(block.filepos+uFirst+(block.csize-uFirst)/2);
+	libmpq_archive_close(pArchive);
+
+	FILE* f = fopen(szArchive, "r+b");
+	if (f==NULL)
+	{
+		return false;
+	}
+	int c = fseek(f, nPos, SEEK_SET)==0?fgetc(f):EOF;
+	bool bWritten = c!=EOF&&fseek(f, nPos, SEEK_SET)==0&&fputc(c^0xFF, f)!=EOF;
+	fclose(f);
+	return bWritten;
+}
+
+static void testClean(const std::vector<TestArchiveFile>& setFile)
+{
+	CHECK(writeTestArchive("verify_ok.mpq", setFile));
+	checkResult(verifyArchive("verify_ok.mpq"), setFile.size()+1, NULL, NULL, 0);
+}
+
+static void testSector(const std::vector<TestArchiveFile>& setFile)
+{
+	// a stored file only has the CRC32 to notice, a broken zlib stream doesn't inflate
+	size_t uBad[] = {findFile(setFile, 0), findFile(setFile, LIBMPQ_FILE_COMPRESS_MULTI)};
+	int nExpected[] = {LIBMPQ_VERIFY_BAD_CRC, LIBMPQ_VERIFY_UNREADABLE};
+	CHECK(writeTestArchive("verify_sector.mpq", setFile));
+	CHECK(corruptBlock("verify_sector.mpq", uBad[0]));
+	CHECK(corruptBlock("verify_sector.mpq", uBad[1]));
+	std::vector<int> setResult = verifyArchive("verify_sector.mpq");
+	// a flipped byte may still inflate, to other bytes or another size
+	if (setResult.size()>uBad[1]&&setResult[uBad[1]]!=LIBMPQ_VERIFY_OK)
+	{
+		nExpected[1] = setResult[uBad[1]];
+	}
+	checkResult(setResult, setFile.size()+1, uBad, nExpected, 2);
+
+	// the front end, the names come from the (listfile)
+	SetMPQIndexCache("");
+	// open to the end, as InitMPQArchives keeps its archives
+	new MPQArchive("verify_sector.mpq");
+	CHECK(GetOpenArchives().size()==1);
+	std::vector<MPQVerifyProblem> setProblem;
+	CHECK(VerifyMPQArchives(setProblem, stdout)==setFile.size()+1);
+	CHECK(setProblem.size()==2);
+	// in block order
+	for (size_t i=0; i<setProblem.size(); ++i)
+	{
+		size_t j = setProblem[i].block==(int)uBad[0]?0:1;
+		CHECK(setProblem[i].block==(int)uBad[j]);
+		CHECK(setProblem[i].result==nExpected[j]);
+		CHECK(setProblem[i].name==MPQIndex::normalize(setFile[uBad[j]].strName.c_str()));
+	}
+}
+
+static void testSize(const std::vector<TestArchiveFile>& setFile)
+{
+	// one more byte than written, rewritten by an append, which also drops the (attributes)
+	size_t uBad[] = {findFile(setFile, 0), findFile(setFile, LIBMPQ_FILE_COMPRESS_MULTI)};
+	int nExpected[] = {LIBMPQ_VERIFY_BAD_SIZE, LIBMPQ_VERIFY_BAD_SIZE};
+	CHECK(writeTestArchive("verify_size.mpq", setFile));
+	mpq_writer writer;
+	CHECK(libmpq_archive_append(&writer, "verify_size.mpq")==LIBMPQ_TOOLS_SUCCESS);
+	writer.mpq_a->blocktable[uBad[0]].fsize++;
+	writer.mpq_a->blocktable[uBad[1]].fsize++;
+	CHECK(libmpq_archive_finish(&writer)==LIBMPQ_TOOLS_SUCCESS);
+
+	// the (attributes) and the old (listfile) are unused now, the new (listfile) is behind them
+	std::vector<int> setResult = verifyArchive("verify_size.mpq");
+	CHECK(setResult.size()==setFile.size()+2);
+	if (setResult.size()==setFile.size()+2)
+	{
+		CHECK(setResult[setFile.size()-1]==LIBMPQ_VERIFY_UNUSED);
+		CHECK(setResult[setFile.size()]==LIBMPQ_VERIFY_UNUSED);
+		setResult[setFile.size()-1] = LIBMPQ_VERIFY_OK;
+		setResult[setFile.size()] = LIBMPQ_VERIFY_OK;
+	}
+	checkResult(setResult, setFile.size()+2, uBad, nExpected, 2);
+}
+
+static void testCrc()
+{
+	std::vector<TestArchiveFile> setFile;
+	makeVerifyFiles(setFile, 7);
+	size_t uBad[] = {7};
+	int nExpected[] = {LIBMPQ_VERIFY_BAD_CRC};
+	CHECK(writeTestArchive("verify_crc.mpq", setFile));
+	checkResult(verifyArchive("verify_crc.mpq"), setFile.size()+1, uBad, nExpected, 1);
+}
+
+int main()
+{
+	std::vector<TestArchiveFile> setFile;
+	makeVerifyFiles(setFile);
+	testClean(setFile);
+	testSector(setFile);
+	testSize(setFile);
+	testCrc();
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,205 @@
+// Writes a generated archive, appends to it as a patch would, replacing files and adding new ones
+// stored, zlib and PKWARE compressed, and reads every file back after each step. Checks the
+// compression of each block, the (listfile), that the archive file ends where its header says,
+// that a full hash table is reported and that an append which fails leaves the archive as it was.
+// Run by ctest.
+#include "TestArchive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <map>
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+static unsigned int nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return uSeed>>8;
+}
+
+// text like, so the compressors have something to do, or random
+static void makeData(unsigned int& uSeed, size_t uSize, bool bText, std::vector<unsigned char>& setData)
+{
+	setData.resize(uSize);
+	for (size_t j=0; j<uSize; ++j)
+	{
+		setData[j] = bText?(unsigned char)("patch data "[nextRandom(uSeed)%11]):(unsigned char)nextRandom(uSeed);
+	}
+}
+
+static bool addFiles(mpq_writer* pWriter, const std::vector<TestArchiveFile>& setFile)
+{
+	std::vector<mpq_add_file> setAdd(setFile.size());
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		setAdd[i].filename	= setFile[i].strName.c_str();
+		setAdd[i].data		= setFile[i].setData.empty()?NULL:&setFile[i].setData[0];
+		setAdd[i].size		= (unsigned int)setFile[i].setData.size();
+		setAdd[i].flags		= setFile[i].uFlags;
+	}
+	return setAdd.empty()||libmpq_archive_add_files(pWriter, &setAdd[0], (unsigned int)setAdd.size())==LIBMPQ_TOOLS_SUCCESS;
+}
+
+// Opens the archive and checks it holds exactly the expected files, by name. Data an append wrote
+// before it failed may be left behind the tables, unless bTrimmed.
+static void checkArchive(const char* szArchive, const std::map<std::string,TestArchiveFile>& mapExpected, bool bTrimmed=true)
+{
+	mpq_archive* pArchive = (mpq_archive*)malloc(sizeof(mpq_archive));
+	if (libmpq_archive_open(pArchive, (unsigned char*)szArchive)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		printf("FAILED to open %s\n", szArchive);
+		++s_nFailed;
+		return;
+	}
+	// the tables are the end of the archive, what an append had behind them is cut off
+	struct stat fileStat;
+	unsigned long long uEnd = pArchive->mpqpos+(unsigned long long)pArchive->header->archivesize;
+	CHECK(stat(szArchive, &fileStat)==0&&(bTrimmed?(unsigned long long)fileStat.st_size==uEnd:(unsigned long long)fileStat.st_size>=uEnd));
+
+	size_t uMismatch = 0;
+	std::vector<unsigned char> setData;
+	for (std::map<std::string,TestArchiveFile>::const_iterator it=mapExpected.begin(); it!=mapExpected.end(); ++it)
+	{
+		const TestArchiveFile& file = it->second;
+		int nFileNo = libmpq_file_number(pArchive, file.strName.c_str());
+		if (nFileNo<0)
+		{
+			printf("FAILED %s is missing\n", file.strName.c_str());
+			++uMismatch;
+			continue;
+		}
+		unsigned int uSize = (unsigned int)libmpq_file_info(pArchive, LIBMPQ_FILE_UNCOMPRESSED_SIZE, nFileNo);
+		setData.assign(uSize+1, 0);
+		bool bRead = uSize==0||libmpq_file_getdata(pArchive, nFileNo, &setData[0])==LIBMPQ_TOOLS_SUCCESS;
+		setData.resize(uSize);
+		if (!bRead||setData!=file.setData)
+		{
+			printf("FAILED %s reads back different\n", file.strName.c_str());
+			++uMismatch;
+		}
+		// the compression asked for, empty files have no blocks and are stored
+		unsigned int uCompression = pArchive->blocktable[nFileNo-1].flags&LIBMPQ_FILE_COMPRESSED;
+		unsigned int uExpected = file.setData.empty()?0:file.uFlags;
+		if (uCompression!=uExpected)
+		{
+			printf("FAILED %s has compression %x, not %x\n", file.strName.c_str(), uCompression, uExpected);
+			++uMismatch;
+		}
+	}
+	CHECK(uMismatch==0);
+
+	// every name once
+	std::vector<std::string> setName;
+	readListFile(pArchive, setName);
+	std::map<std::string,size_t> mapListed;
+	for (size_t i=0; i<setName.size(); ++i)
+	{
+		mapListed[setName[i]]++;
+	}
+	CHECK(setName.size()==mapExpected.size());
+	CHECK(mapListed.size()==mapExpected.size());
+	for (std::map<std::string,TestArchiveFile>::const_iterator it=mapExpected.begin(); it!=mapExpected.end(); ++it)
+	{
+		CHECK(mapListed[it->first]==1);
+	}
+	libmpq_archive_close(pArchive);
+}
+
+static void testCreateAndAppend()
+{
+	const char* szArchive = "write_test.mpq";
+	std::vector<TestArchiveFile> setFile;
+	makeTestFiles(60, setFile);
+	std::map<std::string,TestArchiveFile> mapExpected;
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		mapExpected[setFile[i].strName] = setFile[i];
+	}
+	CHECK(writeTestArchive(szArchive, setFile, 200));
+	checkArchive(szArchive, mapExpected);
+
+	// replace every fifth file with other data and another compression, add new files with a
+	// multi sector PKWARE one among them
+	static const unsigned int s_uFlags[] = {LIBMPQ_FILE_COMPRESS_PKWARE, 0, LIBMPQ_FILE_COMPRESS_MULTI};
+	unsigned int uSeed = 99;
+	std::vector<TestArchiveFile> setPatch;
+	for (size_t i=0; i<setFile.size(); i+=5)
+	{
+		TestArchiveFile file = setFile[i];
+		file.uFlags = s_uFlags[(i/5)%3];
+		makeData(uSeed, nextRandom(uSeed)%0x2000, i%2==0, file.setData);
+		setPatch.push_back(file);
+	}
+	for (size_t i=0; i<20; ++i)
+	{
+		TestArchiveFile file;
+		char szName[64];
+		sprintf(szName, "patch\\new%u.dat", (unsigned int)i);
+		file.strName = szName;
+		file.uFlags = s_uFlags[i%3];
+		makeData(uSeed, i==0?0x30000:nextRandom(uSeed)%0x3000, i%4!=3, file.setData);
+		setPatch.push_back(file);
+	}
+	mpq_writer writer;
+	CHECK(libmpq_archive_append(&writer, szArchive)==LIBMPQ_TOOLS_SUCCESS);
+	CHECK(addFiles(&writer, setPatch));
+	CHECK(libmpq_archive_finish(&writer)==LIBMPQ_TOOLS_SUCCESS);
+	for (size_t i=0; i<setPatch.size(); ++i)
+	{
+		mapExpected[setPatch[i].strName] = setPatch[i];
+	}
+	checkArchive(szArchive, mapExpected);
+
+	// an append without files writes the same archive again
+	CHECK(libmpq_archive_append(&writer, szArchive)==LIBMPQ_TOOLS_SUCCESS);
+	CHECK(libmpq_archive_finish(&writer)==LIBMPQ_TOOLS_SUCCESS);
+	checkArchive(szArchive, mapExpected);
+	remove(szArchive);
+
+	// a failed append frees the writer, finish only reports it
+	CHECK(libmpq_archive_append(&writer, "write_test_missing.mpq")!=LIBMPQ_TOOLS_SUCCESS);
+	CHECK(libmpq_archive_finish(&writer)!=LIBMPQ_TOOLS_SUCCESS);
+}
+
+static void testFull()
+{
+	// room for 63 files and the (listfile), the hash table keeps its size on an append
+	const char* szArchive = "write_full.mpq";
+	std::vector<TestArchiveFile> setFile;
+	makeTestFiles(80, setFile);
+	std::vector<TestArchiveFile> setFirst(setFile.begin(), setFile.begin()+60);
+	std::vector<TestArchiveFile> setMore(setFile.begin()+60, setFile.end());
+	std::map<std::string,TestArchiveFile> mapExpected;
+	for (size_t i=0; i<setFirst.size(); ++i)
+	{
+		mapExpected[setFirst[i].strName] = setFirst[i];
+	}
+	CHECK(writeTestArchive(szArchive, setFirst));
+
+	// three fit, then the table is full and the (listfile) can't be written either
+	mpq_writer writer;
+	CHECK(libmpq_archive_append(&writer, szArchive)==LIBMPQ_TOOLS_SUCCESS);
+	CHECK(!addFiles(&writer, setMore));
+	CHECK(libmpq_archive_finish(&writer)!=LIBMPQ_TOOLS_SUCCESS);
+	checkArchive(szArchive, mapExpected, false);
+	remove(szArchive);
+
+	CHECK(!writeTestArchive(szArchive, setFile, 4));
+	remove(szArchive);
+}
+
+int main()
+{
+	testCreateAndAppend();
+	testFull();
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,198 @@
+// Decodes a corpus of PKWARE streams with libmpq_pkzip_explode_span and with the callback driven
+// libmpq_pkzip_explode it replaced in libmpq_pkzip_decompress, and checks both give the same
+// bytes and lengths. The corpus has imploded data, cut short or not, and random streams of
+// both modes and all dictionary sizes, with valid and invalid headers. Then both are timed on
+// imploded 4 KB sectors. Run by ctest, the number of corpus streams can be given.
+#include "TestArchive.h"
+#include "explode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bytes behind the output that must stay untouched
+static const size_t OUTPUT_GUARD = 16;
+
+static unsigned int nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return uSeed>>8;
+}
+
+// The callbacks and their parameter as libmpq_pkzip_decompress had them before the span version.
+struct ExplodeParam
+{
+	const unsigned char*	pIn;
+	unsigned int			uInPos;
+	unsigned int			uInBytes;
+	unsigned char*			pOut;
+	unsigned int			uOutPos;
+	unsigned int			uMaxOut;
+};
+
+static unsigned int readInput(char* buf, unsigned int* size, void* param)
+{
+	ExplodeParam* pParam = (ExplodeParam*)param;
+	unsigned int uRead = *size<pParam->uInBytes-pParam->uInPos?*size:pParam->uInBytes-pParam->uInPos;
+	memcpy(buf, pParam->pIn+pParam->uInPos, uRead);
+	pParam->uInPos += uRead;
+	return uRead;
+}
+
+static void writeOutput(char* buf, unsigned int* size, void* param)
+{
+	ExplodeParam* pParam = (ExplodeParam*)param;
+	unsigned int uWrite = *size<pParam->uMaxOut-pParam->uOutPos?*size:pParam->uMaxOut-pParam->uOutPos;
+	memcpy(pParam->pOut+pParam->uOutPos, buf, uWrite);
+	pParam->uOutPos += uWrite;
+}
+
+static unsigned int explodeCallbacks(const unsigned char* pIn, unsigned int uInLength, unsigned char* pOut, unsigned int* pOutLength)
+{
+	ExplodeParam param = {pIn, 0, uInLength, pOut, 0, *pOutLength};
+	// sized for the build, LIBMPQ_PKZIP_EXP_BUFFER_SIZE is the 32 bit size
+	char* pWork = (char*)malloc(sizeof(pkzip_data_cmp));
+	unsigned int uResult = libmpq_pkzip_explode(readInput, writeOutput, pWork, &param);
+	free(pWork);
+	*pOutLength = param.uOutPos;
+	return uResult;
+}
+
+// false on a difference
+static bool compareExplode(const std::vector<unsigned char>& setIn, unsigned int uOutLength)
+{
+	std::vector<unsigned char> setSpan(uOutLength+OUTPUT_GUARD, 0xCD);
+	std::vector<unsigned char> setRef(uOutLength+OUTPUT_GUARD, 0xCD);
+	unsigned int uSpan = uOutLength;
+	unsigned int uRef = uOutLength;
+	const unsigned char* pIn = setIn.empty()?NULL:&setIn[0];
+	libmpq_pkzip_explode_span(pIn, (unsigned int)setIn.size(), &setSpan[0], &uSpan);
+	explodeCallbacks(pIn, (unsigned int)setIn.size(), &setRef[0], &uRef);
+	return uSpan==uRef&&setSpan==setRef;
+}
+
+// text like with repeats, or random bytes
+static void makeData(unsigned int& uSeed, size_t uSize, bool bText, std::vector<unsigned char>& setData)
+{
+	static const char* s_szWord[] = {"creature", "model", "texture", "\r\n", "world", "spell", "0x1000", "interface"};
+	setData.resize(uSize);
+	for (size_t j=0; j<uSize;)
+	{
+		if (!bText)
+		{
+			setData[j++] = (unsigned char)nextRandom(uSeed);
+			continue;
+		}
+		for (const char* szWord=s_szWord[nextRandom(uSeed)%8]; *szWord&&j<uSize; ++szWord)
+		{
+			setData[j++] = (unsigned char)*szWord;
+		}
+	}
+}
+
+static bool implode(const std::vector<unsigned char>& setData, std::vector<unsigned char>& setStream)
+{
+	setStream.resize(setData.size()*2+64);
+	unsigned int uSize = libmpq_pkzip_implode_span(&setData[0], (unsigned int)setData.size(), &setStream[0], (unsigned int)setStream.size());
+	setStream.resize(uSize);
+	return uSize>0;
+}
+
+static void benchmark(size_t uSectors)
+{
+	unsigned int uSeed = 99;
+	std::vector<std::vector<unsigned char> > setStream(uSectors);
+	std::vector<unsigned char> setData;
+	for (size_t i=0; i<uSectors; ++i)
+	{
+		makeData(uSeed, 0x1000, i%4!=3, setData);
+		implode(setData, setStream[i]);
+	}
+	std::vector<unsigned char> setOut(0x1000);
+	double fTime[2];
+	for (int nRef=0; nRef<2; ++nRef)
+	{
+		double fStart = getSeconds();
+		for (size_t i=0; i<uSectors; ++i)
+		{
+			unsigned int uOut = 0x1000;
+			if (nRef)
+			{
+				explodeCallbacks(&setStream[i][0], (unsigned int)setStream[i].size(), &setOut[0], &uOut);
+			}
+			else
+			{
+				libmpq_pkzip_explode_span(&setStream[i][0], (unsigned int)setStream[i].size(), &setOut[0], &uOut);
+			}
+		}
+		fTime[nRef] = getSeconds()-fStart;
+	}
+	double fMB = uSectors*0x1000/1048576.0;
+	printf("4 KB sectors: %.1f MB/s, callback version %.1f MB/s (%.1fx)\n", fMB/fTime[0], fMB/fTime[1],
+		fTime[0]>0.0?fTime[1]/fTime[0]:0.0);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t uCases = 20000;
+	if (argc>1)
+	{
+		uCases = (size_t)atoi(argv[1]);
+	}
+	static const unsigned char s_uDictBits[] = {4, 5, 6, 4, 5, 6, 3, 7};
+	int nFailed = 0;
+	unsigned int uSeed = 31337;
+	std::vector<unsigned char> setData, setIn;
+	for (size_t i=0; i<uCases; ++i)
+	{
+		unsigned int uOutLength = 0x1000;
+		if (i%2==0)
+		{
+			// imploded data, every third cut short, every fifth into too small an output
+			makeData(uSeed, 1+nextRandom(uSeed)%0x3000, i%4==0, setData);
+			implode(setData, setIn);
+			uOutLength = (unsigned int)setData.size();
+			if (i%3==0)
+			{
+				setIn.resize(nextRandom(uSeed)%(setIn.size()+1));
+			}
+			if (i%5==0)
+			{
+				uOutLength = nextRandom(uSeed)%(uOutLength+1);
+			}
+		}
+		else
+		{
+			// random bits after a header of either mode, mostly valid dictionary sizes
+			setIn.resize(nextRandom(uSeed)%0x1000);
+			for (size_t j=0; j<setIn.size(); ++j)
+			{
+				setIn[j] = (unsigned char)nextRandom(uSeed);
+			}
+			if (setIn.size()>1)
+			{
+				setIn[0] = (unsigned char)(nextRandom(uSeed)%16==0?2:nextRandom(uSeed)%2);
+				setIn[1] = s_uDictBits[nextRandom(uSeed)%8];
+			}
+			uOutLength = nextRandom(uSeed)%4==0?nextRandom(uSeed)%0x100:0x1000;
+		}
+		if (!compareExplode(setIn, uOutLength))
+		{
+			printf("FAILED case %u: %u bytes in, %u out\n", (unsigned int)i, (unsigned int)setIn.size(), uOutLength);
+			if (++nFailed>=20)
+			{
+				break;
+			}
+		}
+	}
+	printf("%u streams compared\n", (unsigned int)uCases);
+
+	benchmark(4000);
+
+	if (nFailed)
+	{
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
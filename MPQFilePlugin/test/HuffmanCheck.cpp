@@ -0,0 +1,126 @@
+// Decodes a corpus of generated Huffman streams with libmpq_huff_decompress and with the decoder
+// it replaced (reference/HuffmanRef.cpp) and checks both give the same bytes, then times both on
+// sector sized and long streams. Run by ctest, the number of corpus streams can be given.
+#include "TestArchive.h"
+#include "reference/HuffmanRef.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bytes behind the output that must stay untouched
+static const size_t OUTPUT_GUARD = 16;
+
+static unsigned int nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return uSeed>>8;
+}
+
+// A stream of the compression type uType followed by bits of the given density of ones, which
+// moves the walks towards the light items, so new bytes get added and the tree gets reshaped.
+static void makeStream(unsigned int& uSeed, unsigned int uType, size_t uSize, unsigned int uOnes, std::vector<unsigned char>& setIn)
+{
+	setIn.resize(uSize);
+	setIn[0] = (unsigned char)uType;
+	for (size_t i=1; i<uSize; ++i)
+	{
+		unsigned char uByte = 0;
+		for (int b=0; b<8; ++b)
+		{
+			uByte |= (nextRandom(uSeed)%16<uOnes)?(1<<b):0;
+		}
+		setIn[i] = uByte;
+	}
+}
+
+// false on a difference
+static bool compareDecoders(std::vector<unsigned char>& setIn, int nOutLength)
+{
+	std::vector<unsigned char> setOut(nOutLength+OUTPUT_GUARD, 0xCD);
+	std::vector<unsigned char> setRef(nOutLength+OUTPUT_GUARD, 0xCD);
+	int nOut = nOutLength;
+	int nRef = nOutLength;
+	libmpq_huff_decompress((char*)&setOut[0], &nOut, (char*)&setIn[0], (int)setIn.size());
+	libmpq_ref::libmpq_huff_decompress((char*)&setRef[0], &nRef, (char*)&setIn[0], (int)setIn.size());
+	return nOut==nRef&&setOut==setRef;
+}
+
+static double timeDecoder(bool bReference, std::vector<std::vector<unsigned char> >& setStream, int nOutLength, size_t& uBytes)
+{
+	std::vector<unsigned char> setOut(nOutLength);
+	uBytes = 0;
+	double fStart = getSeconds();
+	for (size_t i=0; i<setStream.size(); ++i)
+	{
+		int nOut = nOutLength;
+		char* pIn = (char*)&setStream[i][0];
+		int nIn = (int)setStream[i].size();
+		if (bReference)
+		{
+			libmpq_ref::libmpq_huff_decompress((char*)&setOut[0], &nOut, pIn, nIn);
+		}
+		else
+		{
+			libmpq_huff_decompress((char*)&setOut[0], &nOut, pIn, nIn);
+		}
+		uBytes += nOut;
+	}
+	return getSeconds()-fStart;
+}
+
+static void benchmark(const char* szName, unsigned int uFirstType, size_t uStreams, size_t uInSize, int nOutLength)
+{
+	unsigned int uSeed = 777;
+	std::vector<std::vector<unsigned char> > setStream(uStreams);
+	for (size_t i=0; i<uStreams; ++i)
+	{
+		makeStream(uSeed, uFirstType+(unsigned int)(i%(9-uFirstType)), uInSize, 8, setStream[i]);
+	}
+	size_t uNew, uRef;
+	double fNew = timeDecoder(false, setStream, nOutLength, uNew);
+	double fRef = timeDecoder(true, setStream, nOutLength, uRef);
+	printf("%s: %.1f MB/s, reference %.1f MB/s (%.1fx)\n", szName, uNew/1048576.0/fNew, uRef/1048576.0/fRef,
+		fNew>0.0?fRef/fNew:0.0);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t uCases = 20000;
+	if (argc>1)
+	{
+		uCases = (size_t)atoi(argv[1]);
+	}
+	static const int s_nOutLength[] = {1, 7, 0x200, 0x1000, 0x1000, 0x1000, 0x8000};
+	static const unsigned int s_uOnes[] = {0, 2, 8, 8, 8, 14, 16};
+	int nFailed = 0;
+	unsigned int uSeed = 4242;
+	std::vector<unsigned char> setIn;
+	for (size_t i=0; i<uCases; ++i)
+	{
+		unsigned int uType = (unsigned int)(i%9);
+		size_t uSize = 1+nextRandom(uSeed)%0x1000;
+		int nOutLength = s_nOutLength[nextRandom(uSeed)%7];
+		makeStream(uSeed, uType, uSize, s_uOnes[nextRandom(uSeed)%7], setIn);
+		if (!compareDecoders(setIn, nOutLength))
+		{
+			printf("FAILED case %u: type %u, %u bytes in, %d out\n", (unsigned int)i, uType, (unsigned int)uSize, nOutLength);
+			if (++nFailed>=20)
+			{
+				break;
+			}
+		}
+	}
+	printf("%u streams compared\n", (unsigned int)uCases);
+
+	// sectors rebuild the tree for every few KB, long streams mostly walk it
+	benchmark("4 KB sectors", 0, 4000, 0x1000, 0x1000);
+	benchmark("256 KB streams", 1, 40, 0x40000, 0x40000);
+
+	if (nFailed)
+	{
+		printf("%d checks failed\n", nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include "TestArchive.h"
+#include "zlib.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// small fixed generator, rand() differs between the C runtimes
+static unsigned int nextRandom(unsigned int& uSeed)
+{
+	uSeed = uSeed*1664525u+1013904223u;
+	return uSeed>>8;
+}
+
+void makeTestFiles(size_t uCount, std::vector<TestArchiveFile>& setFile)
+{
+	static const char* s_szWord[] = {"model", "texture", "creature", "wmo", "world", "sound", "interface", "spell"};
+	static const char* s_szExt[] = {"m2", "blp", "skin", "wmo", "dbc", "wav"};
+	static const unsigned int s_uFlags[] = {0, LIBMPQ_FILE_COMPRESS_MULTI, LIBMPQ_FILE_COMPRESS_PKWARE};
+	unsigned int uSeed = 12345;
+	setFile.resize(uCount);
+	for (size_t i=0; i<uCount; ++i)
+	{
+		TestArchiveFile& file = setFile[i];
+		char szName[256];
+		sprintf(szName, "%s\\%s\\file%u.%s", s_szWord[i%8], s_szWord[(i/8)%8], (unsigned int)i, s_szExt[i%6]);
+		file.strName = szName;
+		file.uFlags = s_uFlags[i%3];
+
+		// mostly sector sized, every 16th spans many sectors
+		size_t uSize = nextRandom(uSeed)%0x3000;
+		if (i%16==5)
+		{
+			uSize = 0x40000+nextRandom(uSeed)%0x40000;
+		}
+		file.setData.resize(uSize);
+		if (i%2)
+		{
+			for (size_t j=0; j<uSize; ++j)
+			{
+				file.setData[j] = (unsigned char)nextRandom(uSeed);
+			}
+			continue;
+		}
+		// words separated by spaces
+		for (size_t j=0; j<uSize;)
+		{
+			const char* szWord = s_szWord[nextRandom(uSeed)%8];
+			for (; *szWord&&j<uSize; ++szWord, ++j)
+			{
+				file.setData[j] = (unsigned char)*szWord;
+			}
+			if (j<uSize)
+			{
+				file.setData[j++] = ' ';
+			}
+		}
+	}
+}
+
+bool writeTestArchive(const char* szFilename, const std::vector<TestArchiveFile>& setFile, unsigned int uMaxFiles)
+{
+	mpq_writer mpq_w;
+	if (libmpq_archive_create(&mpq_w, szFilename, uMaxFiles>0?uMaxFiles:(unsigned int)setFile.size(), 3)!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		return false;
+	}
+	std::vector<mpq_add_file> setAdd(setFile.size());
+	for (size_t i=0; i<setFile.size(); ++i)
+	{
+		setAdd[i].filename	= setFile[i].strName.c_str();
+		setAdd[i].data		= setFile[i].setData.empty()?NULL:&setFile[i].setData[0];
+		setAdd[i].size		= (unsigned int)setFile[i].setData.size();
+		setAdd[i].flags		= setFile[i].uFlags;
+	}
+	bool bAdded = setAdd.empty()||libmpq_archive_add_files(&mpq_w, &setAdd[0], (unsigned int)setAdd.size())==LIBMPQ_TOOLS_SUCCESS;
+	// finish also closes a failed archive
+	return libmpq_archive_finish(&mpq_w)==LIBMPQ_TOOLS_SUCCESS&&bAdded;
+}
+
+void readListFile(mpq_archive* pArchive, std::vector<std::string>& setName)
+{
+	setName.clear();
+	int nFileNo = libmpq_file_number(pArchive, "(listfile)");
+	if (nFileNo==LIBMPQ_EFILE_NOT_FOUND)
+	{
+		return;
+	}
+	int nSize = libmpq_file_info(pArchive, LIBMPQ_FILE_UNCOMPRESSED_SIZE, nFileNo);
+	if (nSize<=0)
+	{
+		return;
+	}
+	std::vector<char> setBuffer(nSize);
+	if (libmpq_file_getdata(pArchive, nFileNo, (unsigned char*)&setBuffer[0])!=LIBMPQ_TOOLS_SUCCESS)
+	{
+		return;
+	}
+	// one name per line, some listfiles use ';'
+	size_t uBegin = 0;
+	for (size_t i=0; i<=setBuffer.size(); ++i)
+	{
+		if (i<setBuffer.size()&&setBuffer[i]!='\r'&&setBuffer[i]!='\n'&&setBuffer[i]!=';')
+		{
+			continue;
+		}
+		if (i>uBegin)
+		{
+			setName.push_back(std::string(&setBuffer[uBegin], i-uBegin));
+		}
+		uBegin = i+1;
+	}
+}
+
+unsigned int getChecksum(const unsigned char* pData, size_t uSize)
+{
+	uLong uCrc = crc32(0, Z_NULL, 0);
+	return (unsigned int)crc32(uCrc, pData, (uInt)uSize);
+}
+
+double getSeconds()
+{
+#ifdef _WIN32
+	LARGE_INTEGER nFrequency, nCounter;
+	QueryPerformanceFrequency(&nFrequency);
+	QueryPerformanceCounter(&nCounter);
+	return (double)nCounter.QuadPart/(double)nFrequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec*1e-9;
+#endif
+}
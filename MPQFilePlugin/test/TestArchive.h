@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+// after the C++ headers, it defines min
+#include "mpq.h"
+
+// A file of a generated archive with the contents it was written with.
+struct TestArchiveFile
+{
+	std::string					strName;
+	std::vector<unsigned char>	setData;
+	unsigned int				uFlags;		// mpq_add_file::flags
+};
+
+// uCount files of mixed sizes, text like and random, stored, zlib and PKWARE compressed.
+// The same on every run.
+void makeTestFiles(size_t uCount, std::vector<TestArchiveFile>& setFile);
+// Writes the files and a (listfile) to a new archive with room for uMaxFiles, 0 for just these
+// files. False on failure.
+bool writeTestArchive(const char* szFilename, const std::vector<TestArchiveFile>& setFile, unsigned int uMaxFiles=0);
+// Names of the (listfile) of an open archive, empty without one.
+void readListFile(mpq_archive* pArchive, std::vector<std::string>& setName);
+
+unsigned int getChecksum(const unsigned char* pData, size_t uSize);
+// wall clock seconds
+double getSeconds();
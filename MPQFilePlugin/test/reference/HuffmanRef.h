@@ -0,0 +1,8 @@
+#pragma once
+
+// The libmpq decoders as they were before they were rewritten, kept to check the new ones
+// against. Same arguments as the libmpq functions of the same names.
+namespace libmpq_ref
+{
+	int libmpq_huff_decompress(char *out_buf, int *out_length, char *in_buf, int in_length);
+}
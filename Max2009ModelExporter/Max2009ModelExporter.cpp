@@ -32,8 +32,10 @@
 #include "Vec3D.h"
 #include "ModelData.h"
 #include "CsvFile.h"
+#include "../KeyReduction/KeyReduction.h"
 
 #include <set>
+#include <limits.h>
 
 
 inline Vec3D fixCoordSystemPos(Vec3D v)
@@ -92,6 +94,9 @@ class Max2009ModelExporter : public SceneExport {
 		BOOL exportQuaternions;
 		BOOL exportObjectSpace;
 		BOOL exportRelative;
+		BOOL reduceKeys;		// drop the sampled keys the interpolation rebuilds
+		float keyPosTolerance;	// before exportScale
+		float keyRotTolerance;	// radians
 
 		int exportCoord;
 		bool showPrompts;
@@ -177,6 +182,7 @@ class Max2009ModelExporter : public SceneExport {
 		bool DumpAnim(IGameControl * pGameControl,BoneAnim& boneAnim);
 		void DumpSampleKeys(IGameControl * sc,BoneAnim& boneAnim, IGameControlType Type, bool quick, Point3 pos);
 		void DumpMesh(IGameNode * child, IGameMesh *gm, CModelData& model );
+		void ReduceKeys(CModelData& model);
 
 		//Constructor/Destructor
 		Max2009ModelExporter();
@@ -344,7 +350,9 @@ INT_PTR CALLBACK Max2009ModelExporterOptionsDlgProc(HWND hWnd,UINT message,WPARA
 //--- Max2009ModelExporter -------------------------------------------------------
 Max2009ModelExporter::Max2009ModelExporter()
 {
-
+	reduceKeys = TRUE;
+	keyPosTolerance = 0.001f;
+	keyRotTolerance = 0.0044f;
 }
 
 Max2009ModelExporter::~Max2009ModelExporter() 
@@ -496,6 +504,10 @@ int	Max2009ModelExporter::DoExport(const TCHAR *name,ExpInterface *ei,Interface
 	//	pXMLDoc->save(CComVariant(name));
 	////	pXMLDoc->Release();
 
+	if (reduceKeys)
+	{
+		ReduceKeys(model);
+	}
 	// 
 	model.SaveFile(name);
 	CoUninitialize();
@@ -2022,6 +2034,57 @@ void Max2009ModelExporter::DumpMesh(IGameNode * child, IGameMesh * gm, CModelDat
 
 }
 
+void Max2009ModelExporter::ReduceKeys(CModelData& model)
+{
+	KeyReduceParam param;
+	param.fPosTolerance = keyPosTolerance*exportScale;
+	param.fRotTolerance = keyRotTolerance;
+	CKeyReducer keyReducer(param);
+
+	std::vector<BoneAnim>& setBoneAnim = model.m_Skeleton.m_BoneAnims;
+	std::vector<int> setParent;
+	for (size_t i=0;i<setBoneAnim.size();++i)
+	{
+		setParent.push_back(setBoneAnim[i].parent);
+	}
+	keyReducer.setBoneParents(setParent);
+
+	// Reduce each clip on its own, so the first and last key of a clip are kept.
+	std::vector<ModelAnimation>& setAnim = model.m_AnimList;
+	size_t uClipCount = setAnim.empty()?1:setAnim.size();
+	for (size_t uAnimID=0;uAnimID<uClipCount;++uAnimID)
+	{
+		char szName[256]={0};
+		int nTimeBegin = INT_MIN;
+		int nTimeEnd = INT_MAX;
+		if (uAnimID<setAnim.size())
+		{
+			sprintf(szName,"%d",setAnim[uAnimID].animID);
+			nTimeBegin = setAnim[uAnimID].timeStart;
+			nTimeEnd = setAnim[uAnimID].timeEnd;
+		}
+		else
+		{
+			strcpy(szName,"all");
+		}
+		keyReducer.beginClip(szName);
+		for (size_t uBoneID=0;uBoneID<setBoneAnim.size();++uBoneID)
+		{
+			BoneAnim& boneAnim = setBoneAnim[uBoneID];
+			keyReducer.reduceTrans(uBoneID,boneAnim.trans.m_KeyTimes,boneAnim.trans.m_KeyData,nTimeBegin,nTimeEnd);
+			keyReducer.reduceRot(uBoneID,boneAnim.rot.m_KeyTimes,boneAnim.rot.m_KeyData,nTimeBegin,nTimeEnd);
+		}
+	}
+
+	std::string strReport = std::string(strFilename)+".keys.txt";
+	FILE* f = fopen(strReport.c_str(), "w");
+	if (f)
+	{
+		keyReducer.writeReport(f);
+		fclose(f);
+	}
+}
+
 BOOL Max2009ModelExporter::ReadAnimList(std::vector<ModelAnimation>& setAnimList)
 {
 	std::string filename = GetCOREInterface()->GetCurFilePath();
@@ -2090,6 +2153,14 @@ BOOL Max2009ModelExporter::ReadConfig()
 	exportObjectSpace = fgetc(cfgStream);
 	exportRelative = fgetc(cfgStream);
 	fread(&exportScale,sizeof(float),1,cfgStream);
+	// older config files end here
+	int nReduceKeys = fgetc(cfgStream);
+	if (EOF!=nReduceKeys)
+	{
+		reduceKeys = nReduceKeys;
+		fread(&keyPosTolerance,sizeof(float),1,cfgStream);
+		fread(&keyRotTolerance,sizeof(float),1,cfgStream);
+	}
 	fclose(cfgStream);
 	return TRUE;
 }
@@ -2124,6 +2195,9 @@ void Max2009ModelExporter::WriteConfig()
 	fputc(exportObjectSpace,cfgStream);
 	fputc(exportRelative,cfgStream);
 	fwrite(&exportScale,sizeof(float),1,cfgStream);
+	fputc(reduceKeys,cfgStream);
+	fwrite(&keyPosTolerance,sizeof(float),1,cfgStream);
+	fwrite(&keyRotTolerance,sizeof(float),1,cfgStream);
 	fclose(cfgStream);
 }
 
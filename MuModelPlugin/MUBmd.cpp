@@ -179,4 +179,29 @@ bool CMUBmd::LoadFile(const std::string& strFilename)
 		nFrameCount+=bmdSkeleton.setBmdAnim[i].uFrameCount;
 	}
 	return true;
+}
+
+void CMUBmd::buildBVH(CTriangleBVH& bvh, BmdSkeleton& skeleton)
+{
+	bvh.clear();
+	// past 0xFFFF subs or triangles the ids would collide, those are left out
+	for (size_t i=0; i<setBmdSub.size()&&i<=0xFFFF; ++i)
+	{
+		BmdSub& bmdSub = setBmdSub[i];
+		// posed like the imported mesh
+		std::vector<Vec3D> setPos(bmdSub.setVertex.size());
+		for (size_t j=0; j<setPos.size(); ++j)
+		{
+			setPos[j] = skeleton.getLocalMatrix(bmdSub.setVertex[j].uBones)*fixCoordSystemPos(bmdSub.setVertex[j].vPos);
+		}
+		for (size_t j=0; j<bmdSub.setTriangle.size()&&j<=0xFFFF; ++j)
+		{
+			const unsigned short* pIndex = bmdSub.setTriangle[j].indexVertex;
+			if (pIndex[0]<setPos.size()&&pIndex[1]<setPos.size()&&pIndex[2]<setPos.size())
+			{
+				bvh.addTriangle(&setPos[pIndex[2]].x, &setPos[pIndex[1]].x, &setPos[pIndex[0]].x, (unsigned int)((i<<16)|j));
+			}
+		}
+	}
+	bvh.build();
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "Vec4D.h"
 #include "Matrix.h"
 #include "MemoryStream.h"
+#include "../Common/TriangleBVH.h"
 #include <vector>
 
 //ת zḺһ
@@ -143,6 +144,9 @@ public:
 	};
 
 	bool LoadFile(const std::string& strFilename);
+	// Collision tree over the triangles posed by the skeleton, the ids are (sub<<16)|triangle,
+	// the ones past 0xFFFF are left out.
+	void buildBVH(CTriangleBVH& bvh, BmdSkeleton& skeleton);
 
 	BmdHead head;
 	std::vector<BmdSub> setBmdSub;
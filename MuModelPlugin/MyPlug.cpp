@@ -3,6 +3,8 @@
 #include "FileSystem.h"
 #include "MUBmd.h"
 #include "Material.h"
+#include "../KeyReduction/KeyReduction.h"
+#include <float.h>
 
 CMyPlug::CMyPlug(void)
 {
@@ -34,10 +36,20 @@ void importSkeletonBons(iSkeletonData& skeletonData, CMUBmd& bmd)
 	}
 }
 
-void importSkeletonAnims(iSkeletonData& skeletonData, CMUBmd& bmd)
+void importSkeletonAnims(iSkeletonData& skeletonData, CMUBmd& bmd, const char* szFilename)
 {
 	if (bmd.nFrameCount>1)// if there one frame only, free the animlist
 	{
+		// bmd stores every frame, drop the ones the interpolation rebuilds
+		CKeyReducer keyReducer;
+		{
+			std::vector<int> setParent;
+			for (size_t i=0;i<bmd.bmdSkeleton.setBmdBone.size();++i)
+			{
+				setParent.push_back(bmd.bmdSkeleton.setBmdBone[i].nParent);
+			}
+			keyReducer.setBoneParents(setParent);
+		}
 		int nFrameCount = 0;
 		for (size_t uAnimID=0; uAnimID<bmd.head.uAnimCount; ++uAnimID)
 		{
@@ -141,6 +153,17 @@ void importSkeletonAnims(iSkeletonData& skeletonData, CMUBmd& bmd)
 					bonsAnim.trans.m_KeyData[i].z-=(float)i/(float)(uTotalFrames-1)*fMoveLength;
 				}
 			}
+			// Key Reduction
+			keyReducer.beginClip(strAnimName);
+			for (size_t uBoneID = 0;uBoneID<uBoneSize;++uBoneID)
+			{
+				if (!setBmdBone[uBoneID].bEmpty)
+				{
+					BoneAnim& bonsAnim = setBonesAnim[uBoneID];
+					keyReducer.reduceTrans(uBoneID,bonsAnim.trans.m_KeyTimes,bonsAnim.trans.m_KeyData);
+					keyReducer.reduceRot(uBoneID,bonsAnim.rot.m_KeyTimes,bonsAnim.rot.m_KeyData);
+				}
+			}
 			nFrameCount+=uTotalFrames;
 			if (bFixFrame) // fuck here
 			{
@@ -152,6 +175,10 @@ void importSkeletonAnims(iSkeletonData& skeletonData, CMUBmd& bmd)
 				pSkeletonAnim->setTotalFrames((uTotalFrames-1)*MU_BMD_ANIM_FRAME_TIME);
 			}
 		}
+		// what the reduction saved and its worst error, to the debugger output
+		std::string strReport = std::string("Key reduction: ")+szFilename+"\n";
+		keyReducer.writeReport(strReport);
+		OutputDebugStringA(strReport.c_str());
 	}
 }
 
@@ -311,6 +338,17 @@ iRenderNode* CMyPlug::importData(iRenderNodeMgr* pRenderNodeMgr, const char* szF
 				}
 				pMesh->setBBox(bbox);
 				pMesh->init();
+				// for pick(), posed with the same skeleton
+				if (m_mapBVH.find(szFilename)==m_mapBVH.end())
+				{
+					m_listBVH.push_back(szFilename);
+					if (m_listBVH.size()>(size_t)MAX_BVH_COUNT)
+					{
+						m_mapBVH.erase(m_listBVH.front());
+						m_listBVH.pop_front();
+					}
+				}
+				bmd.buildBVH(m_mapBVH[szFilename], bIsPlayerPart?pPlayerBmd->bmdSkeleton:bmd.bmdSkeleton);
 			}
 			else
 			{
@@ -325,7 +363,7 @@ iRenderNode* CMyPlug::importData(iRenderNodeMgr* pRenderNodeMgr, const char* szF
 			{
 				//m_Mesh.m_Lods.resize(1);
 				importSkeletonBons(*pSkeletonData,bmd);
-				importSkeletonAnims(*pSkeletonData,bmd);
+				importSkeletonAnims(*pSkeletonData,bmd,szFilename);
 			}
 			else
 			{
@@ -412,4 +450,19 @@ bool CMyPlug::exportData(iModelData * pModelData, const std::string& szFilename)
 void CMyPlug::release()
 {
 	delete this;
+}
+
+bool CMyPlug::pick(const char* szFilename, const Vec3D& vRayPos, const Vec3D& vRayDir, Vec3D* pPos) const
+{
+	std::map<std::string, CTriangleBVH>::const_iterator it = m_mapBVH.find(szFilename);
+	CTriangleBVH::RayHit hit;
+	if (it==m_mapBVH.end() || !it->second.intersectRay(&vRayPos.x, &vRayDir.x, FLT_MAX, hit))
+	{
+		return false;
+	}
+	if (pPos)
+	{
+		*pPos = vRayDir*hit.fDist+vRayPos;
+	}
+	return true;
 }
\ No newline at end of file
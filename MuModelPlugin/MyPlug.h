@@ -1,5 +1,9 @@
 #pragma once
 #include "InterfaceModel.h"
+#include "../Common/TriangleBVH.h"
+#include <list>
+#include <map>
+#include <string>
 
 class CMyPlug : public CModelPlugBase  
 {
@@ -10,5 +14,12 @@ public:
 	virtual const char * getFormat() {return ".bmd";}
 	virtual iRenderNode* importData(iRenderNodeMgr* pRenderNodeMgr, const char* szFilename);
 	virtual void release();
+	// The posed mesh of a bmd imported by importData hit first by the ray, in model space.
+	// pPos gets the point hit. Only the last MAX_BVH_COUNT imported meshes can be picked.
+	bool pick(const char* szFilename, const Vec3D& vRayPos, const Vec3D& vRayDir, Vec3D* pPos = NULL) const;
 private:
+	enum {MAX_BVH_COUNT = 64};
+	// over the triangles of each imported mesh, see CMUBmd::buildBVH
+	std::map<std::string, CTriangleBVH> m_mapBVH;
+	std::list<std::string> m_listBVH;	// their files in import order, the oldest evicted first
 };
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "MaterialScript.h"
+#include "IORead.h"
+#include <sys/stat.h>
+
+CMaterialScript::CMaterialScript()
+{
+}
+
+bool CMaterialScript::load(const std::string& strFilename)
+{
+	IOReadBase* pRead = IOReadBase::autoOpen(strFilename);
+	if (pRead==NULL)
+	{
+		return false;
+	}
+	std::vector<char> setBuffer(pRead->GetSize());
+	if (setBuffer.size()>0)
+	{
+		pRead->Read(&setBuffer[0],setBuffer.size());
+	}
+	IOReadBase::autoClose(pRead);
+	m_strFilename = strFilename;
+	parse(setBuffer.size()>0?&setBuffer[0]:NULL,setBuffer.size());
+	return true;
+}
+
+void CMaterialScript::parse(const char* szText, size_t uSize)
+{
+	m_strText.assign(szText,uSize);
+	m_setToken.clear();
+	m_setLineBegin.clear();
+	m_mapMaterial.clear();
+
+	const char* p = m_strText.c_str();
+	size_t i=0;
+	while (i<uSize)
+	{
+		// one line, blank lines and "//" comments leave no tokens
+		size_t uLineBegin = m_setToken.size();
+		while (i<uSize&&'\n'!=p[i]&&char(13)!=p[i])
+		{
+			if ('	'==p[i]||' '==p[i])
+			{
+				++i;
+			}
+			else if ('/'==p[i]&&i+1<uSize&&'/'==p[i+1])
+			{
+				while (i<uSize&&'\n'!=p[i]&&char(13)!=p[i])
+				{
+					++i;
+				}
+			}
+			else
+			{
+				Token token;
+				token.uBegin = i;
+				while (i<uSize&&'	'!=p[i]&&' '!=p[i]&&'\n'!=p[i]&&char(13)!=p[i])
+				{
+					++i;
+				}
+				token.uLength = i-token.uBegin;
+				m_setToken.push_back(token);
+			}
+		}
+		++i;
+		if (m_setToken.size()>uLineBegin)
+		{
+			m_setLineBegin.push_back(uLineBegin);
+			// index "material <name>"
+			if (m_setToken.size()-uLineBegin>=2&&"material"==getToken(uLineBegin))
+			{
+				std::string strName = getToken(uLineBegin+1);
+				if (m_mapMaterial.find(strName)==m_mapMaterial.end())
+				{
+					m_mapMaterial[strName] = m_setLineBegin.size();
+				}
+			}
+		}
+	}
+	m_setLineBegin.push_back(m_setToken.size());
+}
+
+std::string CMaterialScript::getToken(size_t uToken)const
+{
+	return m_strText.substr(m_setToken[uToken].uBegin,m_setToken[uToken].uLength);
+}
+
+std::string CMaterialScript::getLineCommand(size_t& uLine, std::vector<std::string>& setWords)const
+{
+	setWords.clear();
+	if (uLine>=getLineCount())
+	{
+		return "";
+	}
+	size_t uBegin = m_setLineBegin[uLine];
+	size_t uEnd = m_setLineBegin[uLine+1];
+	++uLine;
+	for (size_t i=uBegin+1;i<uEnd;++i)
+	{
+		setWords.push_back(getToken(i));
+	}
+	return getToken(uBegin);
+}
+
+size_t CMaterialScript::findMaterial(const std::string& strName)const
+{
+	std::map<std::string,size_t>::const_iterator it = m_mapMaterial.find(strName);
+	if (it==m_mapMaterial.end())
+	{
+		return getLineCount();
+	}
+	return it->second;
+}
+
+const CMaterialScript* CMaterialScriptCache::get(const std::string& strFilename)
+{
+	long long nTime = -1;
+	long long nSize = -1;
+	struct stat fileStat;
+	if (stat(strFilename.c_str(),&fileStat)==0)
+	{
+		nTime = (long long)fileStat.st_mtime;
+		nSize = (long long)fileStat.st_size;
+	}
+	std::map<std::string,Entry>::iterator it = m_mapScript.find(strFilename);
+	if (it!=m_mapScript.end())
+	{
+		if (it->second.nTime==nTime&&it->second.nSize==nSize)
+		{
+			return &it->second.script;
+		}
+		m_mapScript.erase(it);
+	}
+	CMaterialScript script;
+	if (!script.load(strFilename))
+	{
+		return NULL;
+	}
+	Entry& entry = m_mapScript[strFilename];
+	entry.script = script;
+	entry.nTime = nTime;
+	entry.nSize = nSize;
+	return &entry.script;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+
+// A .material script loaded with one read and split into a flat stream of words,
+// grouped by line; materials are found through the name index instead of rescanning.
+class CMaterialScript
+{
+public:
+	CMaterialScript();
+	bool load(const std::string& strFilename);
+	void parse(const char* szText, size_t uSize);
+
+	const std::string& getFilename()const{return m_strFilename;}
+	size_t getLineCount()const{return m_setLineBegin.size()>0?m_setLineBegin.size()-1:0;}
+	// First word of the line at uLine, the other words go to setWords; uLine moves to the next line.
+	std::string getLineCommand(size_t& uLine, std::vector<std::string>& setWords)const;
+	// The line after "material <strName>", or getLineCount() when the script doesn't define it.
+	size_t findMaterial(const std::string& strName)const;
+	const std::map<std::string,size_t>& getMaterials()const{return m_mapMaterial;}
+private:
+	struct Token
+	{
+		size_t uBegin;
+		size_t uLength;
+	};
+	std::string getToken(size_t uToken)const;
+
+	std::string						m_strFilename;
+	std::string						m_strText;
+	std::vector<Token>				m_setToken;
+	std::vector<size_t>				m_setLineBegin;	// first token of each line, plus the token count
+	std::map<std::string,size_t>	m_mapMaterial;
+};
+
+// Parsed scripts by filename. A script on disk is parsed again when its size or time changed,
+// so an edited .material shows on the next import; one in an archive can't change while the
+// plugin is loaded and keeps its parse.
+class CMaterialScriptCache
+{
+public:
+	// NULL when the file can't be opened
+	const CMaterialScript* get(const std::string& strFilename);
+	void clear(){m_mapScript.clear();}
+private:
+	struct Entry
+	{
+		CMaterialScript	script;
+		long long		nTime;		// of the file on disk when parsed, -1 for a file in an archive
+		long long		nSize;
+	};
+	std::map<std::string,Entry> m_mapScript;
+};
@@ -1,6 +1,10 @@
 #include "MyPlug.h"
 #include "IORead.h"
 #include "FileSystem.h"
+#include <set>
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 BOOL WINAPI Data_Plug_CreateObject(void ** pobj){
 	*pobj = new CMyPlug;
@@ -333,105 +337,213 @@ void readGeometryVertexDeclaration(IOReadBase* pRead, std::vector<GeometryVertex
 	}
 }
 
+// Bytes of one element in the vertex buffer.
+size_t getVertexElementSize(VertexElementType vType)
+{
+	switch(vType)
+	{
+	case VET_FLOAT1:	return 4;
+	case VET_FLOAT2:	return 8;
+	case VET_FLOAT3:	return 12;
+	case VET_FLOAT4:	return 16;
+	case VET_COLOUR:	return 4;
+	case VET_SHORT1:	return 2;
+	case VET_SHORT2:	return 4;
+	case VET_SHORT3:	return 6;
+	case VET_SHORT4:	return 8;
+	case VET_UBYTE4:	return 4;
+	default:			return 0;
+	}
+}
+
+// One row per element of the declaration that goes into the submesh,
+// built once per buffer so decoding is a strided copy per element.
+struct VertexElementDecoder
+{
+	unsigned char*	pDest;		// first appended item of the submesh array
+	size_t			uDestSize;	// bytes per item of the submesh array
+	size_t			uOffset;	// offset in the vertex
+	size_t			uSize;		// bytes copied per vertex
+};
+
+template <class _T>
+unsigned char* appendVertexArray(std::vector<_T>& setArray, size_t uCount)
+{
+	size_t uOldSize = setArray.size();
+	setArray.resize(uOldSize+uCount);
+	return uCount>0?(unsigned char*)&setArray[uOldSize]:NULL;
+}
+
+template <size_t _Size>
+void deinterleaveVertexElement(unsigned char* pDest, size_t uDestSize, const unsigned char* pSrc, size_t uStride, size_t uCount)
+{
+	for (size_t i=0;i<uCount;++i)
+	{
+		memcpy(pDest,pSrc,_Size);
+		pDest+=uDestSize;
+		pSrc+=uStride;
+	}
+}
+
+void deinterleaveVertexElement(const VertexElementDecoder& decoder, const unsigned char* pBuffer, size_t uStride, size_t uCount)
+{
+	const unsigned char* pSrc = pBuffer+decoder.uOffset;
+	switch(decoder.uSize)
+	{
+	case 4:		deinterleaveVertexElement<4>(decoder.pDest,decoder.uDestSize,pSrc,uStride,uCount);	break;
+	case 8:		deinterleaveVertexElement<8>(decoder.pDest,decoder.uDestSize,pSrc,uStride,uCount);	break;
+	case 12:	deinterleaveVertexElement<12>(decoder.pDest,decoder.uDestSize,pSrc,uStride,uCount);	break;
+	default:
+		for (size_t i=0;i<uCount;++i)
+		{
+			memcpy(decoder.pDest+i*decoder.uDestSize,pSrc+i*uStride,decoder.uSize);
+		}
+		break;
+	}
+}
+
+// Ogre is right handed, negate x of uCount packed Vec3D.
+void flipHandedness(Vec3D* pVec, size_t uCount)
+{
+	float* p = (float*)pVec;
+	size_t uFloats = uCount*3;
+	size_t i = 0;
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+	// 4 vectors are 12 floats, the x components are lanes 0 and 3, 2, 1 of the three registers.
+	const __m128 mask0 = _mm_castsi128_ps(_mm_set_epi32(0x80000000,0,0,0x80000000));
+	const __m128 mask1 = _mm_castsi128_ps(_mm_set_epi32(0,0x80000000,0,0));
+	const __m128 mask2 = _mm_castsi128_ps(_mm_set_epi32(0,0,0x80000000,0));
+	for (;i+12<=uFloats;i+=12)
+	{
+		_mm_storeu_ps(p+i,	_mm_xor_ps(_mm_loadu_ps(p+i),	mask0));
+		_mm_storeu_ps(p+i+4,_mm_xor_ps(_mm_loadu_ps(p+i+4),	mask1));
+		_mm_storeu_ps(p+i+8,_mm_xor_ps(_mm_loadu_ps(p+i+8),	mask2));
+	}
+#endif
+	for (;i<uFloats;i+=3)
+	{
+		p[i]=-p[i];
+	}
+}
+
 void readGeometryVertexBuffer(IOReadBase* pRead, CSubMesh& subMesh,std::vector<GeometryVertexElement>& setElement,unsigned int vertexCount)
 {
-	unsigned short bindIndex, vertexSize;
-	// unsigned short bindIndex;	// Index to bind this buffer to
-	pRead->Read(&bindIndex,sizeof(unsigned short));
-	// unsigned short vertexSize;	// Per-vertex size, must agree with declaration at this index
+	unsigned short bindIndex, vertexSize;
+	// unsigned short bindIndex;	// Index to bind this buffer to
+	pRead->Read(&bindIndex,sizeof(unsigned short));
+	// unsigned short vertexSize;	// Per-vertex size, must agree with declaration at this index
 	pRead->Read(&vertexSize,sizeof(unsigned short));
 
 	// Check for vertex data header
 	unsigned short streamID;
-	unsigned int uLength;
+	unsigned int uLength;
 	pRead->Read(&streamID,sizeof(unsigned short));
 	pRead->Read(&uLength,sizeof(unsigned int));
-	if (streamID != M_GEOMETRY_VERTEX_BUFFER_DATA)
-	{
-		MessageBoxW(NULL, L"Can't find vertex buffer data area",	L"MeshSerializerImpl::readGeometryVertexBuffer",0);
+	if (streamID != M_GEOMETRY_VERTEX_BUFFER_DATA)
+	{
+		MessageBoxW(NULL, L"Can't find vertex buffer data area",	L"MeshSerializerImpl::readGeometryVertexBuffer",0);
+	}
+
+	// The whole buffer in one read
+	std::vector<unsigned char> setBuffer(vertexCount*vertexSize);
+	if (setBuffer.empty())
+	{
+		return;
 	}
+	pRead->Read(&setBuffer[0],setBuffer.size());
 
-	for (size_t i=0;i<vertexCount;++i)
+	size_t uPosBegin = subMesh.pos.size();
+	size_t uNormalBegin = subMesh.normal.size();
+	std::vector<VertexElementDecoder> setDecoder;
+	for (size_t n=0;n<setElement.size();++n)
 	{
-		for (size_t n=0;n<setElement.size();++n)
+		const GeometryVertexElement& element = setElement[n];
+		if (element.source!=bindIndex)
 		{
-			if (setElement[n].source==bindIndex)
+			continue;
+		}
+		// a repeated element would append the array twice and move the rows taken before
+		bool bRepeated = false;
+		for (size_t m=0;m<n;++m)
+		{
+			if (setElement[m].source==bindIndex&&setElement[m].vSemantic==element.vSemantic&&setElement[m].index==element.index)
 			{
-				switch(setElement[n].vSemantic)
-				{
-				case VES_POSITION:
-					{
-						Vec3D vPos;
-						pRead->Read(&vPos,sizeof(Vec3D));
-						vPos.x=-vPos.x;
-						subMesh.addPos(vPos);
-					}
-					break;
-				case VES_BLEND_WEIGHTS:
-					{
-						unsigned int uWeight;
-						pRead->Read(&uWeight,sizeof(unsigned int));
-						subMesh.addWeight(uWeight);
-					}
-					break;
-				case VES_BLEND_INDICES:
-					{
-						unsigned int uBone;
-						pRead->Read(&uBone,sizeof(unsigned int));
-						subMesh.addBone(uBone);
-					}
-					break;
-				case VES_NORMAL:
-					{
-						Vec3D vNormal;
-						pRead->Read(&vNormal,sizeof(Vec3D));
-						vNormal.x=-vNormal.x;
-						subMesh.addNormal(vNormal);
-					}
-					break;
-				case VES_DIFFUSE:
-					{
-						Color32 color;
-						pRead->Read(&color,sizeof(Color32));
-						subMesh.addColor(color);
-					}
-					break;
-				case VES_SPECULAR:
-					{
-						Color32 color;
-						pRead->Read(&color,sizeof(Color32));
-						//subMesh.addColor(color);
-					}
-					break;
-				case VES_TEXTURE_COORDINATES:
-					{
-						Vec2D vUV;
-						pRead->Read(&vUV,sizeof(Vec2D));
-						subMesh.addTexcoord(vUV);
-					}
-					break;
-				case VES_BINORMAL:
-					{
-						Vec3D vBiNormal;
-						pRead->Read(&vBiNormal,sizeof(Vec3D));
-						//pMesh->addBiNormal(vBiNormal);
-					}
-					break;
-				case VES_TANGENT:
-					{
-						Vec3D vTangent;
-						pRead->Read(&vTangent,sizeof(Vec3D));
-						//pMesh->addTangent(vTangent);
-					}
-					break;
-				default:
-				    break;
-				}
+				bRepeated = true;
 			}
 		}
+		if (bRepeated)
+		{
+			continue;
+		}
+		VertexElementDecoder decoder;
+		switch(element.vSemantic)
+		{
+		case VES_POSITION:
+			decoder.uDestSize	= sizeof(Vec3D);
+			decoder.pDest		= appendVertexArray(subMesh.pos,vertexCount);
+			break;
+		case VES_BLEND_WEIGHTS:
+			decoder.uDestSize	= sizeof(subMesh.weight[0]);
+			decoder.pDest		= appendVertexArray(subMesh.weight,vertexCount);
+			break;
+		case VES_BLEND_INDICES:
+			decoder.uDestSize	= sizeof(subMesh.bone[0]);
+			decoder.pDest		= appendVertexArray(subMesh.bone,vertexCount);
+			break;
+		case VES_NORMAL:
+			decoder.uDestSize	= sizeof(Vec3D);
+			decoder.pDest		= appendVertexArray(subMesh.normal,vertexCount);
+			break;
+		case VES_DIFFUSE:
+			decoder.uDestSize	= sizeof(Color32);
+			decoder.pDest		= appendVertexArray(subMesh.color,vertexCount);
+			break;
+		case VES_TEXTURE_COORDINATES:
+			decoder.uDestSize	= sizeof(Vec2D);
+			if (0==element.index)
+			{
+				decoder.pDest	= appendVertexArray(subMesh.texcoord,vertexCount);
+			}
+			else if (1==element.index)
+			{
+				decoder.pDest	= appendVertexArray(subMesh.texcoord2,vertexCount);
+			}
+			else
+			{
+				continue;
+			}
+			break;
+		default:
+			// specular, binormal and tangent aren't used
+			continue;
+		}
+		decoder.uOffset	= element.offset;
+		decoder.uSize	= getVertexElementSize(element.vType);
+		if (decoder.uSize>decoder.uDestSize)
+		{
+			decoder.uSize = decoder.uDestSize;
+		}
+		if (decoder.uOffset+decoder.uSize>vertexSize)
+		{
+			// broken declaration, leave the appended items zeroed
+			continue;
+		}
+		setDecoder.push_back(decoder);
 	}
-	//pRead->read(pBuf, dest->vertexCount * vertexSize);
 
+	for (size_t n=0;n<setDecoder.size();++n)
+	{
+		deinterleaveVertexElement(setDecoder[n],&setBuffer[0],vertexSize,vertexCount);
+	}
+
+	if (subMesh.pos.size()>uPosBegin)
+	{
+		flipHandedness(&subMesh.pos[uPosBegin],subMesh.pos.size()-uPosBegin);
+	}
+	if (subMesh.normal.size()>uNormalBegin)
+	{
+		flipHandedness(&subMesh.normal[uNormalBegin],subMesh.normal.size()-uNormalBegin);
+	}
 }
 
 void readGeometry(IOReadBase* pRead, CSubMesh& subMesh)
@@ -489,107 +601,12 @@ typedef struct VertexBoneAssignment_s
 	unsigned short boneIndex;
 	float weight;
 } VertexBoneAssignment;
-bool moveToString(IOReadBase* pRead,const std::string& str)
-{
-	char c;
-	while (!pRead->IsEof())
-	{
-		for (size_t i=0;i<str.length();++i)
-		{
-			pRead->Read(&c,sizeof(char));
-			if (pRead->IsEof())
-			{
-				return false;
-			}
-			if (str[i]!=c)
-			{
-				break;
-			}
-			if (i==str.length()-1)
-			{
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
-std::string getWord(IOReadBase* pRead)
-{
-	std::string str;
-	char c;
-	pRead->Read(&c,sizeof(char));
-	while (!pRead->IsEof())
-	{
-		if ('	'==c||' '==c||'\n'==c||char(13)==c)
-		{
-			if (str.size()>0)
-			{
-				return str;
-			}
-		}
-		else
-		{
-			str.push_back(c);
-		}
-		pRead->Read(&c,sizeof(char));
-	}
-	return str;
-}
-
-std::string getLineCommand(IOReadBase* pRead, std::vector<std::string>& setWords)
-{
-	setWords.clear();
-	std::string str;
-	std::string strCommand;
-	char c;
-	while (!pRead->IsEof())
-	{
-		pRead->Read(&c,sizeof(char));
-		if ('	'==c||' '==c||'\n'==c||char(13)==c)
-		{
-			if (strCommand.length()==0)
-			{
-				strCommand = str;
-			}
-			else
-			{
-				setWords.push_back(str);
-			}
-			str.clear();
-			if ('\n'==c||char(13)==c)
-			{
-				if (strCommand.size()>0)
-				{
-					break;
-				}
-			}
-		}
-		else
-		{
-			str.push_back(c);
-		}
-	}
-	if (pRead->IsEof())
-	{
-		if (strCommand.length()==0)
-		{
-			strCommand = str;
-		}
-		else
-		{
-			setWords.push_back(str);
-		}
-	}
-	return strCommand;
-}
-
-bool readMaterialTexture(CMaterial& material, IOReadBase* pRead, const std::string& strFilename)
+bool readMaterialTexture(CMaterial& material, const CMaterialScript& script, size_t& uLine)
 {
 	std::string strCommand;
 	std::vector<std::string> setWords;
 
-	strCommand = getLineCommand(pRead,setWords);
+	strCommand = script.getLineCommand(uLine,setWords);
 	if ("{"!=strCommand)
 	{
 		return false;
@@ -597,14 +614,14 @@ bool readMaterialTexture(CMaterial& material, IOReadBase* pRead, const std::stri
 
 	std::string strTexture;
 	bool bAdd = false;
-	while (!pRead->IsEof())
+	while (uLine<script.getLineCount())
 	{
-		strCommand = getLineCommand(pRead,setWords);
+		strCommand = script.getLineCommand(uLine,setWords);
 		if ("texture"==strCommand)
 		{
 			if (setWords.size()>0)
 			{
-				strTexture=GetParentPath(strFilename)+setWords[0];
+				strTexture=GetParentPath(script.getFilename())+setWords[0];
 				strTexture = ChangeExtension(strTexture,".dds");
 			}
 		}
@@ -650,19 +667,19 @@ bool readMaterialTexture(CMaterial& material, IOReadBase* pRead, const std::stri
 	return true;
 }
 
-bool readMaterialPass(CMaterial& material, IOReadBase* pRead, const std::string& strFilename)
+bool readMaterialPass(CMaterial& material, const CMaterialScript& script, size_t& uLine)
 {
 	std::string strCommand;
 	std::vector<std::string> setWords;
 
-	strCommand = getLineCommand(pRead,setWords);
+	strCommand = script.getLineCommand(uLine,setWords);
 	if ("{"!=strCommand)
 	{
 		return false;
 	}
-	while (!pRead->IsEof())
+	while (uLine<script.getLineCount())
 	{
-		strCommand = getLineCommand(pRead,setWords);
+		strCommand = script.getLineCommand(uLine,setWords);
 		if ("ambient"==strCommand)
 		{
 			// 3
@@ -726,7 +743,7 @@ bool readMaterialPass(CMaterial& material, IOReadBase* pRead, const std::string&
 		}
 		else if ("texture_unit"==strCommand)
 		{
-			if (!readMaterialTexture(material,pRead,strFilename))
+			if (!readMaterialTexture(material,script,uLine))
 			{
 				MessageBoxA(NULL,"readMaterialTexture()","Error!",0);
 				return false;
@@ -744,22 +761,22 @@ bool readMaterialPass(CMaterial& material, IOReadBase* pRead, const std::string&
 	return true;
 }
 
-bool readMaterialTechnique(CMaterial& material, IOReadBase* pRead, const std::string& strFilename)
+bool readMaterialTechnique(CMaterial& material, const CMaterialScript& script, size_t& uLine)
 {
 	std::string strCommand;
 	std::vector<std::string> setWords;
 
-	strCommand = getLineCommand(pRead,setWords);
+	strCommand = script.getLineCommand(uLine,setWords);
 	if ("{"!=strCommand)
 	{
 		return false;
 	}
-	while (!pRead->IsEof())
+	while (uLine<script.getLineCount())
 	{
-		strCommand = getLineCommand(pRead,setWords);
+		strCommand = script.getLineCommand(uLine,setWords);
 		if ("pass"==strCommand)
 		{
-			if (!readMaterialPass(material,pRead,strFilename))
+			if (!readMaterialPass(material,script,uLine))
 			{
 				return false;
 			}
@@ -776,22 +793,22 @@ bool readMaterialTechnique(CMaterial& material, IOReadBase* pRead, const std::st
 	return true;
 }
 
-bool readMaterial(CMaterial& material, IOReadBase* pRead, const std::string& strFilename)
+bool readMaterial(CMaterial& material, const CMaterialScript& script, size_t& uLine)
 {
 	std::string strCommand;
 	std::vector<std::string> setWords;
 
-	strCommand = getLineCommand(pRead,setWords);
+	strCommand = script.getLineCommand(uLine,setWords);
 	if ("{"!=strCommand)
 	{
 		return false;
 	}
-	while (!pRead->IsEof())
+	while (uLine<script.getLineCount())
 	{
-		strCommand = getLineCommand(pRead,setWords);
+		strCommand = script.getLineCommand(uLine,setWords);
 		if ("technique"==strCommand)
 		{
-			if (!readMaterialTechnique(material,pRead,strFilename))
+			if (!readMaterialTechnique(material,script,uLine))
 			{
 				return false;
 			}
@@ -808,35 +825,11 @@ bool readMaterial(CMaterial& material, IOReadBase* pRead, const std::string& str
 	return true;
 }
 
-bool readMaterial(iModelData * pModelData, const std::string& strFilename)
-{
-	IOReadBase* pRead = IOReadBase::autoOpen(strFilename);
-	if (pRead==NULL)
-	{
-		return false;
-	}
-	std::string strCommand;
-	std::vector<std::string> setWords;
-	while (!pRead->IsEof())
-	{
-		strCommand = getLineCommand(pRead,setWords);
-		if ("material"==strCommand)
-		{
-			if (setWords.size()>0)
-			{
-				CMaterial& material = pModelData->getMaterial(setWords[0].c_str());
-				readMaterial(material,pRead,strFilename);
-			}
-		}
-	}
-	IOReadBase::autoClose(pRead);
-	return true;
-}
-
-void readSubMesh(IOReadBase* pRead, iModelData* pModelData, const CSubMesh& sharedSubMesh)
+void readSubMesh(IOReadBase* pRead, iModelData* pModelData, const CSubMesh& sharedSubMesh, std::set<std::string>& setMaterialName)
 {
 	iLodMesh* pMesh = &pModelData->getMesh();
 	std::string strMaterialName = readString(pRead);
+	setMaterialName.insert(strMaterialName);
 	int nSubID=pMesh->getSubCount();
 	pModelData->setRenderPass(nSubID,nSubID,strMaterialName);
 	
@@ -1018,7 +1011,7 @@ void readHeader(IOReadBase* pRead)
 	}
 }
 
-void readMesh(IOReadBase* pRead, iModelData* pModelData)
+void readMesh(IOReadBase* pRead, iModelData* pModelData, std::set<std::string>& setMaterialName)
 {
 	bool skeletallyAnimated;
 	pRead->Read(&skeletallyAnimated,sizeof(bool));
@@ -1053,7 +1046,7 @@ void readMesh(IOReadBase* pRead, iModelData* pModelData)
 				}
 				break;
 			case M_SUBMESH:
-				readSubMesh(pRead, pModelData, sharedSubMesh);
+				readSubMesh(pRead, pModelData, sharedSubMesh, setMaterialName);
 				break;
 			case M_MESH_SKELETON_LINK:
 				{
@@ -1149,6 +1142,7 @@ bool CMyPlug::importData(iModelData * pModelData, const std::string& strFilename
 	}
 	// header
 	readHeader(pRead);
+	std::set<std::string> setMaterialName;
 	// mesh
 	if (!pRead->IsEof())
 	{
@@ -1161,7 +1155,7 @@ bool CMyPlug::importData(iModelData * pModelData, const std::string& strFilename
 		{
 		case M_MESH:
 			{
-				readMesh(pRead,pModelData);
+				readMesh(pRead,pModelData,setMaterialName);
 				break;
 			}
 		}
@@ -1170,16 +1164,31 @@ bool CMyPlug::importData(iModelData * pModelData, const std::string& strFilename
 	IOReadBase::autoClose(pRead);
 
 	// Loading the materials.
-	if (!readMaterial(pModelData,ChangeExtension(strFilename,".material")))
-	{
-		std::string strMatFilename = GetParentPath(strFilename);
-		strMatFilename=strMatFilename+GetFilename(strMatFilename)+".material";
-		if (!readMaterial(pModelData,strMatFilename))
+	const CMaterialScript* pScript = m_MaterialScriptCache.get(ChangeExtension(strFilename,".material"));
+	if (pScript==NULL)
+	{
+		std::string strMatFilename = GetParentPath(strFilename);
+		strMatFilename=strMatFilename+GetFilename(strMatFilename)+".material";
+		pScript = m_MaterialScriptCache.get(strMatFilename);
+		if (pScript==NULL)
 		{
 			strMatFilename=ChangeExtension(strMatFilename,"_tileset.material");
-			readMaterial(pModelData,strMatFilename);
+			pScript = m_MaterialScriptCache.get(strMatFilename);
 		}
-	}
+	}
+	if (pScript)
+	{
+		// only the materials the submeshes use
+		for (std::set<std::string>::iterator it=setMaterialName.begin();it!=setMaterialName.end();++it)
+		{
+			size_t uLine = pScript->findMaterial(*it);
+			if (uLine<pScript->getLineCount())
+			{
+				CMaterial& material = pModelData->getMaterial(it->c_str());
+				readMaterial(material,*pScript,uLine);
+			}
+		}
+	}
 
 	// mesh update
 	pModelData->getMesh().update();
@@ -1,5 +1,6 @@
 #pragma once
 #include "InterfaceModel.h"
+#include "MaterialScript.h"
 
 class CMyPlug : public CModelPlugBase  
 {
@@ -14,4 +15,6 @@ public:
 
 	virtual void release();
 private:
+	// parsed .material scripts, shared by all the meshes imported
+	CMaterialScriptCache m_MaterialScriptCache;
 };
\ No newline at end of file
@@ -0,0 +1,112 @@
+// Checks the .material tokenizer and CMaterialScriptCache over a stub IO layer: a second
+// lookup returns the cached parse without a read, and rewriting the file picks up the new
+// materials. Returns non zero when a check fails, run by ctest.
+#include "MaterialScript.h"
+#include "IORead.h"
+#include <stdio.h>
+
+static int s_nFailed = 0;
+
+#define CHECK(x) if (!(x)) {printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #x); ++s_nFailed;}
+
+static bool writeText(const char* szFilename, const char* szText)
+{
+	FILE* f = fopen(szFilename, "wb");
+	if (f==NULL)
+	{
+		return false;
+	}
+	fputs(szText, f);
+	fclose(f);
+	return true;
+}
+
+static void testParse()
+{
+	const char szText[] =
+		"// a comment\r\n"
+		"material Wall\r\n"
+		"{\r\n"
+		"\r\n"
+		"	texture wall.dds  // the diffuse\r\n"
+		"}\n"
+		"material Floor\n"
+		"{\n"
+		"	scene_blend alpha_blend\n"
+		"}\n"
+		"material Wall\n";
+	CMaterialScript script;
+	script.parse(szText, sizeof(szText)-1);
+	CHECK(script.getLineCount()==9);
+	CHECK(script.getMaterials().size()==2);
+	// the first definition of a name wins
+	size_t uLine = script.findMaterial("Wall");
+	CHECK(uLine==1);
+	CHECK(script.findMaterial("Floor")==5);
+	CHECK(script.findMaterial("Roof")==script.getLineCount());
+	std::vector<std::string> setWords;
+	CHECK(script.getLineCommand(uLine, setWords)=="{");
+	CHECK(setWords.empty());
+	CHECK(script.getLineCommand(uLine, setWords)=="texture");
+	CHECK(setWords.size()==1&&setWords[0]=="wall.dds");
+	uLine = 6;
+	CHECK(script.getLineCommand(uLine, setWords)=="scene_blend");
+	CHECK(setWords.size()==1&&setWords[0]=="alpha_blend");
+	uLine = script.getLineCount();
+	CHECK(script.getLineCommand(uLine, setWords)=="");
+
+	CMaterialScript empty;
+	empty.parse(NULL, 0);
+	CHECK(empty.getLineCount()==0);
+	CHECK(empty.findMaterial("Wall")==0);
+}
+
+static void testCache()
+{
+	const char* szFilename = "MaterialScriptCheck.material";
+	CHECK(writeText(szFilename, "material Wall\n{\n}\n"));
+	CMaterialScriptCache cache;
+	size_t uOpens = IOReadBase::openCount();
+	const CMaterialScript* pScript = cache.get(szFilename);
+	CHECK(pScript!=NULL);
+	CHECK(IOReadBase::openCount()==uOpens+1);
+	if (pScript)
+	{
+		CHECK(pScript->findMaterial("Wall")<pScript->getLineCount());
+		CHECK(pScript->findMaterial("Floor")==pScript->getLineCount());
+	}
+
+	// unchanged, the same parse and no read
+	CHECK(cache.get(szFilename)==pScript);
+	CHECK(IOReadBase::openCount()==uOpens+1);
+
+	// rewritten, the size differs even within the same second
+	CHECK(writeText(szFilename, "material Wall\n{\n}\nmaterial Floor\n{\n}\n"));
+	pScript = cache.get(szFilename);
+	CHECK(pScript!=NULL);
+	CHECK(IOReadBase::openCount()==uOpens+2);
+	if (pScript)
+	{
+		CHECK(pScript->findMaterial("Floor")<pScript->getLineCount());
+	}
+	CHECK(cache.get(szFilename)==pScript);
+	CHECK(IOReadBase::openCount()==uOpens+2);
+
+	// gone, and not left in the cache
+	remove(szFilename);
+	CHECK(cache.get(szFilename)==NULL);
+	CHECK(cache.get("MaterialScriptCheck.missing")==NULL);
+}
+
+int main()
+{
+	testParse();
+	testCache();
+	if (s_nFailed)
+	{
+		printf("%d checks failed\n", s_nFailed);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+// The engine's IOReadBase as far as MaterialScript.cpp uses it, over stdio, for the checks.
+// Counts the opens so a check can tell a cached parse from a new read.
+#include <stdio.h>
+#include <string>
+
+class IOReadBase
+{
+public:
+	static IOReadBase* autoOpen(const std::string& strFilename)
+	{
+		FILE* f = fopen(strFilename.c_str(), "rb");
+		if (f==NULL)
+		{
+			return NULL;
+		}
+		++openCount();
+		return new IOReadBase(f);
+	}
+	static void autoClose(IOReadBase*& pRead)
+	{
+		delete pRead;
+		pRead = NULL;
+	}
+	static size_t& openCount()
+	{
+		static size_t s_uCount = 0;
+		return s_uCount;
+	}
+	size_t GetSize()
+	{
+		long nPos = ftell(m_pFile);
+		fseek(m_pFile, 0, SEEK_END);
+		long nSize = ftell(m_pFile);
+		fseek(m_pFile, nPos, SEEK_SET);
+		return (size_t)nSize;
+	}
+	size_t Read(void* pBuffer, size_t uSize)
+	{
+		return fread(pBuffer, 1, uSize, m_pFile);
+	}
+private:
+	IOReadBase(FILE* pFile):m_pFile(pFile){}
+	~IOReadBase(){fclose(m_pFile);}
+	FILE* m_pFile;
+};
@@ -0,0 +1,232 @@
+#include "TerrainEditHistory.h"
+#include "zlib.h"
+
+// The planes are stored byte by byte of their values: byte 0 of every value, then byte 1 and so
+// on. The high bytes of heights and colours hardly change over a rectangle and deflate far
+// better kept together. With pXor the xor of both planes is stored.
+static void SplitValueBytes(const unsigned char* pIn, const unsigned char* pXor, size_t uCount, unsigned int uValueSize, unsigned char* pOut)
+{
+	for (unsigned int b=0; b<uValueSize; ++b)
+	{
+		const unsigned char* pSrc = pIn+b;
+		if (pXor)
+		{
+			const unsigned char* pSrcXor = pXor+b;
+			for (size_t i=0; i<uCount; ++i)
+			{
+				*pOut++ = pSrc[i*uValueSize]^pSrcXor[i*uValueSize];
+			}
+		}
+		else
+		{
+			for (size_t i=0; i<uCount; ++i)
+			{
+				*pOut++ = pSrc[i*uValueSize];
+			}
+		}
+	}
+}
+
+static void JoinValueBytes(const unsigned char* pIn, const unsigned char* pXor, size_t uCount, unsigned int uValueSize, unsigned char* pOut)
+{
+	for (unsigned int b=0; b<uValueSize; ++b)
+	{
+		unsigned char* pDest = pOut+b;
+		if (pXor)
+		{
+			const unsigned char* pDestXor = pXor+b;
+			for (size_t i=0; i<uCount; ++i)
+			{
+				pDest[i*uValueSize] = (*pIn++)^pDestXor[i*uValueSize];
+			}
+		}
+		else
+		{
+			for (size_t i=0; i<uCount; ++i)
+			{
+				pDest[i*uValueSize] = *pIn++;
+			}
+		}
+	}
+}
+
+CTerrainEditHistory::CTerrainEditHistory():
+m_uMemoryLimit(64<<20),
+m_uMemorySize(0),
+m_nLevel(Z_BEST_SPEED)
+{
+}
+
+void CTerrainEditHistory::clear()
+{
+	m_setUndo.clear();
+	m_setRedo.clear();
+	m_uMemorySize = 0;
+}
+
+void CTerrainEditHistory::setMemoryLimit(size_t uBytes)
+{
+	m_uMemoryLimit = uBytes;
+	trim();
+}
+
+void CTerrainEditHistory::store(const TerrainEditRect& rect, StoredRect& stored)const
+{
+	stored.nType		= rect.nType;
+	stored.nX			= rect.nX;
+	stored.nY			= rect.nY;
+	stored.nWidth		= rect.nWidth;
+	stored.nHeight		= rect.nHeight;
+	stored.uValueSize	= rect.uValueSize;
+	stored.bCompressed	= false;
+
+	size_t uCount = (size_t)rect.nWidth*rect.nHeight;
+	size_t uPlane = uCount*rect.uValueSize;
+	std::vector<unsigned char> setRaw(uPlane*2);
+	SplitValueBytes(&rect.setBefore[0], NULL, uCount, rect.uValueSize, &setRaw[0]);
+	SplitValueBytes(&rect.setBefore[0], &rect.setAfter[0], uCount, rect.uValueSize, &setRaw[uPlane]);
+	if (m_nLevel>0)
+	{
+		uLongf uStoredSize = compressBound((uLong)setRaw.size());
+		stored.setData.resize(uStoredSize);
+		if (compress2(&stored.setData[0], &uStoredSize, &setRaw[0], (uLong)setRaw.size(), m_nLevel)==Z_OK&&
+			uStoredSize<setRaw.size())
+		{
+			std::vector<unsigned char>(stored.setData.begin(), stored.setData.begin()+uStoredSize).swap(stored.setData);
+			stored.bCompressed = true;
+			return;
+		}
+	}
+	stored.setData.swap(setRaw);
+}
+
+bool CTerrainEditHistory::load(const Step& step, std::vector<TerrainEditRect>& setRect)const
+{
+	setRect.resize(step.size());
+	std::vector<unsigned char> setRaw;
+	for (size_t i=0; i<step.size(); ++i)
+	{
+		const StoredRect& stored = step[i];
+		TerrainEditRect& rect = setRect[i];
+		rect.nType		= stored.nType;
+		rect.nX			= stored.nX;
+		rect.nY			= stored.nY;
+		rect.nWidth		= stored.nWidth;
+		rect.nHeight	= stored.nHeight;
+		rect.uValueSize	= stored.uValueSize;
+
+		size_t uCount = (size_t)stored.nWidth*stored.nHeight;
+		size_t uPlane = uCount*stored.uValueSize;
+		const unsigned char* pRaw = &stored.setData[0];
+		if (stored.bCompressed)
+		{
+			setRaw.resize(uPlane*2);
+			uLongf uSize = (uLongf)setRaw.size();
+			if (uncompress(&setRaw[0], &uSize, &stored.setData[0], (uLong)stored.setData.size())!=Z_OK||
+				uSize!=setRaw.size())
+			{
+				return false;
+			}
+			pRaw = &setRaw[0];
+		}
+		rect.setBefore.resize(uPlane);
+		rect.setAfter.resize(uPlane);
+		JoinValueBytes(pRaw, NULL, uCount, stored.uValueSize, &rect.setBefore[0]);
+		JoinValueBytes(pRaw+uPlane, &rect.setBefore[0], uCount, stored.uValueSize, &rect.setAfter[0]);
+	}
+	return true;
+}
+
+size_t CTerrainEditHistory::getStepSize(const Step& step)
+{
+	size_t uSize = 0;
+	for (size_t i=0; i<step.size(); ++i)
+	{
+		uSize += sizeof(StoredRect)+step[i].setData.size();
+	}
+	return uSize;
+}
+
+void CTerrainEditHistory::trim()
+{
+	// the oldest undo steps first, then the redo steps furthest from the terrain as it is
+	while (m_uMemoryLimit>0&&m_uMemorySize>m_uMemoryLimit&&!m_setUndo.empty()&&
+		m_setUndo.size()+m_setRedo.size()>1)
+	{
+		m_uMemorySize -= getStepSize(m_setUndo.front());
+		m_setUndo.pop_front();
+	}
+	while (m_uMemoryLimit>0&&m_uMemorySize>m_uMemoryLimit&&m_setRedo.size()>1)
+	{
+		m_uMemorySize -= getStepSize(m_setRedo.front());
+		m_setRedo.erase(m_setRedo.begin());
+	}
+}
+
+void CTerrainEditHistory::push(const std::vector<TerrainEditRect>& setRect)
+{
+	Step step;
+	for (size_t i=0; i<setRect.size(); ++i)
+	{
+		const TerrainEditRect& rect = setRect[i];
+		if (rect.setBefore.empty()||rect.setBefore==rect.setAfter)
+		{
+			continue;
+		}
+		step.push_back(StoredRect());
+		store(rect, step.back());
+	}
+	if (step.empty())
+	{
+		return;
+	}
+	for (size_t i=0; i<m_setRedo.size(); ++i)
+	{
+		m_uMemorySize -= getStepSize(m_setRedo[i]);
+	}
+	m_setRedo.clear();
+	m_uMemorySize += getStepSize(step);
+	m_setUndo.push_back(Step());
+	m_setUndo.back().swap(step);
+	trim();
+}
+
+bool CTerrainEditHistory::undo(std::vector<TerrainEditRect>& setRect)
+{
+	if (m_setUndo.empty())
+	{
+		return false;
+	}
+	bool bLoaded = load(m_setUndo.back(), setRect);
+	if (bLoaded)
+	{
+		m_setRedo.push_back(Step());
+		m_setRedo.back().swap(m_setUndo.back());
+	}
+	else
+	{
+		m_uMemorySize -= getStepSize(m_setUndo.back());
+	}
+	m_setUndo.pop_back();
+	return bLoaded;
+}
+
+bool CTerrainEditHistory::redo(std::vector<TerrainEditRect>& setRect)
+{
+	if (m_setRedo.empty())
+	{
+		return false;
+	}
+	bool bLoaded = load(m_setRedo.back(), setRect);
+	if (bLoaded)
+	{
+		m_setUndo.push_back(Step());
+		m_setUndo.back().swap(m_setRedo.back());
+	}
+	else
+	{
+		m_uMemorySize -= getStepSize(m_setRedo.back());
+	}
+	m_setRedo.pop_back();
+	return bLoaded;
+}
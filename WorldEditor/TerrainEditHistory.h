@@ -0,0 +1,68 @@
+#pragma once
+#include <stddef.h>
+#include <deque>
+#include <vector>
+
+// The values of one brush type over a rectangle of vertices or cells, row by row from nY.
+struct TerrainEditRect
+{
+	int				nType;			// CTerrainBrush::BrushType
+	int				nX, nY;
+	int				nWidth, nHeight;
+	unsigned int	uValueSize;		// bytes per value
+	std::vector<unsigned char>	setBefore;
+	std::vector<unsigned char>	setAfter;
+
+	bool contains(int x, int y)const{return x>=nX&&y>=nY&&x<nX+nWidth&&y<nY+nHeight;}
+	size_t getOffset(int x, int y)const{return ((size_t)(y-nY)*nWidth+(x-nX))*uValueSize;}
+};
+
+// Undo and redo steps of the terrain editor, each a rectangle per brush type the step touched.
+// A rectangle is stored as its before plane and the xor of its before and after planes, zlib
+// compressed. The xor is zero wherever the step left a value alone, so a step costs about what
+// it changed rather than its bounding box. Past the memory limit the oldest undo steps go.
+class CTerrainEditHistory
+{
+public:
+	CTerrainEditHistory();
+
+	void clear();
+	// bytes the stored steps may take, 0 for no limit; one step is always kept
+	void setMemoryLimit(size_t uBytes);
+	size_t getMemoryLimit()const{return m_uMemoryLimit;}
+	size_t getMemorySize()const{return m_uMemorySize;}
+	// 0 stores the planes as they are, 1-9 are zlib levels
+	void setCompressionLevel(int nLevel){m_nLevel=nLevel;}
+
+	// Stores a finished step, rectangles it didn't change are left out. A step that changed
+	// anything drops the redo steps.
+	void push(const std::vector<TerrainEditRect>& setRect);
+	size_t getUndoCount()const{return m_setUndo.size();}
+	size_t getRedoCount()const{return m_setRedo.size();}
+	// The newest undo step, it becomes the newest redo step. False when there's none.
+	bool undo(std::vector<TerrainEditRect>& setRect);
+	// The newest redo step, it goes back to the undo steps.
+	bool redo(std::vector<TerrainEditRect>& setRect);
+private:
+	struct StoredRect
+	{
+		int				nType;
+		int				nX, nY;
+		int				nWidth, nHeight;
+		unsigned int	uValueSize;
+		bool			bCompressed;
+		std::vector<unsigned char>	setData;
+	};
+	typedef std::vector<StoredRect> Step;
+
+	void store(const TerrainEditRect& rect, StoredRect& stored)const;
+	bool load(const Step& step, std::vector<TerrainEditRect>& setRect)const;
+	static size_t getStepSize(const Step& step);
+	void trim();
+
+	std::deque<Step>	m_setUndo;		// oldest first
+	std::vector<Step>	m_setRedo;
+	size_t				m_uMemoryLimit;
+	size_t				m_uMemorySize;
+	int					m_nLevel;
+};
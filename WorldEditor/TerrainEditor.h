@@ -1,6 +1,7 @@
 #pragma once
 #include "Terrain.h"
 #include "TerrainBrush.h"
+#include "TerrainEditHistory.h"
 
 class CTerrainEditor : public CTerrain
 {
@@ -16,12 +17,12 @@ public:
 	//
 	CTerrainBrush& GetBrushDecal(){return m_BrushDecal;}
 	//
+	// Starts a new undo step, the edits since the last mark become one.
 	void markEdit();
-	void doEdit(MAP_EDIT_RECORD& mapEditRecordIn,MAP_EDIT_RECORD& mapEditRecordOut);
 	void doEdit(MAP_EDIT_RECORD& mapEditRecordIn);
-	void doEdit(std::vector<MAP_EDIT_RECORD>& mapEditRecordIn,std::vector<MAP_EDIT_RECORD>& mapEditRecordOut);
 	void rebackEdit();
 	void redoEdit();
+	CTerrainEditHistory& getEditHistory(){return m_EditHistory;}
 	//
 	void brushATT(float fPosX, float fPosY, byte uAtt, float fRadius);
 	void brushTileLayer1(float fPosX, float fPosY, int nTileID, float fRadius);
@@ -47,6 +48,14 @@ public:
 protected:
 	void createBrush();
 	virtual bool create();
+	// the open undo step
+	void growEditRect(int nType, int nMinX, int nMinY, int nMaxX, int nMaxY);
+	void closeEdit();
+	void applyEdit(const std::vector<TerrainEditRect>& setRect, bool bRedo);
+	void updateEdit(int nType, int nBeginX, int nBeginY, int nEndX, int nEndY, bool& bUpdateCube, bool& bUpdateIB);
+	static unsigned int getEditValueSize(int nType);
+	void getEditValue(int nType, int x, int y, unsigned char* pValue);
+	void setEditValue(int nType, int x, int y, const unsigned char* pValue);
 	bool m_bShowLayer0;
 	bool m_bShowLayer1;
 	bool m_bShowAttribute;
@@ -56,7 +65,8 @@ protected:
 	CTerrainBrush	m_BrushDecal;
 	std::map<unsigned char,TerrainSub>	m_mapRenderAttributeSubs;
 
-	std::vector<MAP_EDIT_RECORD> m_setReback;
-	std::vector<MAP_EDIT_RECORD> m_setRedo;
+	// the values the open step changes, before planes only until it's closed
+	std::vector<TerrainEditRect>	m_setEditRect;
+	CTerrainEditHistory				m_EditHistory;
 
 };
\ No newline at end of file